@@ -65,6 +65,47 @@ void message_passing(float ed[MAX_EDGE][EMB_DIM], float h[MAX_NODE][EMB_DIM], in
 }
 
 
+/// Message of node v: sum over its incoming edges [u -> v] of Relu(ed + h[u]),
+/// with the bond embedding ed of each edge looked up in the same pass
+void gather_message(const conv_weights_t* cw, float* h, int* edge_attr, graph_csr_t* csr, int v, float* message)
+{
+    memset(message, 0, EMB_DIM * sizeof(float));
+    for(int i = csr->row_ptr[v]; i < csr->row_ptr[v+1]; i++) {
+        int u = csr->col_idx[i];
+        int* e_f = edge_attr + csr->edge_id[i] * EDGE_ATTR;
+        for(int dim = 0; dim < EMB_DIM; dim++) {
+            float ed = 0;
+            ed += cw->bond_embedding_0[e_f[0]][dim];
+            ed += cw->bond_embedding_1[e_f[1]][dim];
+            ed += cw->bond_embedding_2[e_f[2]][dim];
+
+            float msg = ed + h[u * EMB_DIM + dim];
+            if(msg < 0) msg = 0.0;
+            message[dim] += msg;
+        }
+    }
+}
+
+/// Gather-only message passing over the CSR of the graph. Replaces the edge
+/// embedding table and the scatter of message_passing with the same result.
+void message_passing_csr(const conv_weights_t* cw, float h[MAX_NODE][EMB_DIM], int* edge_attr, graph_csr_t* csr, int num_of_nodes)
+{
+    for(int v = 0; v < num_of_nodes; v++) {
+        gather_message(cw, h[0], edge_attr, csr, v, message[v]);
+    }
+
+#ifdef _PRINT_
+    printf("\nMessage of Conv\n");
+    for(int nd = 0; nd < num_of_nodes; nd++) {
+        printf("Node %d: ", nd);
+        for(int dim = 0; dim < 10; dim++) {
+            printf("%.5f ", message[nd][dim]);
+        }
+        printf("...\n");
+    }
+#endif
+}
+
 
 void MLP_BatchNorm_Relu(float d_in[MAX_NODE][MLP_BN_DIM], float d_out[MAX_NODE][MLP_BN_DIM], 
                     // float (*weight), float (*bias), 
@@ -234,7 +275,7 @@ void MLP_Virtualnode(float* vn_mlp_in, float* vn_mlp_out, float* vn_emb, float h
 #endif
 }
 
-void CONV_0(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
+void CONV_0(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
 {
     printf("\n---- Computing CONV 0 ----\n");
     
@@ -258,42 +299,47 @@ void CONV_0(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
     }
 #endif
 
-    ////////////// Embedding: compute edge embedding
-    memset(e_0, 0, MAX_EDGE * EMB_DIM * sizeof(float));
-    for(int e = 0; e < num_of_edges; e++) {
-        for(int ef = 0; ef < EDGE_ATTR; ef++) {
-            int e_f = edge_attr[e * EDGE_ATTR + ef];
-            for(int dim = 0; dim < EMB_DIM; dim++) {
-                float emb_value = 0;
-                switch (ef) {
-                case 0:
-                    emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
-                    break;
-                case 1:
-                    emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
-                    break;
-                case 2:
-                    emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
-                    break;
-                }
-                e_0[e][dim] += emb_value;
-            }   
+    ////////////// Message Passing
+    if(csr != NULL) {
+        message_passing_csr(&conv_weights[0], h_0, edge_attr, csr, num_of_nodes);
+    }
+    else {
+        ////////////// Embedding: compute edge embedding
+        memset(e_0, 0, MAX_EDGE * EMB_DIM * sizeof(float));
+        for(int e = 0; e < num_of_edges; e++) {
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e * EDGE_ATTR + ef];
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    float emb_value = 0;
+                    switch (ef) {
+                    case 0:
+                        emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
+                        break;
+                    case 1:
+                        emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
+                        break;
+                    case 2:
+                        emb_value = gnn_node_convs_0_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
+                        break;
+                    }
+                    e_0[e][dim] += emb_value;
+                }   
+            }
         }
-    }
 
 #ifdef _PRINT_
-    printf("\nInitial edge embedding:\n");
-    for(int e = 0; e < 5; e++) {
-        printf("Edge %d: ", e);
-        for(int dim = 0; dim < 10; dim++) {
-            printf("%.5f ", e_0[e][dim]);
+        printf("\nInitial edge embedding:\n");
+        for(int e = 0; e < 5; e++) {
+            printf("Edge %d: ", e);
+            for(int dim = 0; dim < 10; dim++) {
+                printf("%.5f ", e_0[e][dim]);
+            }
+            printf("...\n");
         }
-        printf("...\n");
-    }
 #endif
 
-    ////////////// Message Passing
-    message_passing(e_0, h_0, edge_list, num_of_nodes, num_of_edges);
+        message_passing(e_0, h_0, edge_list, num_of_nodes, num_of_edges);
+    }
 
     ////////////// MLP of Conv 0
     float eps = gnn_node_convs_0_eps[0];
@@ -337,7 +383,7 @@ void CONV_0(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
 
 
 
-void CONV_1(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
+void CONV_1(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
 {
     printf("\n---- Computing CONV 1 ----\n");
 
@@ -361,42 +407,47 @@ void CONV_1(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
     }
 #endif
 
-    ////////////// Embedding: compute edge embedding
-    memset(e_1, 0, MAX_EDGE * EMB_DIM * sizeof(float));
-    for(int e = 0; e < num_of_edges; e++) {
-        for(int ef = 0; ef < EDGE_ATTR; ef++) {
-            int e_f = edge_attr[e * EDGE_ATTR + ef];
-            for(int dim = 0; dim < EMB_DIM; dim++) {
-                float emb_value = 0;
-                switch (ef) {
-                case 0:
-                    emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
-                    break;
-                case 1:
-                    emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
-                    break;
-                case 2:
-                    emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
-                    break;
-                }
-                e_1[e][dim] += emb_value;
-            }   
+    ////////////// Message Passing
+    if(csr != NULL) {
+        message_passing_csr(&conv_weights[1], h_1, edge_attr, csr, num_of_nodes);
+    }
+    else {
+        ////////////// Embedding: compute edge embedding
+        memset(e_1, 0, MAX_EDGE * EMB_DIM * sizeof(float));
+        for(int e = 0; e < num_of_edges; e++) {
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e * EDGE_ATTR + ef];
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    float emb_value = 0;
+                    switch (ef) {
+                    case 0:
+                        emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
+                        break;
+                    case 1:
+                        emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
+                        break;
+                    case 2:
+                        emb_value = gnn_node_convs_1_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
+                        break;
+                    }
+                    e_1[e][dim] += emb_value;
+                }   
+            }
         }
-    }
 
 #ifdef _PRINT_
-    printf("\nInitial edge embedding:\n");
-    for(int e = 0; e < 5; e++) {
-        printf("Edge %d: ", e);
-        for(int dim = 0; dim < 10; dim++) {
-            printf("%.5f ", e_1[e][dim]);
+        printf("\nInitial edge embedding:\n");
+        for(int e = 0; e < 5; e++) {
+            printf("Edge %d: ", e);
+            for(int dim = 0; dim < 10; dim++) {
+                printf("%.5f ", e_1[e][dim]);
+            }
+            printf("...\n");
         }
-        printf("...\n");
-    }
 #endif
 
-    ////////////// Message Passing
-    message_passing(e_1, h_1, edge_list, num_of_nodes, num_of_edges);
+        message_passing(e_1, h_1, edge_list, num_of_nodes, num_of_edges);
+    }
 
     ////////////// MLP of Conv 1
     float eps = gnn_node_convs_1_eps[0];
@@ -440,7 +491,7 @@ void CONV_1(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
 
 
 
-void CONV_2(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
+void CONV_2(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
 {
     printf("\n---- Computing CONV 2 ----\n");
 
@@ -464,42 +515,47 @@ void CONV_2(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
     }
 #endif
 
-    ////////////// Embedding: compute edge embedding
-    memset(e_2, 0, MAX_EDGE * EMB_DIM * sizeof(float));
-    for(int e = 0; e < num_of_edges; e++) {
-        for(int ef = 0; ef < EDGE_ATTR; ef++) {
-            int e_f = edge_attr[e * EDGE_ATTR + ef];
-            for(int dim = 0; dim < EMB_DIM; dim++) {
-                float emb_value = 0;
-                switch (ef) {
-                case 0:
-                    emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
-                    break;
-                case 1:
-                    emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
-                    break;
-                case 2:
-                    emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
-                    break;
-                }
-                e_2[e][dim] += emb_value;
-            }   
+    ////////////// Message Passing
+    if(csr != NULL) {
+        message_passing_csr(&conv_weights[2], h_2, edge_attr, csr, num_of_nodes);
+    }
+    else {
+        ////////////// Embedding: compute edge embedding
+        memset(e_2, 0, MAX_EDGE * EMB_DIM * sizeof(float));
+        for(int e = 0; e < num_of_edges; e++) {
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e * EDGE_ATTR + ef];
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    float emb_value = 0;
+                    switch (ef) {
+                    case 0:
+                        emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
+                        break;
+                    case 1:
+                        emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
+                        break;
+                    case 2:
+                        emb_value = gnn_node_convs_2_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
+                        break;
+                    }
+                    e_2[e][dim] += emb_value;
+                }   
+            }
         }
-    }
 
 #ifdef _PRINT_
-    printf("\nInitial edge embedding:\n");
-    for(int e = 0; e < 5; e++) {
-        printf("Edge %d: ", e);
-        for(int dim = 0; dim < 10; dim++) {
-            printf("%.5f ", e_2[e][dim]);
+        printf("\nInitial edge embedding:\n");
+        for(int e = 0; e < 5; e++) {
+            printf("Edge %d: ", e);
+            for(int dim = 0; dim < 10; dim++) {
+                printf("%.5f ", e_2[e][dim]);
+            }
+            printf("...\n");
         }
-        printf("...\n");
-    }
 #endif
 
-    ////////////// Message Passing
-    message_passing(e_2, h_2, edge_list, num_of_nodes, num_of_edges);
+        message_passing(e_2, h_2, edge_list, num_of_nodes, num_of_edges);
+    }
 
     ////////////// MLP of Conv 2
     float eps = gnn_node_convs_2_eps[0];
@@ -544,7 +600,7 @@ void CONV_2(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
 
 
 
-void CONV_3(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
+void CONV_3(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
 {
     printf("\n---- Computing CONV 3 ----\n");
 
@@ -568,42 +624,47 @@ void CONV_3(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
     }
 #endif
 
-    ////////////// Embedding: compute edge embedding
-    memset(e_3, 0, MAX_EDGE * EMB_DIM * sizeof(float));
-    for(int e = 0; e < num_of_edges; e++) {
-        for(int ef = 0; ef < EDGE_ATTR; ef++) {
-            int e_f = edge_attr[e * EDGE_ATTR + ef];
-            for(int dim = 0; dim < EMB_DIM; dim++) {
-                float emb_value = 0;
-                switch (ef) {
-                case 0:
-                    emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
-                    break;
-                case 1:
-                    emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
-                    break;
-                case 2:
-                    emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
-                    break;
-                }
-                e_3[e][dim] += emb_value;
-            }   
+    ////////////// Message Passing
+    if(csr != NULL) {
+        message_passing_csr(&conv_weights[3], h_3, edge_attr, csr, num_of_nodes);
+    }
+    else {
+        ////////////// Embedding: compute edge embedding
+        memset(e_3, 0, MAX_EDGE * EMB_DIM * sizeof(float));
+        for(int e = 0; e < num_of_edges; e++) {
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e * EDGE_ATTR + ef];
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    float emb_value = 0;
+                    switch (ef) {
+                    case 0:
+                        emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
+                        break;
+                    case 1:
+                        emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
+                        break;
+                    case 2:
+                        emb_value = gnn_node_convs_3_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
+                        break;
+                    }
+                    e_3[e][dim] += emb_value;
+                }   
+            }
         }
-    }
 
 #ifdef _PRINT_
-    printf("\nInitial edge embedding:\n");
-    for(int e = 0; e < 5; e++) {
-        printf("Edge %d: ", e);
-        for(int dim = 0; dim < 10; dim++) {
-            printf("%.5f ", e_3[e][dim]);
+        printf("\nInitial edge embedding:\n");
+        for(int e = 0; e < 5; e++) {
+            printf("Edge %d: ", e);
+            for(int dim = 0; dim < 10; dim++) {
+                printf("%.5f ", e_3[e][dim]);
+            }
+            printf("...\n");
         }
-        printf("...\n");
-    }
 #endif
 
-    ////////////// Message Passing
-    message_passing(e_3, h_3, edge_list, num_of_nodes, num_of_edges);
+        message_passing(e_3, h_3, edge_list, num_of_nodes, num_of_edges);
+    }
 
     ////////////// MLP of Conv 3
     float eps = gnn_node_convs_3_eps[0];
@@ -648,7 +709,7 @@ void CONV_3(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
 
 
 
-void CONV_4(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
+void CONV_4(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
 {
     printf("\n---- Computing CONV 4 ----\n");
 
@@ -672,42 +733,47 @@ void CONV_4(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
     }
 #endif
 
-    ////////////// Embedding: compute edge embedding
-    memset(e_4, 0, MAX_EDGE * EMB_DIM * sizeof(float));
-    for(int e = 0; e < num_of_edges; e++) {
-        for(int ef = 0; ef < EDGE_ATTR; ef++) {
-            int e_f = edge_attr[e * EDGE_ATTR + ef];
-            for(int dim = 0; dim < EMB_DIM; dim++) {
-                float emb_value = 0;
-                switch (ef) {
-                case 0:
-                    emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
-                    break;
-                case 1:
-                    emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
-                    break;
-                case 2:
-                    emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
-                    break;
-                }
-                e_4[e][dim] += emb_value;
-            }   
+    ////////////// Message Passing
+    if(csr != NULL) {
+        message_passing_csr(&conv_weights[4], h_4, edge_attr, csr, num_of_nodes);
+    }
+    else {
+        ////////////// Embedding: compute edge embedding
+        memset(e_4, 0, MAX_EDGE * EMB_DIM * sizeof(float));
+        for(int e = 0; e < num_of_edges; e++) {
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e * EDGE_ATTR + ef];
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    float emb_value = 0;
+                    switch (ef) {
+                    case 0:
+                        emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_0_weight[e_f][dim];
+                        break;
+                    case 1:
+                        emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_1_weight[e_f][dim];
+                        break;
+                    case 2:
+                        emb_value = gnn_node_convs_4_bond_encoder_bond_embedding_list_2_weight[e_f][dim];
+                        break;
+                    }
+                    e_4[e][dim] += emb_value;
+                }   
+            }
         }
-    }
 
 #ifdef _PRINT_
-    printf("\nInitial edge embedding:\n");
-    for(int e = 0; e < 5; e++) {
-        printf("Edge %d: ", e);
-        for(int dim = 0; dim < 10; dim++) {
-            printf("%.5f ", e_4[e][dim]);
+        printf("\nInitial edge embedding:\n");
+        for(int e = 0; e < 5; e++) {
+            printf("Edge %d: ", e);
+            for(int dim = 0; dim < 10; dim++) {
+                printf("%.5f ", e_4[e][dim]);
+            }
+            printf("...\n");
         }
-        printf("...\n");
-    }
 #endif
 
-    ////////////// Message Passing
-    message_passing(e_4, h_4, edge_list, num_of_nodes, num_of_edges);
+        message_passing(e_4, h_4, edge_list, num_of_nodes, num_of_edges);
+    }
 
     ////////////// MLP of Conv 4
     float eps = gnn_node_convs_4_eps[0];
@@ -739,7 +805,7 @@ void CONV_4(int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes,
 
 
 
-void GIN_virtualnode_compute_one_graph(int* node_feature, int* edge_list, int* edge_attr, int* graph_attr)
+void GIN_virtualnode_compute_one_graph(int* node_feature, int* edge_list, int* edge_attr, int* graph_attr, graph_csr_t* csr)
 {
     int num_of_nodes = graph_attr[0];
     int num_of_edges = graph_attr[1];
@@ -813,15 +879,15 @@ void GIN_virtualnode_compute_one_graph(int* node_feature, int* edge_list, int* e
 #endif
 
     ////////////// CONV 0 //////////////////////////////////
-    CONV_0(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+    CONV_0(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges, csr);
     ////////////// CONV 1 //////////////////////////////////
-    CONV_1(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+    CONV_1(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges, csr);
     ////////////// CONV 2 //////////////////////////////////
-    CONV_2(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+    CONV_2(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges, csr);
     ////////////// CONV 3 //////////////////////////////////
-    CONV_3(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+    CONV_3(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges, csr);
     ////////////// CONV 4 //////////////////////////////////
-    CONV_4(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+    CONV_4(node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges, csr);
 
     
     ////////////// Global mean pooling //////////////////////
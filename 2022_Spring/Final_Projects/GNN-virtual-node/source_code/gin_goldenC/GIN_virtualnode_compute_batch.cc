@@ -0,0 +1,198 @@
+#include "dcl.h"
+
+/// Batched version of GIN_virtualnode_compute_one_graph: all the graphs of
+/// a batch are processed together, with each MLP run as one GEMM over all
+/// the nodes of the batch. Message passing and pooling are parallel across
+/// graphs. Every value is accumulated in the same order as in the per-graph
+/// code, so the predictions are identical.
+
+const conv_weights_t conv_weights[5] = {
+    { gnn_node_convs_0_eps, gnn_node_convs_0_mlp_0_weight, gnn_node_convs_0_mlp_0_bias, gnn_node_convs_0_mlp_2_weight, gnn_node_convs_0_mlp_2_bias,
+      gnn_node_convs_0_bond_encoder_bond_embedding_list_0_weight, gnn_node_convs_0_bond_encoder_bond_embedding_list_1_weight, gnn_node_convs_0_bond_encoder_bond_embedding_list_2_weight },
+    { gnn_node_convs_1_eps, gnn_node_convs_1_mlp_0_weight, gnn_node_convs_1_mlp_0_bias, gnn_node_convs_1_mlp_2_weight, gnn_node_convs_1_mlp_2_bias,
+      gnn_node_convs_1_bond_encoder_bond_embedding_list_0_weight, gnn_node_convs_1_bond_encoder_bond_embedding_list_1_weight, gnn_node_convs_1_bond_encoder_bond_embedding_list_2_weight },
+    { gnn_node_convs_2_eps, gnn_node_convs_2_mlp_0_weight, gnn_node_convs_2_mlp_0_bias, gnn_node_convs_2_mlp_2_weight, gnn_node_convs_2_mlp_2_bias,
+      gnn_node_convs_2_bond_encoder_bond_embedding_list_0_weight, gnn_node_convs_2_bond_encoder_bond_embedding_list_1_weight, gnn_node_convs_2_bond_encoder_bond_embedding_list_2_weight },
+    { gnn_node_convs_3_eps, gnn_node_convs_3_mlp_0_weight, gnn_node_convs_3_mlp_0_bias, gnn_node_convs_3_mlp_2_weight, gnn_node_convs_3_mlp_2_bias,
+      gnn_node_convs_3_bond_encoder_bond_embedding_list_0_weight, gnn_node_convs_3_bond_encoder_bond_embedding_list_1_weight, gnn_node_convs_3_bond_encoder_bond_embedding_list_2_weight },
+    { gnn_node_convs_4_eps, gnn_node_convs_4_mlp_0_weight, gnn_node_convs_4_mlp_0_bias, gnn_node_convs_4_mlp_2_weight, gnn_node_convs_4_mlp_2_bias,
+      gnn_node_convs_4_bond_encoder_bond_embedding_list_0_weight, gnn_node_convs_4_bond_encoder_bond_embedding_list_1_weight, gnn_node_convs_4_bond_encoder_bond_embedding_list_2_weight },
+};
+
+const vn_weights_t vn_weights[4] = {
+    { gnn_node_mlp_virtualnode_list_0_0_weight, gnn_node_mlp_virtualnode_list_0_0_bias, gnn_node_mlp_virtualnode_list_0_2_weight, gnn_node_mlp_virtualnode_list_0_2_bias },
+    { gnn_node_mlp_virtualnode_list_1_0_weight, gnn_node_mlp_virtualnode_list_1_0_bias, gnn_node_mlp_virtualnode_list_1_2_weight, gnn_node_mlp_virtualnode_list_1_2_bias },
+    { gnn_node_mlp_virtualnode_list_2_0_weight, gnn_node_mlp_virtualnode_list_2_0_bias, gnn_node_mlp_virtualnode_list_2_2_weight, gnn_node_mlp_virtualnode_list_2_2_bias },
+    { gnn_node_mlp_virtualnode_list_3_0_weight, gnn_node_mlp_virtualnode_list_3_0_bias, gnn_node_mlp_virtualnode_list_3_2_weight, gnn_node_mlp_virtualnode_list_3_2_bias },
+};
+
+
+
+/// d_out[n][dim_out] = bias[dim_out] + sum_in d_in[n][dim_in] * weight[dim_out][dim_in], with an optional Relu.
+/// Blocks of GEMM_ROWS rows are transposed so that the inner loop runs over the rows
+/// of the block, which vectorizes while keeping the per-output summation order.
+static void gemm_bias(const float* d_in, const float* weight, const float* bias, float* d_out,
+                      int num_of_rows, int dim_in, int dim_out, bool relu)
+{
+    #pragma omp parallel for schedule(static)
+    for(int r0 = 0; r0 < num_of_rows; r0 += GEMM_ROWS) {
+        float in_t[MLP_IN_MAX][GEMM_ROWS];
+        float acc[GEMM_ROWS];
+        int rows = (num_of_rows - r0 < GEMM_ROWS) ? num_of_rows - r0 : GEMM_ROWS;
+
+        for(int r = 0; r < GEMM_ROWS; r++) {
+            for(int k = 0; k < dim_in; k++) {
+                in_t[k][r] = (r < rows) ? d_in[(r0 + r) * dim_in + k] : 0.0;
+            }
+        }
+
+        for(int o = 0; o < dim_out; o++) {
+            const float* w = weight + o * dim_in;
+            for(int r = 0; r < GEMM_ROWS; r++) {
+                acc[r] = bias[o];
+            }
+            for(int k = 0; k < dim_in; k++) {
+                for(int r = 0; r < GEMM_ROWS; r++) {
+                    acc[r] += in_t[k][r] * w[k];
+                }
+            }
+            for(int r = 0; r < rows; r++) {
+                d_out[(r0 + r) * dim_out + o] = (relu && acc[r] < 0) ? 0.0 : acc[r];
+            }
+        }
+    }
+}
+
+
+
+/// Gathers the messages of each node over its incoming edges and builds
+/// the MLP input of the layer.
+static void message_passing_batch(graph_batch_t* batch, const conv_weights_t* cw, float* h, float* mlp_in)
+{
+    float eps = cw->eps[0];
+    graph_csr_t csr = { batch->row_ptr, batch->col_idx, batch->edge_id };
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int g = 0; g < batch->num_of_graphs; g++) {
+        for(int v = batch->node_ptr[g]; v < batch->node_ptr[g+1]; v++) {
+            float message[EMB_DIM];
+            gather_message(cw, h, batch->edge_attr, &csr, v, message);
+
+            for(int dim = 0; dim < EMB_DIM; dim++) {
+                mlp_in[v * MLP_0_IN + dim] = message[dim] + (1 + eps) * h[v * EMB_DIM + dim];
+            }
+        }
+    }
+}
+
+
+
+void GIN_virtualnode_compute_batch(graph_batch_t* batch, float* results)
+{
+    int num_of_graphs = batch->num_of_graphs;
+    int num_of_nodes = batch->num_of_nodes;
+
+    float* h = (float*)malloc(num_of_nodes * EMB_DIM * sizeof(float));
+    float* h_next = (float*)malloc(num_of_nodes * EMB_DIM * sizeof(float));
+    float* mlp_in = (float*)malloc(num_of_nodes * MLP_IN_MAX * sizeof(float));
+    float* mlp_out = (float*)malloc(num_of_nodes * MLP_OUT_MAX * sizeof(float));
+    float* vn_emb = (float*)malloc(num_of_graphs * EMB_DIM * sizeof(float));
+    float* vn_mlp_in = (float*)malloc(num_of_graphs * VN_MLP_IN_MAX * sizeof(float));
+    float* vn_mlp_out = (float*)malloc(num_of_graphs * VN_MLP_OUT_MAX * sizeof(float));
+
+    ////////////// Embedding: initial virtual node and input node embeddings
+    #pragma omp parallel for schedule(dynamic)
+    for(int g = 0; g < num_of_graphs; g++) {
+        memcpy(vn_emb + g * EMB_DIM, gnn_node_virtualnode_embedding_weight[0], EMB_DIM * sizeof(float));
+
+        for(int nd = batch->node_ptr[g]; nd < batch->node_ptr[g+1]; nd++) {
+            int* nd_f = batch->node_feature + nd * ND_FEATURE;
+            for(int dim = 0; dim < EMB_DIM; dim++) {
+                float emb_value = 0;
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_0_weight[nd_f[0]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_1_weight[nd_f[1]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_2_weight[nd_f[2]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_3_weight[nd_f[3]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_4_weight[nd_f[4]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_5_weight[nd_f[5]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_6_weight[nd_f[6]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_7_weight[nd_f[7]][dim];
+                emb_value += gnn_node_atom_encoder_atom_embedding_list_8_weight[nd_f[8]][dim];
+                h[nd * EMB_DIM + dim] = emb_value;
+            }
+        }
+    }
+
+    ////////////// CONV 0 to CONV 4
+    for(int layer = 0; layer < 5; layer++) {
+        bool last_layer = (layer == 4);
+
+        ////////////// Add the virtual node embedding of each graph to its nodes
+        #pragma omp parallel for schedule(dynamic)
+        for(int g = 0; g < num_of_graphs; g++) {
+            for(int nd = batch->node_ptr[g]; nd < batch->node_ptr[g+1]; nd++) {
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    h[nd * EMB_DIM + dim] += vn_emb[g * EMB_DIM + dim];
+                }
+            }
+        }
+
+        ////////////// Message passing and MLP over all the nodes of the batch
+        message_passing_batch(batch, &conv_weights[layer], h, mlp_in);
+        gemm_bias(mlp_in, conv_weights[layer].mlp_0_weight[0], conv_weights[layer].mlp_0_bias, mlp_out,
+                  num_of_nodes, MLP_0_IN, MLP_0_OUT, true);
+        gemm_bias(mlp_out, conv_weights[layer].mlp_2_weight[0], conv_weights[layer].mlp_2_bias, h_next,
+                  num_of_nodes, MLP_3_IN, MLP_3_OUT, !last_layer);
+
+        ////////////// Update the virtual nodes, except in the last layer
+        if(!last_layer) {
+            #pragma omp parallel for schedule(dynamic)
+            for(int g = 0; g < num_of_graphs; g++) {
+                for(int dim = 0; dim < EMB_DIM; dim++) {
+                    vn_mlp_in[g * VN_MLP_0_IN + dim] = vn_emb[g * EMB_DIM + dim];
+                    for(int nd = batch->node_ptr[g]; nd < batch->node_ptr[g+1]; nd++) {
+                        vn_mlp_in[g * VN_MLP_0_IN + dim] += h[nd * EMB_DIM + dim];
+                    }
+                }
+            }
+            gemm_bias(vn_mlp_in, vn_weights[layer].mlp_0_weight[0], vn_weights[layer].mlp_0_bias, vn_mlp_out,
+                      num_of_graphs, VN_MLP_0_IN, VN_MLP_0_OUT, true);
+            gemm_bias(vn_mlp_out, vn_weights[layer].mlp_2_weight[0], vn_weights[layer].mlp_2_bias, vn_emb,
+                      num_of_graphs, VN_MLP_2_IN, VN_MLP_2_OUT, true);
+        }
+
+        float* tmp = h;
+        h = h_next;
+        h_next = tmp;
+    }
+
+    ////////////// Global mean pooling and graph prediction linear
+    #pragma omp parallel for schedule(dynamic)
+    for(int g = 0; g < num_of_graphs; g++) {
+        int g_nodes = batch->node_ptr[g+1] - batch->node_ptr[g];
+        float h_graph[EMB_DIM];
+        for(int dim = 0; dim < EMB_DIM; dim++) {
+            h_graph[dim] = 0;
+            for(int nd = batch->node_ptr[g]; nd < batch->node_ptr[g+1]; nd++) {
+                h_graph[dim] += h[nd * EMB_DIM + dim];
+            }
+            h_graph[dim] = h_graph[dim] / g_nodes;
+        }
+
+        for(int tsk = 0; tsk < NUM_TASK; tsk++) {
+            float task_value = graph_pred_linear_bias[tsk];
+            for(int dim = 0; dim < EMB_DIM; dim++) {
+                task_value += h_graph[dim] * graph_pred_linear_weight[tsk][dim];
+            }
+            results[g * NUM_TASK + tsk] = task_value;
+        }
+    }
+
+    free(h);
+    free(h_next);
+    free(mlp_in);
+    free(mlp_out);
+    free(vn_emb);
+    free(vn_mlp_in);
+    free(vn_mlp_out);
+}
@@ -33,6 +33,9 @@
 #define VN_MLP_IN_MAX 200
 #define VN_MLP_OUT_MAX 200
 
+// Rows per block of the batched MLP GEMM
+#define GEMM_ROWS 16
+
 extern float gnn_node_atom_encoder_atom_embedding_list_0_weight[119][100];
 extern float gnn_node_atom_encoder_atom_embedding_list_1_weight[4][100];
 extern float gnn_node_atom_encoder_atom_embedding_list_2_weight[12][100];
@@ -102,8 +105,59 @@ extern float gnn_node_mlp_virtualnode_list_3_2_bias[100];
 extern float graph_pred_linear_weight[1][100];
 extern float graph_pred_linear_bias[1];
 
+/// Incoming edges of each node of a graph in CSR form, built once per graph
+/// on the host by prepare_csr. Edges keep their original order within each node.
+typedef struct {
+    int* row_ptr;       // first incoming edge of each node, num_of_nodes + 1 entries
+    int* col_idx;       // source node of each incoming edge
+    int* edge_id;       // index of each incoming edge in edge_attr
+} graph_csr_t;
+
+/// Weights of one CONV layer and of one virtual node MLP
+typedef struct {
+    float* eps;
+    float (*mlp_0_weight)[MLP_0_IN];
+    float* mlp_0_bias;
+    float (*mlp_2_weight)[MLP_3_IN];
+    float* mlp_2_bias;
+    float (*bond_embedding_0)[EMB_DIM];
+    float (*bond_embedding_1)[EMB_DIM];
+    float (*bond_embedding_2)[EMB_DIM];
+} conv_weights_t;
+
+typedef struct {
+    float (*mlp_0_weight)[VN_MLP_0_IN];
+    float* mlp_0_bias;
+    float (*mlp_2_weight)[VN_MLP_2_IN];
+    float* mlp_2_bias;
+} vn_weights_t;
+
+extern const conv_weights_t conv_weights[5];
+extern const vn_weights_t vn_weights[4];
+
+/// Batch of graphs packed as one block-diagonal graph. Edges are stored in
+/// CSR form by target node, in their original order within each target.
+typedef struct {
+    int num_of_graphs;
+    int num_of_nodes;
+    int num_of_edges;
+    int* node_ptr;      // first node of each graph, num_of_graphs + 1 entries
+    int* row_ptr;       // first incoming edge of each node, num_of_nodes + 1 entries
+    int* col_idx;       // source node of each incoming edge
+    int* edge_id;       // index of each incoming edge in edge_attr
+    int* node_feature;
+    int* edge_attr;
+} graph_batch_t;
+
 void load_weights();
+int count_graphs();
 void fetch_one_graph(char* graph_name, int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges);
-void GIN_virtualnode_compute_one_graph(int* node_feature, int* edge_list, int* edge_attr, int* graph_attr);
+void prepare_csr(int* edge_list, int num_of_nodes, int num_of_edges, graph_csr_t* csr);
+void fetch_graph_batch(int first_graph, int num_of_graphs, graph_batch_t* batch);
+void free_graph_batch(graph_batch_t* batch);
+void gather_message(const conv_weights_t* cw, float* h, int* edge_attr, graph_csr_t* csr, int v, float* message);
+void GIN_virtualnode_compute_one_graph(int* node_feature, int* edge_list, int* edge_attr, int* graph_attr, graph_csr_t* csr = NULL);
+void GIN_virtualnode_compute_batch(graph_batch_t* batch, float* results);
+void message_passing_benchmark(int num_of_graphs, int reps);
 
 #endif
@@ -217,6 +217,24 @@ void load_weights()
     fclose(f);
 }
 
+/// Counts the graphs g1, g2, ... that have an info file in ../graphs
+int count_graphs()
+{
+    int num_of_graphs = 0;
+    while(true) {
+        char info_file[128];
+        sprintf(info_file, "../graphs/graph_info/g%d_info.txt", num_of_graphs + 1);
+
+        FILE* f_info = fopen(info_file, "r");
+        if(f_info == NULL) {
+            break;
+        }
+        fclose(f_info);
+        num_of_graphs++;
+    }
+    return num_of_graphs;
+}
+
 void fetch_one_graph(char* graph_name, int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges)
 {
     printf("Loading graph ...\n");
@@ -267,3 +285,92 @@ void fetch_one_graph(char* graph_name, int* node_feature, int* edge_list, int* e
     }
 #endif
 }
+
+/// Counting sort of the edges by target node into csr, whose arrays hold
+/// num_of_nodes + 1 and num_of_edges entries. The sort is stable, so that
+/// the messages are summed in the same order as the edge list.
+void prepare_csr(int* edge_list, int num_of_nodes, int num_of_edges, graph_csr_t* csr)
+{
+    memset(csr->row_ptr, 0, (num_of_nodes + 1) * sizeof(int));
+    for(int e = 0; e < num_of_edges; e++) {
+        csr->row_ptr[edge_list[e*2+1] + 1]++;
+    }
+    for(int nd = 0; nd < num_of_nodes; nd++) {
+        csr->row_ptr[nd + 1] += csr->row_ptr[nd];
+    }
+
+    int* fill = (int*)malloc(num_of_nodes * sizeof(int));
+    memcpy(fill, csr->row_ptr, num_of_nodes * sizeof(int));
+    for(int e = 0; e < num_of_edges; e++) {
+        int slot = fill[edge_list[e*2+1]]++;
+        csr->col_idx[slot] = edge_list[e*2];
+        csr->edge_id[slot] = e;
+    }
+    free(fill);
+}
+
+void fetch_graph_batch(int first_graph, int num_of_graphs, graph_batch_t* batch)
+{
+    int* num_of_nodes = (int*)malloc(num_of_graphs * sizeof(int));
+    int* num_of_edges = (int*)malloc(num_of_graphs * sizeof(int));
+
+    batch->num_of_graphs = num_of_graphs;
+    batch->num_of_nodes = 0;
+    batch->num_of_edges = 0;
+    for(int g = 0; g < num_of_graphs; g++) {
+        char info_file[128];
+        sprintf(info_file, "../graphs/graph_info/g%d_info.txt", first_graph + g);
+
+        FILE* f_info = fopen(info_file, "r");
+        fscanf(f_info, "%d\n%d", &num_of_nodes[g], &num_of_edges[g]);
+        fclose(f_info);
+
+        batch->num_of_nodes += num_of_nodes[g];
+        batch->num_of_edges += num_of_edges[g];
+    }
+
+    batch->node_ptr = (int*)malloc((num_of_graphs + 1) * sizeof(int));
+    batch->row_ptr = (int*)malloc((batch->num_of_nodes + 1) * sizeof(int));
+    batch->col_idx = (int*)malloc(batch->num_of_edges * sizeof(int));
+    batch->edge_id = (int*)malloc(batch->num_of_edges * sizeof(int));
+    batch->node_feature = (int*)malloc(ND_FEATURE * batch->num_of_nodes * sizeof(int));
+    batch->edge_attr = (int*)malloc(EDGE_ATTR * batch->num_of_edges * sizeof(int));
+    int* edge_list = (int*)malloc(2 * batch->num_of_edges * sizeof(int));
+
+    /// Read the graphs one after the other, shifting their node ids
+    int node_offset = 0;
+    int edge_offset = 0;
+    for(int g = 0; g < num_of_graphs; g++) {
+        char graph_name[128];
+        sprintf(graph_name, "../graphs/graph_bin/g%d", first_graph + g);
+
+        int* g_edge_list = edge_list + 2 * edge_offset;
+        fetch_one_graph(graph_name, batch->node_feature + ND_FEATURE * node_offset, g_edge_list,
+                        batch->edge_attr + EDGE_ATTR * edge_offset, num_of_nodes[g], num_of_edges[g]);
+        for(int i = 0; i < 2 * num_of_edges[g]; i++) {
+            g_edge_list[i] += node_offset;
+        }
+
+        batch->node_ptr[g] = node_offset;
+        node_offset += num_of_nodes[g];
+        edge_offset += num_of_edges[g];
+    }
+    batch->node_ptr[num_of_graphs] = node_offset;
+
+    graph_csr_t csr = { batch->row_ptr, batch->col_idx, batch->edge_id };
+    prepare_csr(edge_list, batch->num_of_nodes, batch->num_of_edges, &csr);
+
+    free(edge_list);
+    free(num_of_nodes);
+    free(num_of_edges);
+}
+
+void free_graph_batch(graph_batch_t* batch)
+{
+    free(batch->node_ptr);
+    free(batch->row_ptr);
+    free(batch->col_idx);
+    free(batch->edge_id);
+    free(batch->node_feature);
+    free(batch->edge_attr);
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "dcl.h"
 
 // Global weights
@@ -74,50 +75,107 @@ float graph_pred_linear_bias[1];
 
 extern float task[NUM_TASK];
 
-int main()
+int main(int argc, char** argv)
 {
     printf("\n******* This is the golden C file for GIN model with Virtual Node *******\n");
 
     load_weights();
+    int num_of_graphs_total = count_graphs();
+
+    /// "./result -b <batch size>" runs the batched mode
+    /// "./result -c" gathers the messages over a CSR built on the host
+    /// "./result -m" benchmarks message passing with and without the CSR
+    int batch_size = 0;
+    bool use_csr = false;
+    if(argc > 2 && strcmp(argv[1], "-b") == 0) {
+        batch_size = atoi(argv[2]);
+    }
+    if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+        use_csr = true;
+    }
+    if(argc > 1 && strcmp(argv[1], "-m") == 0) {
+        message_passing_benchmark(num_of_graphs_total, 1000);
+        return 0;
+    }
 
     float all_results[4113];
     FILE* c_output = fopen("Golden_C_output.txt", "w+");
-    for(int g = 1; g <= 10; g++ ) {
-        char graph_name[128];
-        char info_file[128];
-        int num_of_nodes;
-        int num_of_edges;
-
-        sprintf(info_file, "../graphs/graph_info/g%d_info.txt", g);
-        sprintf(graph_name, "../graphs/graph_bin/g%d", g);
-
-        FILE* f_info = fopen(info_file, "r");
-        fscanf (f_info, "%d\n%d", &num_of_nodes, &num_of_edges);
-        fclose(f_info);
+    if(batch_size > 0) {
+        double load_time = 0;
+        double compute_time = 0;
+        for(int first = 1; first <= num_of_graphs_total; first += batch_size) {
+            int num_of_graphs = (num_of_graphs_total - first + 1 < batch_size) ? num_of_graphs_total - first + 1 : batch_size;
+
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            graph_batch_t batch;
+            fetch_graph_batch(first, num_of_graphs, &batch);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            load_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+            printf("********** Computing Graphs g%d to g%d *************\n", first, first + num_of_graphs - 1);
+            printf("# of nodes: %d, # of edges: %d\n", batch.num_of_nodes, batch.num_of_edges);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            GIN_virtualnode_compute_batch(&batch, &all_results[first-1]);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            compute_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+            free_graph_batch(&batch);
+        }
+        /// The graphs/sec include loading the graphs from the files, which is done per graph
+        printf("Batched load: %.3f ms, compute: %.3f ms, %.1f graphs/sec (%.1f compute only)\n",
+               load_time * 1e3, compute_time * 1e3, num_of_graphs_total / (load_time + compute_time),
+               num_of_graphs_total / compute_time);
+    }
+    else {
+        for(int g = 1; g <= num_of_graphs_total; g++ ) {
+            char graph_name[128];
+            char info_file[128];
+            int num_of_nodes;
+            int num_of_edges;
+
+            sprintf(info_file, "../graphs/graph_info/g%d_info.txt", g);
+            sprintf(graph_name, "../graphs/graph_bin/g%d", g);
+
+            FILE* f_info = fopen(info_file, "r");
+            fscanf (f_info, "%d\n%d", &num_of_nodes, &num_of_edges);
+            fclose(f_info);
         
 
-        printf("********** Computing Graph %s *************\n", graph_name);
-        printf("# of nodes: %d, # of edges: %d\n", num_of_nodes, num_of_edges);
+            printf("********** Computing Graph %s *************\n", graph_name);
+            printf("# of nodes: %d, # of edges: %d\n", num_of_nodes, num_of_edges);
+
+            int* node_feature = (int*)malloc(ND_FEATURE * num_of_nodes * sizeof(int));
+            int* edge_list = (int*)malloc(2 * num_of_edges * sizeof(int));
+            int* edge_attr = (int*)malloc(EDGE_ATTR * num_of_edges * sizeof(int));
+            int graph_attr[2];
+            graph_attr[0] = num_of_nodes;
+            graph_attr[1] = num_of_edges;
 
-        int* node_feature = (int*)malloc(ND_FEATURE * num_of_nodes * sizeof(int));
-        int* edge_list = (int*)malloc(2 * num_of_edges * sizeof(int));
-        int* edge_attr = (int*)malloc(EDGE_ATTR * num_of_edges * sizeof(int));
-        int graph_attr[2];
-        graph_attr[0] = num_of_nodes;
-        graph_attr[1] = num_of_edges;
+            fetch_one_graph(graph_name, node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
 
-        fetch_one_graph(graph_name, node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+            graph_csr_t csr = { NULL, NULL, NULL };
+            if(use_csr) {
+                csr.row_ptr = (int*)malloc((num_of_nodes + 1) * sizeof(int));
+                csr.col_idx = (int*)malloc(num_of_edges * sizeof(int));
+                csr.edge_id = (int*)malloc(num_of_edges * sizeof(int));
+                prepare_csr(edge_list, num_of_nodes, num_of_edges, &csr);
+            }
         
-        GIN_virtualnode_compute_one_graph(node_feature, edge_list, edge_attr, graph_attr);
+            GIN_virtualnode_compute_one_graph(node_feature, edge_list, edge_attr, graph_attr, use_csr ? &csr : NULL);
         
-        all_results[g-1] = task[0];
+            all_results[g-1] = task[0];
 
-        free(node_feature);
-        free(edge_list);
-        free(edge_attr);
+            free(node_feature);
+            free(edge_list);
+            free(edge_attr);
+            free(csr.row_ptr);
+            free(csr.col_idx);
+            free(csr.edge_id);
+        }
     }
 
-    for(int g = 1; g <= 10; g++) {
+    for(int g = 1; g <= num_of_graphs_total; g++) {
         fprintf(c_output, "g%d: %.8f\n", g, all_results[g-1]);
     }
 
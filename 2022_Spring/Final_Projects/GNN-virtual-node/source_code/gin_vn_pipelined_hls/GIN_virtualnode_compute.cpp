@@ -13,6 +13,12 @@ int edge_list[MAX_EDGE * 2];
 int degree_table[MAX_NODE * 3];
 int neighbor_table[MAX_NODE * MAX_DEGREE * 2];
 
+// CSR of the incoming edges of each node, prebuilt on the host.
+// Used instead of the tables above when CSR_GATHER is defined
+int csr_row_ptr[MAX_NODE + 1];
+int csr_col_idx[MAX_EDGE];
+int csr_edge_id[MAX_EDGE];
+
 /// MLP data and message buffer
 FM_TYPE message1[MAX_NODE][EMB_DIM]; // need two tables for storing the message
 FM_TYPE message2[MAX_NODE][EMB_DIM]; // need two tables for storing the message
@@ -22,6 +28,8 @@ FM_TYPE graph_embedding[EMB_DIM];
 
 // intermediate node embedding buffer
 FM_TYPE node_embedding[MAX_NODE][EMB_DIM];
+// with CSR_GATHER, the layers read one node embedding buffer and write the other
+FM_TYPE node_embedding2[MAX_NODE][EMB_DIM];
 
 /// embedding tables (atom and bond encoder weights)
 WT_TYPE node_embedding_table[ND_FEATURE_TOTAL][EMB_DIM];
@@ -234,6 +242,49 @@ void message_passing_one_node_vec(FM_TYPE emb_vec[EMB_DIM], int nd, FM_TYPE mess
     }   
 }
 
+// Gather-only message passing fused with the MLP input: the bond embedding
+// lookup, the Relu and the sum over the incoming edges of nd are done in one
+// pass, on top of the (1 + eps) * h self term. No message table is needed.
+void gather_mlp_in(FM_TYPE mlp_in[EMB_DIM], int nd, FM_TYPE h_in[MAX_NODE][EMB_DIM], int edge_attr[MAX_EDGE][EDGE_ATTR],
+        int row_ptr[MAX_NODE + 1], int col_idx[MAX_EDGE], int edge_id[MAX_EDGE], WT_TYPE _eps, int layer)
+{
+#pragma HLS inline off
+
+#pragma HLS array_partition variable=edge_embedding_table complete
+#pragma HLS array_partition variable=edge_attr dim=2 complete
+
+    for(int dim = 0; dim < EMB_DIM; dim++) {
+        mlp_in[dim] = (1 + _eps) * h_in[nd][dim];
+    }
+
+    int start_idx = row_ptr[nd];
+    int end_idx = row_ptr[nd + 1];
+
+    for(int i = start_idx; i < end_idx; i++) {
+#pragma HLS loop_tripcount min=1 max=5 avg=3
+
+        int u = col_idx[i];
+        int e = edge_id[i];
+
+        for(int dim = 0; dim < EMB_DIM; dim++) {
+#pragma HLS pipeline
+            FM_TYPE edge_embed = 0;
+
+            for(int ef = 0; ef < EDGE_ATTR; ef++) {
+                int e_f = edge_attr[e][ef];
+                int addr = get_ed_emb_addr(ef, layer);
+                FM_TYPE emb_value = 0;
+                emb_value = edge_embedding_table[addr + e_f][dim];
+                edge_embed += emb_value;
+
+            }   
+            FM_TYPE msg = edge_embed + h_in[u][dim];
+            if(msg < 0) msg = 0.0;
+            mlp_in[dim] += msg;   
+        }
+    }
+}
+
 void clear_message_table_one_node(FM_TYPE message_tb[EMB_DIM], int nd)
 {
 #pragma HLS inline off
@@ -332,6 +383,19 @@ void compute_node_embedding(FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embed
 #endif
 }
 
+// Input node embeddings into node_embedding. With the CSR, the messages
+// are gathered by the first CONV layer, so nothing is scattered here.
+void compute_node_embedding_csr(FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embedding_write[EMB_DIM], int num_of_nodes, int* node_features)
+{
+#pragma HLS inline off
+
+    FM_TYPE emb_vec[EMB_DIM];
+
+    loop_node_emb_csr: for(int nd = 0; nd < num_of_nodes; nd++) {
+        one_node_embedding(nd, node_features, emb_vec, vn_embedding_read, vn_embedding_write);
+    }
+}
+
 // Perform MLP for virtual node.
 // This is to be done before MLP for regular nodes
 void virtualnode_MLP(FM_TYPE vn_embedding1[EMB_DIM], FM_TYPE vn_embedding2[EMB_DIM], int layer)
@@ -406,6 +470,79 @@ void MLP_wrapper(FM_TYPE mlp_in[EMB_DIM], FM_TYPE mlp_out[EMB_DIM], int nd, FM_T
     update_node_embedding_with_Relu_and_vn_embedding(mlp_out, emb_vec, vn_embedding_read, vn_embedding_write, nd, layer);
 }
 
+void update_node_embedding_csr(FM_TYPE mlp_out[EMB_DIM], FM_TYPE h_out[MAX_NODE][EMB_DIM],
+       FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embedding_write[EMB_DIM], int nd, int layer)
+{
+#pragma HLS inline off
+    for(int dim = 0; dim < EMB_DIM; dim++) {
+        if( mlp_out[dim] < 0 && layer != LAYER_NUM - 1 ) {
+            mlp_out[dim] = 0;
+        }
+
+        // Update node embedding with virtual node embedding for the next layer
+        // Note: Updating VN is not required for the final layer
+        if(layer != LAYER_NUM - 1)
+        {
+            h_out[nd][dim] = mlp_out[dim] + vn_embedding_read[dim];
+            vn_embedding_write[dim] += h_out[nd][dim];
+        }
+        else
+        {
+            h_out[nd][dim] = mlp_out[dim];
+        }
+    }
+}
+
+void MLP_wrapper_csr(FM_TYPE mlp_in[EMB_DIM], FM_TYPE mlp_out[EMB_DIM], int nd,
+        FM_TYPE h_in[MAX_NODE][EMB_DIM], FM_TYPE h_out[MAX_NODE][EMB_DIM],
+        FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embedding_write[EMB_DIM],
+        int edge_attr[MAX_EDGE][EDGE_ATTR], int row_ptr[MAX_NODE + 1], int col_idx[MAX_EDGE], int edge_id[MAX_EDGE],
+        WT_TYPE _eps, int layer)
+{
+#pragma HLS inline off
+
+    gather_mlp_in(mlp_in, nd, h_in, edge_attr, row_ptr, col_idx, edge_id, _eps, layer);
+    prepare_mlp_out(mlp_out, nd, mlp_2_bias[layer]);
+    MLP_one_node(nd, mlp_in, mlp_out, layer);
+    update_node_embedding_csr(mlp_out, h_out, vn_embedding_read, vn_embedding_write, nd, layer);
+}
+
+// CONV layer over the CSR: even layers read node_embedding and write
+// node_embedding2, odd layers the other way round
+void compute_CONV_layer_csr(FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embedding_write[EMB_DIM], int num_of_nodes,
+        int edge_attr[MAX_EDGE][EDGE_ATTR], int row_ptr[MAX_NODE + 1], int col_idx[MAX_EDGE], int edge_id[MAX_EDGE], int layer)
+{
+#pragma HLS inline off
+
+    FM_TYPE mlp_in[EMB_DIM];
+    FM_TYPE mlp_out[EMB_DIM];
+
+    /// something special in GIN
+    WT_TYPE _eps = mlp_eps[layer];
+
+    loop_compute_conv_csr: for(int nd = 0; nd < num_of_nodes; nd++) {
+        if( layer % 2 == 0 ) {
+            MLP_wrapper_csr(mlp_in, mlp_out, nd, node_embedding, node_embedding2, vn_embedding_read, vn_embedding_write,
+                edge_attr, row_ptr, col_idx, edge_id, _eps, layer);
+        }
+        else {
+            MLP_wrapper_csr(mlp_in, mlp_out, nd, node_embedding2, node_embedding, vn_embedding_read, vn_embedding_write,
+                edge_attr, row_ptr, col_idx, edge_id, _eps, layer);
+        }
+    }
+
+#ifdef _PRINT_
+    printf("\nOutput of Conv %d\n", layer);
+    for(int nd = 0; nd < 5; nd++) {
+        printf("Node %d: ", nd);
+        for(int dim = 0; dim < 10; dim++) {
+            printf("%.5f ", (layer % 2 == 0) ? node_embedding2[nd][dim].to_float() : node_embedding[nd][dim].to_float());
+        }
+        printf("...\n");
+    }
+#endif
+}
+
 void compute_CONV_layer(FM_TYPE vn_embedding_read[EMB_DIM], FM_TYPE vn_embedding_write[EMB_DIM], int num_of_nodes, int num_of_edges, int layer)
 {
 #pragma HLS inline off
@@ -527,6 +664,60 @@ void load_graph(int* node_feature, int edge_attr[MAX_EDGE][EDGE_ATTR], int* edge
 }
 
 
+void load_graph_csr(int* row_ptr_in, int* col_idx_in, int* edge_id_in, int num_of_nodes, int num_of_edges)
+{
+#pragma HLS inline off
+    for(int i = 0; i <= num_of_nodes; i++) {
+        csr_row_ptr[i] = row_ptr_in[i];
+    }
+
+    for(int e = 0; e < num_of_edges; e++) {
+        csr_col_idx[e] = col_idx_in[e];
+        csr_edge_id[e] = edge_id_in[e];
+    }
+}
+
+// Loads graph g of a queue into the graph buffers and returns its # of nodes.
+// The descriptor of g gives its sizes and the offsets of its first node and
+// first edge in the queue buffers; its row_ptr starts at node offset + g.
+void load_graph_from_queue(int g, int* graph_desc,
+        int* node_feature_in, int* edge_attr_in, int* row_ptr_in, int* col_idx_in, int* edge_id_in,
+        int* node_feature_buf, int edge_attr_buf[MAX_EDGE][EDGE_ATTR],
+        int row_ptr_buf[MAX_NODE + 1], int col_idx_buf[MAX_EDGE], int edge_id_buf[MAX_EDGE], int* num_of_nodes_out)
+{
+#pragma HLS inline off
+    int num_of_nodes = graph_desc[g * GRAPH_DESC_SIZE];
+    int num_of_edges = graph_desc[g * GRAPH_DESC_SIZE + 1];
+    int node_offset = graph_desc[g * GRAPH_DESC_SIZE + 2];
+    int edge_offset = graph_desc[g * GRAPH_DESC_SIZE + 3];
+
+    for(int i = 0; i < num_of_nodes * ND_FEATURE; i++) {
+#pragma HLS loop_tripcount min=90 max=1800 avg=230
+#pragma HLS pipeline
+        node_feature_buf[i] = node_feature_in[node_offset * ND_FEATURE + i];
+    }
+
+    for(int i = 0; i <= num_of_nodes; i++) {
+#pragma HLS loop_tripcount min=11 max=201 avg=27
+#pragma HLS pipeline
+        row_ptr_buf[i] = row_ptr_in[node_offset + g + i];
+    }
+
+    for(int e = 0; e < num_of_edges; e++) {
+#pragma HLS loop_tripcount min=20 max=500 avg=55
+#pragma HLS pipeline
+        for(int i = 0; i < EDGE_ATTR; i++) {
+            edge_attr_buf[e][i] = edge_attr_in[(edge_offset + e) * EDGE_ATTR + i];
+        }
+        col_idx_buf[e] = col_idx_in[edge_offset + e];
+        edge_id_buf[e] = edge_id_in[edge_offset + e];
+    }
+
+    *num_of_nodes_out = num_of_nodes;
+}
+
+
+
 /// these weights will be loaded once and stay in BRAM forever
 void load_misc_weights(
     WT_TYPE eps_in[LAYER_NUM],
@@ -632,6 +823,72 @@ void initialize_virtualnode_embedding(FM_TYPE vn_embedding1[EMB_DIM], FM_TYPE vn
 #endif
 }
 
+// Whole model on one graph whose features and CSR are on chip
+void compute_one_graph_csr(FM_TYPE* task, int* node_features, int edge_attr[MAX_EDGE][EDGE_ATTR],
+        int row_ptr[MAX_NODE + 1], int col_idx[MAX_EDGE], int edge_id[MAX_EDGE], int num_of_nodes)
+{
+#pragma HLS inline off
+
+    // Initialize Virtual Node Embeddings
+    // VN1: Always used for message passing in the current layer
+    // VN2: Always used for aggregation (preparation) for the next layer
+    initialize_virtualnode_embedding(vn_embedding1, vn_embedding2);
+
+    ////////////// Embedding: compute input node embedding
+    compute_node_embedding_csr(vn_embedding1, vn_embedding2, num_of_nodes, node_features);
+
+    ////////////// CONV layers //////////////////////////////////
+    for(int layer = 0; layer < VN_LAYER_NUM; layer++) {
+        virtualnode_MLP(vn_embedding1, vn_embedding2, layer);
+        compute_CONV_layer_csr(vn_embedding1, vn_embedding2, num_of_nodes, edge_attr, row_ptr, col_idx, edge_id, layer);
+    }
+
+    compute_CONV_layer_csr(vn_embedding1, vn_embedding2, num_of_nodes, edge_attr, row_ptr, col_idx, edge_id, LAYER_NUM - 1);
+
+    ////////////// Global mean pooling //////////////////////
+    if( LAYER_NUM % 2 == 1 )
+        global_mean_pooling(graph_embedding, node_embedding2, num_of_nodes);
+    else
+        global_mean_pooling(graph_embedding, node_embedding, num_of_nodes);
+
+    ////////////// Graph prediction linear ///////////////////
+    global_graph_prediction(task, graph_embedding);
+}
+
+
+void load_all_weights(
+    WT_TYPE gnn_node_mlp_1_weights_fixed[LAYER_NUM * MLP_1_OUT * MLP_1_IN],
+    WT_TYPE gnn_node_mlp_1_bias_fixed[LAYER_NUM * MLP_1_OUT],
+    WT_TYPE gnn_node_mlp_2_weights_fixed[LAYER_NUM * MLP_2_OUT * MLP_2_IN],
+    WT_TYPE gnn_node_mlp_2_bias_fixed[LAYER_NUM * MLP_2_OUT],
+    WT_TYPE gnn_node_embedding_fixed[ND_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE gnn_edge_embedding_fixed[EG_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE graph_pred_linear_weight_fixed[NUM_TASK * MLP_2_OUT],
+    WT_TYPE graph_pred_linear_bias_fixed[NUM_TASK],
+    WT_TYPE eps_fixed[LAYER_NUM],
+    FM_TYPE gnn_node_virtualnode_embedding_weight_fixed[1 * EMB_DIM],
+    WT_TYPE gnn_node_virtualnode_mlp_1_weights_fixed[VN_LAYER_NUM * VN_MLP_1_OUT * VN_MLP_1_IN],
+    WT_TYPE gnn_node_virtualnode_mlp_1_bias_fixed[VN_LAYER_NUM * VN_MLP_1_OUT],
+    WT_TYPE gnn_node_virtualnode_mlp_2_weights_fixed[VN_LAYER_NUM * VN_MLP_2_OUT * VN_MLP_2_IN], 
+    WT_TYPE gnn_node_virtualnode_mlp_2_bias_fixed[VN_LAYER_NUM * VN_MLP_2_OUT]
+    )
+{
+#pragma HLS inline off
+    for(int layer = 0; layer < VN_LAYER_NUM; layer++) {
+        load_mlp_weights_one_layer(layer, gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed);
+        load_virtualnode_mlp_weights_one_layer(layer, gnn_node_virtualnode_mlp_1_weights_fixed, gnn_node_virtualnode_mlp_1_bias_fixed, 
+            gnn_node_virtualnode_mlp_2_weights_fixed, gnn_node_virtualnode_mlp_2_bias_fixed);
+    }
+
+    // Load the last layer of mlp weights for regular nodes
+    load_mlp_weights_one_layer(LAYER_NUM - 1, gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed);
+    
+    load_misc_weights(eps_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed,
+                      gnn_node_embedding_fixed, gnn_edge_embedding_fixed);
+
+    load_virtualnode_embedding(gnn_node_virtualnode_embedding_weight_fixed);
+}
+
 void prepare_degree_neighbor_table(int* edge_list, int num_of_nodes, int num_of_edges)
 {
 #pragma HLS inline off
@@ -690,7 +947,8 @@ void prepare_degree_neighbor_table(int* edge_list, int num_of_nodes, int num_of_
 
 extern "C" {
 void GIN_virtualnode_compute_one_graph(
-    int* node_feature_in, int* edge_list_in, int* edge_attr_in, int* graph_attr, FM_TYPE* task,
+    int* node_feature_in, int* edge_list_in, int* edge_attr_in,
+    int* row_ptr_in, int* col_idx_in, int* edge_id_in, int* graph_attr, FM_TYPE* task,
     WT_TYPE gnn_node_mlp_1_weights_fixed[LAYER_NUM * MLP_1_OUT * MLP_1_IN],
     WT_TYPE gnn_node_mlp_1_bias_fixed[LAYER_NUM * MLP_1_OUT],
     WT_TYPE gnn_node_mlp_2_weights_fixed[LAYER_NUM * MLP_2_OUT * MLP_2_IN],
@@ -712,6 +970,9 @@ void GIN_virtualnode_compute_one_graph(
 #pragma HLS INTERFACE m_axi depth=100000 port=node_feature_in offset=slave bundle=mem
 #pragma HLS INTERFACE m_axi depth=100000 port=edge_list_in offset=slave bundle=mem
 #pragma HLS INTERFACE m_axi depth=100000 port=edge_attr_in offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=row_ptr_in offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=col_idx_in offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=edge_id_in offset=slave bundle=mem
 #pragma HLS INTERFACE m_axi depth=100000 port=graph_attr offset=slave bundle=mem
 #pragma HLS INTERFACE m_axi depth=100000 port=task offset=slave bundle=mem
 #pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_mlp_1_weights_fixed offset=slave bundle=mem
@@ -734,6 +995,10 @@ void GIN_virtualnode_compute_one_graph(
 #pragma HLS bind_storage variable=edge_list type=RAM_2P impl=bram
 #pragma HLS bind_storage variable=graph_embedding type=RAM_2P impl=bram
 #pragma HLS bind_storage variable=node_embedding type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=node_embedding2 type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=csr_row_ptr type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=csr_col_idx type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=csr_edge_id type=RAM_2P impl=bram
 #pragma HLS bind_storage variable=node_embedding_table type=RAM_2P impl=bram
 #pragma HLS bind_storage variable=edge_embedding_table type=RAM_2P impl=bram
 #pragma HLS bind_storage variable=message1 type=RAM_2P impl=uram
@@ -746,26 +1011,14 @@ void GIN_virtualnode_compute_one_graph(
     int num_of_edges = graph_attr[1];
     int is_first = graph_attr[2]; //is the first graph
 
-    num_of_nodes = 19;
-    num_of_edges = 40;
-    // is_first = 0;
-
 
     if( is_first == 1 ) {
         ////////////// Load weights
-        for(int layer = 0; layer < VN_LAYER_NUM; layer++) {
-            load_mlp_weights_one_layer(layer, gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed);
-            load_virtualnode_mlp_weights_one_layer(layer, gnn_node_virtualnode_mlp_1_weights_fixed, gnn_node_virtualnode_mlp_1_bias_fixed, 
-                gnn_node_virtualnode_mlp_2_weights_fixed, gnn_node_virtualnode_mlp_2_bias_fixed);
-        }
-
-        // Load the last layer of mlp weights for regular nodes
-        load_mlp_weights_one_layer(LAYER_NUM - 1, gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed);
-        
-        load_misc_weights(eps_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed,
-                          gnn_node_embedding_fixed, gnn_edge_embedding_fixed);
-
-        load_virtualnode_embedding(gnn_node_virtualnode_embedding_weight_fixed);
+        load_all_weights(gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed,
+                         gnn_node_embedding_fixed, gnn_edge_embedding_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed, eps_fixed,
+                         gnn_node_virtualnode_embedding_weight_fixed,
+                         gnn_node_virtualnode_mlp_1_weights_fixed, gnn_node_virtualnode_mlp_1_bias_fixed,
+                         gnn_node_virtualnode_mlp_2_weights_fixed, gnn_node_virtualnode_mlp_2_bias_fixed);
     }
 
     ///////////// Load a new graph onto chip
@@ -773,6 +1026,12 @@ void GIN_virtualnode_compute_one_graph(
 
     printf("Computing GIN Virtual Node...\n");
 
+#ifdef CSR_GATHER
+    ////////////// Preprocess: load the CSR prebuilt on the host
+    load_graph_csr(row_ptr_in, col_idx_in, edge_id_in, num_of_nodes, num_of_edges);
+
+    compute_one_graph_csr(task, node_feature, edge_attr, csr_row_ptr, csr_col_idx, csr_edge_id, num_of_nodes);
+#else
     ////////////// Preprocess: prepare degree table and neighbor table
     prepare_degree_neighbor_table(edge_list, num_of_nodes, num_of_edges);
 
@@ -801,6 +1060,7 @@ void GIN_virtualnode_compute_one_graph(
     
     ////////////// Graph prediction linear ///////////////////
     global_graph_prediction(task, graph_embedding);
+#endif
 
 
     printf("Final graph prediction:\n");
@@ -810,4 +1070,99 @@ void GIN_virtualnode_compute_one_graph(
     printf("\nGIN Virtual Node computation done.\n");
 
 }
+
+// Streaming top: computes a queue of graphs with the weights resident on chip.
+// queue_attr = {number of graphs, load weights}. The weights only need to be
+// loaded by the first call. Loading and computing the graphs is a DATAFLOW
+// pair, so that graph N+1 can be loaded while graph N is computed.
+void GIN_virtualnode_compute_graphs(
+    int* graph_desc, int* queue_attr,
+    int* node_feature_in, int* edge_attr_in, int* row_ptr_in, int* col_idx_in, int* edge_id_in, FM_TYPE* task,
+    WT_TYPE gnn_node_mlp_1_weights_fixed[LAYER_NUM * MLP_1_OUT * MLP_1_IN],
+    WT_TYPE gnn_node_mlp_1_bias_fixed[LAYER_NUM * MLP_1_OUT],
+    WT_TYPE gnn_node_mlp_2_weights_fixed[LAYER_NUM * MLP_2_OUT * MLP_2_IN],
+    WT_TYPE gnn_node_mlp_2_bias_fixed[LAYER_NUM * MLP_2_OUT],
+    WT_TYPE gnn_node_embedding_fixed[ND_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE gnn_edge_embedding_fixed[EG_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE graph_pred_linear_weight_fixed[NUM_TASK * MLP_2_OUT],
+    WT_TYPE graph_pred_linear_bias_fixed[NUM_TASK],
+    WT_TYPE eps_fixed[LAYER_NUM],
+    FM_TYPE gnn_node_virtualnode_embedding_weight_fixed[1 * EMB_DIM],
+    WT_TYPE gnn_node_virtualnode_mlp_1_weights_fixed[VN_LAYER_NUM * VN_MLP_1_OUT * VN_MLP_1_IN],
+    WT_TYPE gnn_node_virtualnode_mlp_1_bias_fixed[VN_LAYER_NUM * VN_MLP_1_OUT],
+    WT_TYPE gnn_node_virtualnode_mlp_2_weights_fixed[VN_LAYER_NUM * VN_MLP_2_OUT * VN_MLP_2_IN], 
+    WT_TYPE gnn_node_virtualnode_mlp_2_bias_fixed[VN_LAYER_NUM * VN_MLP_2_OUT]
+    )
+{
+#pragma HLS INTERFACE s_axilite port=return
+
+// Graph inputs on their own bundle, so that loading the next graph
+// does not compete with the result writes of the current one
+#pragma HLS INTERFACE m_axi depth=100000 port=graph_desc offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=node_feature_in offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=edge_attr_in offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=row_ptr_in offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=col_idx_in offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=edge_id_in offset=slave bundle=graph
+#pragma HLS INTERFACE m_axi depth=100000 port=queue_attr offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=task offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_mlp_1_weights_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_mlp_1_bias_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_mlp_2_weights_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_mlp_2_bias_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_embedding_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_edge_embedding_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=graph_pred_linear_weight_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=graph_pred_linear_bias_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=eps_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_virtualnode_mlp_1_weights_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_virtualnode_mlp_1_bias_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_virtualnode_mlp_2_weights_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_virtualnode_mlp_2_bias_fixed offset=slave bundle=mem
+#pragma HLS INTERFACE m_axi depth=100000 port=gnn_node_virtualnode_embedding_weight_fixed offset=slave bundle=mem
+
+#pragma HLS bind_storage variable=graph_embedding type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=node_embedding type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=node_embedding2 type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=node_embedding_table type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=edge_embedding_table type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=virtualnode_embedding_weight type=RAM_2P impl=bram
+
+    int num_of_graphs = queue_attr[0];
+    int load_weights = queue_attr[1];
+
+    if( load_weights == 1 ) {
+        ////////////// Load weights of all the layers, resident for the whole queue
+        load_all_weights(gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed,
+                         gnn_node_embedding_fixed, gnn_edge_embedding_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed, eps_fixed,
+                         gnn_node_virtualnode_embedding_weight_fixed,
+                         gnn_node_virtualnode_mlp_1_weights_fixed, gnn_node_virtualnode_mlp_1_bias_fixed,
+                         gnn_node_virtualnode_mlp_2_weights_fixed, gnn_node_virtualnode_mlp_2_bias_fixed);
+    }
+
+    ///////////// DATAFLOW: load_graph_from_queue always writes the graph buffers and
+    ///////////// compute_one_graph_csr always reads them. HLS turns the buffers into
+    ///////////// ping-pong (PIPO) channels, so the next graph can be loaded into one
+    ///////////// while the current graph is computed from the other.
+    loop_graphs: for(int g = 0; g < num_of_graphs; g++) {
+#pragma HLS loop_tripcount min=1 max=4113 avg=100
+#pragma HLS dataflow
+        int node_feature_buf[MAX_NODE * ND_FEATURE];
+        int edge_attr_buf[MAX_EDGE][EDGE_ATTR];
+        int row_ptr_buf[MAX_NODE + 1];
+        int col_idx_buf[MAX_EDGE];
+        int edge_id_buf[MAX_EDGE];
+        int num_of_nodes;
+#pragma HLS bind_storage variable=node_feature_buf type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=row_ptr_buf type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=col_idx_buf type=RAM_2P impl=bram
+#pragma HLS bind_storage variable=edge_id_buf type=RAM_2P impl=bram
+#pragma HLS array_partition variable=edge_attr_buf dim=2 complete
+
+        load_graph_from_queue(g, graph_desc, node_feature_in, edge_attr_in, row_ptr_in, col_idx_in, edge_id_in,
+                              node_feature_buf, edge_attr_buf, row_ptr_buf, col_idx_buf, edge_id_buf, &num_of_nodes);
+        compute_one_graph_csr(task + g * NUM_TASK, node_feature_buf, edge_attr_buf,
+                              row_ptr_buf, col_idx_buf, edge_id_buf, num_of_nodes);
+    }
+}
 }
@@ -33,6 +33,15 @@ typedef ap_fixed<32, 10> WT_TYPE;
 // Max bound on the number of neighbors in any graph
 #define MAX_DEGREE 20
 
+// Message passing: with CSR_GATHER, each node gathers its messages over the
+// CSR of its incoming edges, prebuilt on the host by prepare_csr. Comment it
+// out to build the degree/neighbor table on chip and scatter the messages.
+#define CSR_GATHER
+
+// Streaming mode: each graph of a queue is described by GRAPH_DESC_SIZE ints,
+// {# of nodes, # of edges, first node, first edge} in the queue buffers
+#define GRAPH_DESC_SIZE 4
+
 #define LAYER_NUM 5
 #define VN_LAYER_NUM 4
 #define EMB_DIM 100
@@ -84,10 +93,31 @@ extern float gnn_node_virtualnode_mlp_2_bias[VN_LAYER_NUM][VN_MLP_2_OUT];
 
 void load_weights();
 void fetch_one_graph(char* graph_name, int* node_feature, int* edge_list, int* edge_attr, int num_of_nodes, int num_of_edges);
+void prepare_csr(int* edge_list, int num_of_nodes, int num_of_edges, int* row_ptr, int* col_idx, int* edge_id);
 
 extern "C" {
 void GIN_virtualnode_compute_one_graph(
-    int* node_feature_in, int* edge_list_in, int* edge_attr_in, int* graph_attr, FM_TYPE* task,
+    int* node_feature_in, int* edge_list_in, int* edge_attr_in,
+    int* row_ptr_in, int* col_idx_in, int* edge_id_in, int* graph_attr, FM_TYPE* task,
+    WT_TYPE gnn_node_mlp_1_weights_fixed[LAYER_NUM * MLP_1_OUT * MLP_1_IN],
+    WT_TYPE gnn_node_mlp_1_bias_fixed[LAYER_NUM * MLP_1_OUT],
+    WT_TYPE gnn_node_mlp_2_weights_fixed[LAYER_NUM * MLP_2_OUT * MLP_2_IN],
+    WT_TYPE gnn_node_mlp_2_bias_fixed[LAYER_NUM * MLP_2_OUT],
+    WT_TYPE gnn_node_embedding_fixed[ND_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE gnn_edge_embedding_fixed[EG_FEATURE_TOTAL * EMB_DIM],
+    WT_TYPE graph_pred_linear_weight_fixed[NUM_TASK * MLP_2_OUT],
+    WT_TYPE graph_pred_linear_bias_fixed[NUM_TASK],
+    WT_TYPE eps_fixed[LAYER_NUM],
+    FM_TYPE gnn_node_virtualnode_embedding_weight_fixed[1 * EMB_DIM],
+    WT_TYPE gnn_node_virtualnode_mlp_1_weights_fixed[VN_LAYER_NUM * VN_MLP_1_OUT * VN_MLP_1_IN],
+    WT_TYPE gnn_node_virtualnode_mlp_1_bias_fixed[VN_LAYER_NUM * VN_MLP_1_OUT],
+    WT_TYPE gnn_node_virtualnode_mlp_2_weights_fixed[VN_LAYER_NUM * VN_MLP_2_OUT * VN_MLP_2_IN], 
+    WT_TYPE gnn_node_virtualnode_mlp_2_bias_fixed[VN_LAYER_NUM * VN_MLP_2_OUT]
+    );
+
+void GIN_virtualnode_compute_graphs(
+    int* graph_desc, int* queue_attr,
+    int* node_feature_in, int* edge_attr_in, int* row_ptr_in, int* col_idx_in, int* edge_id_in, FM_TYPE* task,
     WT_TYPE gnn_node_mlp_1_weights_fixed[LAYER_NUM * MLP_1_OUT * MLP_1_IN],
     WT_TYPE gnn_node_mlp_1_bias_fixed[LAYER_NUM * MLP_1_OUT],
     WT_TYPE gnn_node_mlp_2_weights_fixed[LAYER_NUM * MLP_2_OUT * MLP_2_IN],
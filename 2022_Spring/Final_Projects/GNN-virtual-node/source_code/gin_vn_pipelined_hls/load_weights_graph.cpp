@@ -213,3 +213,31 @@ void fetch_one_graph(char* graph_name, int* node_feature, int* edge_list, int* e
 	}
 #endif
 }
+
+// CSR of the incoming edges of each node: row_ptr has num_of_nodes + 1 entries,
+// col_idx (source node) and edge_id have num_of_edges entries.
+// Edges keep their original order within each node.
+void prepare_csr(int* edge_list, int num_of_nodes, int num_of_edges, int* row_ptr, int* col_idx, int* edge_id)
+{
+    int fill[MAX_NODE];
+
+    for(int n = 0; n <= num_of_nodes; n++) {
+        row_ptr[n] = 0;
+    }
+    for(int e = 0; e < num_of_edges; e++) {
+        row_ptr[edge_list[e * 2 + 1] + 1] += 1;
+    }
+    for(int n = 0; n < num_of_nodes; n++) {
+        row_ptr[n + 1] += row_ptr[n];
+        fill[n] = row_ptr[n];
+    }
+
+    for(int e = 0; e < num_of_edges; e++) {
+        int u = edge_list[e * 2];     // source node id
+        int v = edge_list[e * 2 + 1];   // target node id
+
+        col_idx[fill[v]] = u;
+        edge_id[fill[v]] = e;
+        fill[v] += 1;
+    }
+}
@@ -36,6 +36,9 @@ WT_TYPE gnn_node_virtualnode_mlp_1_bias_fixed[VN_LAYER_NUM * VN_MLP_1_OUT];
 WT_TYPE gnn_node_virtualnode_mlp_2_weights_fixed[VN_LAYER_NUM * VN_MLP_2_OUT * VN_MLP_2_IN];
 WT_TYPE gnn_node_virtualnode_mlp_2_bias_fixed[VN_LAYER_NUM * VN_MLP_2_OUT];
 
+// Graphs available in ../graphs
+#define NUM_OF_GRAPHS 9
+
 int main()
 {
     printf("\n******* This is the optimized HLS code for GIN Virtual Node model *******\n");
@@ -44,9 +47,23 @@ int main()
 
     // 4113 is total number of graphs in ogbg-molhiv
     float all_results[4113];
-    int is_first = 1;
     FILE* c_output = fopen("HLS_optimized_output.txt", "w+");
-    for(int g = 1; g <= 1; g++ ) {
+
+    // Queue of graphs: features, edge attributes and CSRs of all the graphs
+    // one after the other, with one descriptor per graph
+    int graph_desc[NUM_OF_GRAPHS * GRAPH_DESC_SIZE];
+    int queue_attr[2];
+    int* node_feature = (int*)malloc(NUM_OF_GRAPHS * MAX_NODE * ND_FEATURE * sizeof(int));
+    int* edge_attr = (int*)malloc(NUM_OF_GRAPHS * MAX_EDGE * EDGE_ATTR * sizeof(int));
+    int* row_ptr = (int*)malloc(NUM_OF_GRAPHS * (MAX_NODE + 1) * sizeof(int));
+    int* col_idx = (int*)malloc(NUM_OF_GRAPHS * MAX_EDGE * sizeof(int));
+    int* edge_id = (int*)malloc(NUM_OF_GRAPHS * MAX_EDGE * sizeof(int));
+    int* edge_list = (int*)malloc(NUM_OF_GRAPHS * 2 * MAX_EDGE * sizeof(int));
+    FM_TYPE task_tb[NUM_OF_GRAPHS * NUM_TASK];
+
+    int node_offset = 0;
+    int edge_offset = 0;
+    for(int g = 1; g <= NUM_OF_GRAPHS; g++ ) {
         char graph_name[128];
         char info_file[128];
         int num_of_nodes;
@@ -59,22 +76,48 @@ int main()
         fscanf (f_info, "%d\n%d", &num_of_nodes, &num_of_edges);
         fclose(f_info);
         
-        printf("********** Computing Graph %s *************\n", graph_name);
+        printf("********** Queueing Graph %s *************\n", graph_name);
         printf("# of nodes: %d, # of edges: %d\n", num_of_nodes, num_of_edges);
 
-        int* node_feature = (int*)malloc(ND_FEATURE * num_of_nodes * sizeof(int));
-        int* edge_list = (int*)malloc(3 * num_of_edges * sizeof(int));
-        int* edge_attr = (int*)malloc(EDGE_ATTR * num_of_edges * sizeof(int));
-        int graph_attr[3];
-        graph_attr[0] = num_of_nodes;
-        graph_attr[1] = num_of_edges;
-        graph_attr[2] = is_first;
+        fetch_one_graph(graph_name, node_feature + node_offset * ND_FEATURE, edge_list + edge_offset * 2, edge_attr + edge_offset * EDGE_ATTR, num_of_nodes, num_of_edges);
 
-        FM_TYPE task_tb[NUM_TASK];
+        // CSR of the incoming edges, built once per graph for all the layers
+        prepare_csr(edge_list + edge_offset * 2, num_of_nodes, num_of_edges, row_ptr + node_offset + (g - 1), col_idx + edge_offset, edge_id + edge_offset);
 
-        fetch_one_graph(graph_name, node_feature, edge_list, edge_attr, num_of_nodes, num_of_edges);
+        graph_desc[(g - 1) * GRAPH_DESC_SIZE] = num_of_nodes;
+        graph_desc[(g - 1) * GRAPH_DESC_SIZE + 1] = num_of_edges;
+        graph_desc[(g - 1) * GRAPH_DESC_SIZE + 2] = node_offset;
+        graph_desc[(g - 1) * GRAPH_DESC_SIZE + 3] = edge_offset;
+        node_offset += num_of_nodes;
+        edge_offset += num_of_edges;
+    }
 
-        GIN_virtualnode_compute_one_graph(node_feature, edge_list, edge_attr, graph_attr, task_tb, 
+    queue_attr[0] = NUM_OF_GRAPHS;
+    queue_attr[1] = 1; // first queue: load the weights
+
+    printf("Computing GIN Virtual Node on %d graphs...\n", NUM_OF_GRAPHS);
+    GIN_virtualnode_compute_graphs(graph_desc, queue_attr, node_feature, edge_attr, row_ptr, col_idx, edge_id, task_tb,
+                          gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed, 
+                          gnn_node_embedding_table_fixed, gnn_edge_embedding_table_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed, eps_fixed,
+                          gnn_node_virtualnode_embedding_weight_fixed,
+                          gnn_node_virtualnode_mlp_1_weights_fixed,
+                          gnn_node_virtualnode_mlp_1_bias_fixed,
+                          gnn_node_virtualnode_mlp_2_weights_fixed, 
+                          gnn_node_virtualnode_mlp_2_bias_fixed);
+
+    // The single-graph top, called once per graph, must give the same predictions
+    int mismatches = 0;
+    for(int g = 1; g <= NUM_OF_GRAPHS; g++) {
+        int* desc = &graph_desc[(g - 1) * GRAPH_DESC_SIZE];
+        int graph_attr[3];
+        graph_attr[0] = desc[0];
+        graph_attr[1] = desc[1];
+        graph_attr[2] = (g == 1); // load the weights with the first graph
+        FM_TYPE task_one[NUM_TASK];
+
+        printf("********** Computing Graph g%d with the single-graph top *************\n", g);
+        GIN_virtualnode_compute_one_graph(node_feature + desc[2] * ND_FEATURE, edge_list + desc[3] * 2, edge_attr + desc[3] * EDGE_ATTR,
+                              row_ptr + desc[2] + (g - 1), col_idx + desc[3], edge_id + desc[3], graph_attr, task_one,
                               gnn_node_mlp_1_weights_fixed, gnn_node_mlp_1_bias_fixed, gnn_node_mlp_2_weights_fixed, gnn_node_mlp_2_bias_fixed, 
                               gnn_node_embedding_table_fixed, gnn_edge_embedding_table_fixed, graph_pred_linear_weight_fixed, graph_pred_linear_bias_fixed, eps_fixed,
                               gnn_node_virtualnode_embedding_weight_fixed,
@@ -82,21 +125,34 @@ int main()
                               gnn_node_virtualnode_mlp_1_bias_fixed,
                               gnn_node_virtualnode_mlp_2_weights_fixed, 
                               gnn_node_virtualnode_mlp_2_bias_fixed);
-        
-        all_results[g-1] = task_tb[0];
-
-        free(node_feature);
-        free(edge_list);
-        free(edge_attr);
 
-        is_first = 0;
+        for(int tsk = 0; tsk < NUM_TASK; tsk++) {
+            if( task_one[tsk] != task_tb[(g - 1) * NUM_TASK + tsk] ) {
+                printf("g%d: streaming top gives %.7f, single-graph top %.7f\n", g,
+                       task_tb[(g - 1) * NUM_TASK + tsk].to_float(), task_one[tsk].to_float());
+                mismatches++;
+            }
+        }
     }
 
-    for(int g = 1; g <= 1; g++) {
+    printf("Final graph predictions:\n");
+    for(int g = 1; g <= NUM_OF_GRAPHS; g++) {
+        all_results[g-1] = task_tb[(g-1) * NUM_TASK].to_float();
+        printf("g%d: %.7f\n", g, all_results[g-1]);
         fprintf(c_output, "g%d: %.8f\n", g, all_results[g-1]);
     }
+    if( mismatches == 0 ) {
+        printf("Streaming and single-graph tops match on all %d graphs\n", NUM_OF_GRAPHS);
+    }
+
+    free(node_feature);
+    free(edge_attr);
+    free(row_ptr);
+    free(col_idx);
+    free(edge_id);
+    free(edge_list);
 
     fclose(c_output);
     
-    return 0;
+    return mismatches == 0 ? 0 : 1;
 }
@@ -1,5 +1,5 @@
 open_project project_1
-set_top GIN_virtualnode_compute_one_graph
+set_top GIN_virtualnode_compute_graphs
 
 add_files GIN_virtualnode_compute.cpp
 add_files main.cpp
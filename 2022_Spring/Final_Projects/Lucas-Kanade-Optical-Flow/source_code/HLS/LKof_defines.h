@@ -64,6 +64,10 @@ ALL TIMES.
 //#define INTEGRALS_NOT_OPTIMIZED
 //#define OPTIMIZED_TO_SAVE_DSP48
 
+// integrals as running box sums (column sums plus a horizontal sliding sum):
+// the cost per pixel does not depend on WINDOW_SIZE
+#define INTEGRALS_BOX_SUM
+
 
 // to suppress some boring MS Visual C++ 2010 Express compiler warnings
 //#pragma warning( disable : 4996 ) // fopen, fclose, etc
@@ -85,6 +89,11 @@ ALL TIMES.
 #define MAX_HEIGHT    100 // number of lines per image
 #define MAX_WIDTH     100  // number of pixels per line
 
+// line buffer sizes of the streaming implementations (hls_LK.cpp, cpu_LK.cpp):
+// they only store WINDOW_SIZE lines, so they can run at full resolution
+#define STREAM_MAX_HEIGHT 1080
+#define STREAM_MAX_WIDTH  1920
+
 #define BITS_PER_PIXEL   12 // 8  // 12 //
 #define BITS_PER_COEFF   7  // number of bits for filter coefficients
 
@@ -125,6 +134,13 @@ ALL TIMES.
 #define FILTER_OFFS   (FILTER_SIZE/2)
 #define WINDOW_OFFS   (WINDOW_SIZE/2)
 
+// maximum number of levels of the Gaussian pyramids of pyr_LK.cpp
+#define PYR_MAX_LEVELS  6
+
+// lines and pixels between the input pixel and the motion vector it completes:
+// isotropic filter, derivatives and integration window
+#define STREAM_DELAY  (2*FILTER_OFFS+WINDOW_OFFS)
+
 #define SUBPIX_BITS  3  // number of bits for subpixel accuracy (1 means 1/2, 2 means 1/4, 3 means 1/8, etc)
 
 /* ******************************************************************************* */
@@ -160,7 +176,8 @@ typedef ap_int<2*W_SUM>    sum2_t;              // for matrix inversion
 typedef ap_int<2*W_SUM+3>  det_t;               // determinant in matrix inversion
 */
 
-typedef int sum2_t;
+typedef long long sum_t;  // for the accumulators of integrals computation, W_SUM bits are up to 38
+typedef long long sum2_t;  // for matrix inversion, products of two integrals
 typedef int pix_t;
 
 typedef float  vec_t;    // for motion vector components
@@ -175,6 +192,15 @@ typedef struct ap_rgb {
 
 typedef enum {INTEGER, HALF, QUARTER, EIGTH} subpix_t;
 
+// Gaussian pyramid of one frame: the isotropic filtered levels,
+// level l+1 is level l decimated by 2
+typedef struct lk_pyramid {
+	int levels;
+	unsigned short int height[PYR_MAX_LEVELS];
+	unsigned short int width[PYR_MAX_LEVELS];
+	unsigned char *flt_img[PYR_MAX_LEVELS];
+} lk_pyramid_t;
+
 typedef struct lk_vect {
    signed short int Vx;
    signed short int Vy;
@@ -233,15 +259,29 @@ const int MAX_NUM_OF_WRONG_VECTORS = 1000; // maximum number of allowed wrong ve
 #pragma SDS data sys_port(inp1_img:ACP,inp2_img:ACP,vx_img:ACP,vy_img:ACP)
 //#pragma SDS data data_mover(inp1_img:AXIDMA_SG,inp2_img:AXIDMA_SG,vx_img:AXIDMA_SG,vy_img:AXIDMA_SG)
 #endif
-/*
-int hls_LK(unsigned short int inp1_img[MAX_HEIGHT*MAX_WIDTH],  unsigned short int inp2_img[MAX_HEIGHT*MAX_WIDTH],
-			signed short int vx_img[WINDOW_SIZE*WINDOW_SIZE], 	signed short int vy_img[WINDOW_SIZE*WINDOW_SIZE],
+int hls_LK(unsigned short int *inp1_img,  unsigned short int *inp2_img,
+		   signed short int *vx_img, signed short int *vy_img,
+		   unsigned short int height, unsigned short int width);
+int cpu_stream_LK(unsigned short int *inp1_img,  unsigned short int *inp2_img,
+		   signed short int *vx_img, signed short int *vy_img,
 		   unsigned short int height, unsigned short int width);
-		   */
 
 int ref_LK(unsigned short int *inp1_Img,  unsigned short int *inp2_Img,
 		signed short int *vx_img, 	signed short int *vy_img);
 
+int pyr_Alloc(lk_pyramid_t *pyr, unsigned short int height, unsigned short int width, int levels);
+void pyr_Build(unsigned short int *inp_img, lk_pyramid_t *pyr);
+void pyr_Free(lk_pyramid_t *pyr);
+int pyr_LK(lk_pyramid_t *pyr1, lk_pyramid_t *pyr2, signed short int *vx_img, signed short int *vy_img);
+int pyr_LK_batch(unsigned short int **frames, int num_frames, unsigned short int height, unsigned short int width, int levels,
+		   signed short int **vx_img, signed short int **vy_img);
+
+bool ref_matrix_inversion(float A[2][2], float B[2], float threshold, float &Vx, float &Vy);
+unsigned char ref_isotropic_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE]);
+signed short int ref_Hderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE]);
+signed short int ref_Vderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE]);
+
+pix_t bilinear_interpolation(pix_t A, pix_t B, pix_t C, pix_t D, float k_x, float k_y);
 void motion_compensation(unsigned short int *inp_img, unsigned short int *out_img, signed short int *vx_img, signed short int *vy_img, unsigned short int height, unsigned short int width, unsigned short int offset);
 float compute_PSNR(unsigned short int *I1_img, unsigned short int *I2_img, unsigned int short height, unsigned short int width, unsigned short int offset);
 
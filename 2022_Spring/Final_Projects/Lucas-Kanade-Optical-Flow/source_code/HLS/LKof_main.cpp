@@ -48,6 +48,7 @@ ALL TIMES.
 
 #include "LKof_defines.h"
 #include "ap_bmp.h"
+#include <time.h>
 //#include "sdsoc_defines.h"
 
 /* **************************************************************************************** */
@@ -147,6 +148,190 @@ void Write_Txt_File2(const char* filename, int W, int H, unsigned short int* dat
 
 
 
+// load an image of the test_data sequence as luminance, tiled over a height x width frame
+// and moved by (shift_x, shift_y) pixels
+static int Load_Tiled_Frame(const char *filename, int img_height, int img_width, unsigned short int *frame, int height, int width,
+							int shift_x = 0, int shift_y = 0)
+{
+	unsigned char *R = (unsigned char *) malloc(img_width * img_height * sizeof(unsigned char));
+	unsigned char *G = (unsigned char *) malloc(img_width * img_height * sizeof(unsigned char));
+	unsigned char *B = (unsigned char *) malloc(img_width * img_height * sizeof(unsigned char));
+
+	int read_tmp = BMP_Read((char *) filename, img_height, img_width, R, G, B);
+	if (read_tmp == 0)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int i = ((y - shift_y) % img_height + img_height) % img_height * img_width + ((x - shift_x) % img_width + img_width) % img_width;
+				RGB_t pixel;
+				pixel.R = R[i];
+				pixel.G = G[i];
+				pixel.B = B[i];
+				frame[y*width + x] = rgb2y(pixel);
+			}
+		}
+	}
+
+	free(R); free(G); free(B);
+	return read_tmp;
+}
+
+// frames/sec of the streaming implementations on STREAM_MAX_HEIGHT x STREAM_MAX_WIDTH frames,
+// alternating the two 640x480 images of test_data; every frame is matched with the previous one
+static int Stream_Benchmark(int num_frames)
+{
+	const int height = STREAM_MAX_HEIGHT;
+	const int width  = STREAM_MAX_WIDTH;
+	const char *sequence[2] = {"./test_data/og_car1.bmp", "./test_data/og_car2.bmp"};
+	unsigned short int *frames[2];
+	signed short int *vx_cpu, *vy_cpu, *vx_hls, *vy_hls;
+
+	for (int i = 0; i < 2; i++)
+	{
+		frames[i] = (unsigned short int *) malloc(height * width * sizeof(unsigned short int));
+		if (Load_Tiled_Frame(sequence[i], 480, 640, frames[i], height, width) != 0)
+		{
+			printf("%s Loading image failed\n", sequence[i]);
+			exit (1);
+		}
+	}
+	vx_cpu = (signed short int *) malloc(height * width * sizeof(signed short int));
+	vy_cpu = (signed short int *) malloc(height * width * sizeof(signed short int));
+	vx_hls = (signed short int *) malloc(height * width * sizeof(signed short int));
+	vy_hls = (signed short int *) malloc(height * width * sizeof(signed short int));
+
+	printf("\nStreaming Lukas-Kanade on image size of W=%4d H=%4d, integration window size of %dx%d\n", width, height, WINDOW_SIZE, WINDOW_SIZE);
+
+	struct timespec start, end;
+	int cpu_pt = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int f = 1; f < num_frames; f++)
+	{
+		cpu_pt = cpu_stream_LK(frames[(f-1) % 2], frames[f % 2], vx_cpu, vy_cpu, height, width);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double cpu_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	printf("CPU row streaming: %d frames in %.3f s, %.2f frames/sec\n", num_frames-1, cpu_time, (num_frames-1) / cpu_time);
+
+	// the last pair of frames again through the C model of the HLS top
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int hls_pt = hls_LK(frames[(num_frames-2) % 2], frames[(num_frames-1) % 2], vx_hls, vy_hls, height, width);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double hls_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	printf("HLS C model: 1 frame in %.3f s\n", hls_time);
+
+	// theoretical bound, not a synthesis result: the HLS loop requests II=1 over the frame plus the
+	// lines and pixels of STREAM_DELAY; the achieved II and clock are in the csynth report
+	double hls_cycles = (double) (height + STREAM_DELAY) * (width + STREAM_DELAY);
+	printf("HLS bound at II=1 (not synthesized): %.0f cycles per frame, at most %.2f frames/sec at 100 MHz\n",
+		   hls_cycles, 100e6 / hls_cycles);
+
+	int mismatches = 0;
+	for (int i = 0; i < height * width; i++)
+	{
+		mismatches += (vx_cpu[i] != vx_hls[i]) | (vy_cpu[i] != vy_hls[i]);
+	}
+	printf("number of invertible points = %d (CPU), %d (HLS), vectors with differences = %d\n", cpu_pt, hls_pt, mismatches);
+
+	free(frames[0]); free(frames[1]);
+	free(vx_cpu); free(vy_cpu); free(vx_hls); free(vy_hls);
+
+	return (mismatches != 0);
+}
+
+// share of the vectors, away from the borders, within one pixel of the motion (move_x, move_y)
+static float Tracked_Vectors(signed short int *vx_img, signed short int *vy_img, int height, int width, int margin, int move_x, int move_y)
+{
+	int tracked = 0;
+	int total = 0;
+
+	for (int y = margin; y < height-margin; y++)
+	{
+		for (int x = margin; x < width-margin; x++)
+		{
+			float Vx = ((float) vx_img[y*width + x]) / (1<<SUBPIX_BITS);
+			float Vy = ((float) vy_img[y*width + x]) / (1<<SUBPIX_BITS);
+			tracked += (ABS(Vx - move_x) <= 1) & (ABS(Vy - move_y) <= 1);
+			total++;
+		}
+	}
+
+	return (total > 0) ? (100.0f * tracked) / total : 0;
+}
+
+// pyramidal LK on a sequence of STREAM_MAX_HEIGHT x STREAM_MAX_WIDTH frames where the first
+// 640x480 image of test_data moves by (PYR_MOVE_X, PYR_MOVE_Y) pixels from frame to frame
+#define PYR_MOVE_X  8
+#define PYR_MOVE_Y  4
+static int Pyramid_Benchmark(int levels, int num_frames)
+{
+	const int height = STREAM_MAX_HEIGHT;
+	const int width  = STREAM_MAX_WIDTH;
+	unsigned short int **frames = (unsigned short int **) malloc(num_frames * sizeof(unsigned short int *));
+	signed short int **vx_pyr = (signed short int **) malloc(num_frames * sizeof(signed short int *));
+	signed short int **vy_pyr = (signed short int **) malloc(num_frames * sizeof(signed short int *));
+	signed short int *vx_cpu, *vy_cpu;
+
+	for (int f = 0; f < num_frames; f++)
+	{
+		frames[f] = (unsigned short int *) malloc(height * width * sizeof(unsigned short int));
+		vx_pyr[f] = (signed short int *) malloc(height * width * sizeof(signed short int));
+		vy_pyr[f] = (signed short int *) malloc(height * width * sizeof(signed short int));
+		if (Load_Tiled_Frame("./test_data/og_car1.bmp", 480, 640, frames[f], height, width, f*PYR_MOVE_X, f*PYR_MOVE_Y) != 0)
+		{
+			printf("./test_data/og_car1.bmp Loading image failed\n");
+			exit (1);
+		}
+	}
+	vx_cpu = (signed short int *) malloc(height * width * sizeof(signed short int));
+	vy_cpu = (signed short int *) malloc(height * width * sizeof(signed short int));
+
+	// the levels which fit in the frames, at most PYR_MAX_LEVELS
+	lk_pyramid_t pyr;
+	levels = pyr_Alloc(&pyr, height, width, levels);
+	pyr_Free(&pyr);
+
+	printf("\nPyramidal Lukas-Kanade with %d levels on image size of W=%4d H=%4d, integration window size of %dx%d\n",
+		   levels, width, height, WINDOW_SIZE, WINDOW_SIZE);
+	printf("motion of %d %d pixels per frame\n", PYR_MOVE_X, PYR_MOVE_Y);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int pyr_pt = pyr_LK_batch(frames, num_frames, height, width, levels, vx_pyr, vy_pyr);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double pyr_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	printf("Pyramidal batch: %d frames in %.3f s, %.2f frames/sec\n", num_frames-1, pyr_time, (num_frames-1) / pyr_time);
+
+	int cpu_pt = cpu_stream_LK(frames[0], frames[1], vx_cpu, vy_cpu, height, width);
+
+	// border of the coarsest level without vectors, at full resolution
+	int margin = (1 << (levels-1)) * STREAM_DELAY;
+	printf("vectors within 1 pixel of the motion: %2.2f%% single scale, %2.2f%% pyramidal\n",
+		   Tracked_Vectors(vx_cpu, vy_cpu, height, width, margin, PYR_MOVE_X, PYR_MOVE_Y),
+		   Tracked_Vectors(vx_pyr[0], vy_pyr[0], height, width, margin, PYR_MOVE_X, PYR_MOVE_Y));
+
+	// with a single level the pyramidal mode is the single scale LK
+	pyr_LK_batch(frames, 2, height, width, 1, vx_pyr, vy_pyr);
+	int mismatches = 0;
+	for (int i = 0; i < height * width; i++)
+	{
+		mismatches += (vx_cpu[i] != vx_pyr[0][i]) | (vy_cpu[i] != vy_pyr[0][i]);
+	}
+	printf("number of invertible points = %d (pyramidal, all frames), %d (CPU row streaming, first frame pair)\n", pyr_pt, cpu_pt);
+	printf("1 level vs. CPU row streaming: vectors with differences = %d\n", mismatches);
+
+	for (int f = 0; f < num_frames; f++)
+	{
+		free(frames[f]); free(vx_pyr[f]); free(vy_pyr[f]);
+	}
+	free(frames); free(vx_pyr); free(vy_pyr);
+	free(vx_cpu); free(vy_cpu);
+
+	return (mismatches != 0);
+}
+
 /* **************************************************************************************** */
 /* **************************************************************************************** */
 /* **************************************************************************************** */
@@ -158,7 +343,7 @@ int main(int argc, char** argv)
   char *tempbuf1, *tempbuf2;
   int check_results, ret_res=0;
 
-  int  ref_pt, inv_points;
+  int  ref_pt = 0, inv_points = 0;
 
   // Arrays to store image data
   unsigned char *R, *G, *B;
@@ -169,8 +354,18 @@ int main(int argc, char** argv)
 
   // motion compensated image and motion vectors
   unsigned short int *mc_img, *mc_ref;
-  //signed short int *vx_ref, *vy_ref, *vx_img, *vy_img;
-  signed short int* vx_ref, * vy_ref;
+  signed short int *vx_ref, *vy_ref, *vx_img, *vy_img, *vx_cpu, *vy_cpu;
+
+  // "LKof_main -b <frames>" runs the streaming benchmark on full resolution frames
+  if (argc > 2 && strcmp(argv[1], "-b") == 0)
+  {
+     return Stream_Benchmark(MAX(atoi(argv[2]), 2));
+  }
+  // "LKof_main -p <levels> <frames>" runs the pyramidal mode on a full resolution sequence
+  if (argc > 3 && strcmp(argv[1], "-p") == 0)
+  {
+     return Pyramid_Benchmark(MAX(atoi(argv[2]), 1), MAX(atoi(argv[3]), 2));
+  }
 
   /* **************************************************************************************** */
    // if you want to crop the image into a smaller size here is the place to set it
@@ -196,6 +391,10 @@ int main(int argc, char** argv)
   mc_ref   = (unsigned short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(unsigned short int));
   vx_ref   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
   vy_ref   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
+  vx_img   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
+  vy_img   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
+  vx_cpu   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
+  vy_cpu   = (  signed short int  *) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
 
   inp1_img = (unsigned short int*) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(unsigned short int));
   inp2_img = (unsigned short int*) malloc(MAX_HEIGHT * MAX_WIDTH * sizeof(unsigned short int));
@@ -207,12 +406,12 @@ int main(int argc, char** argv)
     vy_img = (  signed short int  *) sds_alloc(MAX_HEIGHT * MAX_WIDTH * sizeof(  signed short int));
 	*/
 
-  memset(mc_ref,  0, MAX_HEIGHT * MAX_WIDTH);
-  memset(mc_img,  0, MAX_HEIGHT * MAX_WIDTH);
-  //memset( vx_img, 0, MAX_HEIGHT * MAX_WIDTH);
-  //memset( vy_img, 0, MAX_HEIGHT * MAX_WIDTH);
-  memset( vx_ref, 0, MAX_HEIGHT * MAX_WIDTH);
-  memset( vy_ref, 0, MAX_HEIGHT * MAX_WIDTH);
+  memset(mc_ref,  0, MAX_HEIGHT * MAX_WIDTH * sizeof(unsigned short int));
+  memset(mc_img,  0, MAX_HEIGHT * MAX_WIDTH * sizeof(unsigned short int));
+  memset( vx_img, 0, MAX_HEIGHT * MAX_WIDTH * sizeof(signed short int));
+  memset( vy_img, 0, MAX_HEIGHT * MAX_WIDTH * sizeof(signed short int));
+  memset( vx_ref, 0, MAX_HEIGHT * MAX_WIDTH * sizeof(signed short int));
+  memset( vy_ref, 0, MAX_HEIGHT * MAX_WIDTH * sizeof(signed short int));
 
   /* **************************************************************************************** */
   //Get image data 1
@@ -332,17 +531,16 @@ int main(int argc, char** argv)
   }
   printf("number of invertible points = %d, which represents %2.2f%%\n", ref_pt, (ref_pt*100.0)/(height*width));
 
-  /*
   printf("HLS DUT\n");
   for (int i = 0; i < NUM_TESTS; i++) 
   {
-	  hw_sds_clk_start()
-	  inv_points = hls_LK(inp1_img,  inp2_img, vx_img, vy_img, MAX_HEIGHT, MAX_WIDTH); //height, width); // DUT: Design Under Test
-	  hw_sds_clk_stop() 
+	  inv_points = hls_LK(inp1_img,  inp2_img, vx_img, vy_img, height, width); // DUT: Design Under Test
   }
   printf("number of invertible points = %d, which represents %2.2f%%\n", inv_points, (inv_points*100.0)/(height*width));
-  sds_print_results()
-  */
+
+  printf("CPU row streaming\n");
+  inv_points = cpu_stream_LK(inp1_img,  inp2_img, vx_cpu, vy_cpu, height, width);
+  printf("number of invertible points = %d, which represents %2.2f%%\n", inv_points, (inv_points*100.0)/(height*width));
 
   //printf("Motion Compensation of REF design\n");
   //REF motion compensation
@@ -353,17 +551,16 @@ int main(int argc, char** argv)
 
   //printf("Motion Compensation of HLS design\n");
   //HLS motion compensation
-  //motion_compensation(inp2_img, mc_img, vx_img, vy_img, height, width, (FILTER_SIZE+WINDOW_SIZE)/2);
+  motion_compensation(inp2_img, mc_img, vx_img, vy_img, height, width, (FILTER_SIZE+WINDOW_SIZE)/2);
   //HLS compute PSNR
-  //psnr = compute_PSNR(inp1_img, mc_img, height, width, (FILTER_SIZE+WINDOW_SIZE)/2);
-  //printf("PSNR of motion compensated image with HLS optical flow= %4.4f dB\n", psnr);
+  psnr = compute_PSNR(inp1_img, mc_img, height, width, (FILTER_SIZE+WINDOW_SIZE)/2);
+  printf("PSNR of motion compensated image with HLS optical flow= %4.4f dB\n", psnr);
   
 
   ///* **************************************************************************************** */
   //// self checking test bench
   ///* **************************************************************************************** */
-  /*
-  printf("Checking results: REF vs. HLS\n");
+  printf("Checking results: REF vs. HLS and CPU row streaming\n");
   double diff1, abs_diff1, diff2, abs_diff2, total_error;
   
   total_error = 0.0f;
@@ -379,6 +576,11 @@ int main(int argc, char** argv)
 		   vect2x = vx_ref[y*MAX_WIDTH + x];
 		   vect1y = vy_img[y*MAX_WIDTH + x];
 		   vect2y = vy_ref[y*MAX_WIDTH + x];
+		   if ((vx_cpu[y*MAX_WIDTH + x] != vect1x) | (vy_cpu[y*MAX_WIDTH + x] != vect1y))
+		   {
+			   printf("CPU: expected %d %d got %d %d\n", vect1x, vect1y, vx_cpu[y*MAX_WIDTH + x], vy_cpu[y*MAX_WIDTH + x]);
+			   check_results++;
+		   }
 		   diff1 = vect2x - vect1x;
 		   diff2 = vect2y - vect1y;
 		   abs_diff1 = ABS(diff1);
@@ -397,9 +599,7 @@ int main(int argc, char** argv)
 		   }
 	   }
    }
-   */
    printf("Test done\n");
-   /*
    if (check_results > MAX_NUM_OF_WRONG_VECTORS)
    {
      printf("TEST FAILED!: error = %d\n", check_results);
@@ -410,18 +610,17 @@ int main(int argc, char** argv)
      printf("TEST SUCCESSFUL!\n");
  	ret_res = 0;
    }
-   */
 
    /* **************************************************************************************** */
    // write files
-   //Write_Txt_File<signed short int>(OUTPUT_IMAGE1X, width, height, vx_img); // output    Vx motion vectors file
+   Write_Txt_File(OUTPUT_IMAGE1X, width, height, vx_img); // output    Vx motion vectors file
    //Write_Txt_File<signed short int>(   REF_IMAGE1X, width, height, vx_ref); // reference Vx motion vectors file
    Write_Txt_File(REF_IMAGE1X, width, height, vx_ref); // reference Vx motion vectors file
-   //Write_Txt_File<signed short int>(OUTPUT_IMAGE1Y, width, height, vy_img); // output    Vy motion vectors file
+   Write_Txt_File(OUTPUT_IMAGE1Y, width, height, vy_img); // output    Vy motion vectors file
    //Write_Txt_File<signed short int>(   REF_IMAGE1Y, width, height, vy_ref); // reference Vy motion vectors file
    Write_Txt_File(REF_IMAGE1Y, width, height, vy_ref); // reference Vy motion vectors file
 
-   //Write_Txt_File<unsigned short int>(OUT_MOTCOMP, width, height, mc_img); // output    motion compensated file
+   Write_Txt_File2(OUT_MOTCOMP, width, height, mc_img); // output    motion compensated file
    Write_Txt_File2(REF_MOTCOMP, width, height, mc_ref); // reference motion compensated file
 
   /* **************************************************************************************** */
@@ -433,6 +632,11 @@ int main(int argc, char** argv)
   free(vx_ref);
   free(vy_ref);
   free(mc_ref);
+  free(vx_img);
+  free(vy_img);
+  free(vx_cpu);
+  free(vy_cpu);
+  free(mc_img);
   free(inp1_img);
   free(inp2_img);
 
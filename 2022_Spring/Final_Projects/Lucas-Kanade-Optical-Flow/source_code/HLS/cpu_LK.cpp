@@ -0,0 +1,237 @@
+/*************************************************************************************
+Associated Filename:	cpu_LK.cpp
+Purpose:				Row streaming Lukas Kanade Optical Flow for the CPU
+
+Same results as hls_LK, but each stage works on a whole line at a time: the filtered
+lines, and the products of the derivatives, are kept in ring buffers of FILTER_SIZE
+and WINDOW_SIZE lines, so the working set of a 1920x1080 frame stays in the caches
+and the inner loops run along contiguous pixels. The 2D windows of the filter and of
+the integrals are done as vertical then horizontal sums, which is exact in integers.
+With INTEGRALS_BOX_SUM the vertical sums of the integrals are kept from line to line,
+adding the line that enters and removing the one that leaves, and the horizontal sums
+slide along the line, so the cost per pixel does not depend on WINDOW_SIZE.
+*******************************************************************************/
+
+#include "LKof_defines.h"
+
+// ring buffers of filtered lines of image 1 and 2
+static unsigned char flt1_lines[FILTER_SIZE][STREAM_MAX_WIDTH];
+static unsigned char flt2_lines[FILTER_SIZE][STREAM_MAX_WIDTH];
+
+// ring buffers of Ix*Ix, Ix*Iy, Iy*Iy, Ix*It, Iy*It lines, padded with WINDOW_OFFS zeros on both sides
+static sum_t prod_lines[5][WINDOW_SIZE][STREAM_MAX_WIDTH+2*WINDOW_OFFS];
+
+// integrals of one line
+static sum_t integral_line[5][STREAM_MAX_WIDTH];
+
+#ifdef INTEGRALS_BOX_SUM
+// running sums of the products over the last WINDOW_SIZE lines
+static sum_t col_sums[5][STREAM_MAX_WIDTH];
+#endif
+
+// isotropic filter of line r1 of both images, zero outside the region filtered by ref_IsotropicFilter
+static void filter_line(unsigned short int *inp1_img, unsigned short int *inp2_img, int r1,
+						unsigned short int height, unsigned short int width)
+{
+	// the 5x5 isotropic kernel is the outer product of these taps
+	const int taps[FILTER_SIZE] = {1, 4, 6, 4, 1};
+	int col_sum1[STREAM_MAX_WIDTH];
+	int col_sum2[STREAM_MAX_WIDTH];
+
+	unsigned char *flt1 = flt1_lines[r1 % FILTER_SIZE];
+	unsigned char *flt2 = flt2_lines[r1 % FILTER_SIZE];
+	memset(flt1, 0, width);
+	memset(flt2, 0, width);
+	if (r1 < FILTER_OFFS || r1 >= height-FILTER_OFFS) return;
+
+	for (int col = 0; col < width; col++) {
+		col_sum1[col] = 0;
+		col_sum2[col] = 0;
+	}
+	for (int y = 0; y < FILTER_SIZE; y++) {
+		unsigned short int *inp1 = inp1_img + (r1-FILTER_OFFS+y)*width;
+		unsigned short int *inp2 = inp2_img + (r1-FILTER_OFFS+y)*width;
+		for (int col = 0; col < width; col++) {
+			col_sum1[col] += taps[y] * (unsigned char) inp1[col];
+			col_sum2[col] += taps[y] * (unsigned char) inp2[col];
+		}
+	}
+	for (int col = FILTER_OFFS; col < width-FILTER_OFFS; col++) {
+		int accum1 = 0;
+		int accum2 = 0;
+		for (int x = 0; x < FILTER_SIZE; x++) {
+			accum1 += taps[x] * col_sum1[col-FILTER_OFFS+x];
+			accum2 += taps[x] * col_sum2[col-FILTER_OFFS+x];
+		}
+		flt1[col] = (unsigned char) (accum1 / 256);
+		flt2[col] = (unsigned char) (accum2 / 256);
+	}
+}
+
+// derivatives of line r2, stored as the five products summed by the integrals
+static void derivative_line(int r2, unsigned short int height, unsigned short int width)
+{
+	signed short int Ix[STREAM_MAX_WIDTH];
+	signed short int Iy[STREAM_MAX_WIDTH];
+	signed short int It[STREAM_MAX_WIDTH];
+
+	unsigned char *f1 = flt1_lines[r2 % FILTER_SIZE];
+	unsigned char *f2 = flt2_lines[r2 % FILTER_SIZE];
+
+	for (int col = 0; col < width; col++) {
+		Ix[col] = 0;
+		Iy[col] = 0;
+		It[col] = f2[col] - f1[col];
+	}
+	if (r2 >= FILTER_OFFS && r2 < height-FILTER_OFFS) {
+		// same taps as ref_Hderiv_kernel and ref_Vderiv_kernel
+		unsigned char *up2 = flt1_lines[(r2-2) % FILTER_SIZE];
+		unsigned char *up1 = flt1_lines[(r2-1) % FILTER_SIZE];
+		unsigned char *dn1 = flt1_lines[(r2+1) % FILTER_SIZE];
+		unsigned char *dn2 = flt1_lines[(r2+2) % FILTER_SIZE];
+		for (int col = FILTER_OFFS; col < width-FILTER_OFFS; col++) {
+			Ix[col] = (signed short int) ((f1[col-2] - 8*f1[col-1] + 8*f1[col+1] - f1[col+2]) / 12);
+			Iy[col] = (signed short int) ((up2[col] - 8*up1[col] + 8*dn1[col] - dn2[col]) / 12);
+		}
+	}
+
+	int slot = r2 % WINDOW_SIZE;
+	sum_t *p11 = prod_lines[0][slot] + WINDOW_OFFS;
+	sum_t *p12 = prod_lines[1][slot] + WINDOW_OFFS;
+	sum_t *p22 = prod_lines[2][slot] + WINDOW_OFFS;
+	sum_t *pb1 = prod_lines[3][slot] + WINDOW_OFFS;
+	sum_t *pb2 = prod_lines[4][slot] + WINDOW_OFFS;
+
+#ifdef INTEGRALS_BOX_SUM
+	// line r2-WINDOW_SIZE leaves the column sums before line r2 takes its slot
+	for (int k = 0; k < 5; k++) {
+		sum_t *col_sum = col_sums[k];
+		sum_t *prod = prod_lines[k][slot] + WINDOW_OFFS;
+		if (r2 == 0) {
+			for (int col = 0; col < width; col++) {
+				col_sum[col] = 0;
+			}
+		}
+		else if (r2 >= WINDOW_SIZE) {
+			for (int col = 0; col < width; col++) {
+				col_sum[col] -= prod[col];
+			}
+		}
+	}
+#endif
+
+	for (int col = 0; col < width; col++) {
+		p11[col] = (int) Ix[col] * (int) Ix[col];
+		p12[col] = (int) Ix[col] * (int) Iy[col];
+		p22[col] = (int) Iy[col] * (int) Iy[col];
+		pb1[col] = (int) Ix[col] * (int) It[col];
+		pb2[col] = (int) Iy[col] * (int) It[col];
+	}
+
+#ifdef INTEGRALS_BOX_SUM
+	for (int k = 0; k < 5; k++) {
+		sum_t *col_sum = col_sums[k];
+		sum_t *prod = prod_lines[k][slot] + WINDOW_OFFS;
+		for (int col = 0; col < width; col++) {
+			col_sum[col] += prod[col];
+		}
+	}
+#endif
+}
+
+// integrals and vectors of line r3
+static int vector_line(signed short int *vx_img, signed short int *vy_img, int r3,
+					   unsigned short int height, unsigned short int width)
+{
+	int cnt = 0;
+	bool row_valid = (r3 >= WINDOW_OFFS) && (r3 < height-WINDOW_OFFS);
+
+	for (int k = 0; k < 5; k++) {
+		sum_t *acc = integral_line[k];
+		for (int col = 0; col < width; col++) {
+			acc[col] = 0;
+		}
+		if (!row_valid) continue;
+
+#ifdef INTEGRALS_BOX_SUM
+		// the column sums hold the lines r3-WINDOW_OFFS .. r3+WINDOW_OFFS: slide the window
+		// along them, adding the column that enters and removing the one that leaves
+		sum_t *col_sum = col_sums[k];
+		sum_t box = 0;
+		for (int col = 0; col < WINDOW_SIZE; col++) {
+			box += col_sum[col];
+		}
+		for (int col = WINDOW_OFFS; col < width-WINDOW_OFFS; col++) {
+			acc[col] = box;
+			if (col+WINDOW_OFFS+1 < width) {
+				box += col_sum[col+WINDOW_OFFS+1] - col_sum[col-WINDOW_OFFS];
+			}
+		}
+#else
+		// vertical sums of the rows r3-WINDOW_OFFS .. r3+WINDOW_OFFS, then horizontal sums of
+		// the columns; the padding makes the window of every column in range
+		sum_t col_sum[STREAM_MAX_WIDTH+2*WINDOW_OFFS];
+		for (int col = 0; col < width+2*WINDOW_OFFS; col++) {
+			col_sum[col] = 0;
+		}
+		for (int y = 0; y < WINDOW_SIZE; y++) {
+			sum_t *prod = prod_lines[k][(r3-WINDOW_OFFS+y) % WINDOW_SIZE];
+			for (int col = 0; col < width+2*WINDOW_OFFS; col++) {
+				col_sum[col] += prod[col];
+			}
+		}
+		for (int x = 0; x < WINDOW_SIZE; x++) {
+			for (int col = 0; col < width; col++) {
+				acc[col] += col_sum[col+x];
+			}
+		}
+#endif
+	}
+
+	for (int col = 0; col < width; col++) {
+		bool int_valid = row_valid && (col >= WINDOW_OFFS) && (col < width-WINDOW_OFFS);
+		float A[2][2];
+		float B[2];
+		float Vx = 0;
+		float Vy = 0;
+
+		A[0][0] = int_valid ? (float) integral_line[0][col] : 0;
+		A[0][1] = int_valid ? (float) integral_line[1][col] : 0;
+		A[1][0] = A[0][1];
+		A[1][1] = int_valid ? (float) integral_line[2][col] : 0;
+		B[0]    = int_valid ? (float) integral_line[3][col] : 0;
+		B[1]    = int_valid ? (float) integral_line[4][col] : 0;
+
+		bool invertible = ref_matrix_inversion(A, B, (float) THRESHOLD, Vx, Vy);
+		cnt += ((int) invertible);
+
+		//quantize motion vectors
+		vx_img[r3*width+col] = (signed short int) (Vx *(1<<SUBPIX_BITS));
+		vy_img[r3*width+col] = (signed short int) (Vy *(1<<SUBPIX_BITS));
+	}
+
+	return cnt;
+}
+
+int cpu_stream_LK(unsigned short int *inp1_img,  unsigned short int *inp2_img, signed short int *vx_img, signed short int *vy_img,
+				  unsigned short int height, unsigned short int width)
+{
+	int cnt = 0;
+
+	// the ring buffers hold lines of up to STREAM_MAX_WIDTH pixels
+	if (width > STREAM_MAX_WIDTH || height > STREAM_MAX_HEIGHT) return -1;
+
+	// line "row" of the inputs completes filtered line r1, derivative line r2 and vector line r3
+	for (int row = 0; row < height + STREAM_DELAY; row++)
+	{
+		int r1 = row - FILTER_OFFS;
+		int r2 = r1 - FILTER_OFFS;
+		int r3 = r2 - WINDOW_OFFS;
+
+		if (r1 >= 0 && r1 < height) filter_line(inp1_img, inp2_img, r1, height, width);
+		if (r2 >= 0 && r2 < height) derivative_line(r2, height, width);
+		if (r3 >= 0 && r3 < height) cnt += vector_line(vx_img, vy_img, r3, height, width);
+	}
+
+	return cnt;
+}
@@ -0,0 +1,242 @@
+/*************************************************************************************
+Associated Filename:	hls_LK.cpp
+Purpose:				Streaming Lukas Kanade Optical Flow, one pixel per clock
+						with line buffers instead of full frame intermediates
+
+The isotropic filter, the derivatives, the integrals and the vectors of ref_LK are
+chained in one pipelined loop. Each stage keeps only the lines of its window:
+FILTER_SIZE-1 lines for the filter and the derivatives, WINDOW_SIZE-1 lines for the
+integrals, so the frame size is only limited by STREAM_MAX_WIDTH (1920x1080 by default).
+
+With INTEGRALS_BOX_SUM the integrals are running sums over column sums, and the
+WINDOW_SIZE lines of derivatives only provide the line leaving the column sums.
+
+The output of each stage is zero outside the region where ref_LK computes it,
+so that the vectors match ref_LK wherever its inputs are defined.
+*******************************************************************************/
+
+#include "LKof_defines.h"
+
+// shift the column (row-K+1 .. row, col) of a plane into the KxK window of a stage and
+// store pix in the line buffer. Lines and pixels outside the image read as zero
+template <typename T, int K>
+static void shift_window(T line_buf[K-1][STREAM_MAX_WIDTH], T window[K*K], T pix, int row, int col,
+						 unsigned short int height, unsigned short int width)
+{
+#pragma HLS INLINE
+	T column[K];
+	bool in_col = (col >= 0) & (col < width);
+
+	L1: for (int k = 0; k < K-1; k++) {
+		int r = row - (K-1) + k;
+		column[k] = (in_col & (r >= 0) & (r < height)) ? line_buf[k][col] : (T) 0;
+	}
+	column[K-1] = (in_col & (row >= 0) & (row < height)) ? pix : (T) 0;
+
+	if (in_col) {
+		L2: for (int k = 0; k < K-2; k++) {
+			line_buf[k][col] = line_buf[k+1][col];
+		}
+		line_buf[K-2][col] = column[K-1];
+	}
+
+	L3: for (int y = 0; y < K; y++) {
+		L4: for (int x = 0; x < K-1; x++) {
+			window[y*K+x] = window[y*K+x+1];
+		}
+		window[y*K+K-1] = column[y];
+	}
+}
+
+// store pix at (row, col) in N line buffers and return the pixel of line row-N it replaces.
+// Lines and pixels outside the image read as zero
+template <typename T, int N>
+static T shift_line(T line_buf[N][STREAM_MAX_WIDTH], T pix, int row, int col,
+					unsigned short int height, unsigned short int width)
+{
+#pragma HLS INLINE
+	bool in_col = (col >= 0) & (col < width);
+	int r = row - N;
+	T old_pix = (in_col & (r >= 0) & (r < height)) ? line_buf[0][col] : (T) 0;
+
+	if (in_col) {
+		L1: for (int k = 0; k < N-1; k++) {
+			line_buf[k][col] = line_buf[k+1][col];
+		}
+		line_buf[N-1][col] = ((row >= 0) & (row < height)) ? pix : (T) 0;
+	}
+
+	return old_pix;
+}
+
+int hls_LK(unsigned short int *inp1_img,  unsigned short int *inp2_img, signed short int *vx_img, signed short int *vy_img,
+		   unsigned short int height, unsigned short int width)
+{
+	#pragma HLS INTERFACE m_axi depth=1920*1080  port=inp1_img   bundle=mem1
+	#pragma HLS INTERFACE m_axi depth=1920*1080  port=inp2_img   bundle=mem2
+	#pragma HLS INTERFACE m_axi depth=1920*1080  port=vx_img  bundle=mem1
+	#pragma HLS INTERFACE m_axi depth=1920*1080  port=vy_img  bundle=mem2
+	#pragma HLS INTERFACE s_axilite port=height
+	#pragma HLS INTERFACE s_axilite port=width
+	#pragma HLS INTERFACE s_axilite register port=return
+
+	// the line buffers hold lines of up to STREAM_MAX_WIDTH pixels
+	if (width > STREAM_MAX_WIDTH || height > STREAM_MAX_HEIGHT) return -1;
+
+	// line buffers
+	static unsigned char inp1_lines[FILTER_SIZE-1][STREAM_MAX_WIDTH];
+	static unsigned char inp2_lines[FILTER_SIZE-1][STREAM_MAX_WIDTH];
+	static unsigned char flt1_lines[FILTER_SIZE-1][STREAM_MAX_WIDTH];
+	static unsigned char flt2_lines[FILTER_SIZE-1][STREAM_MAX_WIDTH];
+#ifdef INTEGRALS_BOX_SUM
+	// one more line than the window, for the line leaving the column sums
+	static signed short int Ix_lines[WINDOW_SIZE][STREAM_MAX_WIDTH];
+	static signed short int Iy_lines[WINDOW_SIZE][STREAM_MAX_WIDTH];
+	static signed short int It_lines[WINDOW_SIZE][STREAM_MAX_WIDTH];
+	static sum_t col_sums[5][STREAM_MAX_WIDTH];
+	#pragma HLS ARRAY_PARTITION variable=col_sums complete dim=1
+#else
+	static signed short int Ix_lines[WINDOW_SIZE-1][STREAM_MAX_WIDTH];
+	static signed short int Iy_lines[WINDOW_SIZE-1][STREAM_MAX_WIDTH];
+	static signed short int It_lines[WINDOW_SIZE-1][STREAM_MAX_WIDTH];
+#endif
+	#pragma HLS ARRAY_PARTITION variable=inp1_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=inp2_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=flt1_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=flt2_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=Ix_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=Iy_lines complete dim=1
+	#pragma HLS ARRAY_PARTITION variable=It_lines complete dim=1
+
+	// sliding windows
+	static unsigned char inp1_win[FILTER_SIZE*FILTER_SIZE];
+	static unsigned char inp2_win[FILTER_SIZE*FILTER_SIZE];
+	static unsigned char flt1_win[FILTER_SIZE*FILTER_SIZE];
+	static unsigned char flt2_win[FILTER_SIZE*FILTER_SIZE];
+	#pragma HLS ARRAY_PARTITION variable=inp1_win complete
+	#pragma HLS ARRAY_PARTITION variable=inp2_win complete
+	#pragma HLS ARRAY_PARTITION variable=flt1_win complete
+	#pragma HLS ARRAY_PARTITION variable=flt2_win complete
+#ifdef INTEGRALS_BOX_SUM
+	// the last WINDOW_SIZE column sums, and their sum
+	static sum_t col_win[5][WINDOW_SIZE];
+	static sum_t box[5];
+	#pragma HLS ARRAY_PARTITION variable=col_win complete
+	#pragma HLS ARRAY_PARTITION variable=box complete
+#else
+	static signed short int Ix_win[WINDOW_SIZE*WINDOW_SIZE];
+	static signed short int Iy_win[WINDOW_SIZE*WINDOW_SIZE];
+	static signed short int It_win[WINDOW_SIZE*WINDOW_SIZE];
+	#pragma HLS ARRAY_PARTITION variable=Ix_win complete
+	#pragma HLS ARRAY_PARTITION variable=Iy_win complete
+	#pragma HLS ARRAY_PARTITION variable=It_win complete
+#endif
+
+	int cnt = 0;
+
+	// (row, col) is the input pixel, the stages lag behind it by the offsets of their windows
+	L1: for (int row = 0; row < height + STREAM_DELAY; row++)
+	{
+		#pragma HLS LOOP_TRIPCOUNT min=hls_MIN_H max=STREAM_MAX_HEIGHT
+		L2: for (int col = 0; col < width + STREAM_DELAY; col++)
+		{
+			#pragma HLS LOOP_TRIPCOUNT min=hls_MIN_W max=STREAM_MAX_WIDTH
+			#pragma HLS PIPELINE II=1
+
+			bool in_frame = (row < height) & (col < width);
+			unsigned char pix1 = in_frame ? (unsigned char) inp1_img[row*width+col] : 0;
+			unsigned char pix2 = in_frame ? (unsigned char) inp2_img[row*width+col] : 0;
+			shift_window<unsigned char, FILTER_SIZE>(inp1_lines, inp1_win, pix1, row, col, height, width);
+			shift_window<unsigned char, FILTER_SIZE>(inp2_lines, inp2_win, pix2, row, col, height, width);
+
+			// isotropic filter of (r1, c1)
+			int r1 = row - FILTER_OFFS;
+			int c1 = col - FILTER_OFFS;
+			bool flt_valid = (r1 >= FILTER_OFFS) & (r1 < height-FILTER_OFFS) & (c1 >= FILTER_OFFS) & (c1 < width-FILTER_OFFS);
+			unsigned char flt1 = flt_valid ? ref_isotropic_kernel(inp1_win) : 0;
+			unsigned char flt2 = flt_valid ? ref_isotropic_kernel(inp2_win) : 0;
+			shift_window<unsigned char, FILTER_SIZE>(flt1_lines, flt1_win, flt1, r1, c1, height, width);
+			shift_window<unsigned char, FILTER_SIZE>(flt2_lines, flt2_win, flt2, r1, c1, height, width);
+
+			// spatial derivatives of image 1 and temporal derivative of (r2, c2)
+			int r2 = r1 - FILTER_OFFS;
+			int c2 = c1 - FILTER_OFFS;
+			bool der_valid = (r2 >= FILTER_OFFS) & (r2 < height-FILTER_OFFS) & (c2 >= FILTER_OFFS) & (c2 < width-FILTER_OFFS);
+			signed short int Ix = der_valid ? ref_Hderiv_kernel(flt1_win) : 0;
+			signed short int Iy = der_valid ? ref_Vderiv_kernel(flt1_win) : 0;
+			signed short int It = flt2_win[FILTER_OFFS*FILTER_SIZE+FILTER_OFFS] - flt1_win[FILTER_OFFS*FILTER_SIZE+FILTER_OFFS];
+
+			// integrals and vector of (r3, c3)
+			int r3 = r2 - WINDOW_OFFS;
+			int c3 = c2 - WINDOW_OFFS;
+			bool int_valid = (r3 >= WINDOW_OFFS) & (r3 < height-WINDOW_OFFS) & (c3 >= WINDOW_OFFS) & (c3 < width-WINDOW_OFFS);
+
+#ifdef INTEGRALS_BOX_SUM
+			// line r2 enters and line r2-WINDOW_SIZE leaves the column sums of c2,
+			// then column c2 enters and column c2-WINDOW_SIZE leaves the window
+			signed short int Ix_old = shift_line<signed short int, WINDOW_SIZE>(Ix_lines, Ix, r2, c2, height, width);
+			signed short int Iy_old = shift_line<signed short int, WINDOW_SIZE>(Iy_lines, Iy, r2, c2, height, width);
+			signed short int It_old = shift_line<signed short int, WINDOW_SIZE>(It_lines, It, r2, c2, height, width);
+
+			sum_t prod_new[5] = {(int) Ix*Ix, (int) Ix*Iy, (int) Iy*Iy, (int) Ix*It, (int) Iy*It};
+			sum_t prod_old[5] = {(int) Ix_old*Ix_old, (int) Ix_old*Iy_old, (int) Iy_old*Iy_old, (int) Ix_old*It_old, (int) Iy_old*It_old};
+			bool col_in = (r2 >= 0) & (c2 >= 0) & (c2 < width);
+
+			L3: for (int k = 0; k < 5; k++) {
+				if (col == 0) {
+					box[k] = 0;
+					L4: for (int x = 0; x < WINDOW_SIZE; x++) col_win[k][x] = 0;
+				}
+
+				sum_t col_sum = 0;
+				if (col_in) {
+					col_sum = ((r2 == 0) ? (sum_t) 0 : col_sums[k][c2]) + prod_new[k] - prod_old[k];
+					col_sums[k][c2] = col_sum;
+				}
+
+				box[k] += col_sum - col_win[k][0];
+				L5: for (int x = 0; x < WINDOW_SIZE-1; x++) col_win[k][x] = col_win[k][x+1];
+				col_win[k][WINDOW_SIZE-1] = col_sum;
+			}
+			sum_t a11 = box[0], a12 = box[1], a22 = box[2], b1 = box[3], b2 = box[4];
+#else
+			shift_window<signed short int, WINDOW_SIZE>(Ix_lines, Ix_win, Ix, r2, c2, height, width);
+			shift_window<signed short int, WINDOW_SIZE>(Iy_lines, Iy_win, Iy, r2, c2, height, width);
+			shift_window<signed short int, WINDOW_SIZE>(It_lines, It_win, It, r2, c2, height, width);
+
+			sum_t a11 = 0, a12 = 0, a22 = 0, b1 = 0, b2 = 0;
+			L3: for (int i = 0; i < WINDOW_SIZE*WINDOW_SIZE; i++) {
+				a11 += (int) Ix_win[i] * (int) Ix_win[i];
+				a12 += (int) Ix_win[i] * (int) Iy_win[i];
+				a22 += (int) Iy_win[i] * (int) Iy_win[i];
+				b1  += (int) Ix_win[i] * (int) It_win[i];
+				b2  += (int) Iy_win[i] * (int) It_win[i];
+			}
+#endif
+
+			if ((r3 >= 0) & (c3 >= 0))
+			{
+				float A[2][2];
+				float B[2];
+				float Vx = 0;
+				float Vy = 0;
+
+				A[0][0] = int_valid ? (float) a11 : 0;
+				A[0][1] = int_valid ? (float) a12 : 0;
+				A[1][0] = A[0][1];
+				A[1][1] = int_valid ? (float) a22 : 0;
+				B[0]    = int_valid ? (float) b1  : 0;
+				B[1]    = int_valid ? (float) b2  : 0;
+
+				bool invertible = ref_matrix_inversion(A, B, (float) THRESHOLD, Vx, Vy);
+				cnt += ((int) invertible);
+
+				//quantize motion vectors
+				vx_img[r3*width+c3] = (signed short int) (Vx *(1<<SUBPIX_BITS));
+				vy_img[r3*width+c3] = (signed short int) (Vy *(1<<SUBPIX_BITS));
+			}
+		} // end of L2
+	} // end of L1
+
+	return cnt;
+}
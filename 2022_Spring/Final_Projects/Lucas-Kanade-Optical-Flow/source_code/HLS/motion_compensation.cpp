@@ -48,7 +48,7 @@ ALL TIMES.
 #include "LKof_defines.h"
 
 
-static pix_t bilinear_interpolation(pix_t A, pix_t B, pix_t C, pix_t D, float k_x, float k_y)
+pix_t bilinear_interpolation(pix_t A, pix_t B, pix_t C, pix_t D, float k_x, float k_y)
 {
 	float P1, P2, P3;
 	pix_t out_pix;
@@ -0,0 +1,292 @@
+/*************************************************************************************
+Associated Filename:	pyr_LK.cpp
+Purpose:				Coarse to fine (pyramidal) Lukas Kanade Optical Flow
+
+ref_LK only tracks motions smaller than its windows. Here both frames are turned into
+Gaussian pyramids: every level is filtered with ref_isotropic_kernel and decimated by 2
+to give the next one. The flow is estimated at the coarsest level, then at each finer
+level it is doubled, image 2 is warped onto image 1 with bilinear_interpolation of
+motion_compensation.cpp, and one Lukas Kanade step refines it.
+
+With 1 level the flow is the one of cpu_stream_LK. pyr_LK_batch runs a sequence of
+frames, building the pyramid of each frame once and using it with the next frame too.
+*******************************************************************************/
+
+#include "LKof_defines.h"
+
+// isotropic filter of one level, zero where the window does not fit as in ref_IsotropicFilter
+static void pyr_IsotropicFilter(unsigned char *inp_img, unsigned char *out_img, int height, int width)
+{
+	unsigned char window[FILTER_SIZE*FILTER_SIZE];
+
+	memset(out_img, 0, height * width);
+	L1: for (int row = FILTER_OFFS; row < height-FILTER_OFFS; row++) {
+		L2: for (int col = FILTER_OFFS; col < width-FILTER_OFFS; col++) {
+			L3: for (int y = -FILTER_OFFS; y <= FILTER_OFFS; y++) {
+				L4: for (int x = -FILTER_OFFS; x <= FILTER_OFFS; x++) {
+					window[(y+FILTER_OFFS)*FILTER_SIZE + (x+FILTER_OFFS)] = inp_img[(row+y)*width + (col+x)];
+				}
+			}
+			out_img[row*width+col] = ref_isotropic_kernel(window);
+		}
+	}
+}
+
+// allocate the levels of a pyramid, stopping before a level too small for the filter and the window
+int pyr_Alloc(lk_pyramid_t *pyr, unsigned short int height, unsigned short int width, int levels)
+{
+	int l = 0;
+	levels = MIN(levels, PYR_MAX_LEVELS);
+
+	while (l < levels && height >= FILTER_SIZE+WINDOW_SIZE && width >= FILTER_SIZE+WINDOW_SIZE)
+	{
+		pyr->height[l]  = height;
+		pyr->width[l]   = width;
+		pyr->flt_img[l] = (unsigned char *) malloc(height * width * sizeof(unsigned char));
+		height /= 2;
+		width  /= 2;
+		l++;
+	}
+	pyr->levels = l;
+
+	return l;
+}
+
+void pyr_Free(lk_pyramid_t *pyr)
+{
+	for (int l = 0; l < pyr->levels; l++)
+	{
+		free(pyr->flt_img[l]);
+	}
+	pyr->levels = 0;
+}
+
+// filter every level of the frame once
+void pyr_Build(unsigned short int *inp_img, lk_pyramid_t *pyr)
+{
+	if (pyr->levels == 0) return;
+
+	int height = pyr->height[0];
+	int width  = pyr->width[0];
+	unsigned char *level = (unsigned char *) malloc(height * width * sizeof(unsigned char));
+
+	for (int i = 0; i < height * width; i++)
+	{
+		level[i] = (unsigned char) inp_img[i];
+	}
+
+	for (int l = 0; l < pyr->levels; l++)
+	{
+		height = pyr->height[l];
+		width  = pyr->width[l];
+		pyr_IsotropicFilter(level, pyr->flt_img[l], height, width);
+
+		// next level: the filtered level decimated by 2, written in place
+		if (l+1 < pyr->levels)
+		{
+			for (int row = 0; row < pyr->height[l+1]; row++) {
+				for (int col = 0; col < pyr->width[l+1]; col++) {
+					level[row*pyr->width[l+1]+col] = pyr->flt_img[l][(2*row)*width+(2*col)];
+				}
+			}
+		}
+	}
+
+	free(level);
+}
+
+// one Lukas Kanade step on a level: image 2 warped by the flow (Vx, Vy) against image 1,
+// the solution of each window is added to the flow
+static int pyr_RefineFlow(unsigned char *flt1_img, unsigned char *flt2_img, float *Vx_img, float *Vy_img, int height, int width)
+{
+	signed short int *Ix_img = (signed short int *) malloc(height * width * sizeof(signed short int));
+	signed short int *Iy_img = (signed short int *) malloc(height * width * sizeof(signed short int));
+	signed short int *It_img = (signed short int *) malloc(height * width * sizeof(signed short int));
+	sum_t *col_sum[5];
+	int cnt = 0;
+
+	L1: for (int row = 0; row < height; row++)
+	{
+		L2: for (int col = 0; col < width; col++)
+		{
+			int i = row*width + col;
+			unsigned char *f1 = flt1_img + i;
+			Ix_img[i] = 0;
+			Iy_img[i] = 0;
+			if (row >= FILTER_OFFS && row < height-FILTER_OFFS && col >= FILTER_OFFS && col < width-FILTER_OFFS)
+			{
+				// same taps as ref_Hderiv_kernel and ref_Vderiv_kernel
+				Ix_img[i] = (signed short int) ((f1[-2] - 8*f1[-1] + 8*f1[1] - f1[2]) / 12);
+				Iy_img[i] = (signed short int) ((f1[-2*width] - 8*f1[-width] + 8*f1[width] - f1[2*width]) / 12);
+			}
+
+			// image 2 at the position the flow moves the pixel to, nearest pixel of the border outside the image
+			float tot_x = col + Vx_img[i];
+			float tot_y = row + Vy_img[i];
+			int ix0 = (int) floorf(tot_x);
+			int iy0 = (int) floorf(tot_y);
+			pix_t warp;
+			if (ix0 >= 0 && iy0 >= 0 && ix0+1 < width && iy0+1 < height)
+			{
+				pix_t A = flt2_img[iy0*width+ix0];
+				pix_t B = flt2_img[iy0*width+ix0+1];
+				pix_t C = flt2_img[(iy0+1)*width+ix0];
+				pix_t D = flt2_img[(iy0+1)*width+ix0+1];
+				warp = bilinear_interpolation(A, B, C, D, tot_x - ix0, tot_y - iy0);
+			}
+			else
+			{
+				int x = MIN(MAX((int) (tot_x + 0.5f), 0), width-1);
+				int y = MIN(MAX((int) (tot_y + 0.5f), 0), height-1);
+				warp = flt2_img[y*width+x];
+			}
+			It_img[i] = (signed short int) (warp - *f1);
+		}
+	}
+
+	// integrals as running box sums, then the vectors of each line where the window fits
+	for (int k = 0; k < 5; k++)
+	{
+		col_sum[k] = (sum_t *) calloc(width, sizeof(sum_t));
+	}
+	L3: for (int row = 0; row < height; row++)
+	{
+		L4: for (int col = 0; col < width; col++)
+		{
+			int i = row*width + col;
+			col_sum[0][col] += (int) Ix_img[i] * (int) Ix_img[i];
+			col_sum[1][col] += (int) Ix_img[i] * (int) Iy_img[i];
+			col_sum[2][col] += (int) Iy_img[i] * (int) Iy_img[i];
+			col_sum[3][col] += (int) Ix_img[i] * (int) It_img[i];
+			col_sum[4][col] += (int) Iy_img[i] * (int) It_img[i];
+			if (row >= WINDOW_SIZE)
+			{
+				int o = i - WINDOW_SIZE*width;
+				col_sum[0][col] -= (int) Ix_img[o] * (int) Ix_img[o];
+				col_sum[1][col] -= (int) Ix_img[o] * (int) Iy_img[o];
+				col_sum[2][col] -= (int) Iy_img[o] * (int) Iy_img[o];
+				col_sum[3][col] -= (int) Ix_img[o] * (int) It_img[o];
+				col_sum[4][col] -= (int) Iy_img[o] * (int) It_img[o];
+			}
+		}
+		if (row < WINDOW_SIZE-1) continue;
+
+		int r = row - WINDOW_OFFS;
+		sum_t box[5];
+		for (int k = 0; k < 5; k++)
+		{
+			box[k] = 0;
+			for (int col = 0; col < WINDOW_SIZE; col++) box[k] += col_sum[k][col];
+		}
+		L5: for (int col = WINDOW_OFFS; col < width-WINDOW_OFFS; col++)
+		{
+			float A[2][2];
+			float B[2];
+			float dVx = 0;
+			float dVy = 0;
+
+			A[0][0] = (float) box[0];
+			A[0][1] = (float) box[1];
+			A[1][0] = A[0][1];
+			A[1][1] = (float) box[2];
+			B[0]    = (float) box[3];
+			B[1]    = (float) box[4];
+
+			bool invertible = ref_matrix_inversion(A, B, (float) THRESHOLD, dVx, dVy);
+			cnt += ((int) invertible);
+			Vx_img[r*width+col] += dVx;
+			Vy_img[r*width+col] += dVy;
+
+			if (col+WINDOW_OFFS+1 < width)
+			{
+				for (int k = 0; k < 5; k++) box[k] += col_sum[k][col+WINDOW_OFFS+1] - col_sum[k][col-WINDOW_OFFS];
+			}
+		}
+	}
+
+	for (int k = 0; k < 5; k++)
+	{
+		free(col_sum[k]);
+	}
+	free(Ix_img);
+	free(Iy_img);
+	free(It_img);
+
+	return cnt;
+}
+
+int pyr_LK(lk_pyramid_t *pyr1, lk_pyramid_t *pyr2, signed short int *vx_img, signed short int *vy_img)
+{
+	int levels = MIN(pyr1->levels, pyr2->levels);
+	float *Vx_img = NULL;
+	float *Vy_img = NULL;
+	int cnt = 0;
+
+	if (levels == 0) return -1;
+
+	for (int l = levels-1; l >= 0; l--)
+	{
+		int height = pyr1->height[l];
+		int width  = pyr1->width[l];
+		float *Vx_level = (float *) malloc(height * width * sizeof(float));
+		float *Vy_level = (float *) malloc(height * width * sizeof(float));
+
+		// start from twice the flow of the coarser level, zero at the coarsest one
+		for (int row = 0; row < height; row++)
+		{
+			for (int col = 0; col < width; col++)
+			{
+				Vx_level[row*width+col] = 0;
+				Vy_level[row*width+col] = 0;
+				if (Vx_img != NULL)
+				{
+					int coarse = MIN(row/2, pyr1->height[l+1]-1)*pyr1->width[l+1] + MIN(col/2, pyr1->width[l+1]-1);
+					Vx_level[row*width+col] = 2 * Vx_img[coarse];
+					Vy_level[row*width+col] = 2 * Vy_img[coarse];
+				}
+			}
+		}
+		free(Vx_img);
+		free(Vy_img);
+
+		cnt = pyr_RefineFlow(pyr1->flt_img[l], pyr2->flt_img[l], Vx_level, Vy_level, height, width);
+		Vx_img = Vx_level;
+		Vy_img = Vy_level;
+	}
+
+	//quantize motion vectors
+	for (int i = 0; i < pyr1->height[0] * pyr1->width[0]; i++)
+	{
+		vx_img[i] = (signed short int) (Vx_img[i] *(1<<SUBPIX_BITS));
+		vy_img[i] = (signed short int) (Vy_img[i] *(1<<SUBPIX_BITS));
+	}
+	free(Vx_img);
+	free(Vy_img);
+
+	return cnt;
+}
+
+// vectors of frames[f-1] to frames[f] in vx_img[f-1], vy_img[f-1]: each frame is filtered once,
+// its pyramid is kept for the next pair
+int pyr_LK_batch(unsigned short int **frames, int num_frames, unsigned short int height, unsigned short int width, int levels,
+		   signed short int **vx_img, signed short int **vy_img)
+{
+	lk_pyramid_t pyr[2];
+	int cnt = 0;
+
+	// frames too small for the filter and the window
+	if (pyr_Alloc(&pyr[0], height, width, levels) == 0) return -1;
+	pyr_Alloc(&pyr[1], height, width, levels);
+
+	pyr_Build(frames[0], &pyr[0]);
+	for (int f = 1; f < num_frames; f++)
+	{
+		pyr_Build(frames[f], &pyr[f % 2]);
+		cnt += pyr_LK(&pyr[(f-1) % 2], &pyr[f % 2], vx_img[f-1], vy_img[f-1]);
+	}
+
+	pyr_Free(&pyr[0]);
+	pyr_Free(&pyr[1]);
+
+	return cnt;
+}
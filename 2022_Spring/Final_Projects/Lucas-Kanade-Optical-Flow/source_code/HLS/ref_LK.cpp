@@ -207,7 +207,7 @@ void combined_IsotropicFilter(unsigned char inp_img1[MAX_HEIGHT*MAX_WIDTH], unsi
 }
 
 
- static signed short int ref_Hderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE])
+ signed short int ref_Hderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE])
  {
 
  	// derivative filter in a 5x5 kernel size: [-1 8 0 -8 1]
@@ -242,7 +242,7 @@ void combined_IsotropicFilter(unsigned char inp_img1[MAX_HEIGHT*MAX_WIDTH], unsi
  	return final_val;
  }
 
- static signed short int ref_Vderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE])
+ signed short int ref_Vderiv_kernel(unsigned char window[FILTER_SIZE*FILTER_SIZE])
  {
 
  	// derivative filter in a 5x5 kernel size  [-1 8 0 -8 1]^T
@@ -505,10 +505,77 @@ void combined_IsotropicFilter(unsigned char inp_img1[MAX_HEIGHT*MAX_WIDTH], unsi
 
  }
 
+#ifdef INTEGRALS_BOX_SUM
+ // integrals as running box sums: the column sums of the last WINDOW_SIZE lines are updated with the
+ // entering and the leaving line, then the window slides along the line adding and removing one column sum.
+ // sum_t keeps the sums exact, so they match the float sums of ref_integration_kernel whenever these are exact
+ static void ref_BoxSumIntegrals(signed short int Ix_img[MAX_HEIGHT*MAX_WIDTH], signed short int Iy_img[MAX_HEIGHT*MAX_WIDTH], signed short int It_img[MAX_HEIGHT*MAX_WIDTH],
+ 	                    float A11_img[MAX_HEIGHT*MAX_WIDTH], float A12_img[MAX_HEIGHT*MAX_WIDTH], float A22_img[MAX_HEIGHT*MAX_WIDTH],
+ 						float B1_img[MAX_HEIGHT*MAX_WIDTH], float B2_img[MAX_HEIGHT*MAX_WIDTH])
+ {
+ 	unsigned short int row, col;
+ 	int k;
+
+ 	sum_t col_sum[5][MAX_WIDTH];
+ 	sum_t box[5];
+ 	float *integral_img[5] = {A11_img, A12_img, A22_img, B1_img, B2_img};
+
+ 	// no integrals where the window does not fit in the image
+ 	L1: for(k = 0; k < 5; k++){
+ 		L2: for(col = 0; col < MAX_HEIGHT*MAX_WIDTH; col++){
+ 			integral_img[k][col] = 0;
+ 		}
+ 		L3: for(col = 0; col < MAX_WIDTH; col++){
+ 			col_sum[k][col] = 0;
+ 		}
+ 	}
+
+ 	L4: for(row = 0; row < MAX_HEIGHT; row++){
+
+ 		// add line row, and remove line row-WINDOW_SIZE, to the column sums
+ 		L5: for(col = 0; col < MAX_WIDTH; col++){
+ 			int i = row*MAX_WIDTH + col;
+ 			col_sum[0][col] += (int) Ix_img[i] * (int) Ix_img[i];
+ 			col_sum[1][col] += (int) Ix_img[i] * (int) Iy_img[i];
+ 			col_sum[2][col] += (int) Iy_img[i] * (int) Iy_img[i];
+ 			col_sum[3][col] += (int) Ix_img[i] * (int) It_img[i];
+ 			col_sum[4][col] += (int) Iy_img[i] * (int) It_img[i];
+ 			if (row >= WINDOW_SIZE){
+ 				int o = i - WINDOW_SIZE*MAX_WIDTH;
+ 				col_sum[0][col] -= (int) Ix_img[o] * (int) Ix_img[o];
+ 				col_sum[1][col] -= (int) Ix_img[o] * (int) Iy_img[o];
+ 				col_sum[2][col] -= (int) Iy_img[o] * (int) Iy_img[o];
+ 				col_sum[3][col] -= (int) Ix_img[o] * (int) It_img[o];
+ 				col_sum[4][col] -= (int) Iy_img[o] * (int) It_img[o];
+ 			}
+ 		}
+ 		if (row < WINDOW_SIZE-1) continue;
+
+ 		// slide the window along line row-WINDOW_OFFS
+ 		L6: for(k = 0; k < 5; k++){
+ 			box[k] = 0;
+ 			L7: for(col = 0; col < WINDOW_SIZE; col++){
+ 				box[k] += col_sum[k][col];
+ 			}
+ 			L8: for(col = WINDOW_OFFS; col < MAX_WIDTH-WINDOW_OFFS; col++){
+ 				integral_img[k][(row-WINDOW_OFFS)*MAX_WIDTH+col] = (float) box[k];
+ 				if (col+WINDOW_OFFS+1 < MAX_WIDTH){
+ 					box[k] += col_sum[k][col+WINDOW_OFFS+1] - col_sum[k][col-WINDOW_OFFS];
+ 				}
+ 			}
+ 		}
+ 	}
+ }
+#endif
+
  void ref_ComputeIntegrals(signed short int Ix_img[MAX_HEIGHT*MAX_WIDTH], signed short int Iy_img[MAX_HEIGHT*MAX_WIDTH], signed short int It_img[MAX_HEIGHT*MAX_WIDTH],
  	                    float A11_img[MAX_HEIGHT*MAX_WIDTH], float A12_img[MAX_HEIGHT*MAX_WIDTH], float A22_img[MAX_HEIGHT*MAX_WIDTH],
  						float B1_img[MAX_HEIGHT*MAX_WIDTH], float B2_img[MAX_HEIGHT*MAX_WIDTH])
  {
+#ifdef INTEGRALS_BOX_SUM
+ 	ref_BoxSumIntegrals(Ix_img, Iy_img, It_img, A11_img, A12_img, A22_img, B1_img, B2_img);
+ 	return;
+#endif
 
  	unsigned short int row, col, tile_row;
  	signed char x,y;
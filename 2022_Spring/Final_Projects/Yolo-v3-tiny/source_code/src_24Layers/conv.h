@@ -9,6 +9,8 @@
 #include <iostream>
 #include <ap_fixed.h>
 
+#include "layer_plan.h"
+
 //--------------------------------------------------------------------------
 // Compiler Defines
 //--------------------------------------------------------------------------
@@ -50,12 +52,18 @@
 #define N_TILE_ROWS (int) (416/OUT_BUF_HEIGHT)
 #define N_TILE_COLS (int) (416/OUT_BUF_WIDTH)
 
+// Elements of the activation arena with the fused (HLS kernel) plan of
+// layer_plan.h; the test bench checks that the plan fits.
+#define ACT_ARENA_DEPTH 1211392
+
 //--------------------------------------------------------------------------
 // Function Declarations
 //--------------------------------------------------------------------------
 void load_input_tile_block_from_DRAM_id3 (
     fm_t in_fm_buf[IN_BUF_DEPTH1][IN_BUF_HEIGHT][IN_BUF_WIDTH], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti, 
     int  tj, 
     int  d
@@ -63,14 +71,28 @@ void load_input_tile_block_from_DRAM_id3 (
 
 void load_maxpool_input_tile_block_from_DRAM(
     fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1],
-    fm_t input_mp_feature_map[1024][416][416],
-    int d
+    fm_t *input_mp_feature_map,
+    int  ih,
+    int  iw,
+    int  d
 );
 
 void load_upsample_input_tile_block_from_DRAM(
     fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH],
-    fm_t input_us_feature_map[1024][416][416],
-    int d
+    fm_t *input_us_feature_map,
+    int  ih,
+    int  iw,
+    int  d
+);
+
+void load_maxpool_input_tile_block_from_BRAM(
+    fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1],
+    fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2]
+);
+
+void load_upsample_input_tile_block_from_BRAM(
+    fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH],
+    fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2]
 );
 
 void load_layer_params_from_DRAM_id3 (
@@ -88,7 +110,9 @@ void conv_3x3_id3 (
 
 void load_input_tile_block_from_DRAM_id16 (
     fm_t in_fm_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT][IN_BUF_WIDTH], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti, 
     int  tj, 
     int  d
@@ -96,7 +120,9 @@ void load_input_tile_block_from_DRAM_id16 (
 
 void load_input_tile_block_from_DRAM_conv (
     fm_t in_fm_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT2][IN_BUF_WIDTH2], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti, 
     int  tj, 
     int  d
@@ -163,7 +189,9 @@ void save_partial_output_tile_block_bias (
 );
 
 void store_output_tile_to_DRAM (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2], 
     int  ti,
     int  tj,
@@ -171,7 +199,9 @@ void store_output_tile_to_DRAM (
 );
 
 void store_output_tile_to_DRAM_ver1 (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT][OUT_BUF_WIDTH], 
     int  ti,
     int  tj,
@@ -179,7 +209,9 @@ void store_output_tile_to_DRAM_ver1 (
 );
 
 void store_maxpool_output_tile_to_DRAM (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT/2][OUT_BUF_WIDTH/2], 
     int  ti,
     int  tj,
@@ -187,15 +219,19 @@ void store_maxpool_output_tile_to_DRAM (
 );
 
 void store_maxpool_output_tile_to_DRAM_stride1(
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2],
-    int d
+    int  d
 );
 
 void store_upsample_output_tile_to_DRAM(
-    fm_t out_fm[1024][416][416],
+    fm_t *out_fm,
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[US_BUF_DEPTH][US_BUF_HEIGHT*2][US_BUF_WIDTH*2],
-    int d
+    int  d
 );
 
 void model_conv_bn (
@@ -257,7 +293,6 @@ void max_pool_2D_stride1(
 );
 
 void yolov3_tiny (
-    fm_t input_image[3][416][416],
     wt_t conv_layer_1_weights[1024][1024][3][3],
     wt_t conv_layer_2_weights[1024][1024][3][3],
     wt_t conv_layer_3_weights[1024][1024][3][3],
@@ -273,36 +308,59 @@ void yolov3_tiny (
     wt_t conv_layer_13_weights[1024][1024][1][1],
     wt_t bias_layer_10[255],
     wt_t bias_layer_13[255],
-    fm_t input_feature_map[1024][416][416],
-    fm_t output_feature_map[1024][416][416],
-    fm_t output13_feature_map[1024][416][416],
-    fm_t output8_feature_map[1024][416][416]
-);
-
-void copy_output_to_input(
-    fm_t input_feature_map[1024][416][416],
-    fm_t output_feature_map[1024][416][416],
-    int d,
-    int h,
-    int w
+    fm_t activation_arena[ACT_ARENA_DEPTH],
+    int  fm_offset[YOLO_N_TENSORS]
 );
 
-float sigmoid(float x);
-
 // void max_pool_2D(
 //     fm_t in_buf[16][416][416],
 //     fm_t out_buf[16][208][208],
 //     int max
 // );
 
-void model_yolo(
+//--------------------------------------------------------------------------
+// YOLO detection heads. Each head holds YOLO_N_ANCHORS groups of 5 + 80
+// channels: tx, ty, tw, th, objectness and the class logits.
+//--------------------------------------------------------------------------
+#define YOLO_N_ANCHORS  3
+#define YOLO_N_CLASSES  80
+#define YOLO_MAX_GRID   (26*26)
+#define YOLO_TOP_K      256
+
+struct yolo_box_t
+{
+    float x, y, w, h;   // Box center and size in input image pixels
+    float score;        // Objectness x class probability
+    int   cls;
+};
+
+//--------------------------------------------------------------------------
+// Decodes one head and adds the boxes scoring at least score_threshold to
+// the min-heap boxes[0..n_boxes), which keeps the YOLO_TOP_K best ones.
+// Anchors are in grid units, two per anchor. Returns the new box count.
+// Heads of more than YOLO_MAX_GRID pixels are skipped.
+//--------------------------------------------------------------------------
+int model_yolo(
     fm_t *in_buf,
-    fm_t *out_buf,
     int input_d,
     int input_h,
     int input_w,
-    wt_t stride, 
-    wt_t *anchor
+    float stride,
+    const float *anchor,
+    float score_threshold,
+    yolo_box_t boxes[YOLO_TOP_K],
+    int n_boxes
+);
+
+//--------------------------------------------------------------------------
+// Sorts the boxes by decreasing score and drops the ones overlapping a
+// better box of the same class by more than iou_threshold. Returns the
+// number of boxes kept at the front of boxes.
+//--------------------------------------------------------------------------
+int model_yolo_nms(
+    yolo_box_t boxes[YOLO_TOP_K],
+    int n_boxes,
+    float iou_threshold
 );
 
 #endif
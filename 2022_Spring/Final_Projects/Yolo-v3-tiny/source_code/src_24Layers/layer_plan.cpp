@@ -0,0 +1,383 @@
+//--------------------------------------------------------------------------
+// Shape table of Yolov3-tiny and liveness-based planning of the activation
+// arena. See layer_plan.h.
+//--------------------------------------------------------------------------
+#include "layer_plan.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+//--------------------------------------------------------------------------
+// Layers as numbered in yolov3-tiny.cfg. Sources refer to tensor ids, which
+// are the producing layers or YOLO_INPUT_TENSOR for the image.
+//--------------------------------------------------------------------------
+const layer_shape_t yolo_layers[YOLO_N_LAYERS] =
+{
+    //name          type              src                                   param  od    oh   ow   tile
+    { "conv 1",     LAYER_CONV,       { YOLO_INPUT_TENSOR, LAYER_NONE },    3,     16,   416, 416, 26    },
+    { "maxpool",    LAYER_MAXPOOL,    { 0,  LAYER_NONE },                   2,     16,   208, 208, 13    },
+    { "conv 2",     LAYER_CONV,       { 1,  LAYER_NONE },                   3,     32,   208, 208, 26    },
+    { "maxpool",    LAYER_MAXPOOL,    { 2,  LAYER_NONE },                   2,     32,   104, 104, 13    },
+    { "conv 3",     LAYER_CONV,       { 3,  LAYER_NONE },                   3,     64,   104, 104, 26    },
+    { "maxpool",    LAYER_MAXPOOL,    { 4,  LAYER_NONE },                   2,     64,   52,  52,  13    },
+    { "conv 4",     LAYER_CONV,       { 5,  LAYER_NONE },                   3,     128,  52,  52,  26    },
+    { "maxpool",    LAYER_MAXPOOL,    { 6,  LAYER_NONE },                   2,     128,  26,  26,  13    },
+    { "conv 5",     LAYER_CONV,       { 7,  LAYER_NONE },                   3,     256,  26,  26,  26    },
+    { "maxpool",    LAYER_MAXPOOL,    { 8,  LAYER_NONE },                   2,     256,  13,  13,  13    },
+    { "conv 6",     LAYER_CONV,       { 9,  LAYER_NONE },                   3,     512,  13,  13,  13    },
+    { "maxpool",    LAYER_MAXPOOL,    { 10, LAYER_NONE },                   1,     512,  13,  13,  13    },
+    { "conv 7",     LAYER_CONV,       { 11, LAYER_NONE },                   3,     1024, 13,  13,  13    },
+    { "conv 8",     LAYER_CONV,       { 12, LAYER_NONE },                   1,     256,  13,  13,  13    },
+    { "conv 9",     LAYER_CONV,       { 13, LAYER_NONE },                   3,     512,  13,  13,  13    },
+    { "conv 10",    LAYER_CONV_BIAS,  { 14, LAYER_NONE },                   1,     255,  13,  13,  13    },
+    { "yolo",       LAYER_YOLO,       { 15, LAYER_NONE },                   0,     255,  13,  13,  0     },
+    { "route 13",   LAYER_ROUTE,      { 13, LAYER_NONE },                   0,     256,  13,  13,  0     },
+    { "conv 11",    LAYER_CONV,       { 17, LAYER_NONE },                   1,     128,  13,  13,  13    },
+    { "upsample",   LAYER_UPSAMPLE,   { 18, LAYER_NONE },                   2,     128,  26,  26,  26    },
+    { "route 19,8", LAYER_ROUTE,      { 19, 8 },                            0,     384,  26,  26,  0     },
+    { "conv 12",    LAYER_CONV,       { 20, LAYER_NONE },                   3,     256,  26,  26,  13    },
+    { "conv 13",    LAYER_CONV_BIAS,  { 21, LAYER_NONE },                   1,     255,  26,  26,  13    },
+    { "yolo",       LAYER_YOLO,       { 22, LAYER_NONE },                   0,     255,  26,  26,  0     },
+};
+
+int tensor_depth(int tensor)
+{
+    return (tensor == YOLO_INPUT_TENSOR) ? 3 : yolo_layers[tensor].od;
+}
+
+int tensor_height(int tensor)
+{
+    return (tensor == YOLO_INPUT_TENSOR) ? 416 : yolo_layers[tensor].oh;
+}
+
+int tensor_width(int tensor)
+{
+    return (tensor == YOLO_INPUT_TENSOR) ? 416 : yolo_layers[tensor].ow;
+}
+
+void schedule_layer_fusion(layer_schedule_t &sched, fusion_mode_t mode)
+{
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        sched.fuse_next[i] = false;
+        if (mode == FUSION_NONE || i == YOLO_N_LAYERS - 1)
+            continue;
+
+        const layer_shape_t &l = yolo_layers[i];
+        const layer_shape_t &n = yolo_layers[i+1];
+        if (l.type != LAYER_CONV || n.src[0] != i || n.src[1] != LAYER_NONE)
+            continue;
+
+        if (n.type == LAYER_MAXPOOL && n.param == 2)
+            sched.fuse_next[i] = (l.tile % 2 == 0);
+        else if (mode == FUSION_MAXPOOL_STRIDE2)
+            continue;
+        else if (n.type == LAYER_MAXPOOL && n.param == 1)
+            // The window reaches into the next tile, unless the tile is the
+            // whole feature map
+            sched.fuse_next[i] = (l.tile == l.oh) && (l.tile == l.ow);
+        else if (n.type == LAYER_UPSAMPLE)
+            sched.fuse_next[i] = true;
+    }
+}
+
+static bool is_alias(int layer)
+{
+    const layer_shape_t &l = yolo_layers[layer];
+    return (l.type == LAYER_YOLO) || (l.type == LAYER_ROUTE && l.src[1] == LAYER_NONE);
+}
+
+static bool is_concat(int layer)
+{
+    if (layer == YOLO_INPUT_TENSOR)
+        return false;
+    const layer_shape_t &l = yolo_layers[layer];
+    return (l.type == LAYER_ROUTE) && (l.src[1] != LAYER_NONE);
+}
+
+//--------------------------------------------------------------------------
+// Best-fit allocator over the arena address space. Freed blocks are merged
+// with their neighbours, and the arena grows only when no free block fits.
+//--------------------------------------------------------------------------
+struct free_block_t
+{
+    long offset;
+    long size;
+};
+
+static long arena_alloc(std::vector<free_block_t> &free_list, long &arena_size, long size)
+{
+    int best = -1;
+    for (int i = 0; i < (int)free_list.size(); i++)
+    {
+        if (free_list[i].size >= size && (best < 0 || free_list[i].size < free_list[best].size))
+            best = i;
+    }
+
+    if (best < 0)
+    {
+        // Extend the arena, reusing the free block at its end if any
+        long offset = arena_size;
+        if (!free_list.empty() && free_list.back().offset + free_list.back().size == arena_size)
+        {
+            offset = free_list.back().offset;
+            free_list.pop_back();
+        }
+        arena_size = offset + size;
+        return offset;
+    }
+
+    long offset = free_list[best].offset;
+    free_list[best].offset += size;
+    free_list[best].size   -= size;
+    if (free_list[best].size == 0)
+        free_list.erase(free_list.begin() + best);
+    return offset;
+}
+
+static void arena_free(std::vector<free_block_t> &free_list, long offset, long size)
+{
+    auto it = std::lower_bound(free_list.begin(), free_list.end(), offset,
+                               [](const free_block_t &b, long o) { return b.offset < o; });
+    it = free_list.insert(it, free_block_t{offset, size});
+
+    auto next = it + 1;
+    if (next != free_list.end() && it->offset + it->size == next->offset)
+    {
+        it->size += next->size;
+        free_list.erase(next);
+    }
+    if (it != free_list.begin())
+    {
+        auto prev = it - 1;
+        if (prev->offset + prev->size == it->offset)
+        {
+            prev->size += it->size;
+            free_list.erase(it);
+        }
+    }
+}
+
+void plan_activation_arena(arena_plan_t &plan, const layer_schedule_t &sched)
+{
+    // Tensors are placed inside allocation roots: the route aliases share
+    // the root of their source, and the sources of a concatenation are laid
+    // out back to back inside the root of the concatenated tensor.
+    int root[YOLO_N_TENSORS];
+    int sub_offset[YOLO_N_TENSORS];
+    int consumers[YOLO_N_TENSORS] = {0};
+
+    for (int t = 0; t < YOLO_N_TENSORS; t++)
+    {
+        root[t] = t;
+        sub_offset[t] = 0;
+        plan.size[t] = tensor_depth(t) * tensor_height(t) * tensor_width(t);
+        plan.offset[t] = -1;
+    }
+
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        for (int s = 0; s < 2; s++)
+            if (yolo_layers[i].src[s] != LAYER_NONE)
+                consumers[yolo_layers[i].src[s]]++;
+
+        if (is_concat(i))
+        {
+            const int a = yolo_layers[i].src[0];
+            const int b = yolo_layers[i].src[1];
+            assert(root[a] == a && root[b] == b);
+            assert(plan.size[a] + plan.size[b] == plan.size[i]);
+            root[a] = i;
+            root[b] = i;
+            sub_offset[b] = plan.size[a];
+        }
+    }
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        if (is_alias(i))
+        {
+            const int s = yolo_layers[i].src[0];
+            root[i] = root[s];
+            sub_offset[i] = sub_offset[s];
+        }
+    }
+
+    // In the HLS kernel a layer fused with the next one runs in the same
+    // pass, so its inputs are still being read while the next output is
+    // written
+    int step_begin[YOLO_N_LAYERS];
+    int step_end[YOLO_N_LAYERS];
+    bool stored[YOLO_N_TENSORS];
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        const bool fused_with_prev = (i > 0) && sched.fuse_next[i-1];
+        const bool fused_with_next = sched.fuse_next[i];
+        step_begin[i] = fused_with_prev ? i - 1 : i;
+        step_end[i]   = fused_with_next ? i + 1 : i;
+        stored[i] = !is_alias(i) && !is_concat(i)
+                 && !(fused_with_next && consumers[i] == 1 && yolo_layers[i+1].src[0] == i);
+    }
+    stored[YOLO_INPUT_TENSOR] = true;
+
+    // Lifetimes and sizes of the roots
+    long root_size[YOLO_N_TENSORS] = {0};
+    int  root_def[YOLO_N_TENSORS];
+    int  root_last_use[YOLO_N_TENSORS];
+    for (int t = 0; t < YOLO_N_TENSORS; t++)
+    {
+        root_def[t] = YOLO_N_LAYERS;
+        root_last_use[t] = -1;
+        if (root[t] == t && (stored[t] || is_concat(t)))
+            root_size[t] = plan.size[t];
+    }
+    root_def[YOLO_INPUT_TENSOR] = -1;
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        if (stored[i])
+            root_def[root[i]] = std::min(root_def[root[i]], step_begin[i]);
+    }
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        if (is_concat(i) || (is_alias(i) && yolo_layers[i].type == LAYER_ROUTE))
+            continue;
+        for (int s = 0; s < 2; s++)
+        {
+            const int src = yolo_layers[i].src[s];
+            if (src == LAYER_NONE || !(stored[src] || root[src] != src || is_concat(src)))
+                continue;
+            const int r = root[src];
+            // The yolo outputs are the outputs of the network
+            const int use = (yolo_layers[i].type == LAYER_YOLO) ? YOLO_N_LAYERS : step_end[i];
+            root_last_use[r] = std::max(root_last_use[r], use);
+            // The C model pads the input of the stride-1 maxpool in place,
+            // past the end of the tensor, and its last window reads the
+            // element after that padding row
+            if (yolo_layers[i].type == LAYER_MAXPOOL && yolo_layers[i].param == 1)
+                root_size[r] = std::max(root_size[r], (long)sub_offset[src] + plan.size[src] + tensor_width(src) + 1);
+        }
+    }
+
+    // Linear scan over the execution steps: release the dead roots, then
+    // place the roots defined at this step
+    std::vector<free_block_t> free_list;
+    long root_offset[YOLO_N_TENSORS];
+    plan.arena_size = 0;
+    for (int step = -1; step < YOLO_N_LAYERS; step++)
+    {
+        for (int r = 0; r < YOLO_N_TENSORS; r++)
+        {
+            if (root_size[r] > 0 && root_def[r] < step && root_last_use[r] == step - 1)
+                arena_free(free_list, root_offset[r], root_size[r]);
+        }
+        for (int r = 0; r < YOLO_N_TENSORS; r++)
+        {
+            if (root_size[r] > 0 && root_def[r] == step)
+                root_offset[r] = arena_alloc(free_list, plan.arena_size, root_size[r]);
+        }
+    }
+
+    for (int t = 0; t < YOLO_N_TENSORS; t++)
+    {
+        const int r = root[t];
+        plan.first_def[t] = root_def[r];
+        plan.last_use[t] = root_last_use[r];
+        if (root_size[r] > 0 && (stored[t] || r != t || is_concat(t)))
+            plan.offset[t] = (int)(root_offset[r] + sub_offset[t]);
+    }
+}
+
+void print_arena_plan(const arena_plan_t &plan, int elem_bytes)
+{
+    // Footprint of the former fixed-size buffers: input, output, layer 13
+    // and layer 8 feature maps, and the input image
+    const long legacy_size = (2L*1024 + 2L*256 + 3) * 416 * 416;
+
+    std::cout << "Activation arena plan:" << std::endl;
+    for (int t = 0; t < YOLO_N_TENSORS; t++)
+    {
+        const char *name = (t == YOLO_INPUT_TENSOR) ? "input" : yolo_layers[t].name;
+        char line[128];
+        if (plan.offset[t] < 0)
+            snprintf(line, sizeof(line), "  %2d %-10s %4dx%3dx%3d  on-chip",
+                     t, name, tensor_depth(t), tensor_height(t), tensor_width(t));
+        else
+            snprintf(line, sizeof(line), "  %2d %-10s %4dx%3dx%3d  @ %8d  live %3d..%2d",
+                     t, name, tensor_depth(t), tensor_height(t), tensor_width(t),
+                     plan.offset[t], plan.first_def[t], plan.last_use[t]);
+        std::cout << line << std::endl;
+    }
+    std::cout << "Arena size: " << plan.arena_size * elem_bytes / 1024 << " KB ("
+              << legacy_size / plan.arena_size << "x smaller than the fixed-size buffers)"
+              << std::endl;
+}
+
+//--------------------------------------------------------------------------
+// Elements moved between DRAM and the kernel by one layer.
+//--------------------------------------------------------------------------
+static long layer_dram_elements(int layer, const layer_schedule_t &sched, int depth_block)
+{
+    const layer_shape_t &l = yolo_layers[layer];
+    if (l.type == LAYER_ROUTE || l.type == LAYER_YOLO)
+        return 0;
+
+    const int  src = l.src[0];
+    const int  id  = tensor_depth(src);
+    const bool fused_with_prev = (layer > 0) && sched.fuse_next[layer-1];
+    const bool fused_with_next = sched.fuse_next[layer];
+
+    int other_consumers = 0;
+    for (int i = layer + 2; i < YOLO_N_LAYERS; i++)
+        for (int s = 0; s < 2; s++)
+            if (yolo_layers[i].src[s] == layer)
+                other_consumers++;
+
+    long elements = 0;
+    if (l.type == LAYER_CONV || l.type == LAYER_CONV_BIAS)
+    {
+        const long n_tiles  = (long)((l.oh + l.tile - 1) / l.tile) * ((l.ow + l.tile - 1) / l.tile);
+        const long n_blocks = (l.od + depth_block - 1) / depth_block;
+        elements += n_tiles * n_blocks * id * (l.tile + 2) * (l.tile + 2);
+        elements += n_tiles * l.od * id * l.param * l.param;
+        if (l.type == LAYER_CONV_BIAS)
+            elements += n_tiles * l.od;
+    }
+    else if (!fused_with_prev)
+    {
+        elements += (long)id * tensor_height(src) * tensor_width(src);
+    }
+
+    if (!fused_with_next || other_consumers > 0)
+        elements += (long)l.od * l.oh * l.ow;
+    return elements;
+}
+
+void print_dram_traffic(const layer_schedule_t &sched, int elem_bytes, int depth_block)
+{
+    layer_schedule_t previous;
+    schedule_layer_fusion(previous, FUSION_MAXPOOL_STRIDE2);
+
+    long total_before = 0;
+    long total_after  = 0;
+    std::cout << "DRAM traffic per layer (KB), previous kernel -> this schedule:" << std::endl;
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        const long before = layer_dram_elements(i, previous, depth_block) * elem_bytes;
+        const long after  = layer_dram_elements(i, sched, depth_block) * elem_bytes;
+        total_before += before;
+        total_after  += after;
+
+        char line[128];
+        snprintf(line, sizeof(line), "  %2d %-10s %9ld -> %9ld%s",
+                 i, yolo_layers[i].name, before / 1024, after / 1024,
+                 sched.fuse_next[i] ? "  fused with next" : "");
+        std::cout << line << std::endl;
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "Total: %ld KB -> %ld KB (%.2f%% less)",
+             total_before / 1024, total_after / 1024,
+             100.0 * (total_before - total_after) / total_before);
+    std::cout << line << std::endl;
+}
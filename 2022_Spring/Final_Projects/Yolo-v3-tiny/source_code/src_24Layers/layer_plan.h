@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------
+// Per-layer shape table of Yolov3-tiny and the planner of the activation
+// arena shared by the C model and the tiled HLS kernel.
+//
+// Every intermediate feature map lives at a planned offset inside a single
+// arena instead of in its own [1024][416][416] buffer. The offsets come from
+// a liveness analysis over the 24 layers: a tensor is live from the layer
+// that produces it up to its last consumer, and the space of dead tensors
+// is reused by the following layers. Route outputs are aliases, so layer 13
+// stays pinned only until layer 18, and layers 19 and 8 are placed back to
+// back so that the concatenation of layer 20 costs no copy.
+//
+// This file is host-side only and independent of fm_t, all the sizes are in
+// elements.
+//--------------------------------------------------------------------------
+
+#ifndef LAYER_PLAN_H_
+#define LAYER_PLAN_H_
+
+#define YOLO_N_LAYERS       24
+#define YOLO_INPUT_TENSOR   YOLO_N_LAYERS       // Tensor id of the input image
+#define YOLO_N_TENSORS      (YOLO_N_LAYERS + 1)
+#define LAYER_NONE          -1
+
+enum layer_type_t
+{
+    LAYER_CONV,         // Convolution + leaky ReLU
+    LAYER_CONV_BIAS,    // Convolution + bias, linear activation
+    LAYER_MAXPOOL,
+    LAYER_UPSAMPLE,
+    LAYER_ROUTE,        // Channel concatenation of up to two tensors
+    LAYER_YOLO          // Decoded in place, output aliases the input
+};
+
+struct layer_shape_t
+{
+    const char   *name;
+    layer_type_t  type;
+    int           src[2];    // Producer tensors, LAYER_NONE if unused
+    int           param;     // Kernel size of conv, stride of maxpool
+    int           od, oh, ow;
+    int           tile;      // Output tile edge of the HLS kernel pass,
+                             // 0 if the layer is not computed
+};
+
+extern const layer_shape_t yolo_layers[YOLO_N_LAYERS];
+
+//--------------------------------------------------------------------------
+// Fusion of adjacent layers at tile granularity: a layer fused with the
+// next one hands each output tile to it on-chip, in the same kernel pass.
+//--------------------------------------------------------------------------
+struct layer_schedule_t
+{
+    bool fuse_next[YOLO_N_LAYERS];
+};
+
+enum fusion_mode_t
+{
+    FUSION_NONE,            // C model, every layer output is stored
+    FUSION_MAXPOOL_STRIDE2, // Previous kernel, conv + stride-2 maxpool only
+    FUSION_ALL              // Current kernel
+};
+
+struct arena_plan_t
+{
+    int  offset[YOLO_N_TENSORS];      // -1 if the tensor is never stored
+    int  size[YOLO_N_TENSORS];        // Elements, excluding slack
+    int  first_def[YOLO_N_TENSORS];   // -1 for the input image
+    int  last_use[YOLO_N_TENSORS];    // YOLO_N_LAYERS for network outputs
+    long arena_size;                  // Elements
+};
+
+int tensor_depth(int tensor);
+int tensor_height(int tensor);
+int tensor_width(int tensor);
+
+//--------------------------------------------------------------------------
+// Fuses a convolution with the maxpool or upsample that follows it when the
+// window of the second layer stays inside the output tile of the first one.
+// The mode limits the fusions to those of the given kernel.
+//--------------------------------------------------------------------------
+void schedule_layer_fusion(layer_schedule_t &sched, fusion_mode_t mode);
+
+//--------------------------------------------------------------------------
+// Computes the offsets of all the tensors. The outputs of the fused layers
+// that have no other consumer than the next layer are not stored.
+//--------------------------------------------------------------------------
+void plan_activation_arena(arena_plan_t &plan, const layer_schedule_t &sched);
+
+void print_arena_plan(const arena_plan_t &plan, int elem_bytes);
+
+//--------------------------------------------------------------------------
+// Prints the DRAM traffic of every layer of the previous kernel, which fused
+// only the convolutions with the stride-2 maxpools, and with the given
+// schedule. Each conv tile reloads its input tile with halo for every block
+// of depth_block output channels, and the weights for every tile.
+//--------------------------------------------------------------------------
+void print_dram_traffic(const layer_schedule_t &sched, int elem_bytes, int depth_block);
+
+#endif
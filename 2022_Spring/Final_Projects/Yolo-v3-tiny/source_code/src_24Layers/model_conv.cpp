@@ -4,92 +4,125 @@
 #include "conv.h"
 #include <iostream>
 #include <math.h>
+#include <algorithm>
+#include <vector>
+#if defined(CSIM_DEBUG) && defined(__AVX2__)
+    #include <immintrin.h>
+#endif
 
-void model_conv_bn (
+//--------------------------------------------------------------------------
+// The convolutions are computed as an im2col + GEMM: for each block of
+// CONV_PIXEL_BLOCK output pixels, the input patches are unrolled into a
+// K x CONV_PIXEL_BLOCK panel (K = input_d*kernel_h*kernel_w), and every
+// filter row of the weights is multiplied with the panel. The output
+// channels are spread over the OpenMP threads.
+//
+// Each output is accumulated over k = (c, kh, kw) in the same order and
+// with the same operations as the former direct loop nest, so the results
+// are bit-identical in float mode. No FMA is used for the same reason.
+//--------------------------------------------------------------------------
+#define CONV_PIXEL_BLOCK 64
+
+// Reused across the calls, grown to the largest panel
+static std::vector<fm_t> conv_panel;
+
+static void im2col_panel(
     fm_t *input_feature_map,
-    wt_t *layer_conv_weights,
-    wt_t *layer_bn_weights,
-    fm_t *output_feature_map,
+    fm_t *panel,
     int input_d,
     int input_h,
     int input_w,
-    int filter_size,
     int kernel_h,
-    int kernel_w
+    int kernel_w,
+    int p0
 )
 {
+    const int pad_h = (kernel_h - 1)/2;
+    const int pad_w = (kernel_w - 1)/2;
+    const int n_pixels = input_h*input_w;
+
+    for(int c = 0; c < input_d; c++)
+        for(int kh = 0; kh < kernel_h; kh++)
+            for(int kw = 0; kw < kernel_w; kw++)
+            {
+                fm_t *row = panel + (((c*kernel_h + kh)*kernel_w + kw)*CONV_PIXEL_BLOCK);
+                for(int p = 0; p < CONV_PIXEL_BLOCK; p++)
+                {
+                    const int pixel = p0 + p;
+                    const int i = pixel/input_w + kh - pad_h;
+                    const int j = pixel%input_w + kw - pad_w;
+                    if((pixel >= n_pixels) || (i < 0) || (i >= input_h) || (j < 0) || (j >= input_w))
+                        row[p] = 0;
+                    else
+                        row[p] = input_feature_map[(c*input_h*input_w) + (i*input_w) + j];
+                }
+            }
+}
+
+#if defined(CSIM_DEBUG) && defined(__AVX2__)
 //--------------------------------------------------------------------------
-// Your code for TASK A goes here 
-//
-// Implement the specified convolution layer at the software level 
-// without any hardware level features. Refer to the article on Sharc Lab 
-// Knowledge Pool site to learn more.
-//
-// Hint: Do not forget to add bias and apply ReLU while writing your
-//       convolution code!
+// One filter row times the panel, 64 float accumulators held in registers.
 //--------------------------------------------------------------------------
-//Batch Normalization parameters
-fm_t *gamma, *beta, *mean, *var, epsilon = 0.001, A, B;
-gamma = (fm_t *)malloc(filter_size * sizeof(fm_t));
-beta  = (fm_t *)malloc(filter_size * sizeof(fm_t));
-mean  = (fm_t *)malloc(filter_size * sizeof(fm_t));
-var   = (fm_t *)malloc(filter_size * sizeof(fm_t));
-for (int i = 0; i < filter_size; i++)
+static void gemm_row(
+    const fm_t *panel,
+    const wt_t *weights,
+    const wt_t *bias,
+    fm_t acc[CONV_PIXEL_BLOCK],
+    int k_size
+)
 {
-    gamma[i] = layer_bn_weights[(i*4) + 0];
-    beta[i]  = layer_bn_weights[(i*4) + 1];
-    mean[i]  = layer_bn_weights[(i*4) + 2];
-    var[i]   = layer_bn_weights[(i*4) + 3];
-}
-
-//Padding of input_feature_map
-fm_t ***input_fm_padded;
+    __m256 sum[CONV_PIXEL_BLOCK/8];
+    __m256 w = _mm256_set1_ps(weights[0]);
+    for(int v = 0; v < CONV_PIXEL_BLOCK/8; v++)
+    {
+        sum[v] = _mm256_mul_ps(_mm256_loadu_ps(panel + 8*v), w);
+        if(bias)
+            sum[v] = _mm256_add_ps(sum[v], _mm256_set1_ps(*bias));
+    }
 
-input_fm_padded = (fm_t ***) malloc(input_d * sizeof(fm_t **));
+    for(int k = 1; k < k_size; k++)
+    {
+        const fm_t *row = panel + (k*CONV_PIXEL_BLOCK);
+        w = _mm256_set1_ps(weights[k]);
+        for(int v = 0; v < CONV_PIXEL_BLOCK/8; v++)
+            sum[v] = _mm256_add_ps(sum[v], _mm256_mul_ps(_mm256_loadu_ps(row + 8*v), w));
+    }
 
-for(int i = 0;i < input_d; i++)
-{
-    input_fm_padded[i]=(fm_t **)malloc((input_h + kernel_h - 1) * sizeof(fm_t *));
-    for(int j = 0;j < (input_h + kernel_h - 1); j++)
-        input_fm_padded[i][j]=(fm_t *)malloc((input_w + kernel_w - 1) * sizeof(fm_t));
+    for(int v = 0; v < CONV_PIXEL_BLOCK/8; v++)
+        _mm256_storeu_ps(acc + 8*v, sum[v]);
 }
+#else
+//--------------------------------------------------------------------------
+// Generic path, also used for ap_fixed<16,2>: the accumulator is an fm_t
+// and is quantized after every MAC, as in the direct loop nest.
+//--------------------------------------------------------------------------
+static void gemm_row(
+    const fm_t *panel,
+    const wt_t *weights,
+    const wt_t *bias,
+    fm_t acc[CONV_PIXEL_BLOCK],
+    int k_size
+)
+{
+    for(int p = 0; p < CONV_PIXEL_BLOCK; p++)
+    {
+        if(bias)
+            acc[p] = panel[p] * weights[0] + *bias;
+        else
+            acc[p] = panel[p] * weights[0];
+    }
 
-for (int f = 0; f < input_d; f++)
-    for(int i = 0; i < (input_h + kernel_h - 1); i++)
-        for(int j = 0; j < (input_w + kernel_w - 1); j++)
-        {
-            if ((i == 0) || ( j==0 ) || (i == (input_h + kernel_h - 2)) || (j == (input_w + kernel_w - 2)))
-                input_fm_padded[f][i][j] = 0;
-            else
-                input_fm_padded[f][i][j] = input_feature_map[(f*input_h*input_w) + ((i-1)*input_w) + (j-1)];
-        }
-
-
-//Convolution computation
-for(volatile int f = 0; f < filter_size; f++)    // Filter Size (Output Depth)
-    for(int i = 0; i < input_h; i++)             // Output Height
-        for(int j = 0; j < input_w; j++)           // Output Width
-        {
-            for(int c = 0; c < input_d; c++)        // Input Depth
-                for(int kh = 0; kh < kernel_h; kh++)   // Kernel Height
-                    for(int kw = 0; kw < kernel_w; kw++) // Kernel Width		
-                    {
-                        if(c == 0 && kh == 0 && kw == 0)  // Initialize output feature
-                            output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  = input_fm_padded[c][i+kh][j+kw] * layer_conv_weights[(f*input_d*kernel_h*kernel_w)+(c*kernel_h*kernel_w)+(kh*kernel_w)+kw];
-                        else                              // Multiple and Accumulate (MAC)
-                            output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  += input_fm_padded[c][i+kh][j+kw] * layer_conv_weights[(f*input_d*kernel_h*kernel_w)+(c*kernel_h*kernel_w)+(kh*kernel_w)+kw];
-                    }
-            //Batch Normalisation
-            //A = gamma[f]/(fm_t)(sqrt(var[f] + epsilon));
-            //B = beta[f] - ((gamma[f]*mean[f])/(fm_t)(sqrt(var[f] + epsilon)));
-            //output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)] = (A * output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]) + B;
-            //Leaky ReLU activation with 0.1 slope as defined by https://github.com/pjreddie/darknet/blob/master/src/activations.h
-            if(output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  < 0)
-                output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  = (fm_t)(0.1)*output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)];
-        }
+    for(int k = 1; k < k_size; k++)
+    {
+        const fm_t *row = panel + (k*CONV_PIXEL_BLOCK);
+        const wt_t w = weights[k];
+        for(int p = 0; p < CONV_PIXEL_BLOCK; p++)
+            acc[p] += row[p] * w;
+    }
 }
+#endif
 
-void model_conv (
+static void conv_gemm(
     fm_t *input_feature_map,
     wt_t *layer_conv_weights,
     wt_t *layer_bias,
@@ -99,58 +132,75 @@ void model_conv (
     int input_w,
     int filter_size,
     int kernel_h,
-    int kernel_w
+    int kernel_w,
+    bool leaky_relu
 )
 {
-//--------------------------------------------------------------------------
-// Your code for TASK A goes here 
-//
-// Implement the specified convolution layer at the software level 
-// without any hardware level features. Refer to the article on Sharc Lab 
-// Knowledge Pool site to learn more.
-//
-// Hint: Do not forget to add bias and apply ReLU while writing your
-//       convolution code!
-//--------------------------------------------------------------------------
-
-//Padding of input_feature_map
-fm_t ***input_fm_padded;
+    const int k_size = input_d*kernel_h*kernel_w;
+    const int n_pixels = input_h*input_w;
 
-input_fm_padded = (fm_t ***) malloc(input_d * sizeof(fm_t **));
+    if(conv_panel.size() < (size_t)k_size*CONV_PIXEL_BLOCK)
+        conv_panel.resize((size_t)k_size*CONV_PIXEL_BLOCK);
+    fm_t *panel = conv_panel.data();
 
-for(int i = 0;i < input_d; i++)
-{
-    input_fm_padded[i]=(fm_t **)malloc((input_h + kernel_h - 1) * sizeof(fm_t *));
-    for(int j = 0;j < (input_h + kernel_h - 1); j++)
-        input_fm_padded[i][j]=(fm_t *)malloc((input_w + kernel_w - 1) * sizeof(fm_t));
-}
+    for(int p0 = 0; p0 < n_pixels; p0 += CONV_PIXEL_BLOCK)
+    {
+        im2col_panel(input_feature_map, panel, input_d, input_h, input_w, kernel_h, kernel_w, p0);
+        const int n_valid = std::min(CONV_PIXEL_BLOCK, n_pixels - p0);
 
-for (int f = 0; f < input_d; f++)
-    for(int i = 0; i < (input_h + kernel_h - 1); i++)
-        for(int j = 0; j < (input_w + kernel_w - 1); j++)
+        #pragma omp parallel for schedule(static)
+        for(int f = 0; f < filter_size; f++)    // Filter Size (Output Depth)
         {
-            if ((i == 0) || ( j==0 ) || (i == (input_h + kernel_h - 2)) || (j == (input_w + kernel_w - 2)))
-                input_fm_padded[f][i][j] = 0;
-            else
-                input_fm_padded[f][i][j] = input_feature_map[(f*input_h*input_w) + ((i-1)*input_w) + (j-1)];
+            fm_t acc[CONV_PIXEL_BLOCK];
+            gemm_row(panel, layer_conv_weights + ((long)f*k_size), layer_bias ? layer_bias + f : NULL, acc, k_size);
+
+            fm_t *out = output_feature_map + ((long)f*n_pixels) + p0;
+            for(int p = 0; p < n_valid; p++)
+            {
+                //Leaky ReLU activation with 0.1 slope as defined by https://github.com/pjreddie/darknet/blob/master/src/activations.h
+                if(leaky_relu && (acc[p] < 0))
+                    out[p] = (fm_t)(0.1)*acc[p];
+                else
+                    out[p] = acc[p];
+            }
         }
+    }
+}
 
+void model_conv_bn (
+    fm_t *input_feature_map,
+    wt_t *layer_conv_weights,
+    wt_t *layer_bn_weights,
+    fm_t *output_feature_map,
+    int input_d,
+    int input_h,
+    int input_w,
+    int filter_size,
+    int kernel_h,
+    int kernel_w
+)
+{
+    // The reference outputs are computed without batch normalization, so
+    // layer_bn_weights is not applied here
+    conv_gemm(input_feature_map, layer_conv_weights, NULL, output_feature_map,
+              input_d, input_h, input_w, filter_size, kernel_h, kernel_w, true);
+}
 
-//Convolution computation
-for(volatile int f = 0; f < filter_size; f++)    // Filter Size (Output Depth)
-    for(int i = 0; i < input_h; i++)             // Output Height
-        for(int j = 0; j < input_w; j++)           // Output Width
-        {
-            for(int c = 0; c < input_d; c++)        // Input Depth
-                for(int kh = 0; kh < kernel_h; kh++)   // Kernel Height
-                    for(int kw = 0; kw < kernel_w; kw++) // Kernel Width		
-                    {
-                        if(c == 0 && kh == 0 && kw == 0)  // Initialize output feature
-                            output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  = input_fm_padded[c][i+kh][j+kw] * layer_conv_weights[(f*input_d*kernel_h*kernel_w)+(c*kernel_h*kernel_w)+(kh*kernel_w)+kw]  + layer_bias[f];
-                        else                              // Multiple and Accumulate (MAC)
-                            output_feature_map[(f*input_h*input_w)+(i*input_w)+(j)]  += input_fm_padded[c][i+kh][j+kw] * layer_conv_weights[(f*input_d*kernel_h*kernel_w)+(c*kernel_h*kernel_w)+(kh*kernel_w)+kw];
-                    }
-        }
+void model_conv (
+    fm_t *input_feature_map,
+    wt_t *layer_conv_weights,
+    wt_t *layer_bias,
+    fm_t *output_feature_map,
+    int input_d,
+    int input_h,
+    int input_w,
+    int filter_size,
+    int kernel_h,
+    int kernel_w
+)
+{
+    conv_gemm(input_feature_map, layer_conv_weights, layer_bias, output_feature_map,
+              input_d, input_h, input_w, filter_size, kernel_h, kernel_w, false);
 }
 
 void model_maxpool2D(
@@ -226,213 +276,218 @@ void model_upsample(
             }
 }
 
-fm_t sigmoid(fm_t x)
+//--------------------------------------------------------------------------
+// Fast exp: 2^(x*log2(e)) split into an integer power of two, built in the
+// float exponent bits, and a degree 6 polynomial for the fraction. The
+// relative error is below 1e-5, finer than the fm_t resolution.
+//--------------------------------------------------------------------------
+#define EXP_P1 0.693147180f
+#define EXP_P2 0.240226507f
+#define EXP_P3 0.0555041087f
+#define EXP_P4 0.00961812911f
+#define EXP_P5 0.00133335581f
+#define EXP_P6 0.000154035304f
+
+static inline float fast_exp(float x)
 {
-    fm_t output;
-    output = 1/(1 + exp(-1*x));
-    return output;
+    x = std::min(std::max(x, -87.0f), 88.0f);
+    const float t = x * 1.44269504f;
+    const float n = floorf(t);
+    const float f = t - n;
+    const float p = 1.0f + f*(EXP_P1 + f*(EXP_P2 + f*(EXP_P3 + f*(EXP_P4 + f*(EXP_P5 + f*EXP_P6)))));
+
+    union { float f; int i; } scale;
+    scale.i = ((int)n + 127) << 23;
+    return p * scale.f;
 }
 
-// YOLO layer
-void model_yolo(
-    fm_t *in_buf,
-    fm_t *out_buf,
-    int input_d,
-    int input_h,
-    int input_w,
-    wt_t stride, // for the scaling to represent the output, TODO: update it to a pointer
-    wt_t *anchor // for updating the expected width and height of the image, TODO: update to a pointer
-    // TODO: update to 255 layers from 85
-)
+static inline float fast_sigmoid(float x)
 {
+    return 1.0f/(1.0f + fast_exp(-x));
+}
 
-    fm_t ***input_dxdy0, ***input_dwdh0, ***input_conf0, ***input_prob0, ***xy_grid0;
-    fm_t ***input_dxdy1, ***input_dwdh1, ***input_conf1, ***input_prob1, ***xy_grid1;
-    fm_t ***input_dxdy2, ***input_dwdh2, ***input_conf2, ***input_prob2, ***xy_grid2;
-    //input_dxdy = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_dxdy0 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_dwdh0 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_conf0 = (fm_t ***) malloc(1 * sizeof(fm_t **));
-    input_prob0 = (fm_t ***) malloc(80 * sizeof(fm_t **));
-
-    input_dxdy1 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_dwdh1 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_conf1 = (fm_t ***) malloc(1 * sizeof(fm_t **));
-    input_prob1 = (fm_t ***) malloc(80 * sizeof(fm_t **));
-
-    input_dxdy2 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_dwdh2 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    input_conf2 = (fm_t ***) malloc(1 * sizeof(fm_t **));
-    input_prob2 = (fm_t ***) malloc(80 * sizeof(fm_t **));
+#if defined(CSIM_DEBUG) && defined(__AVX2__)
+static inline __m256 fast_exp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(88.0f));
+    const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f));
+    const __m256 n = _mm256_floor_ps(t);
+    const __m256 f = _mm256_sub_ps(t, n);
+
+    __m256 p = _mm256_set1_ps(EXP_P6);
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_P5));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_P4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_P3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_P2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_P1));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+
+    const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
 
+static inline __m256 fast_sigmoid_avx2(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 e = fast_exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), x));
+    return _mm256_div_ps(one, _mm256_add_ps(one, e));
+}
+#endif
 
-    xy_grid0 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    xy_grid1 = (fm_t ***) malloc(2 * sizeof(fm_t **));
-    xy_grid2 = (fm_t ***) malloc(2 * sizeof(fm_t **));
+//--------------------------------------------------------------------------
+// Objectness sigmoid and class argmax of one anchor over the whole grid.
+// The sigmoid is monotonic, so the best class is the one with the largest
+// logit and only that logit goes through the sigmoid.
+//--------------------------------------------------------------------------
+static void yolo_anchor_scores(
+    fm_t *anchor_buf,
+    int n_pixels,
+    float conf[YOLO_MAX_GRID],
+    float prob[YOLO_MAX_GRID],
+    int best_cls[YOLO_MAX_GRID]
+)
+{
+    const fm_t *conf_plane  = anchor_buf + (4*n_pixels);
+    const fm_t *class_plane = anchor_buf + (5*n_pixels);
+    int p = 0;
 
-    for(int i = 0;i < 80; i++)
+#if defined(CSIM_DEBUG) && defined(__AVX2__)
+    for(; p + 8 <= n_pixels; p += 8)
     {
-        input_prob0[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_prob1[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_prob2[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        for(int j = 0;j < (input_h); j++)
+        __m256  best = _mm256_loadu_ps(class_plane + p);
+        __m256i cls  = _mm256_setzero_si256();
+        for(int c = 1; c < YOLO_N_CLASSES; c++)
         {
-            input_prob0[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_prob1[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_prob2[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
+            const __m256 logit  = _mm256_loadu_ps(class_plane + (c*n_pixels) + p);
+            const __m256 better = _mm256_cmp_ps(logit, best, _CMP_GT_OQ);
+            best = _mm256_blendv_ps(best, logit, better);
+            cls  = _mm256_blendv_epi8(cls, _mm256_set1_epi32(c), _mm256_castps_si256(better));
         }
+        _mm256_storeu_ps(conf + p, fast_sigmoid_avx2(_mm256_loadu_ps(conf_plane + p)));
+        _mm256_storeu_ps(prob + p, fast_sigmoid_avx2(best));
+        _mm256_storeu_si256((__m256i *)(best_cls + p), cls);
     }
+#endif
 
-    for(int i = 0;i < 1; i++)
+    for(; p < n_pixels; p++)
     {
-        input_conf0[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_conf1[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_conf2[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        for(int j = 0;j < input_h; j++)
+        float best = (float) class_plane[p];
+        int   cls  = 0;
+        for(int c = 1; c < YOLO_N_CLASSES; c++)
         {
-            input_conf0[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_conf1[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_conf2[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
+            const float logit = (float) class_plane[(c*n_pixels) + p];
+            if(logit > best)
+            {
+                best = logit;
+                cls  = c;
+            }
         }
+        conf[p]     = fast_sigmoid((float) conf_plane[p]);
+        prob[p]     = fast_sigmoid(best);
+        best_cls[p] = cls;
+    }
+}
+
+// Used as the heap order, it puts the worst kept box at the root
+static bool yolo_box_higher_score(const yolo_box_t &a, const yolo_box_t &b)
+{
+    return a.score > b.score;
+}
+
+// YOLO layer
+int model_yolo(
+    fm_t *in_buf,
+    int input_d,
+    int input_h,
+    int input_w,
+    float stride,
+    const float *anchor,
+    float score_threshold,
+    yolo_box_t boxes[YOLO_TOP_K],
+    int n_boxes
+)
+{
+    const int n_pixels = input_h*input_w;
+    const int n_anchors = input_d/(5 + YOLO_N_CLASSES);
+
+    // The per-pixel scores of an anchor are kept in fixed-size buffers
+    if(n_pixels > YOLO_MAX_GRID)
+    {
+        std::cout << "YOLO head of " << input_h << "x" << input_w
+                  << " exceeds YOLO_MAX_GRID, skipped" << std::endl;
+        return n_boxes;
     }
 
-    for(int i = 0;i < 2; i++)
+    float conf[YOLO_MAX_GRID];
+    float prob[YOLO_MAX_GRID];
+    int   best_cls[YOLO_MAX_GRID];
+
+    for(int a = 0; a < n_anchors; a++)
     {
-        input_dxdy0[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_dxdy1[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_dxdy2[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_dwdh0[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_dwdh1[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        input_dwdh2[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        xy_grid0[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        xy_grid1[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        xy_grid2[i]=(fm_t **)malloc((input_h) * sizeof(fm_t *));
-        for(int j = 0;j < input_h; j++)
+        fm_t *anchor_buf = in_buf + (a*(5 + YOLO_N_CLASSES)*n_pixels);
+        yolo_anchor_scores(anchor_buf, n_pixels, conf, prob, best_cls);
+
+        for(int p = 0; p < n_pixels; p++)
         {
-            input_dxdy0[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_dxdy1[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_dxdy2[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_dwdh0[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_dwdh1[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            input_dwdh2[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            xy_grid0[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            xy_grid1[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
-            xy_grid2[i][j]=(fm_t *)malloc((input_w) * sizeof(fm_t));
+            const float score = conf[p]*prob[p];
+            if(score < score_threshold)
+                continue;
+            if(n_boxes == YOLO_TOP_K && score <= boxes[0].score)
+                continue;
+
+            // Box transforms only for the boxes that are kept
+            const int i = p/input_w;
+            const int j = p%input_w;
+            yolo_box_t box;
+            box.x     = (fast_sigmoid((float) anchor_buf[p]) + j) * stride;
+            box.y     = (fast_sigmoid((float) anchor_buf[n_pixels + p]) + i) * stride;
+            box.w     = fast_exp((float) anchor_buf[(2*n_pixels) + p]) * anchor[2*a] * stride;
+            box.h     = fast_exp((float) anchor_buf[(3*n_pixels) + p]) * anchor[(2*a) + 1] * stride;
+            box.score = score;
+            box.cls   = best_cls[p];
+
+            if(n_boxes == YOLO_TOP_K)
+            {
+                std::pop_heap(boxes, boxes + n_boxes, yolo_box_higher_score);
+                n_boxes--;
+            }
+            boxes[n_boxes++] = box;
+            std::push_heap(boxes, boxes + n_boxes, yolo_box_higher_score);
         }
     }
+    return n_boxes;
+}
 
-    for (int f = 0; f < 85; f++)
-        for(int i = 0; i < (input_h); i++)
-            for(int j = 0; j < (input_w); j++)
-            {
-                if ((f==0) || (f==1))
-		        {
-                    input_dxdy0[f][i][j] = in_buf[(f*input_h*input_w) + ((i)*input_w) + (j)];
-                    if(f==0) xy_grid0[f][i][j] = i;
-                    if(f==1) xy_grid0[f][i][j] = j;
-
-                    input_dxdy1[f][i][j] = in_buf[((f+85)*input_h*input_w) + ((i)*input_w) + (j)];
-                    if(f==0) xy_grid1[f][i][j] = i;
-                    if(f==1) xy_grid1[f][i][j] = j;
-
-                    input_dxdy2[f][i][j] = in_buf[((f+170)*input_h*input_w) + ((i)*input_w) + (j)];
-                    if(f==0) xy_grid2[f][i][j] = i;
-                    if(f==1) xy_grid2[f][i][j] = j;
-		        }
-                else if((f==2) || (f==3))
-		        {
-                    input_dwdh0[f-2][i][j] = in_buf[(f*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_dwdh1[f-2][i][j] = in_buf[((f+85)*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_dwdh2[f-2][i][j] = in_buf[((f+170)*input_h*input_w) + ((i)*input_w) + (j)];
-		        }
-                else if(f==4)
-		        {
-                    input_conf0[f-4][i][j] = in_buf[(f*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_conf1[f-4][i][j] = in_buf[((f+85)*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_conf2[f-4][i][j] = in_buf[((f+170)*input_h*input_w) + ((i)*input_w) + (j)];
-		        }
-                else
-		        {
-                    input_prob0[f-5][i][j] = in_buf[(f*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_prob1[f-5][i][j] = in_buf[((f+85)*input_h*input_w) + ((i)*input_w) + (j)];
-                    input_prob2[f-5][i][j] = in_buf[((f+170)*input_h*input_w) + ((i)*input_w) + (j)];
-		        }
-            }
+static float yolo_box_iou(const yolo_box_t &a, const yolo_box_t &b)
+{
+    const float w = std::min(a.x + a.w/2, b.x + b.w/2) - std::max(a.x - a.w/2, b.x - b.w/2);
+    const float h = std::min(a.y + a.h/2, b.y + b.h/2) - std::max(a.y - a.h/2, b.y - b.h/2);
+    if(w <= 0 || h <= 0)
+        return 0;
+    const float inter = w*h;
+    return inter/((a.w*a.h) + (b.w*b.h) - inter);
+}
 
-    for (int f = 0; f < 2; f++)
-            for(int i = 0; i < (input_h); i++)
-                for(int j = 0; j < (input_w); j++)
-                {
-                    input_dxdy0[f][i][j] = (sigmoid(input_dxdy0[f][i][j]) + xy_grid0[f][i][j]) * stride;
-                    input_dxdy1[f][i][j] = (sigmoid(input_dxdy1[f][i][j]) + xy_grid1[f][i][j]) * stride;
-                    input_dxdy2[f][i][j] = (sigmoid(input_dxdy2[f][i][j]) + xy_grid2[f][i][j]) * stride;
-                    // TODO: Uncomment this
-                    input_dwdh0[f][i][j] = fm_t(exp(input_dwdh0[f][i][j])) * *(anchor + f) * stride;
-                    input_dwdh1[f][i][j] = fm_t(exp(input_dwdh1[f][i][j])) * *(anchor + 2 + f) * stride;
-                    input_dwdh2[f][i][j] = fm_t(exp(input_dwdh2[f][i][j])) * *(anchor + 4 + f) * stride;
-
-                    //std::cout << "f = " << f << " and value = " << *(anchor+f) << std::endl;
-                    // std::cout << "f = " << f << " and value = " <<  *(anchor + 2 + f) << ", input_dwdh1[f][i][j] = " << input_dwdh1[f][i][j] << std::endl;
-                    // std::cout << "f = " << f << " and value = " <<  *(anchor + 4 + f) << std::endl;
-                }
-    // std::cout << *(anchor) << std::endl;
-    // std::cout << *(anchor+1) << std::endl;
-    // std::cout << *(anchor+2) << std::endl;
-    // std::cout << *(anchor+3) << std::endl;
-    // std::cout << *(anchor+4) << std::endl;
-    // std::cout << *(anchor+5) << std::endl;
-    // std::cout("*(*(anchor)+1) = %f\n",*(*(anchor)+1));
-    // std::cout("*(*(anchor+1)) = %f\n",*(*(anchor+1)));
-    // std::cout("*(*(anchor+1)+1) = %f\n",*(*(anchor+1)+1));
-    // std::cout("*(*(anchor+2)) = %f\n",*(*(anchor+2)));
-    // std::cout("*(*(anchor+2)+1) = %f\n",*(*(anchor+2)+1));
-    //std::cout("*(*(anchor)) = %f\n");
-
-    for (int f = 0; f < 1; f++)
-            for(int i = 0; i < (input_h); i++)
-                for(int j = 0; j < (input_w); j++)
-                {
-                    input_conf0[f][i][j] = sigmoid(input_conf0[f][i][j]);
-                    input_conf1[f][i][j] = sigmoid(input_conf1[f][i][j]);
-                    input_conf2[f][i][j] = sigmoid(input_conf2[f][i][j]);
-                }
-    
-    for (int f = 0; f < 80; f++)
-            for(int i = 0; i < (input_h); i++)
-                for(int j = 0; j < (input_w); j++)
-                {
-                    input_prob0[f][i][j] = sigmoid(input_prob0[f][i][j]);
-                    input_prob1[f][i][j] = sigmoid(input_prob1[f][i][j]);
-                    input_prob2[f][i][j] = sigmoid(input_prob2[f][i][j]);
-                }
+int model_yolo_nms(
+    yolo_box_t boxes[YOLO_TOP_K],
+    int n_boxes,
+    float iou_threshold
+)
+{
+    std::sort(boxes, boxes + n_boxes, yolo_box_higher_score);
 
-    for (int f = 0; f < 85; f++)
-        for(int i = 0; i < input_h; i++)
-            for(int j = 0; j < input_w; j++)
-            {
-                if ((f==0) || (f==1))
-                {
-                    out_buf[(f*input_h*input_w)+(i*input_w)+(j)] = input_dxdy0[f][i][j];
-                    out_buf[((f+85)*input_h*input_w)+(i*input_w)+(j)] = input_dxdy1[f][i][j];
-                    out_buf[((f+170)*input_h*input_w)+(i*input_w)+(j)] = input_dxdy2[f][i][j];
-                }
-                else if((f==2) || (f==3))
-                {
-                    out_buf[(f*input_h*input_w)+(i*input_w)+(j)] = input_dwdh0[f-2][i][j];
-                    out_buf[((f+85)*input_h*input_w)+(i*input_w)+(j)] = input_dwdh1[f-2][i][j];
-                    out_buf[((f+170)*input_h*input_w)+(i*input_w)+(j)] = input_dwdh2[f-2][i][j];
-                }
-                else if(f==4)
-                {
-                    out_buf[(f*input_h*input_w)+(i*input_w)+(j)] = input_conf0[f-4][i][j];
-                    out_buf[((f+85)*input_h*input_w)+(i*input_w)+(j)] = input_conf1[f-4][i][j];
-                    out_buf[((f+170)*input_h*input_w)+(i*input_w)+(j)] = input_conf2[f-4][i][j];
-                }
-                else
-                {
-                    out_buf[(f*input_h*input_w)+(i*input_w)+(j)] = input_prob0[f-5][i][j];
-                    out_buf[((f+85)*input_h*input_w)+(i*input_w)+(j)] = input_prob1[f-5][i][j];
-                    out_buf[((f+170)*input_h*input_w)+(i*input_w)+(j)] = input_prob2[f-5][i][j];
-                }
-            }  
+    // The kept boxes are compacted at the front, in decreasing score order
+    int n_kept = 0;
+    for(int b = 0; b < n_boxes; b++)
+    {
+        bool keep = true;
+        for(int k = 0; k < n_kept && keep; k++)
+        {
+            if(boxes[k].cls == boxes[b].cls && yolo_box_iou(boxes[k], boxes[b]) > iou_threshold)
+                keep = false;
+        }
+        if(keep)
+            boxes[n_kept++] = boxes[b];
+    }
+    return n_kept;
 }
@@ -56,9 +56,6 @@ float bn_layer_12_weights[256][4];
 float bias_layer_10[255];
 float bias_layer_13[255];
 
-fm_t    fixp_conv_layer_input_feature_map[1024][416][416];
-fm_t    fixp_input_image[3][416][416];
-
 wt_t    fixp_conv_layer_1_weights[16][1024][3][3];
 wt_t    fixp_conv_layer_2_weights[32][1024][3][3];
 wt_t    fixp_conv_layer_3_weights[64][1024][3][3];
@@ -89,11 +86,76 @@ wt_t    fixp_bias_layer_10[255];
 wt_t    fixp_bias_layer_13[255];
 
 //--------------------------------------------------------------------------
-// Computed outputs
+// Feature maps, placed in the activation arena as planned in layer_plan.h
+//--------------------------------------------------------------------------
+arena_plan_t fm_plan;
+fm_t        *activation_arena;
+
+fm_t *fm(int tensor)
+{
+    return activation_arena + fm_plan.offset[tensor];
+}
+
+//--------------------------------------------------------------------------
+// Layers that yolov3_tiny() runs in one pass with the next one, and the
+// fused layers whose output it still stores (store_conv_output of
+// tiled_conv_maxpool_id16). To be kept in sync with yolov3_tiny.cpp.
 //--------------------------------------------------------------------------
-fm_t   fixp_conv_layer_output_feature_map[1024][416][416]    = {0};
-fm_t   fixp_conv_layer_13_output_feature_map[256][416][416] = {0};
-fm_t   fixp_conv_layer_8_output_feature_map[256][416][416]     = {0};
+const int kernel_fused_layers[]        = {0, 2, 4, 6, 8, 10, 18};
+const int kernel_stored_fused_layers[] = {8};
+
+static bool is_listed(int layer, const int *list, int n)
+{
+    for (int i = 0; i < n; i++)
+        if (list[i] == layer)
+            return true;
+    return false;
+}
+
+//--------------------------------------------------------------------------
+// Checks that the schedule fuses the same layers as the kernel, and that
+// the arena plan stores the outputs of exactly the fused layers the kernel
+// writes to DRAM.
+//--------------------------------------------------------------------------
+bool check_kernel_fusion(const layer_schedule_t &sched, const arena_plan_t &plan)
+{
+    const int n_fused  = sizeof(kernel_fused_layers) / sizeof(kernel_fused_layers[0]);
+    const int n_stored = sizeof(kernel_stored_fused_layers) / sizeof(kernel_stored_fused_layers[0]);
+
+    bool ok = true;
+    for (int i = 0; i < YOLO_N_LAYERS; i++)
+    {
+        const bool fused = is_listed(i, kernel_fused_layers, n_fused);
+        if (sched.fuse_next[i] != fused)
+        {
+            std::cout << "Layer " << i << " is " << (fused ? "" : "not ")
+                      << "fused with the next one in the kernel, but "
+                      << (fused ? "not " : "") << "in the schedule" << std::endl;
+            ok = false;
+        }
+        else if (fused && (plan.offset[i] >= 0) != is_listed(i, kernel_stored_fused_layers, n_stored))
+        {
+            std::cout << "Layer " << i << " output is "
+                      << (plan.offset[i] >= 0 ? "" : "not ")
+                      << "stored in the arena plan, unlike in the kernel" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+//--------------------------------------------------------------------------
+// Detections of the two YOLO heads. The anchors of yolov3-tiny.cfg (masks
+// 3,4,5 and 1,2,3) are given in grid units of their head.
+//--------------------------------------------------------------------------
+#define YOLO_SCORE_THRESHOLD 0.25f
+#define YOLO_IOU_THRESHOLD   0.45f
+
+const float yolo_anchors_13[6] = {81/32.0f, 82/32.0f, 135/32.0f, 169/32.0f, 344/32.0f, 319/32.0f};
+const float yolo_anchors_26[6] = {23/16.0f, 27/16.0f,  37/16.0f,  58/16.0f,  81/16.0f,  82/16.0f};
+
+yolo_box_t yolo_boxes[YOLO_TOP_K];
+int        n_yolo_boxes = 0;
 
 //--------------------------------------------------------------------------
 // Read the reference files into test bench arrays
@@ -228,7 +290,7 @@ void convert_type()
     for(int c = 0; c < 3; c++)
         for(int i = 0; i < 416; i++)
             for(int j = 0; j < 416; j++)
-                fixp_input_image[c][i][j] = (fm_t) input_image[c][i][j];
+                fm(YOLO_INPUT_TENSOR)[(c*416*416) + (i*416) + j] = (fm_t) input_image[c][i][j];
     
     // Weights for convolution layer
     for(int f = 0; f < 16; f++)
@@ -391,6 +453,30 @@ int main ()
     
     // Read reference inputs and output
     read_bin_files();
+
+    // Plan the activation arena; the C model stores every layer output
+    // while the HLS kernel keeps the fused ones on-chip
+    layer_schedule_t schedule;
+    #ifdef CMODEL_SIM
+        schedule_layer_fusion(schedule, FUSION_NONE);
+        plan_activation_arena(fm_plan, schedule);
+    #else
+        schedule_layer_fusion(schedule, FUSION_ALL);
+        plan_activation_arena(fm_plan, schedule);
+        if(!check_kernel_fusion(schedule, fm_plan))
+        {
+            std::cout << "Layer fusion schedule does not match the kernel" << std::endl;
+            return 1;
+        }
+        if(fm_plan.arena_size > ACT_ARENA_DEPTH)
+        {
+            std::cout << "Activation arena exceeds ACT_ARENA_DEPTH" << std::endl;
+            return 1;
+        }
+        print_dram_traffic(schedule, sizeof(fm_t), OUT_BUF_DEPTH);
+    #endif
+    print_arena_plan(fm_plan, sizeof(fm_t));
+    activation_arena = new fm_t[fm_plan.arena_size]();
    
     // Convert to fixed-point types 
     convert_type();
@@ -398,10 +484,10 @@ int main ()
     #ifdef CMODEL_SIM
         std::cout << "Beginning C model simulation..." << std::endl;
         //Layer 0 - Convolution layer 1
-        model_conv_bn ((fm_t *)fixp_input_image,
+        model_conv_bn (fm(YOLO_INPUT_TENSOR),
                     (wt_t *)fixp_conv_layer_1_weights,
                     (wt_t *)fixp_bn_layer_1_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(0),
                     3,
                     416,
                     416,
@@ -409,21 +495,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(16*416*416), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 1 - Maxpooling layer
-        model_maxpool2D ((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D (fm(0),
+                        fm(1),
                         16,
                         416,
                         416,
                         2
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(16*208*208), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 2 - Convolution layer 2
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(1),
                     (wt_t *)fixp_conv_layer_2_weights,
                     (wt_t *)fixp_bn_layer_2_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(2),
                     16,
                     208,
                     208,
@@ -431,21 +515,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(32*208*208), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 3 - Maxpooling layer
-        model_maxpool2D((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D(fm(2),
+                        fm(3),
                         32,
                         208,
                         208,
                         2
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(32*104*104), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 4 - Convolution layer 3
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(3),
                     (wt_t *)fixp_conv_layer_3_weights,
                     (wt_t *)fixp_bn_layer_3_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(4),
                     32,
                     104,
                     104,
@@ -453,21 +535,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(64*104*104), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 5 - Maxpooling layer
-        model_maxpool2D((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D(fm(4),
+                        fm(5),
                         64,
                         104,
                         104,
                         2
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(64*52*52), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 6 - Convolution layer 4
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(5),
                     (wt_t *)fixp_conv_layer_4_weights,
                     (wt_t *)fixp_bn_layer_4_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(6),
                     64,
                     52,
                     52,
@@ -475,21 +555,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(128*52*52), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 7 - Maxpooling layer
-        model_maxpool2D((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D(fm(6),
+                        fm(7),
                         128,
                         52,
                         52,
                         2
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(128*26*26), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 8 - Convolution layer 5
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(7),
                     (wt_t *)fixp_conv_layer_5_weights,
                     (wt_t *)fixp_bn_layer_5_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(8),
                     128,
                     26,
                     26,
@@ -497,22 +575,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*26*26), (fm_t *)fixp_conv_layer_input_feature_map);
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*26*26), (fm_t *)fixp_conv_layer_8_output_feature_map);
         //Layer 9 - Maxpooling layer
-        model_maxpool2D((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D(fm(8),
+                        fm(9),
                         256,
                         26,
                         26,
                         2
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 10 - Convolution layer 6
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(9),
                     (wt_t *)fixp_conv_layer_6_weights,
                     (wt_t *)fixp_bn_layer_6_weights,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(10),
                     256,
                     13,
                     13,
@@ -520,21 +595,19 @@ int main ()
                     3,
                     3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(512*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 11
-        model_maxpool2D((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_maxpool2D(fm(10),
+                        fm(11),
                         512,
                         13,
                         13,
                         1
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 12 - Convolution layer 7
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(11),
                         (wt_t *)fixp_conv_layer_7_weights,
                         (wt_t *)fixp_bn_layer_7_weights,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+                        fm(12),
                         512,
                         13,
                         13,
@@ -542,12 +615,11 @@ int main ()
                         3,
                         3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(1024*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 13 - Convolution layer 8
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(12),
                         (wt_t *)fixp_conv_layer_8_weights,
                         (wt_t *)fixp_bn_layer_8_weights,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+                        fm(13),
                         1024,
                         13,
                         13,
@@ -555,14 +627,11 @@ int main ()
                         1,
                         1
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
-        //Layer 17 - Route 13
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*13*13), (fm_t *)fixp_conv_layer_13_output_feature_map);
         //Layer 14 - Convolution layer 9
-        model_conv_bn ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn (fm(13),
                         (wt_t *)fixp_conv_layer_9_weights,
                         (wt_t *)fixp_bn_layer_9_weights,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+                        fm(14),
                         256,
                         13,
                         13,
@@ -570,12 +639,11 @@ int main ()
                         3,
                         3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(512*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 15 - Convolution layer 10
-        model_conv ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv (fm(14),
                     (wt_t *)fixp_conv_layer_10_weights,
                     (wt_t *)fixp_bias_layer_10,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(15),
                     512,
                     13,
                     13,
@@ -583,14 +651,25 @@ int main ()
                     1,
                     1
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(255*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
-        //TODO: Layer 16 - Insert call to Yolo layer
+        //Layer 16 - Yolo
+        n_yolo_boxes = model_yolo(fm(15),
+                                  255,
+                                  13,
+                                  13,
+                                  32,
+                                  yolo_anchors_13,
+                                  YOLO_SCORE_THRESHOLD,
+                                  yolo_boxes,
+                                  n_yolo_boxes
+        );
+
+        //Layer 17 - Route 13, aliases the output of layer 13
 
         //Layer 18 - Convolution layer 11
-        model_conv_bn  ((fm_t *)fixp_conv_layer_13_output_feature_map,
+        model_conv_bn  (fm(17),
                         (wt_t *)fixp_conv_layer_11_weights,
                         (wt_t *)fixp_bn_layer_11_weights,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+                        fm(18),
                         256,
                         13,
                         13,
@@ -598,22 +677,21 @@ int main ()
                         1,
                         1
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(128*13*13), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 19 - Upsampling
-        model_upsample ((fm_t *)fixp_conv_layer_input_feature_map,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+        model_upsample (fm(18),
+                        fm(19),
                         128,
                         13,
                         13
         );
-        //Layer 20 - Route 19,8
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(128*26*26), (fm_t *)fixp_conv_layer_input_feature_map);
-        std::copy((fm_t *)fixp_conv_layer_8_output_feature_map, (fm_t *)fixp_conv_layer_8_output_feature_map+(256*26*26), ((fm_t *)fixp_conv_layer_input_feature_map)+(128*26*26));
+        //Layer 20 - Route 19,8, the outputs of layers 19 and 8 are adjacent
+        //in the arena
+
         //Layer 21 - Convolution layer 12
-        model_conv_bn  ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv_bn  (fm(20),
                         (wt_t *)fixp_conv_layer_12_weights,
                         (wt_t *)fixp_bn_layer_12_weights,
-                        (fm_t *)fixp_conv_layer_output_feature_map,
+                        fm(21),
                         384,
                         26,
                         26,
@@ -621,12 +699,11 @@ int main ()
                         3,
                         3
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(256*26*26), (fm_t *)fixp_conv_layer_input_feature_map);
         //Layer 22 - Convolution layer 13
-        model_conv ((fm_t *)fixp_conv_layer_input_feature_map,
+        model_conv (fm(21),
                     (wt_t *)fixp_conv_layer_13_weights,
                     (wt_t *)fixp_bias_layer_13,
-                    (fm_t *)fixp_conv_layer_output_feature_map,
+                    fm(22),
                     256,
                     26,
                     26,
@@ -634,14 +711,24 @@ int main ()
                     1,
                     1
         );
-        std::copy((fm_t *)fixp_conv_layer_output_feature_map, (fm_t *)fixp_conv_layer_output_feature_map+(255*26*26), (fm_t *)fixp_conv_layer_input_feature_map);
-        //TODO: Layer 23 - Insert call to Yolo layer
+        //Layer 23 - Yolo
+        n_yolo_boxes = model_yolo(fm(22),
+                                  255,
+                                  26,
+                                  26,
+                                  16,
+                                  yolo_anchors_26,
+                                  YOLO_SCORE_THRESHOLD,
+                                  yolo_boxes,
+                                  n_yolo_boxes
+        );
+        n_yolo_boxes = model_yolo_nms(yolo_boxes, n_yolo_boxes, YOLO_IOU_THRESHOLD);
+        std::cout << "Detected boxes: " << n_yolo_boxes << std::endl;
 
         std::cout << "C model simulation complete!\n" << std::endl;
     #else
         std::cout << "Beginning HLS tiled-convolution simulation..." << std::endl;
-        yolov3_tiny(fixp_input_image,
-                    fixp_conv_layer_1_weights,
+        yolov3_tiny(fixp_conv_layer_1_weights,
                     fixp_conv_layer_2_weights,
                     fixp_conv_layer_3_weights,
                     fixp_conv_layer_4_weights,
@@ -656,10 +743,8 @@ int main ()
                     fixp_conv_layer_13_weights,
                     fixp_bias_layer_10,
                     fixp_bias_layer_13,
-                    fixp_conv_layer_input_feature_map,
-                    fixp_conv_layer_output_feature_map,
-                    fixp_conv_layer_13_output_feature_map,
-                    fixp_conv_layer_8_output_feature_map
+                    activation_arena,
+                    fm_plan.offset
         );
         std::cout << "Tiled-convolution simulation complete!\n" << std::endl;
     #endif
@@ -709,5 +794,7 @@ int main ()
     #endif
     std::cout << "----------------------------------------" << std::endl;
 
+    delete[] activation_arena;
+
     return 0;
 }
@@ -69,8 +69,10 @@ void max_pool_2D_stride1(
 
 void load_maxpool_input_tile_block_from_DRAM(
     fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1],
-    fm_t input_mp_feature_map[1024][416][416],
-    int d
+    fm_t *input_mp_feature_map,
+    int  ih,
+    int  iw,
+    int  d
 )
 {
     const int depth_offset  =  d * OUT_BUF_DEPTH;
@@ -85,10 +87,10 @@ void load_maxpool_input_tile_block_from_DRAM(
             for(int j = 0; j < OUT_BUF_WIDTH2+1; j++)
             {
                 // Handling border features here
-                if((i == OUT_BUF_HEIGHT2) || (j == OUT_BUF_WIDTH2))
+                if((i >= ih) || (j >= iw))
                     maxpool_in_buf[c][i][j] = 0;
                 else
-		            maxpool_in_buf[c][i][j] = input_mp_feature_map[depth_offset + c][i][j];
+		            maxpool_in_buf[c][i][j] = input_mp_feature_map[((depth_offset + c)*ih + i)*iw + j];
             }
         }
     }
@@ -96,8 +98,10 @@ void load_maxpool_input_tile_block_from_DRAM(
 
 void load_upsample_input_tile_block_from_DRAM(
     fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH],
-    fm_t input_us_feature_map[1024][416][416],
-    int d
+    fm_t *input_us_feature_map,
+    int  ih,
+    int  iw,
+    int  d
 )
 {
     const int depth_offset  =  d * US_BUF_DEPTH;
@@ -111,7 +115,60 @@ void load_upsample_input_tile_block_from_DRAM(
             UPSAMPLE_INPUT_BUFFER_WIDTH:
             for(int j = 0; j < US_BUF_WIDTH; j++)
             {
-		        upsample_in_buf[c][i][j] = input_us_feature_map[depth_offset + c][i][j];
+		        upsample_in_buf[c][i][j] = input_us_feature_map[((depth_offset + c)*ih + i)*iw + j];
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------
+// Functions to pass a conv output tile to the fused maxpool or upsample
+// on-chip, applying the leaky ReLU done by store_output_tile_to_DRAM.
+//--------------------------------------------------------------------------
+void load_maxpool_input_tile_block_from_BRAM(
+    fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1],
+    fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2]
+)
+{
+    MAXPOOL_INPUT_BUFFER_DEPTH:
+    for(int c = 0; c < OUT_BUF_DEPTH; c++)
+    {
+        MAXPOOL_INPUT_BUFFER_HEIGHT:
+        for(int i = 0; i < OUT_BUF_HEIGHT2+1; i++)
+        {
+            MAXPOOL_INPUT_BUFFER_WIDTH:
+            for(int j = 0; j < OUT_BUF_WIDTH2+1; j++)
+            {
+                // Handling border features here
+                if((i == OUT_BUF_HEIGHT2) || (j == OUT_BUF_WIDTH2))
+                    maxpool_in_buf[c][i][j] = 0;
+                else if(out_fm_buf[c][i][j] < (fm_t) 0)
+                    maxpool_in_buf[c][i][j] = (fm_t)(0.1) * out_fm_buf[c][i][j];
+                else
+                    maxpool_in_buf[c][i][j] = out_fm_buf[c][i][j];
+            }
+        }
+    }
+}
+
+void load_upsample_input_tile_block_from_BRAM(
+    fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH],
+    fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2]
+)
+{
+    UPSAMPLE_INPUT_BUFFER_DEPTH:
+    for(int c = 0; c < US_BUF_DEPTH; c++)
+    {
+        UPSAMPLE_INPUT_BUFFER_HEIGHT:
+        for(int i = 0; i < US_BUF_HEIGHT; i++)
+        {
+            UPSAMPLE_INPUT_BUFFER_WIDTH:
+            for(int j = 0; j < US_BUF_WIDTH; j++)
+            {
+                if(out_fm_buf[c][i][j] < (fm_t) 0)
+                    upsample_in_buf[c][i][j] = (fm_t)(0.1) * out_fm_buf[c][i][j];
+                else
+                    upsample_in_buf[c][i][j] = out_fm_buf[c][i][j];
             }
         }
     }
@@ -153,7 +210,9 @@ void upsample_2D(
 //--------------------------------------------------------------------------
 void load_input_tile_block_from_DRAM_id3 (
     fm_t in_fm_buf[IN_BUF_DEPTH1][IN_BUF_HEIGHT][IN_BUF_WIDTH], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti,
     int  tj, 
     int  d
@@ -172,13 +231,13 @@ void load_input_tile_block_from_DRAM_id3 (
             INPUT_BUFFER_WIDTH:
             for(int j = 0; j < IN_BUF_WIDTH; j++)
             {
-                // TODO: Handle border features here
-                if(((ti == 0) && (i == 0)) || ((ti == N_TILE_ROWS - 1) && (i == IN_BUF_HEIGHT - 1)))
-                    in_fm_buf[c][i][j] = 0;
-                else if(((tj == 0) && (j == 0)) || ((tj == N_TILE_COLS - 1) && (j == IN_BUF_WIDTH - 1)))
+                // Zero padding outside of the feature map
+                const int h = height_offset + i - 1;
+                const int w = width_offset + j - 1;
+                if((h < 0) || (h >= ih) || (w < 0) || (w >= iw))
                     in_fm_buf[c][i][j] = 0;
                 else
-		            in_fm_buf[c][i][j] = in_fm[depth_offset + c][height_offset + i - 1][width_offset + j - 1];
+		            in_fm_buf[c][i][j] = in_fm[((depth_offset + c)*ih + h)*iw + w];
             }
         }
     }
@@ -238,7 +297,9 @@ void load_layer_params_from_DRAM_id3 (
 //--------------------------------------------------------------------------
 void load_input_tile_block_from_DRAM_id16 (
     fm_t in_fm_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT][IN_BUF_WIDTH], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti,
     int  tj, 
     int  d
@@ -257,13 +318,13 @@ void load_input_tile_block_from_DRAM_id16 (
             INPUT_BUFFER_WIDTH:
             for(int j = 0; j < IN_BUF_WIDTH; j++)
             {
-                // TODO: Handle border features here
-                if(((ti == 0) && (i == 0)) || ((ti == N_TILE_ROWS - 1) && (i == IN_BUF_HEIGHT - 1)))
-                    in_fm_buf[c][i][j] = 0;
-                else if(((tj == 0) && (j == 0)) || ((tj == N_TILE_COLS - 1) && (j == IN_BUF_WIDTH - 1)))
+                // Zero padding outside of the feature map
+                const int h = height_offset + i - 1;
+                const int w = width_offset + j - 1;
+                if((h < 0) || (h >= ih) || (w < 0) || (w >= iw))
                     in_fm_buf[c][i][j] = 0;
                 else
-		            in_fm_buf[c][i][j] = in_fm[depth_offset + c][height_offset + i - 1][width_offset + j - 1];
+		            in_fm_buf[c][i][j] = in_fm[((depth_offset + c)*ih + h)*iw + w];
             }
         }
     }
@@ -373,7 +434,9 @@ void load_layer_params_from_DRAM_bias (
 //--------------------------------------------------------------------------
 void load_input_tile_block_from_DRAM_conv (
     fm_t in_fm_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT2][IN_BUF_WIDTH2], 
-    fm_t in_fm[1024][416][416], 
+    fm_t *in_fm, 
+    int  ih,
+    int  iw,
     int  ti,
     int  tj, 
     int  d
@@ -392,13 +455,13 @@ void load_input_tile_block_from_DRAM_conv (
             INPUT_BUFFER_WIDTH:
             for(int j = 0; j < IN_BUF_WIDTH2; j++)
             {
-                // TODO: Handle border features here
-                if(((ti == 0) && (i == 0)) || ((ti == N_TILE_ROWS - 1) && (i == IN_BUF_HEIGHT - 1)))
-                    in_fm_buf[c][i][j] = 0;
-                else if(((tj == 0) && (j == 0)) || ((tj == N_TILE_COLS - 1) && (j == IN_BUF_WIDTH - 1)))
+                // Zero padding outside of the feature map
+                const int h = height_offset + i - 1;
+                const int w = width_offset + j - 1;
+                if((h < 0) || (h >= ih) || (w < 0) || (w >= iw))
                     in_fm_buf[c][i][j] = 0;
                 else
-		            in_fm_buf[c][i][j] = in_fm[depth_offset + c][height_offset + i - 1][width_offset + j - 1];
+		            in_fm_buf[c][i][j] = in_fm[((depth_offset + c)*ih + h)*iw + w];
             }
         }
     }
@@ -515,7 +578,9 @@ void save_partial_output_tile_block_bias (
 // You should not need to modify this function. 
 //--------------------------------------------------------------------------
 void store_output_tile_to_DRAM (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2], 
     int  ti,
     int  tj,
@@ -538,11 +603,11 @@ void store_output_tile_to_DRAM (
                 // Leaky ReLU in-place
                 if(out_fm_buf[f][i][j] < (fm_t) 0)
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
                 }
                 else
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = out_fm_buf[f][i][j];
                 }
             }
         }
@@ -550,7 +615,9 @@ void store_output_tile_to_DRAM (
 }
 
 void store_output_tile_to_DRAM_ver1 (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT][OUT_BUF_WIDTH], 
     int  ti,
     int  tj,
@@ -573,11 +640,11 @@ void store_output_tile_to_DRAM_ver1 (
                 // Leaky ReLU in-place
                 if(out_fm_buf[f][i][j] < (fm_t) 0)
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
                 }
                 else
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = out_fm_buf[f][i][j];
                 }
             }
         }
@@ -585,9 +652,11 @@ void store_output_tile_to_DRAM_ver1 (
 }
 
 void store_maxpool_output_tile_to_DRAM_stride1(
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2],
-    int d
+    int  d
 )
 {
     const int depth_offset  =  d * OUT_BUF_DEPTH;
@@ -601,16 +670,18 @@ void store_maxpool_output_tile_to_DRAM_stride1(
             MAXPOOL_OUTPUT_BUFFER_WIDTH:
             for(int j = 0; j < OUT_BUF_WIDTH2; j++)
             {
-                out_fm[depth_offset + f][i][j] = out_fm_buf[f][i][j];
+                out_fm[((depth_offset + f)*oh + i)*ow + j] = out_fm_buf[f][i][j];
             }
         }
     }
 }
 
 void store_upsample_output_tile_to_DRAM(
-    fm_t out_fm[1024][416][416],
+    fm_t *out_fm,
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[US_BUF_DEPTH][US_BUF_HEIGHT*2][US_BUF_WIDTH*2],
-    int d
+    int  d
 )
 {
     const int depth_offset  =  d * US_BUF_DEPTH;
@@ -624,7 +695,7 @@ void store_upsample_output_tile_to_DRAM(
             UPSAMPLE_OUTPUT_BUFFER_WIDTH:
             for(int j = 0; j < US_BUF_WIDTH*2; j++)
             {
-                out_fm[depth_offset + f][i][j] = out_fm_buf[f][i][j];
+                out_fm[((depth_offset + f)*oh + i)*ow + j] = out_fm_buf[f][i][j];
             }
         }
     }
@@ -636,7 +707,9 @@ void store_upsample_output_tile_to_DRAM(
 // You should not need to modify this function. 
 //--------------------------------------------------------------------------
 void store_maxpool_output_tile_to_DRAM (
-    fm_t out_fm[1024][416][416], 
+    fm_t *out_fm, 
+    int  oh,
+    int  ow,
     fm_t out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT/2][OUT_BUF_WIDTH/2], 
     int  ti,
     int  tj,
@@ -659,11 +732,11 @@ void store_maxpool_output_tile_to_DRAM (
                 // Leaky ReLU in-place
                 if(out_fm_buf[f][i][j] < (fm_t) 0)
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = (fm_t)(0.1) * out_fm_buf[f][i][j];
                 }
                 else
                 {
-                    out_fm[depth_offset + f][height_offset + i][width_offset + j] = out_fm_buf[f][i][j];
+                    out_fm[((depth_offset + f)*oh + height_offset + i)*ow + width_offset + j] = out_fm_buf[f][i][j];
                 }
             }
         }
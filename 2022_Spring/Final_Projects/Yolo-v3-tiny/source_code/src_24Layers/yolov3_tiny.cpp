@@ -1,9 +1,9 @@
 #include "conv.h"
 
 void tiled_conv_maxpool_id3 (
-    fm_t input_feature_map[1024][416][416],
+    fm_t *input_feature_map,
     wt_t layer_conv_weights[1024][1024][3][3],
-    fm_t output_feature_map[1024][416][416],
+    fm_t *output_feature_map,
     int id,
     int ih,
     int iw,
@@ -35,23 +35,24 @@ void tiled_conv_maxpool_id3 (
             {
                 for(int d = 0; d < (id/IN_BUF_DEPTH1); d++)
                 {
-                    load_input_tile_block_from_DRAM_id3(conv_in_buf, input_feature_map, ti, tj, d);
+                    load_input_tile_block_from_DRAM_id3(conv_in_buf, input_feature_map, ih, iw, ti, tj, d);
                     load_layer_params_from_DRAM_id3(conv_wt_buf, layer_conv_weights, b, d);
                     conv_3x3_id3(conv_out_buf, conv_in_buf, conv_wt_buf);
                     save_partial_output_tile_block(partial_out_fm_buf, conv_out_buf, d);
                 }
                 max_pool_2D(partial_out_fm_buf, maxpool_out_fm_buf);
-                store_maxpool_output_tile_to_DRAM(output_feature_map, maxpool_out_fm_buf, ti, tj, b);
+                store_maxpool_output_tile_to_DRAM(output_feature_map, ih/2, iw/2, maxpool_out_fm_buf, ti, tj, b);
             }
         }
     }
 }
 
 void tiled_conv_maxpool_id16 (
-    fm_t input_feature_map[1024][416][416],
+    fm_t *input_feature_map,
     wt_t layer_conv_weights[1024][1024][3][3],
-    fm_t output_feature_map[1024][416][416],
-    fm_t conv_output_feature_map[1024][416][416],
+    fm_t *output_feature_map,
+    fm_t *conv_output_feature_map,
+    bool store_conv_output,
     int id,
     int ih,
     int iw,
@@ -83,7 +84,7 @@ void tiled_conv_maxpool_id16 (
             
             for(int b = 0; b < (od/OUT_BUF_DEPTH); b++)
             {
-                load_input_tile_block_from_DRAM_id16(conv_in_buf_Ping, input_feature_map, ti, tj, 0);
+                load_input_tile_block_from_DRAM_id16(conv_in_buf_Ping, input_feature_map, ih, iw, ti, tj, 0);
                 load_layer_params_from_DRAM_id16(conv_wt_buf_Ping, layer_conv_weights, b, 0);
                 for(int d = 0; d < (id/IN_BUF_DEPTH2) - 1; d++)
                 {
@@ -92,14 +93,14 @@ void tiled_conv_maxpool_id16 (
                     {
                         conv_3x3_id16(conv_out_buf, conv_in_buf_Ping, conv_wt_buf_Ping);
                         save_partial_output_tile_block(partial_out_fm_buf, conv_out_buf, d);
-                        load_input_tile_block_from_DRAM_id16(conv_in_buf_Pong, input_feature_map, ti, tj, d+1);
+                        load_input_tile_block_from_DRAM_id16(conv_in_buf_Pong, input_feature_map, ih, iw, ti, tj, d+1);
                         load_layer_params_from_DRAM_id16(conv_wt_buf_Pong, layer_conv_weights, b, d+1);
                     }
                     else if (d % 2 == 1)
                     {
                         conv_3x3_id16(conv_out_buf, conv_in_buf_Pong, conv_wt_buf_Pong);
                         save_partial_output_tile_block(partial_out_fm_buf, conv_out_buf, d);
-                        load_input_tile_block_from_DRAM_id16(conv_in_buf_Ping, input_feature_map, ti, tj, d+1);
+                        load_input_tile_block_from_DRAM_id16(conv_in_buf_Ping, input_feature_map, ih, iw, ti, tj, d+1);
                         load_layer_params_from_DRAM_id16(conv_wt_buf_Ping, layer_conv_weights, b, d+1);
                     }
                 }
@@ -114,18 +115,19 @@ void tiled_conv_maxpool_id16 (
                     save_partial_output_tile_block(partial_out_fm_buf, conv_out_buf, (id/IN_BUF_DEPTH2) - 1);
                 }
                 //#pragma HLS DATAFLOW
-                store_output_tile_to_DRAM_ver1(conv_output_feature_map, partial_out_fm_buf, ti, tj, b);
+                if(store_conv_output)
+                    store_output_tile_to_DRAM_ver1(conv_output_feature_map, ih, iw, partial_out_fm_buf, ti, tj, b);
                 max_pool_2D(partial_out_fm_buf, maxpool_out_fm_buf);
-                store_maxpool_output_tile_to_DRAM(output_feature_map, maxpool_out_fm_buf, ti, tj, b);
+                store_maxpool_output_tile_to_DRAM(output_feature_map, ih/2, iw/2, maxpool_out_fm_buf, ti, tj, b);
             }
         }
     }
 }
 
 void tiled_conv (
-    fm_t input_feature_map[1024][416][416],
+    fm_t *input_feature_map,
     wt_t layer_conv_weights[1024][1024][3][3],
-    fm_t output_feature_map[1024][416][416],
+    fm_t *output_feature_map,
     int id,
     int ih,
     int iw,
@@ -154,21 +156,21 @@ void tiled_conv (
             {
                 for(int d = 0; d < (id/IN_BUF_DEPTH2); d++)
                 {
-                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ti, tj, d);
+                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ih, iw, ti, tj, d);
                     load_layer_params_from_DRAM_id16(conv_wt_buf, layer_conv_weights, b, d);
                     conv_ver3(conv_out_buf, conv_in_buf, conv_wt_buf);
                     save_partial_output_tile_block_conv(partial_out_fm_buf, conv_out_buf, d);
                 }
-                store_output_tile_to_DRAM(output_feature_map, partial_out_fm_buf, ti, tj, b);
+                store_output_tile_to_DRAM(output_feature_map, ih, iw, partial_out_fm_buf, ti, tj, b);
             }
         }
     }
 }
 
 void tiled_conv_1x1 (
-    fm_t input_feature_map[1024][416][416],
+    fm_t *input_feature_map,
     wt_t layer_conv_weights[1024][1024][1][1],
-    fm_t output_feature_map[1024][416][416],
+    fm_t *output_feature_map,
     int id,
     int ih,
     int iw,
@@ -197,22 +199,22 @@ void tiled_conv_1x1 (
             {
                 for(int d = 0; d < (id/IN_BUF_DEPTH2); d++)
                 {
-                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ti, tj, d);
+                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ih, iw, ti, tj, d);
                     load_layer_params_from_DRAM_conv1x1(conv_wt_buf, layer_conv_weights, b, d);
                     conv_1x1(conv_out_buf, conv_in_buf, conv_wt_buf);
                     save_partial_output_tile_block_conv(partial_out_fm_buf, conv_out_buf, d);
                 }
-                store_output_tile_to_DRAM(output_feature_map, partial_out_fm_buf, ti, tj, b);
+                store_output_tile_to_DRAM(output_feature_map, ih, iw, partial_out_fm_buf, ti, tj, b);
             }
         }
     }
 }
 
 void tiled_conv_bias (
-    fm_t input_feature_map[1024][416][416],
+    fm_t *input_feature_map,
     wt_t layer_conv_weights[1024][1024][1][1],
     wt_t layer_bias[255],
-    fm_t output_feature_map[1024][416][416],
+    fm_t *output_feature_map,
     int id,
     int ih,
     int iw,
@@ -242,20 +244,23 @@ void tiled_conv_bias (
             {
                 for(int d = 0; d < (id/IN_BUF_DEPTH2); d++)
                 {
-                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ti, tj, d);
+                    load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ih, iw, ti, tj, d);
                     load_layer_params_from_DRAM_bias(conv_wt_buf, conv_bias_buf, layer_conv_weights, layer_bias, b, d);
                     conv_1x1(conv_out_buf, conv_in_buf, conv_wt_buf);
                     save_partial_output_tile_block_bias(partial_out_fm_buf, conv_out_buf, conv_bias_buf, d);
                 }
-                store_output_tile_to_DRAM(output_feature_map, partial_out_fm_buf, ti, tj, b);
+                store_output_tile_to_DRAM(output_feature_map, ih, iw, partial_out_fm_buf, ti, tj, b);
             }
         }
     }
 }
 
 void tiled_maxpool_stride1(
-    fm_t input_mp_feature_map[1024][416][416],
-    fm_t output_mp_feature_map[1024][416][416]
+    fm_t *input_mp_feature_map,
+    fm_t *output_mp_feature_map,
+    int id,
+    int ih,
+    int iw
 )
 {
     //--------------------------------------------------------------------------
@@ -264,17 +269,20 @@ void tiled_maxpool_stride1(
     fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1];
     fm_t maxpool_out_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
 
-    for(int d = 0; d < (512/OUT_BUF_DEPTH); d++)
+    for(int d = 0; d < (id/OUT_BUF_DEPTH); d++)
     {
-        load_maxpool_input_tile_block_from_DRAM(maxpool_in_buf, input_mp_feature_map, d);
+        load_maxpool_input_tile_block_from_DRAM(maxpool_in_buf, input_mp_feature_map, ih, iw, d);
         max_pool_2D_stride1(maxpool_in_buf, maxpool_out_buf);
-        store_maxpool_output_tile_to_DRAM_stride1(output_mp_feature_map, maxpool_out_buf, d);
+        store_maxpool_output_tile_to_DRAM_stride1(output_mp_feature_map, ih, iw, maxpool_out_buf, d);
     }
 }
 
 void tiled_upsample(
-    fm_t input_us_feature_map[1024][416][416],
-    fm_t output_us_feature_map[1024][416][416]
+    fm_t *input_us_feature_map,
+    fm_t *output_us_feature_map,
+    int id,
+    int ih,
+    int iw
 )
 {
     //--------------------------------------------------------------------------
@@ -283,32 +291,109 @@ void tiled_upsample(
     fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH];
     fm_t upsample_out_buf[US_BUF_DEPTH][US_BUF_HEIGHT*2][US_BUF_WIDTH*2];
 
-    for(int d = 0; d < (128/US_BUF_DEPTH); d++)
+    for(int d = 0; d < (id/US_BUF_DEPTH); d++)
     {
-        load_upsample_input_tile_block_from_DRAM(upsample_in_buf, input_us_feature_map, d);
+        load_upsample_input_tile_block_from_DRAM(upsample_in_buf, input_us_feature_map, ih, iw, d);
         upsample_2D(upsample_in_buf, upsample_out_buf);
-        store_upsample_output_tile_to_DRAM(output_us_feature_map, upsample_out_buf, d);
+        store_upsample_output_tile_to_DRAM(output_us_feature_map, 2*ih, 2*iw, upsample_out_buf, d);
     }
 }
 
-void copy_output_to_input(
-    fm_t input_feature_map[1024][416][416],
-    fm_t output_feature_map[1024][416][416],
-    int d,
-    int h,
-    int w
+//--------------------------------------------------------------------------
+// Convolution fused with the stride-1 maxpool. The output tile covers the
+// whole feature map, so each block of output channels is pooled on-chip.
+//--------------------------------------------------------------------------
+void tiled_conv_maxpool_stride1 (
+    fm_t *input_feature_map,
+    wt_t layer_conv_weights[1024][1024][3][3],
+    fm_t *output_feature_map,
+    int id,
+    int ih,
+    int iw,
+    int od
 )
 {
-    for (int id = 0; id < d; id++)
-        for (int ih = 0; ih < h; ih++)
-            for (int iw = 0; iw < w; iw++)
-            {
-                input_feature_map[id][ih][iw] = output_feature_map[id][ih][iw];
-            }
+    //--------------------------------------------------------------------------
+    // On-chip buffers
+    //--------------------------------------------------------------------------
+    fm_t conv_in_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT2][IN_BUF_WIDTH2];
+    wt_t conv_wt_buf[OUT_BUF_DEPTH][IN_BUF_DEPTH2][3][3];
+    fm_t conv_out_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
+    
+    // Partial output storage buffer   
+    fm_t partial_out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
+
+    // Maxpool storage buffers
+    fm_t maxpool_in_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2+1][OUT_BUF_WIDTH2+1];
+    fm_t maxpool_out_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
+
+    for(int b = 0; b < (od/OUT_BUF_DEPTH); b++)
+    {
+        for(int d = 0; d < (id/IN_BUF_DEPTH2); d++)
+        {
+            load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ih, iw, 0, 0, d);
+            load_layer_params_from_DRAM_id16(conv_wt_buf, layer_conv_weights, b, d);
+            conv_ver3(conv_out_buf, conv_in_buf, conv_wt_buf);
+            save_partial_output_tile_block_conv(partial_out_fm_buf, conv_out_buf, d);
+        }
+        load_maxpool_input_tile_block_from_BRAM(maxpool_in_buf, partial_out_fm_buf);
+        max_pool_2D_stride1(maxpool_in_buf, maxpool_out_buf);
+        store_maxpool_output_tile_to_DRAM_stride1(output_feature_map, ih, iw, maxpool_out_buf, b);
+    }
+}
+
+//--------------------------------------------------------------------------
+// 1x1 convolution fused with the upsampling of its output tiles.
+//--------------------------------------------------------------------------
+void tiled_conv_1x1_upsample (
+    fm_t *input_feature_map,
+    wt_t layer_conv_weights[1024][1024][1][1],
+    fm_t *output_feature_map,
+    int id,
+    int ih,
+    int iw,
+    int od
+)
+{
+    //--------------------------------------------------------------------------
+    // On-chip buffers
+    //--------------------------------------------------------------------------
+    fm_t conv_in_buf[IN_BUF_DEPTH2][IN_BUF_HEIGHT2][IN_BUF_WIDTH2];
+    wt_t conv_wt_buf[OUT_BUF_DEPTH][IN_BUF_DEPTH2][1][1];
+    fm_t conv_out_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
+    
+    // Partial output storage buffer   
+    fm_t partial_out_fm_buf[OUT_BUF_DEPTH][OUT_BUF_HEIGHT2][OUT_BUF_WIDTH2];
+
+    // Upsample storage buffers
+    fm_t upsample_in_buf[US_BUF_DEPTH][US_BUF_HEIGHT][US_BUF_WIDTH];
+    fm_t upsample_out_buf[US_BUF_DEPTH][US_BUF_HEIGHT*2][US_BUF_WIDTH*2];
+
+    for(int b = 0; b < (od/OUT_BUF_DEPTH); b++)
+    {
+        for(int d = 0; d < (id/IN_BUF_DEPTH2); d++)
+        {
+            load_input_tile_block_from_DRAM_conv(conv_in_buf, input_feature_map, ih, iw, 0, 0, d);
+            load_layer_params_from_DRAM_conv1x1(conv_wt_buf, layer_conv_weights, b, d);
+            conv_1x1(conv_out_buf, conv_in_buf, conv_wt_buf);
+            save_partial_output_tile_block_conv(partial_out_fm_buf, conv_out_buf, d);
+        }
+        load_upsample_input_tile_block_from_BRAM(upsample_in_buf, partial_out_fm_buf);
+        upsample_2D(upsample_in_buf, upsample_out_buf);
+        store_upsample_output_tile_to_DRAM(output_feature_map, 2*ih, 2*iw, upsample_out_buf, b);
+    }
 }
 
+//--------------------------------------------------------------------------
+// All the feature maps live in one activation arena, at the offsets planned
+// by plan_activation_arena() with the schedule_layer_fusion() schedule, which
+// fuses the same layers as this kernel (checked by the test bench against
+// kernel_fused_layers in sim.cpp). The input image is expected at
+// fm_offset[YOLO_INPUT_TENSOR].
+//--------------------------------------------------------------------------
+#define FM(tensor) (activation_arena + fm_offset[tensor])
+
 void yolov3_tiny (
-    fm_t input_image[3][416][416],
     wt_t conv_layer_1_weights[1024][1024][3][3],
     wt_t conv_layer_2_weights[1024][1024][3][3],
     wt_t conv_layer_3_weights[1024][1024][3][3],
@@ -324,16 +409,13 @@ void yolov3_tiny (
     wt_t conv_layer_13_weights[1024][1024][1][1],
     wt_t bias_layer_10[255],
     wt_t bias_layer_13[255],
-    fm_t input_feature_map[1024][416][416],
-    fm_t output_feature_map[1024][416][416],
-    fm_t output13_feature_map[1024][416][416],
-    fm_t output8_feature_map[1024][416][416]
+    fm_t activation_arena[ACT_ARENA_DEPTH],
+    int  fm_offset[YOLO_N_TENSORS]
 )
 {
     //--------------------------------------------------------------------------
     // Defines interface IO ports for HLS. 
     //--------------------------------------------------------------------------
-    #pragma HLS INTERFACE m_axi depth=3*416*416      port=input_image          bundle=fm
     #pragma HLS INTERFACE m_axi depth=16*3*3*3       port=conv_layer_1_weights bundle=wt
     #pragma HLS INTERFACE m_axi depth=32*16*3*3      port=conv_layer_2_weights bundle=wt
     #pragma HLS INTERFACE m_axi depth=64*32*3*3      port=conv_layer_3_weights bundle=wt
@@ -349,193 +431,157 @@ void yolov3_tiny (
     #pragma HLS INTERFACE m_axi depth=255*256*1*1    port=conv_layer_13_weights bundle=wt
     #pragma HLS INTERFACE m_axi depth=255            port=bias_layer_10         bundle=wt
     #pragma HLS INTERFACE m_axi depth=255            port=bias_layer_13         bundle=wt
-    #pragma HLS INTERFACE m_axi depth=1024*416*416   port=input_feature_map    bundle=fm
-    #pragma HLS INTERFACE m_axi depth=1024*416*416   port=output_feature_map   bundle=fm
-    #pragma HLS INTERFACE m_axi depth=1024*416*416   port=output13_feature_map   bundle=fm
-    #pragma HLS INTERFACE m_axi depth=1024*416*416   port=output8_feature_map   bundle=fm
+    #pragma HLS INTERFACE m_axi depth=ACT_ARENA_DEPTH port=activation_arena    bundle=fm
 
+    #pragma HLS INTERFACE s_axilite port=fm_offset
     #pragma HLS INTERFACE s_axilite register	port=return
 
-    for (int id = 0; id < 3; id++)
-        for (int ih = 0; ih < 416; ih++)
-            for (int iw = 0; iw < 416; iw++)
-            {
-                input_feature_map[id][ih][iw] = input_image[id][ih][iw];
-            }
-
     //Layers 0,1 - Convolution layer 1/Maxpool
-    tiled_conv_maxpool_id3 (input_feature_map, 
+    tiled_conv_maxpool_id3 (FM(YOLO_INPUT_TENSOR), 
                             conv_layer_1_weights,
-                            output_feature_map,
+                            FM(1),
                             3,
                             416,
                             416,
                             16
                             );
-    copy_output_to_input(input_feature_map, output_feature_map, 16, 208, 208);
     
     //Layerss 2,3 - Convolution layer 2/Maxpool
-    tiled_conv_maxpool_id16 (input_feature_map, 
+    tiled_conv_maxpool_id16 (FM(1), 
                             conv_layer_2_weights,
-                            output_feature_map,
-                            output8_feature_map,
+                            FM(3),
+                            activation_arena,
+                            false,
                             16,
                             208,
                             208,
                             32
                             );
-    copy_output_to_input(input_feature_map, output_feature_map, 32, 104, 104);
 
     //Layers 4,5 - Convolution layer 3/Maxpool
-    tiled_conv_maxpool_id16 (input_feature_map, 
+    tiled_conv_maxpool_id16 (FM(3), 
                             conv_layer_3_weights,
-                            output_feature_map,
-                            output8_feature_map,
+                            FM(5),
+                            activation_arena,
+                            false,
                             32,
                             104,
                             104,
                             64
                             );
-    copy_output_to_input(input_feature_map, output_feature_map, 64, 52, 52);
 
     //Layers 6,7 - Convolution layer 4/Maxpool
-    tiled_conv_maxpool_id16 (input_feature_map, 
+    tiled_conv_maxpool_id16 (FM(5), 
                             conv_layer_4_weights,
-                            output_feature_map,
-                            output8_feature_map,
+                            FM(7),
+                            activation_arena,
+                            false,
                             64,
                             52,
                             52,
                             128
                             );
-    copy_output_to_input(input_feature_map, output_feature_map, 128, 26, 26);
 
-    //Layers 8,9 - Convolution layer 5/Maxpool
-    tiled_conv_maxpool_id16 (input_feature_map, 
+    //Layers 8,9 - Convolution layer 5/Maxpool, layer 8 is kept for route 19,8
+    tiled_conv_maxpool_id16 (FM(7), 
                             conv_layer_5_weights,
-                            output_feature_map,
-                            output8_feature_map,
+                            FM(9),
+                            FM(8),
+                            true,
                             128,
                             26,
                             26,
                             256
                             );
-    copy_output_to_input(input_feature_map, output_feature_map, 256, 13, 13);
 
-    //Layer 10 - Convolution layer 6
-    tiled_conv (input_feature_map, 
-                conv_layer_6_weights,
-                output_feature_map,
-                256,
-                13,
-                13,
-                512
-                );
-    copy_output_to_input(input_feature_map, output_feature_map, 512, 13, 13);
-    
-    //Layer 11 - Maxpool
-    tiled_maxpool_stride1 (input_feature_map,
-                   output_feature_map
-                  );
-    copy_output_to_input(input_feature_map, output_feature_map, 512, 13, 13);
+    //Layers 10,11 - Convolution layer 6/Maxpool
+    tiled_conv_maxpool_stride1 (FM(9), 
+                                conv_layer_6_weights,
+                                FM(11),
+                                256,
+                                13,
+                                13,
+                                512
+                                );
 
     //Layer 12 - Convolution layer 7
-    tiled_conv (input_feature_map, 
+    tiled_conv (FM(11), 
                 conv_layer_7_weights,
-                output_feature_map,
+                FM(12),
                 512,
                 13,
                 13,
                 1024
                 );
-    copy_output_to_input(input_feature_map, output_feature_map, 1024, 13, 13);
 
     //Layer 13 - Convolution layer 8
-    tiled_conv_1x1 (input_feature_map, 
+    tiled_conv_1x1 (FM(12), 
                     conv_layer_8_weights,
-                    output_feature_map,
+                    FM(13),
                     1024,
                     13,
                     13,
                     256
                     );
-    copy_output_to_input(input_feature_map, output_feature_map, 256, 13, 13);
-
-    //Layer 17 - Route 13
-    copy_output_to_input(output13_feature_map, output_feature_map, 256, 13, 13);
 
     //Layer 14 - Convolution layer 9
-    tiled_conv (input_feature_map, 
+    tiled_conv (FM(13), 
                 conv_layer_9_weights,
-                output_feature_map,
+                FM(14),
                 256,
                 13,
                 13,
                 512
                 );
-    copy_output_to_input(input_feature_map, output_feature_map, 512, 13, 13);
 
     //Layer 15 - Convolution layer 10
-    tiled_conv_bias(input_feature_map, 
+    tiled_conv_bias(FM(14), 
                     conv_layer_10_weights,
                     bias_layer_10,
-                    output_feature_map,
+                    FM(15),
                     512,
                     13,
                     13,
                     255
                     );
-    copy_output_to_input(input_feature_map, output_feature_map, 255, 13, 13);
 
     //TODO: Layer 16 - Yolo
 
-    //Layer 18 - Convolution layer 11
-    tiled_conv_1x1 (output13_feature_map,
-                    conv_layer_11_weights,
-                    output_feature_map,
-                    256,
-                    13,
-                    13,
-                    128
-                    );
-    copy_output_to_input(input_feature_map, output_feature_map, 128, 13, 13);
-
-    //Layer 19 - Upsampling
-    tiled_upsample(input_feature_map,
-                   output_feature_map
-                  );
-
-    //Layer 20 - Route 19,8
-    copy_output_to_input(input_feature_map, output_feature_map, 128, 26, 26);
-    for (int id = 128; id < 384; id++)
-        for (int ih = 0; ih < 26; ih++)
-            for (int iw = 0; iw < 26; iw++)
-            {
-                input_feature_map[id][ih][iw] = output8_feature_map[id][ih][iw];
-            }
-    
+    //Layer 17 - Route 13, aliases the output of layer 13
+
+    //Layers 18,19 - Convolution layer 11/Upsampling
+    tiled_conv_1x1_upsample (FM(17),
+                             conv_layer_11_weights,
+                             FM(19),
+                             256,
+                             13,
+                             13,
+                             128
+                             );
+
+    //Layer 20 - Route 19,8, the outputs of layers 19 and 8 are adjacent in
+    //the arena
+
     //Layer 21 - Convolution layer 12
-    tiled_conv (input_feature_map, 
+    tiled_conv (FM(20), 
                 conv_layer_12_weights,
-                output_feature_map,
+                FM(21),
                 384,
                 26,
                 26,
                 256
                 );
-    copy_output_to_input(input_feature_map, output_feature_map, 256, 26, 26);
 
     //Layer 22 - Convolution layer 13
-    tiled_conv_bias(input_feature_map, 
+    tiled_conv_bias(FM(21), 
                     conv_layer_13_weights,
                     bias_layer_13,
-                    output_feature_map,
+                    FM(22),
                     256,
                     26,
                     26,
                     255
                     );
-    copy_output_to_input(input_feature_map, output_feature_map, 255, 26, 26);
 
     //TODO: Layer 23 - Yolo
-}
\ No newline at end of file
+}
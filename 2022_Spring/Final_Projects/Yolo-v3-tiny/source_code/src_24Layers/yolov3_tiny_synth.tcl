@@ -3,6 +3,7 @@ open_project layer_hls
 set_top yolov3_tiny
 
 add_files conv.h
+add_files layer_plan.h
 add_files utils.cpp
 add_files conv_3x3_id3.cpp
 add_files conv_3x3_id16.cpp
@@ -15,6 +16,7 @@ add_files -tb ./conv_layer_weights.bin
 add_files -tb ./conv_layer_bias.bin
 add_files -tb ./conv_layer_output_feature_map.bin
 add_files -tb ./sim.cpp
+add_files -tb ./layer_plan.cpp
 
 open_solution "solution1" -flow_target vivado
 set_part {xczu3eg-sbva484-1-e}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <numeric>
+
+#include "problem_instance.h"  // NodeList
 #include "utils.h"
 
 
@@ -73,29 +76,62 @@ struct Solution {
 };
 
 
+/*
+ * The unvisited nodes are kept in an indexed sparse set: unvisited_[0..count)
+ * holds the unvisited nodes, where count = dimension_ - visited_count_, and
+ * unvisited_pos_[node] is the position of the node in unvisited_. Visiting a
+ * node swaps it with the last unvisited one, i.e. takes O(1) time. The order
+ * of the nodes in unvisited_ is arbitrary, hence unvisited_ is always
+ * a permutation of all the nodes and does not need to be reset for the next
+ * solution.
+ *
+ * Updating the set costs two random writes per visited node, which is
+ * noticeable for large instances, hence it can be disabled if the unvisited
+ * nodes are found otherwise, i.e. with the k-d tree unvisited_tree_. The
+ * searches mark the buckets of the tree without unvisited nodes as empty
+ * (see KDTree::find_nearest_if), and the marks are cleared when the ant is
+ * initialized, so the tree can be shared by ants built one after another.
+ */
 struct Ant : public Solution {
     std::vector<uint32_t> unvisited_;
+    std::vector<uint32_t> unvisited_pos_;
     Bitmask  visited_bitmask_;
     uint32_t dimension_ = 0;
     uint32_t visited_count_ = 0;
+    bool track_unvisited_ = true;
+    KDTree *unvisited_tree_ = nullptr;
 
     Ant() : Solution() {}
 
     Ant(const std::vector<uint32_t> &route, double cost)
         : Solution(route, cost),
-          unvisited_(route.size(), static_cast<uint32_t >(route.size())),
+          unvisited_(route.size()),
+          unvisited_pos_(route.size()),
           dimension_(static_cast<uint32_t>(route.size())),
           visited_count_(static_cast<uint32_t>(route.size())) {
+        std::iota(unvisited_.begin(), unvisited_.end(), 0);
+        std::iota(unvisited_pos_.begin(), unvisited_pos_.end(), 0);
     }
 
-    void initialize(uint32_t dimension) {
+    void initialize(uint32_t dimension, bool track_unvisited = true,
+                    KDTree *unvisited_tree = nullptr) {
         dimension_ = dimension;
         visited_count_ = 0;
+        track_unvisited_ = track_unvisited;
+
+        unvisited_tree_ = unvisited_tree;
+        if (unvisited_tree_ != nullptr) {
+            unvisited_tree_->restore_pruned_buckets();
+        }
 
         route_.resize(dimension);
 
-        unvisited_.resize(dimension);
-        std::iota(unvisited_.begin(), unvisited_.end(), 0);
+        if (track_unvisited_ && unvisited_.size() != dimension) {
+            unvisited_.resize(dimension);
+            std::iota(unvisited_.begin(), unvisited_.end(), 0);
+            unvisited_pos_.resize(dimension);
+            std::iota(unvisited_pos_.begin(), unvisited_pos_.end(), 0);
+        }
 
         visited_bitmask_.resize(dimension);
         visited_bitmask_.clear();
@@ -104,6 +140,17 @@ struct Ant : public Solution {
     void visit(uint32_t node) {
         assert(!is_visited(node));
 
+        if (track_unvisited_) {
+            // Move the node past the end of the unvisited part
+            const auto last = dimension_ - visited_count_ - 1;
+            const auto pos = unvisited_pos_[node];
+            const auto last_node = unvisited_[last];
+            unvisited_[pos] = last_node;
+            unvisited_pos_[last_node] = pos;
+            unvisited_[last] = node;
+            unvisited_pos_[node] = last;
+        }
+
         route_[visited_count_++] = node;
         visited_bitmask_.set_bit(node);
     }
@@ -128,22 +175,9 @@ struct Ant : public Solution {
         return dimension_ - visited_count_;
     }
 
-    const std::vector<uint32_t> &get_unvisited_nodes() {
-        // Filter out visited nodes from unvisited_ list that
-        // now can be invalid
-        //
-        // This has linear complexity but should not be a problem
-        // if this method is not called very often.
-        size_t n = unvisited_.size();
-        size_t j = 0;
-        for (size_t i = 0; i < n; ++i) {
-            auto node = unvisited_[i];
-            if (!is_visited(node)) {
-                unvisited_[j++] = node;
-            }
-        }
-        assert(j == get_unvisited_count());
-        unvisited_.resize(j);
-        return unvisited_;
+    // The nodes are in an arbitrary order
+    [[nodiscard]] NodeList get_unvisited_nodes() const {
+        assert(track_unvisited_);
+        return { unvisited_.data(), get_unvisited_count() };
     }
 };
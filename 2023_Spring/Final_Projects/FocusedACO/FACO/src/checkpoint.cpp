@@ -0,0 +1,201 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+
+struct CheckpointHeader {
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char magic_[8] = { 'F', 'A', 'C', 'O', 'C', 'K', 'P', 'T' };
+    uint32_t version_ = CurrentVersion;
+    uint32_t header_size_ = sizeof(CheckpointHeader);
+    uint64_t file_size_ = 0;
+};
+
+
+// Appends values and length-prefixed arrays to a byte buffer
+struct BinaryWriter {
+    std::vector<uint8_t> buffer_;
+
+    template<typename T>
+    void write(const T &value) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    void write(const std::vector<T> &values) {
+        write(static_cast<uint64_t>(values.size()));
+        const auto *bytes = reinterpret_cast<const uint8_t *>(values.data());
+        buffer_.insert(buffer_.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+};
+
+
+// Reads the data written by the BinaryWriter, checking the bounds
+struct BinaryReader {
+    const uint8_t *data_;
+    size_t size_;
+    size_t offset_ = 0;
+
+    BinaryReader(const uint8_t *data, size_t size)
+        : data_(data), size_(size) {
+    }
+
+    void read_bytes(void *dest, size_t count) {
+        if (count > size_ - offset_) {
+            throw std::runtime_error("Checkpoint file is truncated");
+        }
+        memcpy(dest, data_ + offset_, count);
+        offset_ += count;
+    }
+
+    template<typename T>
+    void read(T &value) { read_bytes(&value, sizeof(T)); }
+
+    template<typename T>
+    void read(std::vector<T> &values) {
+        uint64_t count = 0;
+        read(count);
+        if (count > (size_ - offset_) / sizeof(T)) {
+            throw std::runtime_error("Checkpoint file is truncated");
+        }
+        values.resize(count);
+        read_bytes(values.data(), count * sizeof(T));
+    }
+};
+
+
+bool save_checkpoint(const CheckpointData &data, const std::string &path) {
+    using namespace std;
+
+    BinaryWriter writer;
+    writer.write(CheckpointHeader{});
+
+    writer.write(data.dimension_);
+    writer.write(data.ants_count_);
+    writer.write(data.cand_list_size_);
+    writer.write(data.seed_);
+    writer.write(data.iteration_);
+    writer.write(data.elapsed_time_);
+    writer.write(data.best_route_);
+    writer.write(data.best_cost_);
+    writer.write(data.source_route_);
+    writer.write(data.source_cost_);
+    writer.write(data.trail_min_);
+    writer.write(data.trail_max_);
+    writer.write(data.trails_);
+    writer.write(data.default_pheromone_value_);
+    writer.write(data.lazy_.epochs_);
+    writer.write(data.lazy_.decay_powers_);
+    writer.write(data.lazy_.epoch_);
+    writer.write(data.lazy_.rate_);
+    writer.write(data.lazy_.min_value_);
+    writer.write(data.rng_states_);
+
+    auto &buffer = writer.buffer_;
+    CheckpointHeader header;
+    header.file_size_ = buffer.size();
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    const auto tmp_path = path + ".tmp" + to_string(getpid());
+    {
+        ofstream out(tmp_path, ios::binary);
+        out.write(reinterpret_cast<const char *>(buffer.data()), static_cast<streamsize>(buffer.size()));
+        if (!out) {
+            cerr << "Warning: cannot write checkpoint file: " << tmp_path << endl;
+            filesystem::remove(tmp_path);
+            return false;
+        }
+    }
+    error_code ec;
+    filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        cerr << "Warning: cannot write checkpoint file: " << path << endl;
+        filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+
+// Returns true if the route is a permutation of the nodes 0, 1, ..., dimension-1
+static bool is_valid_route(const std::vector<uint32_t> &route, uint32_t dimension) {
+    if (route.size() != dimension) {
+        return false;
+    }
+    std::vector<bool> visited(dimension, false);
+    for (auto node : route) {
+        if (node >= dimension || visited[node]) {
+            return false;
+        }
+        visited[node] = true;
+    }
+    return true;
+}
+
+
+bool load_checkpoint(const std::string &path, CheckpointData &data) {
+    using namespace std;
+
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    vector<uint8_t> buffer((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    BinaryReader reader(buffer.data(), buffer.size());
+
+    CheckpointHeader header;
+    const CheckpointHeader expected;
+    reader.read(header);
+    if (memcmp(header.magic_, expected.magic_, sizeof(header.magic_)) != 0
+            || header.version_ != CheckpointHeader::CurrentVersion
+            || header.header_size_ != sizeof(header)
+            || header.file_size_ != buffer.size()) {
+        throw runtime_error("Invalid checkpoint file: " + path);
+    }
+
+    reader.read(data.dimension_);
+    reader.read(data.ants_count_);
+    reader.read(data.cand_list_size_);
+    reader.read(data.seed_);
+    reader.read(data.iteration_);
+    reader.read(data.elapsed_time_);
+    reader.read(data.best_route_);
+    reader.read(data.best_cost_);
+    reader.read(data.source_route_);
+    reader.read(data.source_cost_);
+    reader.read(data.trail_min_);
+    reader.read(data.trail_max_);
+    reader.read(data.trails_);
+    reader.read(data.default_pheromone_value_);
+    reader.read(data.lazy_.epochs_);
+    reader.read(data.lazy_.decay_powers_);
+    reader.read(data.lazy_.epoch_);
+    reader.read(data.lazy_.rate_);
+    reader.read(data.lazy_.min_value_);
+    reader.read(data.rng_states_);
+
+    // The routes and the state of the lazy evaporation are used as indices,
+    // so they are checked before anything reads them
+    const auto &lazy = data.lazy_;
+    bool is_valid = data.dimension_ > 0
+                 && is_valid_route(data.best_route_, data.dimension_)
+                 && is_valid_route(data.source_route_, data.dimension_)
+                 && lazy.decay_powers_.size() == static_cast<size_t>(lazy.epoch_) + 1
+                 && (lazy.epochs_.empty() || lazy.epochs_.size() == data.trails_.size())
+                 && data.rng_states_.size() % 2 == 0;
+    for (size_t i = 0; is_valid && i < lazy.epochs_.size(); ++i) {
+        is_valid = lazy.epochs_[i] <= lazy.epoch_;
+    }
+    if (!is_valid) {
+        throw runtime_error("Invalid checkpoint file: " + path);
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+/**
+ * Checkpoints of the FACO computations.
+ *
+ * A checkpoint holds everything needed to continue a run from the iteration
+ * following the last completed one: the best and the source solutions, the
+ * (cand. list) pheromone memory with the state of the lazy evaporation, the
+ * MMAS trail limits and the states of the threads' RNGs. If the run is resumed
+ * with the same # of threads, it follows exactly the same path as if it was
+ * not interrupted.
+ *
+ * The file starts with the CheckpointHeader followed by the sections in the
+ * order of the CheckpointData fields. Arrays are prefixed with their length
+ * (uint64_t).
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pheromone.h"
+
+
+struct CheckpointData {
+    // The checkpoint can be used only if these match the current run. A run
+    // resumed without --seed takes the seed from the checkpoint
+    uint32_t dimension_ = 0;
+    uint32_t ants_count_ = 0;
+    uint32_t cand_list_size_ = 0;
+    uint64_t seed_ = 0;
+
+    int32_t  iteration_ = 0;     // Last completed iteration
+    double   elapsed_time_ = 0;  // Sum of the times of all the previous runs (sec.)
+
+    std::vector<uint32_t> best_route_;
+    double best_cost_ = 0;
+
+    std::vector<uint32_t> source_route_;
+    double source_cost_ = 0;
+
+    double trail_min_ = 0;
+    double trail_max_ = 0;
+
+    std::vector<double> trails_;  // CandListPheromone::trails_
+    double default_pheromone_value_ = 0;
+    LazyEvaporation lazy_;
+
+    std::vector<uint64_t> rng_states_;  // Two words for every thread
+};
+
+
+/*
+ * Writes the checkpoint to a temporary file which then replaces the file at
+ * the given path, so that a crash while writing never destroys the previous
+ * checkpoint. Returns false (and prints a warning) on failure.
+ */
+bool save_checkpoint(const CheckpointData &data, const std::string &path);
+
+/*
+ * Reads the checkpoint from the file. Returns false if the file does not
+ * exist, throws std::runtime_error if it is not a valid checkpoint.
+ */
+bool load_checkpoint(const std::string &path, CheckpointData &data);
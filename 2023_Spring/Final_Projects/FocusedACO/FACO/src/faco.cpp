@@ -23,11 +23,19 @@
 #include <functional>
 #include <filesystem>
 #include <omp.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "problem_instance.h"
 #include "ant.h"
+#include "checkpoint.h"
 #include "pheromone.h"
+#include "island.h"
+#include "profiling.h"
 #include "local_search.h"
+#include "ls_trace.h"
+#include "two_opt_batch.h"
 #include "utils.h"
 #include "rand.h"
 #include "progargs.h"
@@ -43,11 +51,32 @@ bool DUMP_LOG = false;
 struct HeuristicData {
     const ProblemInstance &problem_;
     double beta_;
+    // A copy of the instance's k-d tree (if it has one) from which the
+    // threads' trees used to find the nearest unvisited nodes are copied
+    // (see make_unvisited_tree). The instance's tree cannot be used as it is
+    // modified by build_nn_tour, which in the island model can run at the
+    // same time in another colony
+    std::unique_ptr<KDTree> kdtree_;
 
     HeuristicData(const ProblemInstance &instance,
                   double beta)
         : problem_(instance),
           beta_(beta) {
+        if (instance.kdtree_ != nullptr) {
+            // build_nn_tour deletes points from the instance's tree inside
+            // this critical section and restores them before leaving it, so
+            // the copy taken here is complete and not torn
+            #pragma omp critical(build_nn_tour_kdtree)
+            kdtree_ = std::make_unique<KDTree>(*instance.kdtree_);
+        }
+    }
+
+    // Returns a copy of the k-d tree for a thread, or nullptr if there is no
+    // tree. The searches of the thread's ants mark the visited regions of
+    // the tree as empty (see Ant::unvisited_tree_), so each thread needs its
+    // own
+    [[nodiscard]] std::unique_ptr<KDTree> make_unvisited_tree() const {
+        return (kdtree_ != nullptr) ? std::make_unique<KDTree>(*kdtree_) : nullptr;
     }
 
     [[nodiscard]] double get(uint32_t from, uint32_t to) const {
@@ -55,14 +84,37 @@ struct HeuristicData {
         return (d > 0) ? 1. / std::pow(d, beta_) : 1;
     }
 
-    [[nodiscard]] uint32_t find_node_with_max_value(uint32_t from, const std::vector<uint32_t> &nodes) const {
+    // The same as get(node, nn), where nn is the index-th nearest neighbor of
+    // the node, but uses the stored NN distances (if available)
+    [[nodiscard]] double get_nn(uint32_t node, uint32_t index) const {
+        auto d = problem_.get_nn_distance(node, index);
+        return (d > 0) ? 1. / std::pow(d, beta_) : 1;
+    }
+
+    /*
+     * Returns the unvisited node with the max. heuristic value, i.e. the one
+     * closest to from. Ties are broken by the node index, so that the result
+     * does not depend on the order of the ant's unvisited nodes.
+     *
+     * If the ant has a k-d tree, only the nodes around from are checked, and
+     * the buckets of the tree holding only visited nodes are marked as empty,
+     * so that the next searches of the ant skip them. Otherwise all the
+     * unvisited nodes (which the ant has to track) are checked.
+     */
+    [[nodiscard]] uint32_t find_nearest_unvisited(uint32_t from, const Ant &ant) const {
         assert(beta_ > 0);
 
+        if (ant.unvisited_tree_ != nullptr) {
+            return ant.unvisited_tree_->find_nearest_if(from,
+                [&ant](uint32_t node) { return !ant.is_visited(node); },
+                [this, from](uint32_t node) { return problem_.get_distance(from, node); });
+        }
+
         auto result = from;
         auto min_dist = std::numeric_limits<double>::max();
-        for (auto node : nodes) {
+        for (auto node : ant.get_unvisited_nodes()) {
             auto dist = problem_.get_distance(from, node);
-            if (dist < min_dist) {
+            if (dist < min_dist || (dist == min_dist && node < result)) {
                 min_dist = dist;
                 result = node;
             }
@@ -78,20 +130,20 @@ uint32_t select_max_product_node(
         const MatrixPheromone &pheromone,
         const HeuristicData &heuristic) {
 
-    const auto unvisited_count = ant.get_unvisited_count();
-    assert( unvisited_count > 0 );
+    assert( ant.get_unvisited_count() > 0 );
 
     double max_product = 0;
-    const auto &unvisited = ant.get_unvisited_nodes();
-    uint32_t chosen_node  = unvisited.front();
+    const auto unvisited = ant.get_unvisited_nodes();
+    uint32_t chosen_node  = unvisited[0];
 
     // Nodes in the bucket have non-default pheromone value -- we use
-    // a standard method selecting the node with the max. product value
-    for (uint32_t i = 0; i < unvisited_count; ++i) {
-        auto node = unvisited[i];
+    // a standard method selecting the node with the max. product value.
+    // Ties are broken by the node index as the order of the nodes is
+    // arbitrary
+    for (auto node : unvisited) {
         auto prod = pheromone.get(current_node, node)
                   * heuristic.get(current_node, node);
-        if (prod > max_product) {
+        if (prod > max_product || (prod == max_product && node < chosen_node)) {
             chosen_node = node;
             max_product = prod;
         }
@@ -110,7 +162,7 @@ uint32_t select_max_product_node(
     // We are assuming that all nodes on the cand list of the current_node
     // have been visited and thus we do not need to look for pheromone values
     // as all the other edges have the same - default - value
-    return heuristic.find_node_with_max_value(current_node, ant.get_unvisited_nodes());
+    return heuristic.find_nearest_unvisited(current_node, ant);
 }
 
 static const uint32_t MaxCandListSize = 32;
@@ -164,13 +216,44 @@ typedef Limits (*calc_trail_limits_fn_t)(uint32_t dimension,
                          double solution_cost);
 
 
+/**
+ * Called when all the nodes on the candidates list were visited. Selects the
+ * first unvisited node from the backup list, or if there is none, the one
+ * with the maximum product of pheromone and heuristic.
+ *
+ * If stats is not null, the backup list hits and the fallbacks to the
+ * (linear time) scan of the unvisited nodes are counted.
+ */
+template<typename Pheromone_t>
+uint32_t select_backup_node(const Pheromone_t &pheromone,
+                            const HeuristicData &heuristic,
+                            const NodeList &backup_nn_list,
+                            Ant &ant,
+                            ConstructionStats *stats) {
+    for (auto node : backup_nn_list) {
+        if (!ant.is_visited(node)) {
+            if (stats != nullptr) {
+                ++stats->backup_list_hits_;
+            }
+            return node;
+        }
+    }
+    if (stats != nullptr) {
+        ++stats->max_product_fallbacks_;
+        stats->fallback_unvisited_nodes_ += ant.get_unvisited_count();
+    }
+    return select_max_product_node(ant.get_current_node(), ant, pheromone, heuristic);
+}
+
+
 template<typename Pheromone_t>
 uint32_t select_next_node(const Pheromone_t &pheromone,
                           const HeuristicData &heuristic,
                           const NodeList &nn_list,
                           const vector<double> &nn_product_cache,
                           const NodeList &backup_nn_list,
-                          Ant &ant) {
+                          Ant &ant,
+                          ConstructionStats *stats = nullptr) {
     assert(!ant.route_.empty());
 
     const auto current_node = ant.get_current_node();
@@ -218,17 +301,156 @@ uint32_t select_next_node(const Pheromone_t &pheromone,
                 break;
             }
         }
-    } else if (cl_size == 0) { // Select from the rest of the unvisited nodes the one with the
-                               // maximum product of pheromone and heuristic
-        for (auto node : backup_nn_list) {
-            if (!ant.is_visited(node)) {
-                chosen_node = node;
+    } else if (cl_size == 0) {
+        chosen_node = select_backup_node(pheromone, heuristic, backup_nn_list, ant, stats);
+    }
+    assert(chosen_node != current_node);
+    return chosen_node;
+}
+
+
+/**
+ * Single-precision counterpart of the nn_product_cache.
+ *
+ * Each node's row holds the pheromone * heuristic products for the nodes on
+ * its candidates list followed by a copy of the list itself. Rows are padded
+ * to a multiple of 8 elements and start at 32-byte boundaries, so that a
+ * whole row can be processed with aligned AVX2 loads. The padding entries
+ * refer to the row's node, which is always visited when the row is read.
+ */
+struct CompactProductCache {
+    uint32_t cl_size_ = 0;
+    uint32_t stride_ = 0;  // cl_size_ rounded up to a multiple of 8
+    AlignedVector<float> products_;
+    AlignedVector<uint32_t> nodes_;
+
+    CompactProductCache(const ProblemInstance &problem, uint32_t cl_size)
+        : cl_size_(cl_size),
+          stride_((cl_size + 7) / 8 * 8),
+          products_(static_cast<size_t>(problem.dimension_) * stride_, 0.0f),
+          nodes_(static_cast<size_t>(problem.dimension_) * stride_) {
+
+        assert(stride_ <= ::MaxCandListSize);
+
+        for (uint32_t node = 0 ; node < problem.dimension_ ; ++node) {
+            auto nodes_it = nodes_.begin() + node * stride_;
+            for (auto nn : problem.get_nearest_neighbors(node, cl_size)) {
+                *nodes_it++ = nn;
+            }
+            std::fill(nodes_it, nodes_.begin() + (node + 1) * stride_, node);
+        }
+    }
+
+    // Should be called by all threads of a parallel region, or outside of it.
+    // The threads do not wait for each other at the end, so a barrier is
+    // needed before the products are read
+    template<typename Pheromone_t>
+    void update(const vector<double> &cl_heuristic_cache,
+                const Pheromone_t &pheromone) {
+        const auto dimension = static_cast<uint32_t>(products_.size() / stride_);
+
+        #pragma omp for schedule(static) nowait
+        for (uint32_t node = 0 ; node < dimension ; ++node) {
+            auto products_it = products_.begin() + node * stride_;
+            auto nodes_it = nodes_.begin() + node * stride_;
+            auto heuristic_it = cl_heuristic_cache.begin() + node * cl_size_;
+            for (uint32_t i = 0; i < cl_size_; ++i) {
+                *products_it++ = static_cast<float>(*heuristic_it++ * pheromone.get(node, *nodes_it++));
+            }
+        }
+    }
+};
+
+
+/**
+ * The same as select_next_node above but uses the single-precision cache.
+ * If AVX2 is available the visited bits are gathered, the products masked
+ * and the prefix sums computed 8 candidates at a time.
+ */
+template<typename Pheromone_t>
+uint32_t select_next_node(const Pheromone_t &pheromone,
+                          const HeuristicData &heuristic,
+                          const CompactProductCache &cache,
+                          const NodeList &backup_nn_list,
+                          Ant &ant,
+                          ConstructionStats *stats = nullptr) {
+    assert(!ant.route_.empty());
+
+    const auto current_node = ant.get_current_node();
+    const auto stride = cache.stride_;
+    const float *products = cache.products_.data() + current_node * stride;
+    const uint32_t *nodes = cache.nodes_.data() + current_node * stride;
+
+    alignas(32) float prefix_sums[::MaxCandListSize];
+    uint32_t unvisited_bits = 0;  // i-th bit is set if nodes[i] is unvisited
+
+#ifdef __AVX2__
+    const auto *mask_words = reinterpret_cast<const int *>(ant.visited_bitmask_.mask_.data());
+    const __m256i bit_pos_mask = _mm256_set1_epi32(31);
+    const __m256i ones = _mm256_set1_epi32(1);
+    __m256 carry = _mm256_setzero_ps();  // Sum of the previous blocks
+
+    for (uint32_t i = 0; i < stride; i += 8) {
+        auto block_nodes = _mm256_load_si256(reinterpret_cast<const __m256i *>(nodes + i));
+        auto words = _mm256_i32gather_epi32(mask_words, _mm256_srli_epi32(block_nodes, 5), 4);
+        auto bits = _mm256_and_si256(
+                _mm256_srlv_epi32(words, _mm256_and_si256(block_nodes, bit_pos_mask)), ones);
+        auto unvisited = _mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, _mm256_setzero_si256()));
+        unvisited_bits |= static_cast<uint32_t>(_mm256_movemask_ps(unvisited)) << i;
+
+        auto x = _mm256_and_ps(_mm256_load_ps(products + i), unvisited);
+        // Prefix sums inside each of the 128-bit lanes...
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 4)));
+        x = _mm256_add_ps(x, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(x), 8)));
+        // ...then the total of the lower lane is added to the upper one
+        auto low_total = _mm256_permute_ps(x, 0xFF);
+        x = _mm256_add_ps(x, _mm256_permute2f128_ps(low_total, low_total, 0x08));
+        x = _mm256_add_ps(x, carry);
+        _mm256_store_ps(prefix_sums + i, x);
+
+        carry = _mm256_permute_ps(_mm256_permute2f128_ps(x, x, 0x11), 0xFF);
+    }
+#else
+    float products_sum = 0;
+    for (uint32_t i = 0; i < stride; ++i) {
+        uint32_t valid = 1 - ant.is_visited(nodes[i]);
+        unvisited_bits |= valid << i;
+        products_sum += products[i] * static_cast<float>(valid);
+        prefix_sums[i] = products_sum;
+    }
+#endif
+
+    uint32_t chosen_node;
+    const auto cl_size = __builtin_popcount(unvisited_bits);
+
+    if (cl_size > 1) { // Select from the closest nodes
+        // Prefix sums grow only at the unvisited nodes, hence the first sum
+        // exceeding r belongs to one of them. If none does, due to a rounding
+        // error, the last unvisited node is chosen.
+        chosen_node = nodes[31 - __builtin_clz(unvisited_bits)];
+        const auto r = static_cast<float>(get_rng().next_float()) * prefix_sums[stride - 1];
+#ifdef __AVX2__
+        const auto r_vec = _mm256_set1_ps(r);
+        for (uint32_t i = 0; i < stride; i += 8) {
+            auto greater = _mm256_cmp_ps(r_vec, _mm256_load_ps(prefix_sums + i), _CMP_LT_OQ);
+            auto greater_bits = static_cast<uint32_t>(_mm256_movemask_ps(greater));
+            if (greater_bits != 0) {
+                chosen_node = nodes[i + __builtin_ctz(greater_bits)];
                 break ;
             }
         }
-        if (chosen_node == max_node) {  // Still nothing selected
-            chosen_node = select_max_product_node(current_node, ant, pheromone, heuristic);
+#else
+        for (uint32_t i = 0; i < stride; ++i) {
+            if (r < prefix_sums[i]) {
+                chosen_node = nodes[i];
+                break ;
+            }
         }
+#endif
+    } else if (cl_size == 1) {
+        chosen_node = nodes[__builtin_ctz(unvisited_bits)];
+    } else {
+        chosen_node = select_backup_node(pheromone, heuristic, backup_nn_list, ant, stats);
     }
     assert(chosen_node != current_node);
     return chosen_node;
@@ -243,9 +465,8 @@ void calc_cand_list_heuristic_cache(HeuristicData &heuristic,
     cache.resize(cl_size * dimension);
     for (uint32_t node = 0 ; node < dimension ; ++node) {
         auto cache_it = cache.begin() + node * cl_size;
-        for (auto &nn : problem.get_nearest_neighbors(node, cl_size)) {
-            auto value = heuristic.get(node, nn);
-            *cache_it++ = value;
+        for (uint32_t index = 0; index < cl_size; ++index) {
+            *cache_it++ = heuristic.get_nn(node, index);
         }
     }
 }
@@ -262,6 +483,7 @@ protected:
     double p_best_;
     double rho_;
     uint32_t cand_list_size_;
+    bool lazy_evaporation_;
 public:
     Limits trail_limits_;
 
@@ -273,6 +495,7 @@ public:
         , p_best_(options.p_best_)
         , rho_(options.rho_)
         , cand_list_size_(options.cand_list_size_)
+        , lazy_evaporation_(options.lazy_evaporation_)
     {}
 
     void init(double solution_cost) {
@@ -321,7 +544,8 @@ public:
     void init_impl() {
         pheromone_ = std::make_unique<MatrixPheromone>(problem_.dimension_,
                                                        trail_limits_.max_,
-                                                       problem_.is_symmetric_);
+                                                       problem_.is_symmetric_,
+                                                       lazy_evaporation_);
     }
 };
 
@@ -339,17 +563,19 @@ public:
         pheromone_ = std::make_unique<CandListPheromone>(
                 problem_.get_nn_lists(cand_list_size_),
                 trail_limits_.max_,
-                problem_.is_symmetric_);
+                problem_.is_symmetric_,
+                lazy_evaporation_);
     }
 };
 
 std::pair<std::vector<uint32_t>, double>
-build_initial_route(const ProblemInstance &problem, bool use_local_search=false) {
+build_initial_route(const ProblemInstance &problem, bool use_local_search=false,
+                    TourRepresentation repr=TourRepresentation::Array) {
     auto start_node = get_rng().next_uint32(problem.dimension_);
     auto route = problem.build_nn_tour(start_node);
     uint32_t nn_count = 16;
     if (use_local_search) {
-        two_opt_nn(problem, route, true, nn_count);
+        two_opt_nn(problem, route, true, nn_count, repr);
     }
     return { route, problem.calculate_route_length(route) };
 }
@@ -358,13 +584,15 @@ build_initial_route(const ProblemInstance &problem, bool use_local_search=false)
 std::vector<std::vector<uint32_t>>
 par_build_initial_routes(const ProblemInstance &problem,
                          bool use_local_search,
-                         uint32_t sol_count=0) {
+                         uint32_t sol_count=0,
+                         TourRepresentation repr=TourRepresentation::Array) {
     uint32_t nn_count = 16;
 
     if (sol_count == 0) {
-        // #pragma omp parallel default(none) shared(sol_count)
-        // #pragma omp master
-        sol_count = omp_get_num_procs();
+        // One initial solution per thread -- we use the # of threads
+        // instead of the # of cores so that the results are reproducible
+        // for a fixed --threads value
+        sol_count = static_cast<uint32_t>(omp_get_max_threads());
     }
 
     std::vector<std::vector<uint32_t>> routes(sol_count);
@@ -375,10 +603,10 @@ par_build_initial_routes(const ProblemInstance &problem,
     }
 
     if (use_local_search) {
-        // #pragma omp parallel for default(none) shared(problem, routes, nn_count, sol_count)
+        #pragma omp parallel for default(none) shared(problem, routes, nn_count, sol_count, repr)
         for (uint32_t i = 0; i < sol_count; ++i) {
-            two_opt_nn(problem, routes[i], true, nn_count);
-            three_opt_nn(problem,  routes[i], /*use_dont_look_bits*/ true, nn_count);
+            two_opt_nn(problem, routes[i], true, nn_count, repr);
+            three_opt_nn(problem,  routes[i], /*use_dont_look_bits*/ true, nn_count, repr);
         }
     }
     return routes;
@@ -400,9 +628,12 @@ run_mmas(const ProblemInstance &problem,
     const auto ants_count = opt.ants_count_;
     const auto iterations = opt.iterations_;
     const auto use_ls     = opt.local_search_ != 0;
+    const auto ls_repr    = opt.two_level_list_ ? TourRepresentation::TwoLevelList
+                                                : TourRepresentation::Array;
 
-    const auto start_sol = build_initial_route(problem);
+    const auto start_sol = build_initial_route(problem, false, ls_repr);
     const auto initial_cost = start_sol.second;
+    comp_log("nn lists build time", problem.nn_lists_build_time_);
     comp_log("initial sol cost", initial_cost);
 
     Model_t model(problem, opt);
@@ -414,7 +645,9 @@ run_mmas(const ProblemInstance &problem,
     vector<double> cl_heuristic_cache;
     calc_cand_list_heuristic_cache(heuristic, cl_size, cl_heuristic_cache);
 
-    vector<double> nn_product_cache(dimension * cl_size);
+    const auto use_compact_cache = opt.compact_cache_;
+    vector<double> nn_product_cache(use_compact_cache ? 0 : dimension * cl_size);
+    CompactProductCache compact_cache(problem, use_compact_cache ? cl_size : 0);
 
     Ant best_ant;
     best_ant.route_ = start_sol.first;
@@ -431,38 +664,53 @@ run_mmas(const ProblemInstance &problem,
     Timer main_timer;
 
     vector<double> sol_costs(ants_count);
+    double pher_evaporation_time = 0;
 
-    // #pragma omp parallel default(shared)
+    #pragma omp parallel default(shared)
     {
+        // The thread's ants are built one after another, so they share the
+        // tree (see HeuristicData::make_unvisited_tree)
+        auto unvisited_tree = heuristic.make_unvisited_tree();
+
         for (int32_t iteration = 0 ; iteration < iterations ; ++iteration) {
-            // #pragma omp barrier
+            #pragma omp barrier
             // Load pheromone * heuristic for each edge connecting nearest
             // neighbors (up to cl_size)
-            // #pragma omp for schedule(static)
-            for (uint32_t node = 0 ; node < dimension ; ++node) {
-                auto cache_it = nn_product_cache.begin() + node * cl_size;
-                auto heuristic_it = cl_heuristic_cache.begin() + node * cl_size;
-                for (auto &nn : problem.get_nearest_neighbors(node, cl_size)) {
-                    *cache_it++ = *heuristic_it++ * pheromone.get(node, nn);
+            if (use_compact_cache) {
+                compact_cache.update(cl_heuristic_cache, pheromone);
+            } else {
+                #pragma omp for schedule(static) nowait
+                for (uint32_t node = 0 ; node < dimension ; ++node) {
+                    auto cache_it = nn_product_cache.begin() + node * cl_size;
+                    auto heuristic_it = cl_heuristic_cache.begin() + node * cl_size;
+                    for (auto &nn : problem.get_nearest_neighbors(node, cl_size)) {
+                        *cache_it++ = *heuristic_it++ * pheromone.get(node, nn);
+                    }
                 }
             }
+            #pragma omp barrier
 
             // Changing schedule from "static" to "dynamic" can speed up
             // computations a bit, however it introduces non-determinism due to
             // threads scheduling. With "static" the computations always follow
             // the same path -- i.e. if we run the program with the same PRNG
             // seed (--seed X) then we get exactly the same results.
-            // #pragma omp for schedule(static, 1)
+            #pragma omp for schedule(static, 1)
             for (uint32_t ant_idx = 0; ant_idx < ants.size(); ++ant_idx) {
                 auto &ant = ants[ant_idx];
-                ant.initialize(dimension);
+                ant.initialize(dimension, true, unvisited_tree.get());
 
                 auto start_node = get_rng().next_uint32(dimension);
                 ant.visit(start_node);
 
                 while (ant.visited_count_ < dimension) {
                     auto curr = ant.get_current_node();
-                    auto next = select_next_node(pheromone, heuristic,
+                    auto next = use_compact_cache
+                              ? select_next_node(pheromone, heuristic,
+                                                 compact_cache,
+                                                 problem.get_backup_neighbors(curr, cl_size, bl_size),
+                                                 ant)
+                              : select_next_node(pheromone, heuristic,
                                                  problem.get_nearest_neighbors(curr, cl_size),
                                                  nn_product_cache,
                                                  problem.get_backup_neighbors(curr, cl_size, bl_size),
@@ -470,14 +718,14 @@ run_mmas(const ProblemInstance &problem,
                     ant.visit(next);
                 }
                 if (use_ls) {
-                    two_opt_nn(problem, ant.route_, true, opt.ls_cand_list_size_);
+                    two_opt_nn(problem, ant.route_, true, opt.ls_cand_list_size_, ls_repr);
                 }
 
                 ant.cost_ = problem.calculate_route_length(ant.route_);
                 sol_costs[ant_idx] = ant.cost_;
             }
 
-            // #pragma omp master
+            #pragma omp master
             {
                 iteration_best = &ants.front();
                 for (auto &ant : ants) {
@@ -500,11 +748,14 @@ run_mmas(const ProblemInstance &problem,
             }
 
             // Synchronize threads before pheromone update
-            // #pragma omp barrier
+            #pragma omp barrier
 
+            const double evaporation_start = omp_get_wtime();
             model.evaporate_pheromone();
+            #pragma omp master
+            pher_evaporation_time += omp_get_wtime() - evaporation_start;
 
-            // #pragma omp master
+            #pragma omp master
             {
                 bool use_best_ant = (get_rng().next_float() < opt.gbest_as_source_prob_);
                 auto &update_ant = use_best_ant ? best_ant : *iteration_best;
@@ -513,14 +764,22 @@ run_mmas(const ProblemInstance &problem,
             }
         }
     }
+    comp_log("pher_evaporation_time", pher_evaporation_time);
+    comp_log("threads", omp_get_max_threads());
+    comp_log("iterations per sec", round(iterations / main_timer(), 3));
     return make_unique<Solution>(best_ant.route_, best_ant.cost_);
 }
 
+/**
+ * Runs a single colony of the FACO. If island is not null, the colony takes
+ * part in the migrations of the island model.
+ */
 template<typename ComputationsLog_t>
 std::unique_ptr<Solution>
-run_focused_aco(const ProblemInstance &problem,
+run_faco_colony(const ProblemInstance &problem,
                 const ProgramOptions &opt,
-                ComputationsLog_t &comp_log) {
+                ComputationsLog_t &comp_log,
+                IslandContext *island) {
 
     const auto dimension  = problem.dimension_;
     const auto cl_size    = opt.cand_list_size_;
@@ -528,14 +787,24 @@ run_focused_aco(const ProblemInstance &problem,
     const auto ants_count = opt.ants_count_;
     const auto iterations = opt.iterations_;
     const auto use_ls     = opt.local_search_ != 0;
+    const auto ls_repr    = opt.two_level_list_ ? TourRepresentation::TwoLevelList
+                                                : TourRepresentation::Array;
+    const auto use_3opt   = opt.local_search_ == 2;
+    const auto ls_order   = opt.ls_order_ == "gain" ? ActiveNodesOrder::Gain
+                                                    : ActiveNodesOrder::Fifo;
+    // The batched 2-opt is used only if it gives the same results as the
+    // 2-opt called for each ant separately
+    const auto use_ls_batch = opt.ls_batch_ && use_ls && !use_3opt
+                            && !DUMP_LOG
+                            && TwoOptBatch::is_supported(problem);
 
     Timer start_sol_timer;
-    const auto start_routes = par_build_initial_routes(problem, use_ls);
+    const auto start_routes = par_build_initial_routes(problem, use_ls, 0, ls_repr);
     auto start_sol_count = start_routes.size();
     std::vector<double> start_costs(start_sol_count);
 
-    // #pragma omp parallel default(none) shared(start_sol_count, problem, start_costs, start_routes)
-    // #pragma omp for
+    #pragma omp parallel default(none) shared(start_sol_count, problem, start_costs, start_routes)
+    #pragma omp for
     for (size_t i = 0; i < start_sol_count; ++i) {
         start_costs[i] = problem.calculate_route_length(start_routes[i]);
     }
@@ -545,6 +814,7 @@ run_focused_aco(const ProblemInstance &problem,
                                       min_element(begin(start_costs), end(start_costs)));
     auto initial_cost = start_costs[smallest_pos];
     const auto &start_route = start_routes[smallest_pos];
+    comp_log("nn lists build time", problem.nn_lists_build_time_);
     comp_log("initial sol cost", initial_cost);
 
     HeuristicData heuristic(problem, opt.beta_);
@@ -554,8 +824,8 @@ run_focused_aco(const ProblemInstance &problem,
     for (uint32_t node = 0 ; node < dimension ; ++node) {
         auto cache_it = cl_heuristic_cache.begin() + node * cl_size;
 
-        for (auto &nn : problem.get_nearest_neighbors(node, cl_size)) {
-            *cache_it++ = heuristic.get(node, nn);
+        for (uint32_t index = 0; index < cl_size; ++index) {
+            *cache_it++ = heuristic.get_nn(node, index);
         }
     }
 
@@ -568,15 +838,62 @@ run_focused_aco(const ProblemInstance &problem,
     auto &pheromone = model.get_pheromone();
     pheromone.set_all_trails(model.trail_limits_.max_);
 
-    vector<double> nn_product_cache(dimension * cl_size);
+    const auto use_compact_cache = opt.compact_cache_;
+    vector<double> nn_product_cache(use_compact_cache ? 0 : dimension * cl_size);
+    CompactProductCache compact_cache(problem, use_compact_cache ? cl_size : 0);
 
     auto best_ant = make_unique<Ant>(start_route, initial_cost);
 
     vector<Ant> ants(ants_count);
     Ant *iteration_best = nullptr;
+    // With the k-d tree the fallback node is found without the ants' sets
+    // of the unvisited nodes (see HeuristicData::find_nearest_unvisited)
+    const bool track_unvisited = (heuristic.kdtree_ == nullptr);
+
+    unique_ptr<TwoOptBatch> ls_batch;
+    if (use_ls_batch) {
+        ls_batch = make_unique<TwoOptBatch>(problem, opt.ls_cand_list_size_, ants_count);
+    }
 
     auto source_solution = make_unique<Solution>(start_route, best_ant->cost_);
 
+    // Checkpoints are supported only for a single colony
+    const auto time_limit = opt.time_limit_;
+    const auto use_checkpoints = island == nullptr && !opt.checkpoint_path_.empty();
+    CheckpointData checkpoint;
+    bool is_resumed = false;
+    int32_t first_iteration = 0;
+    double prev_runs_time = 0;  // Time of the runs preceding the checkpoint
+
+    if (use_checkpoints && opt.resume_
+            && load_checkpoint(opt.checkpoint_path_, checkpoint)) {
+        if (checkpoint.dimension_ != dimension
+                || checkpoint.ants_count_ != ants_count
+                || checkpoint.cand_list_size_ != cl_size
+                || checkpoint.seed_ != opt.seed_
+                || checkpoint.trails_.size() != pheromone.trails_.size()
+                || checkpoint.lazy_.is_enabled() != pheromone.lazy_.is_enabled()) {
+            throw runtime_error("Checkpoint does not match the current settings: "
+                                + opt.checkpoint_path_);
+        }
+        best_ant->update(checkpoint.best_route_, checkpoint.best_cost_);
+        source_solution->update(checkpoint.source_route_, checkpoint.source_cost_);
+        model.trail_limits_ = { checkpoint.trail_min_, checkpoint.trail_max_ };
+        pheromone.trails_ = checkpoint.trails_;
+        pheromone.default_pheromone_value_ = checkpoint.default_pheromone_value_;
+        pheromone.lazy_ = checkpoint.lazy_;
+
+        if (checkpoint.rng_states_.size() != 2 * static_cast<size_t>(omp_get_max_threads())) {
+            cerr << "Warning: the # of threads differs from the checkpoint, "
+                 << "the results will not be repeatable\n";
+        }
+        is_resumed = true;
+        first_iteration = checkpoint.iteration_ + 1;
+        prev_runs_time = checkpoint.elapsed_time_;
+        comp_log("resumed from iteration", first_iteration);
+        comp_log("resumed sol cost", best_ant->cost_);
+    }
+
     // The following are mainly for raporting purposes
     int64_t select_next_node_calls = 0;
     Trace<ComputationsLog_t, SolutionCost> best_cost_trace(comp_log,
@@ -586,60 +903,136 @@ run_focused_aco(const ProblemInstance &problem,
     Trace<ComputationsLog_t, double> mean_cost_trace(comp_log, "sol cost mean", iterations, 20);
     Trace<ComputationsLog_t, double> stdev_cost_trace(comp_log, "sol cost stdev", iterations, 20);
     Timer main_timer;
+    // The times are counted from the start of the first run, i.e. include
+    // the runs preceding the checkpoint
+    auto elapsed_time = [&]() { return prev_runs_time + main_timer(); };
+
+    // Time to target quality: for each of the target relative errors (in %)
+    // the iteration and time at which the best solution reached it. If the
+    // run was resumed, the targets reached before are recorded at the
+    // checkpoint's iteration.
+    auto target_errors = parse_values_list<double>(opt.target_errors_);
+    std::sort(target_errors.begin(), target_errors.end(), std::greater<>());
+    size_t next_target = 0;
+    Trace<ComputationsLog_t, double> time_to_target_trace(comp_log, "time to target error",
+                                                          target_errors.size(), 1, true);
+    auto record_reached_targets = [&](int32_t iteration) {
+        if (problem.best_known_cost_ <= 0) {
+            return ;
+        }
+        const auto error = problem.calc_relative_error(best_ant->cost_);
+        while (next_target < target_errors.size() && error <= target_errors[next_target]) {
+            time_to_target_trace.add(target_errors[next_target], iteration, elapsed_time());
+            ++next_target;
+        }
+    };
+    record_reached_targets(first_iteration - 1);
+
+    const auto end_iteration = (time_limit > 0 && prev_runs_time >= time_limit)
+                             ? first_iteration : iterations;
+    bool time_limit_reached = end_iteration < iterations;
+    bool save_checkpoint_now = false;
+    double last_checkpoint_time = 0;
+    int32_t completed_iterations = 0;
+    vector<uint64_t> rng_states(use_checkpoints ? 2 * omp_get_max_threads() : 0);
 
     vector<double> sol_costs(ants_count);
 
     double  pher_deposition_time = 0;
-
-    ofstream myfile; // for local search dump
-
-    if (DUMP_LOG) {
-        // Write the coordinates to a text file        
-        myfile.open ("stats.txt");
-        myfile << "coordinates: " << endl;
-        for (int i = 0; i < problem.coords_.size(); i++) {
-            myfile << problem.coords_[i].x_ << " " << problem.coords_[i].y_ << endl;
-        }
+    double  pher_evaporation_time = 0;
+    LocalSearchStats ls_stats;
+    ConstructionStats construction_stats;
+    PhaseTimers phase_timers;  // Max. over the threads
+    CycleClock cycle_clock;
+
+    vector<uint32_t> immigrant_route;
+    double immigrant_cost = 0;
+
+    // Binary trace of the LS inputs and outputs (see ls_trace.h)
+    unique_ptr<LocalSearchTraceWriter> ls_trace;
+    if (DUMP_LOG && use_ls && island == nullptr) {
+        ls_trace = make_unique<LocalSearchTraceWriter>("stats.bin", problem, opt.ls_cand_list_size_);
     }
 
-    // #pragma omp parallel default(shared)
+    #pragma omp parallel default(shared)
     {
-        double ls_time = 0;
-        double total_time = 0;
         // Endpoints of new edges (not present in source_route) are inserted
         // into ls_checklist and later used to guide local search
         vector<uint32_t> ls_checklist;
         ls_checklist.reserve(dimension);
+        LocalSearchStats thread_ls_stats;
+        ConstructionStats thread_construction_stats;
+        PhaseTimers thread_timers;
+        // The thread's ants are built one after another, so they share the
+        // tree (see HeuristicData::make_unvisited_tree)
+        auto unvisited_tree = heuristic.make_unvisited_tree();
+
+        // The colony runs in a nested parallel region whose threads may not
+        // be the ones of the previous run, so all of them (including the
+        // colony's thread 0) are seeded here, once per run
+        if (island != nullptr) {
+            init_thread_random_number_generator(island->seed_, omp_get_thread_num());
+        }
+        if (is_resumed) {
+            const auto state_idx = 2 * static_cast<size_t>(omp_get_thread_num());
+            if (state_idx < checkpoint.rng_states_.size()) {
+                get_rng().set_state(&checkpoint.rng_states_[state_idx]);
+            }
+        }
 
-        for (int32_t iteration = 0 ; iteration < iterations ; ++iteration) {
-            // #pragma omp barrier
+        auto run_local_search = [&](Ant &ant) {
+            if (use_3opt) {
+                three_opt_nn(problem, ant.route_, ls_checklist, opt.ls_cand_list_size_,
+                             ls_order, &thread_ls_stats);
+            } else {
+                // The ant's route would have to be converted to the two-level
+                // list and back for only a few moves, which takes longer than
+                // the moves on the vector, so ls_repr is used only for the
+                // initial routes
+                two_opt_nn(problem, ant.route_, ls_checklist, opt.ls_cand_list_size_,
+                           TourRepresentation::Array, &thread_ls_stats);
+            }
+        };
+
+        for (int32_t iteration = first_iteration ; iteration < end_iteration ; ++iteration) {
+            auto phase_start = read_cycle_counter();
+            #pragma omp barrier
+            phase_start = thread_timers.add(Phase::BarrierWait, phase_start);
 
             // Load pheromone * heuristic for each edge connecting nearest
             // neighbors (up to cl_size)
-            // #pragma omp for schedule(static)
-            for (uint32_t node = 0 ; node < dimension ; ++node) {
-                auto cache_it = nn_product_cache.begin() + node * cl_size;
-                auto heuristic_it = cl_heuristic_cache.begin() + node * cl_size;
-                for (auto &nn : problem.get_nearest_neighbors(node, cl_size)) {
-                    *cache_it++ = *heuristic_it++ * pheromone.get(node, nn);
+            if (use_compact_cache) {
+                compact_cache.update(cl_heuristic_cache, pheromone);
+            } else {
+                #pragma omp for schedule(static) nowait
+                for (uint32_t node = 0 ; node < dimension ; ++node) {
+                    // The cand. list pheromone uses the same NN lists, so
+                    // the trails can be read by the slot (position)
+                    auto cache_it = nn_product_cache.begin() + node * cl_size;
+                    auto heuristic_it = cl_heuristic_cache.begin() + node * cl_size;
+                    for (uint32_t slot = 0; slot < cl_size; ++slot) {
+                        *cache_it++ = *heuristic_it++ * pheromone.get_by_slot(node, slot);
+                    }
                 }
             }
-
-            // #pragma omp master
-            select_next_node_calls = 0;
+            // The waiting for the other threads, i.e. the load imbalance, is
+            // measured separately
+            phase_start = thread_timers.add(Phase::CacheRefresh, phase_start);
+            #pragma omp barrier
+            thread_timers.add(Phase::BarrierWait, phase_start);
 
             // Changing schedule from "static" to "dynamic" can speed up
             // computations a bit, however it introduces non-determinism due to
             // threads scheduling. With "static" the computations always follow
             // the same path -- i.e. if we run the program with the same PRNG
             // seed (--seed X) then we get exactly the same results.
-            // #pragma omp for schedule(static, 1) reduction(+ : select_next_node_calls)
+            #pragma omp for schedule(static, 1) reduction(+ : select_next_node_calls)
             for (uint32_t ant_idx = 0; ant_idx < ants.size(); ++ant_idx) {
-                Timer iteration_timer;
+                auto ant_start = read_cycle_counter();
                 uint32_t target_new_edges = opt.min_new_edges_;
 
                 auto &ant = ants[ant_idx];
-                ant.initialize(dimension);
+                ant.initialize(dimension, track_unvisited, unvisited_tree.get());
 
                 auto start_node = get_rng().next_uint32(dimension);
                 ant.visit(start_node);
@@ -654,14 +1047,20 @@ run_focused_aco(const ProblemInstance &problem,
 
                 while (ant.visited_count_ < dimension) {
                     auto curr = ant.get_current_node();
-                    auto next = select_next_node(pheromone, heuristic,
+                    auto next = use_compact_cache
+                              ? select_next_node(pheromone, heuristic,
+                                                 compact_cache,
+                                                 problem.get_backup_neighbors(curr, cl_size, bl_size),
+                                                 ant, &thread_construction_stats)
+                              : select_next_node(pheromone, heuristic,
                                                  problem.get_nearest_neighbors(curr, cl_size),
                                                  nn_product_cache,
                                                  problem.get_backup_neighbors(curr, cl_size, bl_size),
-                                                 ant);
+                                                 ant, &thread_construction_stats);
                     ant.visit(next);
 
                     ++select_next_node_calls;
+                    ++thread_construction_stats.select_next_node_calls_;
 
                     if (!source_solution->contains_edge(curr, next)) {
                         ++new_edges;
@@ -683,63 +1082,48 @@ run_focused_aco(const ProblemInstance &problem,
                         }
                     }
                 }
+                if (use_ls_batch) {
+                    // The LS is run later, for all the ants at once
+                    ls_batch->set_route(ant_idx, ant.route_);
+                    ls_batch->set_checklist(ant_idx, ls_checklist);
+                    thread_timers.add(Phase::Construction, ant_start);
+                    continue ;
+                }
+                ant_start = thread_timers.add(Phase::Construction, ant_start);
                 if (use_ls) {
-                    if (DUMP_LOG) {
-                        // Print all inputs into two_opt_nn
-                        // #pragma omp critical
-                        {                        
-                        myfile << "New iteration" << endl;
-                        myfile << "ls_checklist: ";
-                        for (auto i : ls_checklist) {
-                            myfile << i << " ";
-                        }
-                        myfile << endl;
-
-                        myfile << "ant.route_: ";
-                        for (auto i : ant.route_) {
-                            myfile << i << " ";
-                        }
-                        myfile << endl;
-
-                        myfile << "ls_cand_list_size_: " << opt.ls_cand_list_size_ << endl;
-
-                        // Print result of get_nearest_neighbors of each node in ant.route_ and the coordinates of each neighbor
-                        for (auto i : ls_checklist) {
-                            myfile << "get_nearest_neighbors of node " << i << ": ";
-                            for (auto j : problem.get_nearest_neighbors(i, opt.ls_cand_list_size_)) {
-                                myfile << j << " ";
-                                // myfile << "(" << problem.coords_[j].x_ << ", " << problem.coords_[j].y_ << ") ";
-                                // myfile << endl;
-                            }
-                            myfile << endl;
-                        }
-                        // Timer ls_timer;
-                        two_opt_nn(problem, ant.route_, ls_checklist, opt.ls_cand_list_size_);
-                        // ls_time += ls_timer();
-
-                        // Print ant path after two_opt_nn
-                        myfile << "ant.route_ after two_opt_nn: ";
-                        for (auto i : ant.route_) {
-                            myfile << i << " ";
-                        }
-                        myfile << endl;
-                        myfile << "Done with iteration" << endl;
-                        } // end of omp critical section
-                    }
-                    else { // DUMP_LOG = false
-                        // Timer ls_timer;
-                        two_opt_nn(problem, ant.route_, ls_checklist, opt.ls_cand_list_size_);
-                        // ls_time += ls_timer();
+                    if (ls_trace != nullptr) {
+                        // The LS inputs and output are written as test
+                        // vectors for the HLS testbenches
+                        LocalSearchTraceWriter::Record record(iteration, ant_idx,
+                                                              ant.route_, ls_checklist);
+                        run_local_search(ant);
+                        record.set_result(ant.route_);
+                        ls_trace->submit(std::move(record));
+                    } else {
+                        run_local_search(ant);
                     }
                 }
 
                 ant.cost_ = problem.calculate_route_length(ant.route_);
                 sol_costs[ant_idx] = ant.cost_;
+                thread_timers.add(Phase::LocalSearch, ant_start);
+            }
 
-                total_time += iteration_timer();
+            if (use_ls_batch) {
+                auto ls_start = read_cycle_counter();
+                ls_batch->run(&thread_ls_stats);
+
+                #pragma omp for schedule(static)
+                for (uint32_t ant_idx = 0; ant_idx < ants.size(); ++ant_idx) {
+                    auto &ant = ants[ant_idx];
+                    ls_batch->copy_route(ant_idx, ant.route_);
+                    ant.cost_ = problem.calculate_route_length(ant.route_);
+                    sol_costs[ant_idx] = ant.cost_;
+                }
+                thread_timers.add(Phase::LocalSearch, ls_start);
             }
 
-            // #pragma omp master
+            #pragma omp master
             {
                 iteration_best = &ants.front();
                 for (auto &ant : ants) {
@@ -751,55 +1135,266 @@ run_focused_aco(const ProblemInstance &problem,
                     best_ant->update(iteration_best->route_, iteration_best->cost_);
 
                     auto error = problem.calc_relative_error(best_ant->cost_);
-                    best_cost_trace.add({ best_ant->cost_, error }, iteration, main_timer());
+                    best_cost_trace.add({ best_ant->cost_, error }, iteration, elapsed_time());
+                    record_reached_targets(iteration);
 
                     model.update_trail_limits(best_ant->cost_);
                 }
 
+                // Island model: send the best solution to the next colony and
+                // check the one received from the previous colony
+                if (island != nullptr && island->is_migration_iteration(iteration)) {
+                    island->ring_->publish(island->colony_, best_ant->route_, best_ant->cost_);
+
+                    if (island->ring_->receive(island->colony_, island->last_received_version_,
+                                               immigrant_route, immigrant_cost)) {
+                        MigrationEvent event;
+                        event.iteration_ = iteration;
+                        event.time_ = round(elapsed_time(), 3);
+                        event.from_ = island->ring_->get_source(island->colony_);
+                        event.to_ = island->colony_;
+                        event.cost_ = immigrant_cost;
+                        event.local_cost_ = best_ant->cost_;
+                        event.accepted_ = immigrant_cost < best_ant->cost_;
+
+                        if (event.accepted_) {
+                            best_ant->update(immigrant_route, immigrant_cost);
+
+                            auto error = problem.calc_relative_error(best_ant->cost_);
+                            best_cost_trace.add({ best_ant->cost_, error }, iteration, elapsed_time());
+                            record_reached_targets(iteration);
+
+                            model.update_trail_limits(best_ant->cost_);
+                        }
+                        island->events_.push_back(event);
+                    }
+                }
+
                 auto total_edges = (dimension - 1) * ants_count;
                 select_next_node_calls_trace.add(
                         round(100.0 * static_cast<double>(select_next_node_calls) / total_edges, 2),
-                        iteration, main_timer());
+                        iteration, elapsed_time());
+                // Reset here, and not at the start of the iteration, so that
+                // no thread can add to it before the reset takes place
+                select_next_node_calls = 0;
 
                 mean_cost_trace.add(round(sample_mean(sol_costs), 1), iteration);
                 stdev_cost_trace.add(round(sample_stdev(sol_costs), 1), iteration);
             }
 
             // Synchronize threads before pheromone update
-            // #pragma omp barrier
+            #pragma omp barrier
 
+            const double evaporation_start = omp_get_wtime();
+            phase_start = read_cycle_counter();
             model.evaporate_pheromone();
+            thread_timers.add(Phase::Evaporation, phase_start);
+            #pragma omp master
+            pher_evaporation_time += omp_get_wtime() - evaporation_start;
 
-            // #pragma omp master
+            #pragma omp master
             {
                 bool use_best_ant = (get_rng().next_float() < opt.gbest_as_source_prob_);
                 auto &update_ant = use_best_ant ? *best_ant : *iteration_best;
 
                 double start = omp_get_wtime();
+                phase_start = read_cycle_counter();
 
                 model.deposit_pheromone(update_ant);
 
+                thread_timers.add(Phase::Deposition, phase_start);
                 pher_deposition_time += omp_get_wtime() - start;
 
                 // Increase pheromone values on the edges of the new
                 // source_solution
                 source_solution->update(update_ant.route_, update_ant.cost_);
+
+                ++completed_iterations;
+                // Anytime mode: stop after the iteration in which the time
+                // limit was reached
+                time_limit_reached = time_limit > 0 && elapsed_time() >= time_limit;
+                save_checkpoint_now = use_checkpoints
+                                   && (time_limit_reached
+                                       || main_timer() - last_checkpoint_time >= opt.checkpoint_interval_);
+            }
+
+            if (time_limit > 0 || use_checkpoints) {
+                // The flags set by the master have to be visible to all
+                // the threads
+                #pragma omp barrier
+
+                if (save_checkpoint_now) {
+                    // Each thread has its own RNG
+                    get_rng().get_state(&rng_states[2 * static_cast<size_t>(omp_get_thread_num())]);
+
+                    #pragma omp barrier
+
+                    #pragma omp master
+                    {
+                        checkpoint.dimension_ = dimension;
+                        checkpoint.ants_count_ = ants_count;
+                        checkpoint.cand_list_size_ = cl_size;
+                        checkpoint.seed_ = opt.seed_;
+                        checkpoint.iteration_ = iteration;
+                        checkpoint.elapsed_time_ = elapsed_time();
+                        checkpoint.best_route_ = best_ant->route_;
+                        checkpoint.best_cost_ = best_ant->cost_;
+                        checkpoint.source_route_ = source_solution->route_;
+                        checkpoint.source_cost_ = source_solution->cost_;
+                        checkpoint.trail_min_ = model.trail_limits_.min_;
+                        checkpoint.trail_max_ = model.trail_limits_.max_;
+                        checkpoint.trails_ = pheromone.trails_;
+                        checkpoint.default_pheromone_value_ = pheromone.default_pheromone_value_;
+                        checkpoint.lazy_ = pheromone.lazy_;
+                        checkpoint.rng_states_ = rng_states;
+
+                        save_checkpoint(checkpoint, opt.checkpoint_path_);
+                        last_checkpoint_time = main_timer();
+                    }
+                }
+                if (time_limit_reached) {
+                    break ;
+                }
             }
         }
 
-        // #pragma omp critical
-        // {
-        // // Print ls_time/total_time ratio
-        // cout << "LS time: " << ls_time << "s, total time: " << total_time << "s, ratio: "
-        //      << round(100.0 * ls_time / total_time, 2) << "%\n";
-        // }
+        #pragma omp critical
+        {
+            ls_stats.evaluated_moves_ += thread_ls_stats.evaluated_moves_;
+            ls_stats.applied_moves_ += thread_ls_stats.applied_moves_;
+            construction_stats += thread_construction_stats;
+            phase_timers.merge_max(thread_timers);
+        }
     }
     comp_log("pher_deposition_time", pher_deposition_time);
+    comp_log("pher_evaporation_time", pher_evaporation_time);
+    comp_log("ls evaluated moves", ls_stats.evaluated_moves_);
+    comp_log("ls applied moves", ls_stats.applied_moves_);
+    comp_log("select next node calls", construction_stats.select_next_node_calls_);
+    comp_log("backup list hits", construction_stats.backup_list_hits_);
+    comp_log("max product fallbacks", construction_stats.max_product_fallbacks_);
+    comp_log("fallback unvisited nodes", construction_stats.fallback_unvisited_nodes_);
+    // The phase times are those of the slowest thread (in sec.)
+    const auto cycles_per_sec = cycle_clock.get_cycles_per_sec();
+    for (uint32_t phase = 0; phase < PhasesCount; ++phase) {
+        const auto cycles = static_cast<double>(phase_timers.cycles_[phase]);
+        comp_log(string(PhaseNames[phase]) + " time", round(cycles / cycles_per_sec, 6));
+    }
+    comp_log("threads", omp_get_max_threads());
+    comp_log("completed iterations", completed_iterations);
+    if (ls_trace != nullptr) {
+        ls_trace->close();
+        comp_log("ls trace records", ls_trace->get_records_count());
+        comp_log("ls trace bytes", ls_trace->get_bytes_written());
+    }
+    comp_log("iterations per sec", round(completed_iterations / main_timer(), 3));
+    if (time_limit > 0) {
+        comp_log("time limit reached", time_limit_reached);
+    }
+    // The checkpoint of a finished run is not needed, while the one of a run
+    // stopped by the time limit allows to continue it (with a larger limit)
+    if (use_checkpoints && !time_limit_reached) {
+        std::error_code ec;
+        fs::remove(opt.checkpoint_path_, ec);
+    }
 
     return unique_ptr<Solution>(dynamic_cast<Solution*>(best_ant.release()));
 }
 
 
+template<typename ComputationsLog_t>
+std::unique_ptr<Solution>
+run_focused_aco(const ProblemInstance &problem,
+                const ProgramOptions &opt,
+                ComputationsLog_t &comp_log) {
+    return run_faco_colony(problem, opt, comp_log, nullptr);
+}
+
+
+/**
+ * Runs the island model of the FACO, i.e. opt.islands_ colonies with
+ * different parameters (see get_colony_options), each using its own group of
+ * threads (nested OpenMP parallel region). Every opt.migration_interval_
+ * iterations the colonies exchange their best solutions through the
+ * MigrationRing. Apart from that the colonies run independently.
+ */
+template<typename ComputationsLog_t>
+std::unique_ptr<Solution>
+run_island_faco(const ProblemInstance &problem,
+                const ProgramOptions &opt,
+                ComputationsLog_t &comp_log) {
+    using LogMap_t = std::decay_t<decltype(comp_log.log_)>;
+
+    const auto islands = opt.islands_;
+    const auto threads_per_island = std::max(1, omp_get_max_threads()
+                                                / static_cast<int32_t>(islands));
+    MigrationRing ring(islands);
+    vector<IslandContext> contexts(islands);
+    vector<LogMap_t> island_records(islands);
+    vector<unique_ptr<Solution>> results(islands);
+    Timer main_timer;
+
+    // The seeds of the colonies are drawn from the RNG of the calling thread,
+    // so the next trial continues its sequence instead of repeating this one.
+    // The k-th thread of a colony is seeded from the colony's seed as the
+    // k-th thread of a team is by init_random_number_generators
+    for (auto &context : contexts) {
+        context.seed_ = get_rng()();
+    }
+
+    const auto prev_max_active_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+
+    #pragma omp parallel num_threads(islands) default(shared)
+    {
+        const auto colony = static_cast<uint32_t>(omp_get_thread_num());
+        const auto colony_opt = get_colony_options(opt, colony);
+
+        auto &context = contexts[colony];
+        context.ring_ = &ring;
+        context.colony_ = colony;
+        context.migration_interval_ = opt.migration_interval_;
+
+        omp_set_num_threads(threads_per_island);
+
+        std::ostream null_out(nullptr);  // The colonies' progress is not printed
+        ComputationsLog_t colony_log(island_records[colony], null_out);
+        dump(colony_opt, island_records[colony]["args"]);
+
+        results[colony] = run_faco_colony(problem, colony_opt, colony_log, &context);
+    }
+    omp_set_max_active_levels(prev_max_active_levels);
+
+    vector<double> island_costs;
+    vector<MigrationEvent> migrations;
+    int64_t accepted_migrations = 0;
+    int32_t completed_iterations = 0;  // Can be < opt.iterations_ if the time limit is set
+    for (uint32_t colony = 0; colony < islands; ++colony) {
+        island_costs.push_back(results[colony]->cost_);
+        completed_iterations = std::max(completed_iterations,
+                                        island_records[colony].value("completed iterations", 0));
+        for (auto &event : contexts[colony].events_) {
+            migrations.push_back(event);
+            accepted_migrations += event.accepted_ ? 1 : 0;
+        }
+    }
+    std::sort(migrations.begin(), migrations.end(),
+              [](const MigrationEvent &a, const MigrationEvent &b) { return a.time_ < b.time_; });
+
+    comp_log("islands", islands);
+    comp_log("threads per island", threads_per_island);
+    comp_log("island costs", island_costs);
+    comp_log("accepted migrations", accepted_migrations);
+    comp_log("migrations", migrations);
+    comp_log("island logs", island_records);
+    comp_log("iterations per sec", round(completed_iterations / main_timer(), 3));
+
+    auto best = std::min_element(results.begin(), results.end(),
+                                 [](const auto &a, const auto &b) { return a->cost_ < b->cost_; });
+    return std::move(*best);
+}
+
+
 std::string get_results_filename(const ProblemInstance &problem,
                                  const std::string &alg_name) {
     using namespace std;
@@ -837,24 +1432,35 @@ int main(int argc, char *argv[]) {
 
     auto args = parse_program_options(argc, argv);
 
+    // A resumed run without --seed continues with the seed of the checkpoint
+    if (args.seed_ == 0 && args.resume_ && !args.checkpoint_path_.empty()) {
+        CheckpointData checkpoint;
+        try {
+            if (load_checkpoint(args.checkpoint_path_, checkpoint)) {
+                args.seed_ = checkpoint.seed_;
+            }
+        } catch (const std::runtime_error &) {
+            // Reported when the run loads the checkpoint
+        }
+    }
     if (args.seed_ == 0) {
         std::random_device rd;
         args.seed_ = rd();
     }
-    init_random_number_generators(args.seed_);
-
+    // Has to be set before the RNGs are initialized as each thread has its
+    // own generator
     if (args.threads_ > 0) {
         cout << "Setting # threads:" << args.threads_ << endl;
         omp_set_num_threads(args.threads_);
     }
 
+    init_random_number_generators(args.seed_);
+
     if (args.dump_log_) {
-        cout << "LOCAL SEARCH DUMP ENABLED: dumping to stats.txt!\n";
+        cout << "LOCAL SEARCH DUMP ENABLED: dumping to stats.bin!\n";
         DUMP_LOG = true;
-        if (args.iterations_ > 24) {
-            cout << "WARNING: reduce number of iterations to less than 25. Local search logging takes up a lot of space.\n";
-            exit(0); // kill program
-        }
+        // Each record holds two routes, i.e. the trace grows by about
+        // 8 * dimension bytes per ant and iteration
         cout << endl;
     }
 
@@ -862,32 +1468,65 @@ int main(int argc, char *argv[]) {
         json experiment_record;
         Log exp_log(experiment_record, std::cout);
 
-        auto problem = load_tsplib_instance(args.problem_path_.c_str());
+        Timer load_timer;
+        auto nn_count = std::max(args.cand_list_size_ + args.backup_list_size_,
+                                 args.ls_cand_list_size_);
+        const auto distances_budget = (args.distances_memory_mb_ > 0)
+                                    ? static_cast<uint64_t>(args.distances_memory_mb_) << 20
+                                    : get_auto_distances_memory_budget();
+        auto problem = args.instance_cache_
+                     ? load_tsplib_instance_cached(args.problem_path_.c_str(), nn_count,
+                                                   distances_budget)
+                     : load_tsplib_instance(args.problem_path_.c_str(), distances_budget);
         load_best_known_solutions("best-known.json");
         problem.best_known_cost_ = get_best_known_value(problem.name_, -1);
 
-        Timer nn_lists_timer;
-        auto nn_count = std::max(args.cand_list_size_ + args.backup_list_size_,
-                                 args.ls_cand_list_size_);
-        problem.compute_nn_lists(nn_count);
-        exp_log("nn and backup lists calc time", nn_lists_timer());
+        if (!args.instance_cache_) {
+            problem.compute_nn_lists(nn_count);
+        }
+        exp_log("nn and backup lists calc time", problem.nn_lists_build_time_);
+        exp_log("instance load time", load_timer());
+        exp_log("distances", ProblemInstance::get_distance_tier_name(problem.distance_tier_));
+        exp_log("distances memory budget mb", distances_budget >> 20);
 
         aco_fn alg = nullptr;
         if (args.algorithm_ == "faco") {
-            alg = run_focused_aco;
+            if (args.islands_ > 1) {
+                alg = run_island_faco;
+            } else {
+                alg = run_focused_aco;
+            }
 
             if (args.ants_count_ == 0) {
                 auto r = 4 * sqrt(problem.dimension_);
                 args.ants_count_ = static_cast<uint32_t>(lround(r / 64) * 64);
             }
-        } else if (args.algorithm_ == "mmas") {
-            alg = run_mmas<CandListModel>;
+        } else if (args.algorithm_ == "mmas" || args.algorithm_ == "mmas-matrix") {
+            // mmas-matrix stores the pheromone for all the edges
+            if (args.algorithm_ == "mmas") {
+                alg = run_mmas<CandListModel>;
+            } else {
+                alg = run_mmas<MatrixModel>;
+            }
 
             if (args.ants_count_ == 0) {
                 args.ants_count_ = problem.dimension_;
             }
         }
 
+        // In the thread scaling mode the i-th execution uses thread_counts[i]
+        // threads
+        vector<int32_t> thread_counts;
+        if (args.thread_scaling_) {
+            const int32_t max_threads = (args.threads_ > 0) ? args.threads_ : omp_get_num_procs();
+            for (int32_t t = 1; t < max_threads; t *= 2) {
+                thread_counts.push_back(t);
+            }
+            thread_counts.push_back(max_threads);
+            args.repeat_ = static_cast<int32_t>(thread_counts.size());
+        }
+        vector<double> iterations_per_sec;
+
         dump(args, experiment_record["args"]);
         experiment_record["executions"] = json::array();
         vector<double> costs;
@@ -901,6 +1540,12 @@ int main(int argc, char *argv[]) {
             Log exlog(execution_log, std::cout);
             exlog("started_at", get_current_datetime_string("-", ":", "T", true));
 
+            if (args.thread_scaling_) {
+                cout << "Setting # threads:" << thread_counts[i] << endl;
+                omp_set_num_threads(thread_counts[i]);
+                init_random_number_generators(args.seed_);
+            }
+
             Timer execution_timer;
             auto result = alg(problem, args, exlog);
 
@@ -912,11 +1557,25 @@ int main(int argc, char *argv[]) {
             experiment_record["executions"].emplace_back(execution_log);
 
             costs.push_back(result->cost_);
+            iterations_per_sec.push_back(execution_log.value("iterations per sec", 0.0));
 
             bool is_last_execution = (i + 1 == args.repeat_);
             if (is_last_execution) {
                 exp_log("trial time", trial_timer());
 
+                if (args.thread_scaling_) {
+                    vector<double> speedups;
+                    for (size_t j = 0; j < thread_counts.size(); ++j) {
+                        speedups.push_back(round(iterations_per_sec[j] / iterations_per_sec[0], 2));
+                        cout << "Threads: " << thread_counts[j]
+                             << "\titerations/sec: " << iterations_per_sec[j]
+                             << "\tspeedup: " << speedups.back() << "\n";
+                    }
+                    exp_log("thread scaling threads", thread_counts);
+                    exp_log("thread scaling iterations per sec", iterations_per_sec);
+                    exp_log("thread scaling speedup", speedups);
+                }
+
                 if (args.save_route_picture_) {
                     auto filename = ((!problem.name_.empty()) ? problem.name_ : "route") + ".svg";
                     auto svg_path = get_results_dir_path(args) / filename;
@@ -0,0 +1,153 @@
+/**
+ * Island model of the FACO: a number of independent colonies (islands), each
+ * run by its own group of threads, which periodically exchange their best
+ * solutions.
+ *
+ * The colonies are connected in a (unidirectional) ring: every K iterations
+ * colony i publishes its best solution in its slot of the MigrationRing and
+ * checks the slot of colony (i - 1) mod N. The immigrant solution replaces the
+ * colony's best solution only if it is shorter.
+*/
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "progargs.h"
+
+
+struct MigrationEvent {
+    int32_t  iteration_ = 0;  // Iteration of the receiving colony
+    double   time_ = 0;       // Time of the receiving colony (sec.)
+    uint32_t from_ = 0;       // Source colony
+    uint32_t to_ = 0;         // Receiving colony
+    double   cost_ = 0;       // Cost of the immigrant solution
+    double   local_cost_ = 0; // Cost of the receiving colony's best sol.
+    bool     accepted_ = false;
+
+    template<typename Json>
+    friend void to_json(Json& j, const MigrationEvent& e) {
+        j = Json{ { "iteration", e.iteration_ },
+                  { "time", e.time_ },
+                  { "from", e.from_ },
+                  { "to", e.to_ },
+                  { "cost", e.cost_ },
+                  { "local cost", e.local_cost_ },
+                  { "accepted", e.accepted_ } };
+    }
+};
+
+
+/**
+ * Shared memory through which the colonies exchange their best solutions.
+ * Each colony has its own slot, which is written only by that colony, so the
+ * lock is held only while a route is copied.
+ */
+class MigrationRing {
+    struct Slot {
+        std::mutex mutex_;
+        uint64_t version_ = 0;  // Incremented on every publish
+        std::vector<uint32_t> route_;
+        double cost_ = std::numeric_limits<double>::max();
+    };
+
+    std::vector<Slot> slots_;
+
+public:
+    explicit MigrationRing(uint32_t colonies_count)
+        : slots_(colonies_count) {
+    }
+
+    [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(slots_.size()); }
+
+    // Returns the colony from which the given colony receives solutions
+    [[nodiscard]] uint32_t get_source(uint32_t colony) const {
+        return (colony + size() - 1) % size();
+    }
+
+    void publish(uint32_t colony, const std::vector<uint32_t> &route, double cost) {
+        auto &slot = slots_.at(colony);
+        std::lock_guard<std::mutex> lock(slot.mutex_);
+        slot.route_ = route;
+        slot.cost_ = cost;
+        ++slot.version_;
+    }
+
+    /*
+     * Copies the solution published by the source colony of the given colony
+     * if it has changed since the last_version. Returns true if it was copied.
+     */
+    bool receive(uint32_t colony, uint64_t &last_version,
+                 std::vector<uint32_t> &route, double &cost) {
+        auto &slot = slots_.at(get_source(colony));
+        std::lock_guard<std::mutex> lock(slot.mutex_);
+        if (slot.version_ == last_version) {
+            return false;
+        }
+        last_version = slot.version_;
+        route = slot.route_;
+        cost = slot.cost_;
+        return true;
+    }
+};
+
+
+// State of a single colony taking part in the migrations
+struct IslandContext {
+    MigrationRing *ring_ = nullptr;
+    uint32_t colony_ = 0;
+    uint32_t migration_interval_ = 0;
+    uint64_t seed_ = 0;  // Seed of the colony's RNGs
+    uint64_t last_received_version_ = 0;
+    std::vector<MigrationEvent> events_;
+
+    [[nodiscard]] bool is_migration_iteration(int32_t iteration) const {
+        return migration_interval_ > 0
+            && (iteration + 1) % static_cast<int32_t>(migration_interval_) == 0;
+    }
+};
+
+
+/**
+ * Parses a comma separated list of values, e.g. "0.5,0.8,0.9".
+ */
+template<typename T>
+std::vector<T> parse_values_list(const std::string &list) {
+    std::vector<T> values;
+    std::istringstream in(list);
+    std::string token;
+    while (std::getline(in, token, ',')) {
+        if (!token.empty()) {
+            std::istringstream token_in(token);
+            T value;
+            token_in >> value;
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+
+/**
+ * Returns the options of the given colony. The per-island values of rho,
+ * min_new_edges and gbest_as_source_prob are taken (cyclically) from the
+ * corresponding lists, or are left unchanged if a list is empty.
+ */
+inline ProgramOptions get_colony_options(const ProgramOptions &opt, uint32_t colony) {
+    ProgramOptions colony_opt = opt;
+
+    if (auto values = parse_values_list<double>(opt.island_rho_); !values.empty()) {
+        colony_opt.rho_ = values[colony % values.size()];
+    }
+    if (auto values = parse_values_list<uint32_t>(opt.island_min_new_edges_); !values.empty()) {
+        colony_opt.min_new_edges_ = values[colony % values.size()];
+    }
+    if (auto values = parse_values_list<double>(opt.island_gbest_prob_); !values.empty()) {
+        colony_opt.gbest_as_source_prob_ = values[colony % values.size()];
+    }
+    return colony_opt;
+}
@@ -81,6 +81,8 @@ public:
     int nn_pt_idx_ = 0;
     double nn_dist_ = 0;
 
+    std::vector<uint32_t> pruned_buckets_;  // Emptied by find_nearest_if
+
 
     explicit KDTree(const std::vector<Point> &points) {
         points_ = points;
@@ -316,6 +318,215 @@ public:
     }
 
 
+    // (squared distance, point index) pairs kept in a bounded max-heap
+    using KnnHeap = std::vector<std::pair<double, uint32_t>>;
+
+    /**
+     * Finds k nearest neighbors of the given point and stores them in result,
+     * sorted by the (exact) distance, ties are broken by the point index.
+     *
+     * Unlike nn_bottom_up, this does not modify the tree (no deletions are
+     * needed to find the consecutive neighbors), so it can be called from
+     * many threads simultaneously. The heap is a working buffer which can be
+     * reused between calls to avoid memory allocations.
+     */
+    void knn(uint32_t point_idx, uint32_t k, KnnHeap &heap,
+             std::vector<uint32_t> &result) const {
+        assert(point_idx < points_.size());
+        assert(root_ != Sentinel);
+
+        heap.clear();
+        result.clear();
+        if (k == 0) {
+            return ;
+        }
+        const auto node_id = point_idx_to_node_[point_idx];
+        rknn(node_id, point_idx, k, heap);
+
+        auto *p = &nodes_[node_id];
+        while (p->parent_ != Sentinel) {
+            const auto prev_id = static_cast<uint32_t>(p - nodes_.data());
+            p = &nodes_[p->parent_];
+
+            auto coord = get_coordinate(points_[point_idx], p->cutdim_);
+            auto diff = coord - p->cutval_;
+            if (heap.size() < k || diff * diff <= heap.front().first) {
+                rknn((prev_id == p->left_) ? p->right_ : p->left_, point_idx, k, heap);
+            }
+            // We use + 1 so that TSPLIB rounded distance calculation can be
+            // handled properly
+            if (heap.size() == k
+                    && ball_in_bounds(p->bounds_, point_idx, std::sqrt(heap.front().first) + 1)) {
+                break ;
+            }
+        }
+        std::sort_heap(heap.begin(), heap.end());
+        for (auto [dist, idx] : heap) {
+            result.push_back(idx);
+        }
+    }
+
+
+    void rknn(uint32_t node_id, uint32_t target_idx, uint32_t k, KnnHeap &heap) const {
+        const auto *p = &nodes_[node_id];
+        if (p->is_empty_) {
+            return ;
+        }
+        const auto &target = points_[target_idx];
+
+        if (p->is_bucket()) {
+            for (auto i = p->bucket_start_; i <= p->bucket_end_; i++) {
+                auto pt_id = bucket_points_[i];
+                if (pt_id == target_idx) {
+                    continue ;
+                }
+                const std::pair<double, uint32_t> el { (points_[pt_id] - target).length_squared(), pt_id };
+                if (heap.size() < k) {
+                    heap.push_back(el);
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (el < heap.front()) {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = el;
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        } else {
+            auto diff = get_coordinate(target, p->cutdim_) - p->cutval_;
+            auto near = (diff < 0) ? p->left_ : p->right_;
+            auto far = (diff < 0) ? p->right_ : p->left_;
+
+            rknn(near, target_idx, k, heap);
+            if (heap.size() < k || diff * diff <= heap.front().first) {
+                rknn(far, target_idx, k, heap);
+            }
+        }
+    }
+
+
+    // State of the find_nearest_if search
+    struct NearestIfState {
+        uint32_t best_idx_ = Sentinel;
+        double best_distance_ = std::numeric_limits<double>::max();
+        double min_euclid_ = std::numeric_limits<double>::max();
+
+        // Subtrees farther than this cannot contain a better point
+        [[nodiscard]] double get_radius() const { return min_euclid_ + 1; }
+    };
+
+    /**
+     * Finds the point closest to the given one among the points for which
+     * is_candidate(idx) is true, or returns Sentinel if there is none.
+     *
+     * The points are compared by distance(idx), e.g. the rounded TSPLIB
+     * distance, and ties are broken by the point index. As the rounded
+     * distance differs from the Euclidean by less than 1, all the candidates
+     * closer than the closest one + 1 are checked.
+     *
+     * The buckets without candidates are marked as empty, so that the next
+     * calls skip them and the subtrees made of them, e.g. the regions already
+     * visited by an ant are not scanned again. Hence is_candidate cannot
+     * become true again for a point until restore_pruned_buckets() is
+     * called, and the tree cannot be shared by threads.
+     */
+    template<typename IsCandidate, typename Distance>
+    uint32_t find_nearest_if(uint32_t point_idx,
+                             const IsCandidate &is_candidate,
+                             const Distance &distance) {
+        assert(point_idx < points_.size());
+        assert(root_ != Sentinel);
+
+        NearestIfState state;
+        const auto node_id = point_idx_to_node_[point_idx];
+        rnearest_if(node_id, point_idx, is_candidate, distance, state);
+
+        auto *p = &nodes_[node_id];
+        while (p->parent_ != Sentinel) {
+            const auto prev_id = static_cast<uint32_t>(p - nodes_.data());
+            p = &nodes_[p->parent_];
+
+            auto diff = get_coordinate(points_[point_idx], p->cutdim_) - p->cutval_;
+            if (std::fabs(diff) <= state.get_radius()) {
+                rnearest_if((prev_id == p->left_) ? p->right_ : p->left_,
+                            point_idx, is_candidate, distance, state);
+            }
+            if (state.best_idx_ != Sentinel
+                    && ball_in_bounds(p->bounds_, point_idx, state.get_radius())) {
+                break ;
+            }
+        }
+        return state.best_idx_;
+    }
+
+
+    // Clears the empty marks set by find_nearest_if
+    void restore_pruned_buckets() {
+        for (auto node_id : pruned_buckets_) {
+            auto *p = &nodes_[node_id];
+            while (p != nullptr && p->is_empty_) {
+                p->is_empty_ = false;
+                p = get_parent(*p);
+            }
+        }
+        pruned_buckets_.clear();
+    }
+
+
+    template<typename IsCandidate, typename Distance>
+    void rnearest_if(uint32_t node_id, uint32_t target_idx,
+                     const IsCandidate &is_candidate,
+                     const Distance &distance,
+                     NearestIfState &state) {
+        auto *p = &nodes_[node_id];
+        if (p->is_empty_) {
+            return ;
+        }
+        const auto &target = points_[target_idx];
+
+        if (p->is_bucket()) {
+            bool has_candidates = false;
+            for (auto i = p->bucket_start_; i <= p->bucket_end_; i++) {
+                auto pt_id = bucket_points_[i];
+                if (!is_candidate(pt_id)) {
+                    continue ;
+                }
+                has_candidates = true;
+                if (pt_id == target_idx) {
+                    continue ;
+                }
+                const auto euclid = (points_[pt_id] - target).length();
+                if (euclid > state.get_radius()) {
+                    continue ;
+                }
+                state.min_euclid_ = std::min(state.min_euclid_, euclid);
+                const double dist = distance(pt_id);
+                if (dist < state.best_distance_
+                        || (dist == state.best_distance_ && pt_id < state.best_idx_)) {
+                    state.best_distance_ = dist;
+                    state.best_idx_ = pt_id;
+                }
+            }
+            if (!has_candidates) {
+                pruned_buckets_.push_back(node_id);
+                p->is_empty_ = true;
+                while ( (p = get_parent(*p)) != nullptr
+                        && nodes_[p->left_].is_empty_
+                        && nodes_[p->right_].is_empty_ ) {
+                    p->is_empty_ = true;
+                }
+            }
+        } else {
+            auto diff = get_coordinate(target, p->cutdim_) - p->cutval_;
+            auto near = (diff < 0) ? p->left_ : p->right_;
+            auto far = (diff < 0) ? p->right_ : p->left_;
+
+            rnearest_if(near, target_idx, is_candidate, distance, state);
+            if (std::fabs(diff) <= state.get_radius()) {
+                rnearest_if(far, target_idx, is_candidate, distance, state);
+            }
+        }
+    }
+
+
     [[nodiscard]] double get_distance(size_t first_pt_idx, size_t second_pt_idx) const {
         const auto &a = points_[first_pt_idx];
         const auto &b = points_[second_pt_idx];
@@ -4,6 +4,7 @@
 #include <array>
 #include <algorithm>
 #include <numeric>
+#include <queue>
 
 #include "local_search.h"
 #include "utils.h"
@@ -94,6 +95,306 @@ void flip_route_section(std::vector<uint32_t> &route,
 }
 
 
+/*
+ * Queue of the nodes which should be checked for an improving move, i.e.
+ * nodes with the don't look bits cleared. Walking over a whole linked-list
+ * tour to find such nodes (as it is done for the vector route) is
+ * expensive, hence the queue.
+ */
+struct ActiveNodesQueue {
+    std::vector<uint32_t> queue_;  // Circular buffer
+    Bitmask in_queue_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+
+    explicit ActiveNodesQueue(uint32_t nodes_count)
+        : queue_(nodes_count),
+          in_queue_(nodes_count) {
+    }
+
+    // Initially all nodes are active, in the order of the tour
+    explicit ActiveNodesQueue(const TwoLevelList &tour)
+        : ActiveNodesQueue(tour.size()) {
+        uint32_t node = 0;
+        for (uint32_t i = 0; i < tour.size(); ++i) {
+            push(node);
+            node = tour.succ(node);
+        }
+    }
+
+    [[nodiscard]] bool empty() const { return count_ == 0; }
+
+    uint32_t pop() {
+        auto node = queue_[head_];
+        head_ = (head_ + 1 < queue_.size()) ? head_ + 1 : 0;
+        --count_;
+        in_queue_.clear_bit(node);
+        return node;
+    }
+
+    void push(uint32_t node) {
+        if (!in_queue_[node]) {
+            auto tail = head_ + count_;
+            queue_[tail < queue_.size() ? tail : tail - queue_.size()] = node;
+            ++count_;
+            in_queue_.set_bit(node);
+        }
+    }
+};
+
+
+/*
+ * Active nodes ordered by the (estimated) gain -- nodes with the highest
+ * gain are returned first.
+ */
+struct GainOrderedQueue {
+    std::priority_queue<std::pair<double, uint32_t>> queue_;
+    Bitmask in_queue_;
+
+    explicit GainOrderedQueue(uint32_t nodes_count)
+        : in_queue_(nodes_count) {
+    }
+
+    [[nodiscard]] bool empty() const { return queue_.empty(); }
+
+    uint32_t pop() {
+        auto node = queue_.top().second;
+        queue_.pop();
+        in_queue_.clear_bit(node);
+        return node;
+    }
+
+    // If the node is already in the queue, its gain is not updated
+    void push(uint32_t node, double gain) {
+        if (!in_queue_[node]) {
+            queue_.emplace(gain, node);
+            in_queue_.set_bit(node);
+        }
+    }
+};
+
+
+/**
+ * The 2-opt heuristic working on the two-level doubly-linked list tour.
+ * A 2-opt move is a single path reversal, which takes O(sqrt(n)) time.
+ *
+ * If use_dont_look_bits is true, only the nodes from the queue of active
+ * nodes are checked, otherwise the tour is scanned circularly until n
+ * consecutive nodes do not yield any improvement.
+ *
+ * Returns a number of changes (moves) applied to the tour.
+ */
+int64_t two_opt_nn(const ProblemInstance &instance,
+                   TwoLevelList &tour,
+                   bool use_dont_look_bits,
+                   uint32_t nn_count) {
+    assert(instance.is_symmetric_);
+
+    const auto route_size = tour.size();
+
+    ActiveNodesQueue active(tour);
+
+    const int64_t MaxChanges = UINT64_C(10) * route_size;
+    int64_t changes_count = 0;
+
+    uint32_t a = 0;
+    uint32_t unimproved_count = 0;  // Consecutive nodes without an improvement
+
+    while (changes_count < MaxChanges) {
+        if (use_dont_look_bits) {
+            if (active.empty()) {
+                break ;
+            }
+            a = active.pop();
+        } else if (unimproved_count == route_size) {
+            break ;
+        }
+
+        const auto a_next = tour.succ(a);
+        const auto a_prev = tour.pred(a);
+
+        const auto dist_a_to_next = instance.get_distance(a, a_next);
+        const auto dist_a_to_prev = instance.get_distance(a, a_prev);
+
+        double max_diff = -1;
+        bool is_next_move = false;
+        uint32_t best_b = 0;
+
+        const auto nn_list = instance.get_nearest_neighbors(a, nn_count);
+        for (uint32_t b_index = 0; b_index < nn_count; ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
+            if (dist_a_to_next > dist_ab) {
+                const auto b_next = tour.succ(b);
+
+                auto diff = dist_a_to_next
+                          + instance.get_distance(b, b_next)
+                          - dist_ab
+                          - instance.get_distance(a_next, b_next);
+
+                if (diff > max_diff) {
+                    max_diff = diff;
+                    is_next_move = true;
+                    best_b = b;
+                }
+            }
+        }
+
+        for (uint32_t b_index = 0; b_index < nn_count; ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
+            if (dist_a_to_prev > dist_ab) {
+                const auto b_prev = tour.pred(b);
+
+                auto diff = dist_a_to_prev
+                          + instance.get_distance(b_prev, b)
+                          - dist_ab
+                          - instance.get_distance(a_prev, b_prev);
+
+                if (diff > max_diff) {
+                    max_diff = diff;
+                    is_next_move = false;
+                    best_b = b;
+                }
+            }
+        }
+
+        if (max_diff > 0) {
+            const auto b = best_b;
+            if (is_next_move) {  // a -> a_next ... b -> b_next
+                const auto b_next = tour.succ(b);
+                tour.reverse_path(a_next, b);  // a -> b ... a_next -> b_next
+
+                active.push(a_next);
+                active.push(b_next);
+            } else {  // a_prev -> a ... b_prev -> b
+                const auto b_prev = tour.pred(b);
+                tour.reverse_path(a, b_prev);  // a_prev -> b_prev ... a -> b
+
+                active.push(a_prev);
+                active.push(b_prev);
+            }
+            active.push(a);
+            active.push(b);
+
+            unimproved_count = 0;
+            ++changes_count;
+        } else if (!use_dont_look_bits) {
+            a = tour.succ(a);
+            ++unimproved_count;
+        }
+    }
+    return changes_count;
+}
+
+
+/**
+ * The checklist based 2-opt heuristic working on the two-level
+ * doubly-linked list tour.
+ */
+int64_t two_opt_nn(const ProblemInstance &instance,
+                   TwoLevelList &tour,
+                   std::vector<uint32_t> &checklist,
+                   uint32_t nn_list_size,
+                   LocalSearchStats *stats) {
+    assert(instance.is_symmetric_);
+
+    const uint32_t MaxChanges = tour.size();
+    uint32_t changes_count = 0;
+
+    int64_t evaluated_count = 0;
+
+    size_t checklist_pos_pos = 0;
+    while (checklist_pos_pos < checklist.size() && changes_count < MaxChanges) {
+        auto a = checklist[checklist_pos_pos++];
+        assert(a < instance.dimension_);
+
+        const auto a_next = tour.succ(a);
+        const auto a_prev = tour.pred(a);
+
+        const auto dist_a_to_next = instance.get_distance(a, a_next);
+        const auto dist_a_to_prev = instance.get_distance(a, a_prev);
+
+        double max_diff = -1;
+        bool is_next_move = false;
+        uint32_t best_b = 0;
+
+        const auto &nn_list = instance.get_nearest_neighbors(a, nn_list_size);
+
+        for (uint32_t b_index = 0; b_index < nn_list.size(); ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
+            if (dist_a_to_next > dist_ab) {
+                const auto b_next = tour.succ(b);
+
+                ++evaluated_count;
+                auto diff = dist_a_to_next
+                          + instance.get_distance(b, b_next)
+                          - dist_ab
+                          - instance.get_distance(a_next, b_next);
+
+                if (diff > max_diff) {
+                    max_diff = diff;
+                    is_next_move = true;
+                    best_b = b;
+                }
+            } else {
+                break ;
+            }
+        }
+
+        for (uint32_t b_index = 0; b_index < nn_list.size(); ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
+            if (dist_a_to_prev > dist_ab) {
+                const auto b_prev = tour.pred(b);
+
+                ++evaluated_count;
+                auto diff = dist_a_to_prev
+                          + instance.get_distance(b_prev, b)
+                          - dist_ab
+                          - instance.get_distance(a_prev, b_prev);
+
+                if (diff > max_diff) {
+                    max_diff = diff;
+                    is_next_move = false;
+                    best_b = b;
+                }
+            } else {
+                break ;
+            }
+        }
+
+        if (max_diff > 0) {
+            const auto b = best_b;
+            uint32_t endpoints[4];
+            if (is_next_move) {
+                const auto b_next = tour.succ(b);
+                tour.reverse_path(a_next, b);
+                endpoints[0] = b; endpoints[1] = a_next; endpoints[2] = a; endpoints[3] = b_next;
+            } else {
+                const auto b_prev = tour.pred(b);
+                tour.reverse_path(a, b_prev);
+                endpoints[0] = b_prev; endpoints[1] = a; endpoints[2] = a_prev; endpoints[3] = b;
+            }
+
+            for (auto x : endpoints) {
+                if (std::find(checklist.begin() + static_cast<int32_t>(checklist_pos_pos),
+                              checklist.end(), x) == checklist.end()) {
+                    checklist.push_back(x);
+                }
+            }
+            ++changes_count;
+        }
+    }
+    if (stats != nullptr) {
+        stats->evaluated_moves_ += evaluated_count;
+        stats->applied_moves_ += changes_count;
+    }
+    return changes_count;
+}
+
+
 /**
  * This is an implementation of an approximate 2-opt heuristic which uses the
  * nearest neighbor lists to limit the search for an improving move.
@@ -103,9 +404,17 @@ void flip_route_section(std::vector<uint32_t> &route,
 int64_t two_opt_nn(const ProblemInstance &instance,
                    std::vector<uint32_t> &route,
                    bool use_dont_look_bits,
-                   uint32_t nn_count) {
+                   uint32_t nn_count,
+                   TourRepresentation repr) {
 // #pragma HLS disaggregate variable = instance
 // #pragma HLS disaggregate variable = route
+    if (repr == TourRepresentation::TwoLevelList) {
+        TwoLevelList tour(route);
+        const auto changes = two_opt_nn(instance, tour, use_dont_look_bits, nn_count);
+        tour.to_vector(route);
+        assert(instance.is_route_valid(route));
+        return changes;
+    }
     // We assume symmetry so that the order of the nodes does not matter
     assert(instance.is_symmetric_);
 
@@ -145,10 +454,10 @@ int64_t two_opt_nn(const ProblemInstance &instance,
             uint32_t left = 0;
             uint32_t right = 0;
 
-            uint32_t b_index = 0;
-            for (auto b : instance.get_nearest_neighbors(a, nn_count)) {
-                auto dist_ab = instance.get_distance(a, b);
-                ++b_index;
+            const auto nn_list = instance.get_nearest_neighbors(a, nn_count);
+            for (uint32_t b_index = 0; b_index < nn_count; ++b_index) {
+                const auto b = nn_list[b_index];
+                auto dist_ab = instance.get_nn_distance(a, b_index);
 
                 auto b_pos = pos_in_route[b];
 
@@ -168,10 +477,9 @@ int64_t two_opt_nn(const ProblemInstance &instance,
                 }
             }
 
-            b_index = 0;
-            for (auto b : instance.get_nearest_neighbors(a, nn_count)) {
-                auto dist_ab = instance.get_distance(a, b);
-                ++b_index;
+            for (uint32_t b_index = 0; b_index < nn_count; ++b_index) {
+                const auto b = nn_list[b_index];
+                auto dist_ab = instance.get_nn_distance(a, b_index);
 
                 auto b_pos = pos_in_route[b];
                 if (dist_a_to_prev > dist_ab) {
@@ -228,8 +536,17 @@ int64_t two_opt_nn(const ProblemInstance &instance,
 int64_t two_opt_nn(const ProblemInstance &instance,
                    std::vector<uint32_t> &route,
                    std::vector<uint32_t> &checklist,
-                   uint32_t nn_list_size) {
-
+                   uint32_t nn_list_size,
+                   TourRepresentation repr,
+                   LocalSearchStats *stats) {
+
+    if (repr == TourRepresentation::TwoLevelList) {
+        TwoLevelList tour(route);
+        const auto changes = two_opt_nn(instance, tour, checklist, nn_list_size, stats);
+        tour.to_vector(route);
+        assert(instance.is_route_valid(route));
+        return changes;
+    }
     // We assume symmetry so that the order of the nodes does not matter
     assert(instance.is_symmetric_);
 
@@ -246,6 +563,8 @@ int64_t two_opt_nn(const ProblemInstance &instance,
     const uint32_t MaxChanges = route_size;
     uint32_t changes_count = 0;
 
+    int64_t evaluated_count = 0;
+
     size_t checklist_pos_pos = 0;
     while (checklist_pos_pos < checklist.size() && changes_count < MaxChanges) {
         auto a = checklist[checklist_pos_pos++];
@@ -264,8 +583,9 @@ int64_t two_opt_nn(const ProblemInstance &instance,
 
         const auto &nn_list = instance.get_nearest_neighbors(a, nn_list_size);
 
-        for (auto b : nn_list) {
-            auto dist_ab = instance.get_distance(a, b);
+        for (uint32_t b_index = 0; b_index < nn_list.size(); ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
             if (dist_a_to_next > dist_ab) {
                 // We rotate the section between a and b_next so that
                 // two new (undirected) edges are created: { a, b } and { a_next, b_next }
@@ -280,6 +600,7 @@ int64_t two_opt_nn(const ProblemInstance &instance,
                 auto b_pos = pos_in_route[b];
                 auto b_next = (b_pos + 1 < route_size) ? route[b_pos + 1] : route[0];
 
+                ++evaluated_count;
                 auto diff = dist_a_to_next
                           + instance.get_distance(b, b_next)
                           - dist_ab
@@ -295,8 +616,9 @@ int64_t two_opt_nn(const ProblemInstance &instance,
             }
         }
 
-        for (auto b : nn_list) {
-            auto dist_ab = instance.get_distance(a, b);
+        for (uint32_t b_index = 0; b_index < nn_list.size(); ++b_index) {
+            const auto b = nn_list[b_index];
+            auto dist_ab = instance.get_nn_distance(a, b_index);
             if (dist_a_to_prev > dist_ab) {
                 // We rotate the section between a_prev and b so that
                 // two new (undirected) edges are created: { a, b } and { a_prev, b_prev }
@@ -311,6 +633,7 @@ int64_t two_opt_nn(const ProblemInstance &instance,
                 auto b_pos = pos_in_route[b];
                 auto b_prev = (b_pos > 0) ? route[b_pos-1] : route[route_size-1];
 
+                ++evaluated_count;
                 auto diff = dist_a_to_prev
                           + instance.get_distance(b_prev, b)
                           - dist_ab
@@ -348,6 +671,10 @@ int64_t two_opt_nn(const ProblemInstance &instance,
         }
     }
     assert(instance.is_route_valid(route));
+    if (stats != nullptr) {
+        stats->evaluated_moves_ += evaluated_count;
+        stats->applied_moves_ += changes_count;
+    }
     return changes_count;
 }
 
@@ -514,6 +841,337 @@ void perform_3_opt_move(std::vector<uint32_t> &route,
 }
 
 
+/*
+ * The 3-opt heuristic working on the two-level doubly-linked list tour.
+ * Each of the 3-opt moves is performed as a sequence of at most 3 path
+ * reversals. Let s0 = (z_1 .. x), s1 = (x_1 .. y), s2 = (y_1 .. z), then:
+ *
+ * s0 s1' s2'  -- reverse s1, reverse s2
+ * s0 s2  s1   -- reverse s1 s2, then s2' and s1'
+ * s0 s2' s1   -- reverse s1 s2, then s1'
+ * s0 s2  s1'  -- reverse s1 s2, then s2'
+ *
+ * As in the 2-opt, the don't look bits are replaced with a queue of active
+ * nodes.
+ *
+ * Returns a number of changes (moves) applied to the tour.
+ */
+int64_t three_opt_nn(const ProblemInstance &instance,
+                     TwoLevelList &tour,
+                     bool use_dont_look_bits,
+                     uint32_t nn_count) {
+    using namespace std;
+
+    assert( instance.is_symmetric_ );
+
+    const auto len = tour.size();
+
+    ActiveNodesQueue active(tour);
+
+    int64_t two_opt_changes = 0;
+    int64_t three_opt_changes = 0;
+
+    uint32_t at_i = 0;
+    uint32_t unimproved_count = 0;
+
+    while (true) {
+        if (use_dont_look_bits) {
+            if (active.empty()) {
+                break ;
+            }
+            at_i = active.pop();
+        } else if (unimproved_count == len) {
+            break ;
+        }
+        bool found_improvement = false;
+        const auto &i_nn_list = instance.get_nearest_neighbors(at_i, nn_count);
+
+        for (auto i_nn_idx = 0u; i_nn_idx < nn_count && !found_improvement; ++i_nn_idx) {
+            const auto at_j = i_nn_list[i_nn_idx];
+            const auto at_i_1 = tour.succ(at_i);
+
+            const auto dist_i_to_next = instance.get_distance(at_i, at_i_1);
+            const auto dist_i_to_j = instance.get_nn_distance(at_i, i_nn_idx);
+
+            if (dist_i_to_next < dist_i_to_j) {
+                break ;
+            }
+
+            const auto at_j_1 = tour.succ(at_j);
+
+            auto cost_before_2opt = dist_i_to_next
+                                  + instance.get_distance(at_j, at_j_1);
+
+            auto cost_after_2opt = dist_i_to_j
+                                 + instance.get_distance(at_i_1, at_j_1);
+
+            if (cost_after_2opt < cost_before_2opt) {
+                tour.reverse_path(at_i_1, at_j);
+
+                found_improvement = true;
+
+                active.push(at_i);
+                active.push(at_i_1);
+
+                active.push(at_j);
+                active.push(at_j_1);
+
+                ++two_opt_changes;
+
+                continue ;
+            }
+
+            const auto &j_nn_list = instance.get_nearest_neighbors(at_j, nn_count);
+
+            assert(at_i != at_j);
+
+            for (auto j_nn_idx = 0u; j_nn_idx < nn_count && !found_improvement ; ++j_nn_idx) {
+                const auto at_k = j_nn_list[j_nn_idx];
+
+                if (at_k == at_i) {
+                    continue ;
+                }
+
+                uint32_t at_x = at_i;
+                uint32_t at_y = at_j;
+                uint32_t at_z = at_k;
+                auto x = tour.sequence(at_x);
+                auto y = tour.sequence(at_y);
+                auto z = tour.sequence(at_z);
+
+                // Sort (x, y, z) in the order of the tour
+                if (x > y) { swap(x, y); swap(at_x, at_y); }
+                if (x > z) { swap(x, z); swap(at_x, at_z); }
+                if (y > z) { swap(y, z); swap(at_y, at_z); }
+
+                const auto at_x_1 = tour.succ(at_x);
+                const auto at_y_1 = tour.succ(at_y);
+                const auto at_z_1 = tour.succ(at_z);
+
+                const auto curr = instance.get_distance(at_x, at_x_1)
+                                + instance.get_distance(at_y, at_y_1)
+                                + instance.get_distance(at_z, at_z_1);
+
+                const array<pair<uint32_t, uint32_t>, 4 * 3> edges{{
+                    { at_y, at_x   }, { at_z_1, at_y_1 }, {   at_z, at_x_1 },
+                    { at_y, at_z_1 }, {   at_x, at_y_1 }, {   at_z, at_x_1 },
+                    { at_y, at_z_1 }, {   at_x, at_z   }, { at_y_1, at_x_1 },
+                    { at_y, at_z   }, { at_y_1, at_x   }, { at_z_1, at_x_1 }
+                }};
+
+                for (auto l = 0u; l < 4 * 3 && !found_improvement; l += 3) {
+                    auto e1 = edges[l + 0];
+                    auto e2 = edges[l + 1];
+                    auto e3 = edges[l + 2];
+
+                    const auto cost = instance.get_distance(e1.first, e1.second)
+                                    + instance.get_distance(e2.first, e2.second)
+                                    + instance.get_distance(e3.first, e3.second);
+
+                    if (cost < curr) {
+                        found_improvement = true;
+
+                        if (l == 0) {
+                            tour.reverse_path(at_x_1, at_y);
+                            tour.reverse_path(at_y_1, at_z);
+                        } else {
+                            tour.reverse_path(at_x_1, at_z);  // s0 s2' s1'
+                            if (l != 6) {
+                                tour.reverse_path(at_z, at_y_1);
+                            }
+                            if (l != 9) {
+                                tour.reverse_path(at_y, at_x_1);
+                            }
+                        }
+                        active.push(e1.first);
+                        active.push(e1.second);
+
+                        active.push(e2.first);
+                        active.push(e2.second);
+
+                        active.push(e3.first);
+                        active.push(e3.second);
+
+                        ++three_opt_changes;
+                    }
+                }
+            }
+        }
+        if (found_improvement) {
+            unimproved_count = 0;
+        } else if (!use_dont_look_bits) {
+            at_i = tour.succ(at_i);
+            ++unimproved_count;
+        }
+    }
+    return two_opt_changes + three_opt_changes;
+}
+
+
+/*
+ * Looks for an improving 2-opt or 3-opt move which removes the edge between
+ * the node at position i of the route and its successor. The first
+ * improving move found is performed and pos_in_route is updated
+ * accordingly. The endpoints of the new edges are stored in touched.
+ *
+ * Returns true if the route was changed.
+ */
+static bool three_opt_nn_at(const ProblemInstance &instance,
+                            std::vector<uint32_t> &route,
+                            std::vector<uint32_t> &pos_in_route,
+                            uint32_t i,
+                            uint32_t nn_count,
+                            std::vector<uint32_t> &touched,
+                            LocalSearchStats &stats) {
+    using namespace std;
+
+    const auto len = static_cast<uint32_t>(route.size());
+    const auto at_i = route[i];
+    const auto &i_nn_list = instance.get_nearest_neighbors(at_i, nn_count);
+
+    touched.clear();
+
+    for (auto i_nn_idx = 0u; i_nn_idx < nn_count; ++i_nn_idx) {
+        const auto at_j = i_nn_list[i_nn_idx];
+        const auto j = pos_in_route[at_j];
+
+        // Check for 2-opt move
+        const auto i_1 = (i + 1) % len;
+        const auto j_1 = (j + 1) % len;
+        const auto at_i_1 = route[i_1];
+
+        const auto dist_i_to_next = instance.get_distance(at_i, at_i_1);
+        const auto dist_i_to_j = instance.get_nn_distance(at_i, i_nn_idx);
+
+        // This shortens time considerably although results in longer tours
+        if (dist_i_to_next < dist_i_to_j) {
+            break ;
+        }
+
+        const auto at_j_1 = route[j_1];
+
+        auto cost_before_2opt = dist_i_to_next
+                              + instance.get_distance(at_j, at_j_1);
+
+        auto cost_after_2opt = dist_i_to_j
+                             + instance.get_distance(at_i_1, at_j_1);
+
+        ++stats.evaluated_moves_;
+
+        if (cost_after_2opt < cost_before_2opt) {
+            // The same as perform_2_opt_move but also updates pos_in_route
+            flip_route_section(route, pos_in_route,
+                               static_cast<int32_t>(i + 1), static_cast<int32_t>(j + 1));
+
+            touched = { at_i, at_i_1, at_j, at_j_1 };
+            ++stats.applied_moves_;
+            return true;
+        }
+
+        const auto &j_nn_list = instance.get_nearest_neighbors(at_j, nn_count);
+
+        assert(at_i != at_j);  // These two should be different
+
+        for (auto j_nn_idx = 0u; j_nn_idx < nn_count; ++j_nn_idx) {
+            const auto at_k = j_nn_list[j_nn_idx];
+            const auto k = pos_in_route[at_k];
+
+            if (k == len || k == i) {  // Unlikely but possible, we want at_i != at_j != at_k
+                continue ;
+            }
+
+            uint32_t x = i;
+            uint32_t y = j;
+            uint32_t z = k;
+            uint32_t at_x = at_i;
+            uint32_t at_y = at_j;
+            uint32_t at_z = at_k;
+
+            // Sort (x, y, z)
+            if (x > y) { swap(x, y); swap(at_x, at_y); }
+            if (x > z) { swap(x, z); swap(at_x, at_z); }
+            if (y > z) { swap(y, z); swap(at_y, at_z); }
+
+            const auto x_1 = (x + 1) % len;
+            const auto y_1 = (y + 1) % len;
+            const auto z_1 = (z + 1) % len;
+
+            const auto at_x_1 = route[x_1];
+            const auto at_y_1 = route[y_1];
+            const auto at_z_1 = route[z_1];
+
+            const auto curr = instance.get_distance(at_x, at_x_1)
+                            + instance.get_distance(at_y, at_y_1)
+                            + instance.get_distance(at_z, at_z_1);
+
+            // 4 sets of possible new edges to check
+            const array<pair<uint32_t, uint32_t>, 4 * 3> edges{{
+                { at_y, at_x   }, { at_z_1, at_y_1 }, {   at_z, at_x_1 },
+                { at_y, at_z_1 }, {   at_x, at_y_1 }, {   at_z, at_x_1 },
+                { at_y, at_z_1 }, {   at_x, at_z   }, { at_y_1, at_x_1 },
+                { at_y, at_z   }, { at_y_1, at_x   }, { at_z_1, at_x_1 }
+            }};
+
+            // Which segments do we need to reverse in order to transform
+            // route so that the new edges are created properly
+            const array<bool, 4 * 3> segment_reversals{{
+                false, true, true,
+                true, true, true,
+                true, true, false,
+                true, false, true
+            }};
+
+            Segment seg[3] = {
+                { z_1, x, len, 0 },
+                { x_1, y, len, 1 },
+                { y_1, z, len, 2 }
+            };
+
+            for (auto l = 0u; l < 4 * 3; l += 3) {
+                auto e1 = edges[l + 0];
+                auto e2 = edges[l + 1];
+                auto e3 = edges[l + 2];
+
+                const auto cost = instance.get_distance(e1.first, e1.second)
+                                + instance.get_distance(e2.first, e2.second)
+                                + instance.get_distance(e3.first, e3.second);
+
+                ++stats.evaluated_moves_;
+
+                if (cost < curr) {
+                    // perform_3_opt_move keeps the longest segment intact,
+                    // only the positions of the nodes outside of it change
+                    Segment kept = seg[0];
+                    if (kept.size() < seg[1].size()) { kept = seg[1]; }
+                    if (kept.size() < seg[2].size()) { kept = seg[2]; }
+
+                    if (segment_reversals[l + 0]) {
+                        seg[0].reverse();
+                    }
+                    if (segment_reversals[l + 1]) {
+                        seg[1].reverse();
+                    }
+                    if (segment_reversals[l + 2]) {
+                        seg[2].reverse();
+                    }
+                    perform_3_opt_move(route, seg[0], seg[1], seg[2]);
+
+                    for (uint32_t m = 0, p = (kept.last_ + 1) % len; m < len - kept.size(); ++m) {
+                        pos_in_route[ route[p] ] = p;
+                        p = (p + 1 < len) ? p + 1 : 0;
+                    }
+
+                    touched = { e1.first, e1.second, e2.first, e2.second, e3.first, e3.second };
+                    ++stats.applied_moves_;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
 /*
  * Impl. of the 3-opt heuristic. Tries to change the order of nodes in
  * solution to shorten the travel distance.
@@ -533,9 +1191,18 @@ void perform_3_opt_move(std::vector<uint32_t> &route,
 int64_t three_opt_nn(const ProblemInstance &instance,
                      std::vector<uint32_t> &sol,
                      bool use_dont_look_bits,
-                     uint32_t nn_count) {
+                     uint32_t nn_count,
+                     TourRepresentation repr) {
     using namespace std;
 
+    if (repr == TourRepresentation::TwoLevelList) {
+        TwoLevelList tour(sol);
+        const auto changes = three_opt_nn(instance, tour, use_dont_look_bits, nn_count);
+        tour.to_vector(sol);
+        assert(instance.is_route_valid(sol));
+        return changes;
+    }
+
     assert( instance.is_symmetric_ );
 
     const auto len = static_cast<uint32_t>(sol.size());
@@ -543,19 +1210,17 @@ int64_t three_opt_nn(const ProblemInstance &instance,
 
     Bitmask dont_look_bits(len);
     vector<uint32_t> pos_in_route(len);
+    for (auto i = 0u; i < len; ++i) {
+        pos_in_route[ route[i] ] = i;
+    }
 
-    int64_t two_opt_changes = 0;
-    int64_t three_opt_changes = 0;
-
+    LocalSearchStats stats;
+    vector<uint32_t> touched;
     bool found_improvement;
 
     do {
         found_improvement = false;
 
-        for (auto i = 0u; i < len; ++i) {
-            pos_in_route[ route[i] ] = i;
-        }
-
         for (auto i = 0u; i < len && !found_improvement; ++i) {
             const auto at_i = route[i];
 
@@ -563,152 +1228,99 @@ int64_t three_opt_nn(const ProblemInstance &instance,
                 continue ;  // Do not check, it probably won't find an
                             // improvement
             }
-            const auto &i_nn_list = instance.get_nearest_neighbors(at_i, nn_count);
-
-            for (auto i_nn_idx = 0u; i_nn_idx < nn_count && !found_improvement; ++i_nn_idx) {
-                const auto at_j = i_nn_list[i_nn_idx];
-                const auto j = pos_in_route[at_j];
-
-                // Check for 2-opt move
-                const auto i_1 = (i + 1) % len;
-                const auto j_1 = (j + 1) % len;
-                const auto at_i_1 = route[i_1];
-
-                const auto dist_i_to_next = instance.get_distance(at_i, at_i_1);
-                const auto dist_i_to_j = instance.get_distance(at_i, at_j);
-
-                // This shortens time considerably although results in longer tours
-                if (dist_i_to_next < dist_i_to_j) {
-                    break ;
+            found_improvement = three_opt_nn_at(instance, route, pos_in_route,
+                                                i, nn_count, touched, stats);
+            if (found_improvement) {
+                for (auto node : touched) {
+                    dont_look_bits.clear_bit(node);
                 }
+            } else if (use_dont_look_bits) {
+                dont_look_bits.set_bit(at_i);
+            }
+        }
+    } while(found_improvement);
 
-                const auto at_j_1 = route[j_1];
-
-                auto cost_before_2opt = dist_i_to_next
-                                      + instance.get_distance(at_j, at_j_1);
-
-                auto cost_after_2opt = dist_i_to_j
-                                     + instance.get_distance(at_i_1, at_j_1);
-
-                if (cost_after_2opt < cost_before_2opt) {
-                    perform_2_opt_move(route, static_cast<int32_t>(i), static_cast<int32_t>(j));
-
-                    found_improvement = true;
-
-                    dont_look_bits.clear_bit(at_i);
-                    dont_look_bits.clear_bit(at_i_1);
-
-                    dont_look_bits.clear_bit(at_j);
-                    dont_look_bits.clear_bit(at_j_1);
+    return stats.applied_moves_;
+}
 
-                    ++two_opt_changes;
 
-                    continue ;
-                }
+/*
+ * The 3-opt heuristic driven by a queue of active nodes (nodes with the
+ * don't look bits cleared), initially filled with the nodes from the
+ * checklist. Only the active nodes are checked for an improving move and
+ * after a move the endpoints of the new edges become active. Unlike the
+ * version above, the route is not scanned from the beginning after each
+ * change, so the time is proportional to the number of the active nodes.
+ *
+ * With ActiveNodesOrder::Gain the active nodes are checked in the
+ * decreasing order of the estimated gain, i.e. the difference between the
+ * length of the longer route edge of the node and the distance to its
+ * nearest neighbor.
+ *
+ * Returns a number of changes (moves) applied to the route.
+ */
+int64_t three_opt_nn(const ProblemInstance &instance,
+                     std::vector<uint32_t> &route,
+                     const std::vector<uint32_t> &checklist,
+                     uint32_t nn_count,
+                     ActiveNodesOrder order,
+                     LocalSearchStats *stats) {
+    assert( instance.is_symmetric_ );
 
-                const auto &j_nn_list = instance.get_nearest_neighbors(at_j, nn_count);
+    const auto len = static_cast<uint32_t>(route.size());
 
-                assert(at_i != at_j);  // These two should be different
+    std::vector<uint32_t> pos_in_route(len);
+    for (auto i = 0u; i < len; ++i) {
+        pos_in_route[ route[i] ] = i;
+    }
 
-                for (auto j_nn_idx = 0u; j_nn_idx < nn_count && !found_improvement ; ++j_nn_idx) {
-                    const auto at_k = j_nn_list[j_nn_idx];
-                    const auto k = pos_in_route[at_k];
+    const bool use_gain = (order == ActiveNodesOrder::Gain);
+    ActiveNodesQueue fifo_queue(use_gain ? 0 : len);
+    GainOrderedQueue gain_queue(use_gain ? len : 0);
+
+    auto activate = [&](uint32_t node) {
+        if (use_gain) {
+            const auto pos = pos_in_route[node];
+            const auto next = route[(pos + 1 < len) ? pos + 1 : 0];
+            const auto prev = route[(pos > 0) ? pos - 1 : len - 1];
+            const auto gain = std::max(instance.get_distance(node, next),
+                                       instance.get_distance(node, prev))
+                            - instance.get_nn_distance(node, 0);
+            gain_queue.push(node, gain);
+        } else {
+            fifo_queue.push(node);
+        }
+    };
 
-                    if (k == len || k == i) {  // Unlikely but possible, we want at_i != at_j != at_k
-                        continue ;
-                    }
+    for (auto node : checklist) {
+        activate(node);
+    }
 
-                    uint32_t x = i;
-                    uint32_t y = j;
-                    uint32_t z = k;
-                    uint32_t at_x = at_i;
-                    uint32_t at_y = at_j;
-                    uint32_t at_z = at_k;
-
-                    // Sort (x, y, z)
-                    if (x > y) { swap(x, y); swap(at_x, at_y); }
-                    if (x > z) { swap(x, z); swap(at_x, at_z); }
-                    if (y > z) { swap(y, z); swap(at_y, at_z); }
-
-                    const auto x_1 = (x + 1) % len;
-                    const auto y_1 = (y + 1) % len;
-                    const auto z_1 = (z + 1) % len;
-
-                    const auto at_x_1 = route[x_1];
-                    const auto at_y_1 = route[y_1];
-                    const auto at_z_1 = route[z_1];
-
-                    const auto curr = instance.get_distance(at_x, at_x_1)
-                                    + instance.get_distance(at_y, at_y_1)
-                                    + instance.get_distance(at_z, at_z_1);
-
-                    // 4 sets of possible new edges to check
-                    const array<pair<uint32_t, uint32_t>, 4 * 3> edges{{
-                        { at_y, at_x   }, { at_z_1, at_y_1 }, {   at_z, at_x_1 },
-                        { at_y, at_z_1 }, {   at_x, at_y_1 }, {   at_z, at_x_1 },
-                        { at_y, at_z_1 }, {   at_x, at_z   }, { at_y_1, at_x_1 },
-                        { at_y, at_z   }, { at_y_1, at_x   }, { at_z_1, at_x_1 }
-                    }};
-
-                    // Which segments do we need to reverse in order to transform
-                    // route so that the new edges are created properly
-                    const array<bool, 4 * 3> segment_reversals{{
-                        false, true, true,
-                        true, true, true,
-                        true, true, false,
-                        true, false, true
-                    }};
-
-                    Segment seg[3] = {
-                        { z_1, x, len, 0 },
-                        { x_1, y, len, 1 },
-                        { y_1, z, len, 2 }
-                    };
-
-                    for (auto l = 0u; l < 4 * 3 && !found_improvement; l += 3) {
-                        auto e1 = edges[l + 0];
-                        auto e2 = edges[l + 1];
-                        auto e3 = edges[l + 2];
-
-                        const auto cost = instance.get_distance(e1.first, e1.second)
-                                        + instance.get_distance(e2.first, e2.second)
-                                        + instance.get_distance(e3.first, e3.second);
-
-
-                        if (cost < curr) {
-                            found_improvement = true;
-
-                            if (segment_reversals[l + 0]) {
-                                seg[0].reverse();
-                            }
-                            if (segment_reversals[l + 1]) {
-                                seg[1].reverse();
-                            }
-                            if (segment_reversals[l + 2]) {
-                                seg[2].reverse();
-                            }
-                            dont_look_bits.clear_bit(e1.first);
-                            dont_look_bits.clear_bit(e1.second);
+    LocalSearchStats local_stats;
+    std::vector<uint32_t> touched;
 
-                            dont_look_bits.clear_bit(e2.first);
-                            dont_look_bits.clear_bit(e2.second);
+    // Setting maximum number of allowed route changes prevents very long-running times
+    // for very hard to solve TSP instances.
+    const int64_t MaxChanges = INT64_C(10) * len;
 
-                            dont_look_bits.clear_bit(e3.first);
-                            dont_look_bits.clear_bit(e3.second);
+    while (local_stats.applied_moves_ < MaxChanges) {
+        if (use_gain ? gain_queue.empty() : fifo_queue.empty()) {
+            break ;
+        }
+        const auto node = use_gain ? gain_queue.pop() : fifo_queue.pop();
 
-                            ++three_opt_changes;
-                        }
-                    }
-                    if (found_improvement) {
-                        perform_3_opt_move(route, seg[0], seg[1], seg[2]);
-                    }
-                }
-            }
-            if (!found_improvement && use_dont_look_bits) {
-                dont_look_bits.set_bit(at_i);
+        if (three_opt_nn_at(instance, route, pos_in_route, pos_in_route[node],
+                            nn_count, touched, local_stats)) {
+            activate(node);
+            for (auto x : touched) {
+                activate(x);
             }
         }
-    } while(found_improvement);
-
-    return two_opt_changes + three_opt_changes;
+    }
+    if (stats != nullptr) {
+        stats->evaluated_moves_ += local_stats.evaluated_moves_;
+        stats->applied_moves_ += local_stats.applied_moves_;
+    }
+    assert(instance.is_route_valid(route));
+    return local_stats.applied_moves_;
 }
@@ -2,6 +2,28 @@
 
 #include <vector>
 #include "problem_instance.h"
+#include "two_level_list.h"
+
+/*
+ * Representation of a tour used internally by the local search heuristics.
+ * Array is a vector of nodes in which a 2-opt move takes O(n) time, while
+ * TwoLevelList allows to perform it in O(sqrt(n)) time -- this becomes
+ * beneficial for large instances.
+ */
+enum class TourRepresentation { Array, TwoLevelList };
+
+/*
+ * Order in which the active nodes (with the don't look bits cleared) are
+ * checked by the queue-based 3-opt: first-in first-out or starting from
+ * the nodes with the highest estimated gain.
+ */
+enum class ActiveNodesOrder { Fifo, Gain };
+
+// Counters of the local search moves
+struct LocalSearchStats {
+    int64_t evaluated_moves_ = 0;  // # of moves for which the gain was calculated
+    int64_t applied_moves_ = 0;
+};
 
 /**
  * This is an implementation of an approximate 2-opt heuristic which uses the
@@ -10,13 +32,27 @@
 int64_t two_opt_nn(const ProblemInstance &instance,
                    std::vector<uint32_t> &route,
                    bool use_dont_look_bits,
-                   uint32_t nn_count);
+                   uint32_t nn_count,
+                   TourRepresentation repr = TourRepresentation::Array);
 
 int64_t two_opt_nn(const ProblemInstance &instance,
                    std::vector<uint32_t> &route,
                    std::vector<uint32_t> &check_queue,
+                   uint32_t nn_count,
+                   TourRepresentation repr = TourRepresentation::Array,
+                   LocalSearchStats *stats = nullptr);
+
+int64_t two_opt_nn(const ProblemInstance &instance,
+                   TwoLevelList &tour,
+                   bool use_dont_look_bits,
                    uint32_t nn_count);
 
+int64_t two_opt_nn(const ProblemInstance &instance,
+                   TwoLevelList &tour,
+                   std::vector<uint32_t> &check_queue,
+                   uint32_t nn_count,
+                   LocalSearchStats *stats = nullptr);
+
 /*
  * Impl. of the 3-opt heuristic. Tries to change the order of nodes in
  * solution to shorten the travel distance.
@@ -38,4 +74,27 @@ int64_t two_opt_nn(const ProblemInstance &instance,
 int64_t three_opt_nn(const ProblemInstance &instance,
                      std::vector<uint32_t> &sol,
                      bool use_dont_look_bits,
+                     uint32_t nn_count,
+                     TourRepresentation repr = TourRepresentation::Array);
+
+int64_t three_opt_nn(const ProblemInstance &instance,
+                     TwoLevelList &tour,
+                     bool use_dont_look_bits,
                      uint32_t nn_count);
+
+/*
+ * The 3-opt heuristic which checks only the active nodes, starting from the
+ * nodes in the checklist. This is useful if the route was (nearly) 3-optimal
+ * and only a few new edges were introduced, e.g. the route of an ant.
+ *
+ * If stats is not null, the counts of the evaluated and applied moves are
+ * added to it.
+ *
+ * Returns a number of changes (moves) applied to the route.
+ */
+int64_t three_opt_nn(const ProblemInstance &instance,
+                     std::vector<uint32_t> &route,
+                     const std::vector<uint32_t> &checklist,
+                     uint32_t nn_count,
+                     ActiveNodesOrder order = ActiveNodesOrder::Fifo,
+                     LocalSearchStats *stats = nullptr);
@@ -0,0 +1,152 @@
+/**
+ * Benchmark of the local search heuristics using the vector (array) and the
+ * two-level doubly-linked list tour representations.
+ *
+ * For each instance the following scenarios are run with both
+ * representations:
+ *
+ * 2-opt     -- the 2-opt heuristic with the don't look bits applied to
+ *              the nearest neighbor tour
+ * 3-opt     -- the 3-opt heuristic applied to the nearest neighbor tour
+ * checklist -- the checklist 2-opt heuristic applied repeatedly to a slightly
+ *              perturbed 2-optimal tour, which resembles the way the LS is
+ *              used by the FACO
+ *
+ * Usage: ./ls_bench [instance.tsp ...]
+ * By default all instances in the "instances" folder are used.
+*/
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "problem_instance.h"
+#include "local_search.h"
+#include "utils.h"
+
+using namespace std;
+
+
+struct BenchResult {
+    int64_t moves_ = 0;
+    double time_ = 0;
+    double cost_ = 0;
+};
+
+
+/*
+ * Reverses a few random sections of the route and returns the endpoints of
+ * the new edges.
+ */
+vector<uint32_t> perturb_route(vector<uint32_t> &route, std::mt19937 &rng,
+                               uint32_t changes_count) {
+    const auto n = static_cast<uint32_t>(route.size());
+    const uint32_t MaxSectionLength = std::min(50u, n / 2);
+    vector<uint32_t> endpoints;
+
+    for (uint32_t k = 0; k < changes_count; ++k) {
+        const auto first = static_cast<uint32_t>(rng() % (n - MaxSectionLength));
+        const auto last = first + 2 + static_cast<uint32_t>(rng() % (MaxSectionLength - 2));
+        std::reverse(route.begin() + first, route.begin() + last);
+
+        endpoints.push_back(route[first]);
+        endpoints.push_back(route[last - 1]);
+        endpoints.push_back(route[(first > 0) ? first - 1 : n - 1]);
+        endpoints.push_back(route[last % n]);
+    }
+    return endpoints;
+}
+
+
+BenchResult run_scenario(const ProblemInstance &problem,
+                         const string &scenario,
+                         const vector<uint32_t> &start_route,
+                         TourRepresentation repr,
+                         uint32_t nn_count) {
+    BenchResult res;
+    auto route = start_route;
+
+    if (scenario == "2-opt") {
+        Timer timer;
+        res.moves_ = two_opt_nn(problem, route, true, nn_count, repr);
+        res.time_ = timer();
+    } else if (scenario == "3-opt") {
+        Timer timer;
+        res.moves_ = three_opt_nn(problem, route, true, nn_count, repr);
+        res.time_ = timer();
+    } else {  // checklist
+        const uint32_t Trials = 1000;
+        const uint32_t ChangesPerTrial = 8;
+        std::mt19937 rng(1234);  // The same perturbations for both repr.
+
+        for (uint32_t trial = 0; trial < Trials; ++trial) {
+            auto copy = start_route;
+            auto checklist = perturb_route(copy, rng, ChangesPerTrial);
+
+            Timer timer;
+            res.moves_ += two_opt_nn(problem, copy, checklist, nn_count, repr);
+            res.time_ += timer();
+
+            if (trial + 1 == Trials) {
+                route = copy;
+            }
+        }
+    }
+    res.cost_ = problem.calculate_route_length(route);
+    return res;
+}
+
+
+int main(int argc, char *argv[]) {
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        paths.emplace_back(argv[i]);
+    }
+    if (paths.empty()) {
+        for (const auto &entry : std::filesystem::directory_iterator("instances")) {
+            if (entry.path().extension() == ".tsp") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    }
+
+    const uint32_t NNCount = 20;
+    const vector<pair<TourRepresentation, string>> representations{
+        { TourRepresentation::Array, "array" },
+        { TourRepresentation::TwoLevelList, "two-level list" }
+    };
+
+    cout << left << setw(20) << "instance" << setw(12) << "scenario"
+         << setw(16) << "repr" << right << setw(10) << "moves"
+         << setw(12) << "time [s]" << setw(14) << "moves/sec"
+         << setw(14) << "cost" << '\n';
+
+    for (const auto &path : paths) {
+        auto problem = load_tsplib_instance(path.c_str());
+        problem.compute_nn_lists(NNCount);
+
+        const auto nn_tour = problem.build_nn_tour(0);
+        auto two_opt_tour = nn_tour;
+        two_opt_nn(problem, two_opt_tour, true, NNCount);
+
+        for (const string scenario : { "2-opt", "3-opt", "checklist" }) {
+            const auto &start_route = (scenario == "checklist") ? two_opt_tour : nn_tour;
+
+            for (const auto &[repr, repr_name] : representations) {
+                auto res = run_scenario(problem, scenario, start_route, repr, NNCount);
+
+                cout << left << setw(20) << problem.name_ << setw(12) << scenario
+                     << setw(16) << repr_name << right << setw(10) << res.moves_
+                     << setw(12) << fixed << setprecision(3) << res.time_
+                     << setw(14) << setprecision(0) << (res.moves_ / std::max(res.time_, 1e-9))
+                     << setw(14) << res.cost_ << endl;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
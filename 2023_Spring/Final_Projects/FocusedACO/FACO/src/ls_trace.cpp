@@ -0,0 +1,131 @@
+#include <iostream>
+
+#include "ls_trace.h"
+#include "problem_instance.h"
+
+
+LocalSearchTraceWriter::Record::Record(uint32_t iteration, uint32_t ant,
+                                       const std::vector<uint32_t> &route,
+                                       const std::vector<uint32_t> &checklist) {
+    buffer_.reserve((5 + 2 * route.size() + checklist.size()) * sizeof(uint32_t));
+    const uint32_t ids[] = { iteration, ant };
+    buffer_.insert(buffer_.end(), reinterpret_cast<const uint8_t *>(ids),
+                   reinterpret_cast<const uint8_t *>(ids + 2));
+    append(route.data(), static_cast<uint32_t>(route.size()));
+    append(checklist.data(), static_cast<uint32_t>(checklist.size()));
+}
+
+
+void LocalSearchTraceWriter::Record::set_result(const std::vector<uint32_t> &route) {
+    append(route.data(), static_cast<uint32_t>(route.size()));
+}
+
+
+void LocalSearchTraceWriter::Record::append(const uint32_t *values, uint32_t count) {
+    const auto *count_bytes = reinterpret_cast<const uint8_t *>(&count);
+    buffer_.insert(buffer_.end(), count_bytes, count_bytes + sizeof(count));
+    const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+    buffer_.insert(buffer_.end(), bytes, bytes + count * sizeof(uint32_t));
+}
+
+
+LocalSearchTraceWriter::LocalSearchTraceWriter(const std::string &path,
+                                               const ProblemInstance &instance,
+                                               uint32_t nn_count,
+                                               size_t max_queued_bytes)
+    : max_queued_bytes_(max_queued_bytes) {
+
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        throw std::runtime_error("Cannot create LS trace file: " + path);
+    }
+
+    const auto dimension = instance.dimension_;
+    LocalSearchTraceHeader header;
+    header.dimension_ = dimension;
+    header.nn_count_ = nn_count;
+    header.coords_offset_ = sizeof(header);  // A multiple of 8
+    header.neighbors_offset_ = header.coords_offset_ + 2 * sizeof(double) * dimension;
+    header.records_offset_ = header.neighbors_offset_
+                           + static_cast<uint64_t>(dimension) * nn_count * sizeof(uint32_t);
+
+    std::vector<double> coords(2 * static_cast<size_t>(dimension), 0.0);
+    for (uint32_t node = 0; node < dimension && node < instance.coords_.size(); ++node) {
+        coords[2 * node]     = instance.coords_[node].x_;
+        coords[2 * node + 1] = instance.coords_[node].y_;
+    }
+    std::vector<uint32_t> neighbors;
+    neighbors.reserve(static_cast<size_t>(dimension) * nn_count);
+    for (uint32_t node = 0; node < dimension; ++node) {
+        for (auto nn : instance.get_nearest_neighbors(node, nn_count)) {
+            neighbors.push_back(nn);
+        }
+    }
+
+    fwrite(&header, sizeof(header), 1, file_);
+    fwrite(coords.data(), sizeof(double), coords.size(), file_);
+    fwrite(neighbors.data(), sizeof(uint32_t), neighbors.size(), file_);
+    bytes_written_ = header.records_offset_;
+
+    thread_ = std::thread(&LocalSearchTraceWriter::write_loop, this);
+}
+
+
+void LocalSearchTraceWriter::submit(Record &&record) {
+    const auto size = record.buffer_.size();
+    std::unique_lock<std::mutex> lock(mutex_);
+    // A single record larger than the limit is still accepted
+    queue_not_full_.wait(lock, [&] {
+        return queued_bytes_ == 0 || queued_bytes_ + size <= max_queued_bytes_;
+    });
+    queue_.emplace_back(std::move(record.buffer_));
+    queued_bytes_ += size;
+    lock.unlock();
+    queue_not_empty_.notify_one();
+}
+
+
+void LocalSearchTraceWriter::write_loop() {
+    std::deque<std::vector<uint8_t>> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_not_empty_.wait(lock, [&] { return !queue_.empty() || is_closing_; });
+            if (queue_.empty()) {  // and is_closing_
+                break ;
+            }
+            batch.swap(queue_);
+        }
+        size_t batch_bytes = 0;
+        for (auto &buffer : batch) {
+            fwrite(buffer.data(), 1, buffer.size(), file_);
+            batch_bytes += buffer.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued_bytes_ -= batch_bytes;
+            records_count_ += batch.size();
+            bytes_written_ += batch_bytes;
+        }
+        batch.clear();
+        queue_not_full_.notify_all();
+    }
+}
+
+
+void LocalSearchTraceWriter::close() {
+    if (file_ == nullptr) {
+        return ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_closing_ = true;
+    }
+    queue_not_empty_.notify_one();
+    thread_.join();
+
+    if (fclose(file_) != 0) {
+        std::cerr << "Warning: error while writing the LS trace file\n";
+    }
+    file_ = nullptr;
+}
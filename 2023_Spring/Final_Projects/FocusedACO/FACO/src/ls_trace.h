@@ -0,0 +1,318 @@
+/**
+ * Binary trace of the local search inputs and outputs, i.e. for every ant the
+ * route and the checklist passed to the LS and the route it returned. The
+ * trace is used by the HLS testbenches (HLS/.../main.cpp) as test vectors.
+ *
+ * File layout (all values little-endian):
+ *
+ *   LocalSearchTraceHeader
+ *   coords     -- dimension x 2 x double, at header.coords_offset_
+ *   neighbors  -- dimension x nn_count x uint32_t, at header.neighbors_offset_,
+ *                 i.e. the same layout as the HLS kernel's neighbors[NODES][NN_LIST_SIZE]
+ *   records    -- from header.records_offset_ to the end of the file
+ *
+ * Each record consists of:
+ *
+ *   uint32_t iteration, uint32_t ant
+ *   uint32_t size, uint32_t route[size]        -- route before the LS
+ *   uint32_t size, uint32_t checklist[size]
+ *   uint32_t size, uint32_t route[size]        -- route after the LS
+ *
+ * The records are written in the order in which the ants finish, which
+ * depends on the threads' scheduling.
+ *
+ * The reader is header-only and depends only on the standard library and
+ * POSIX, so that it can be included by the testbenches, which load their
+ * test vectors with read_trace_test_vectors().
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+struct LocalSearchTraceHeader {
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char magic_[8] = { 'F', 'A', 'C', 'O', 'L', 'S', 'T', 'R' };
+    uint32_t version_ = CurrentVersion;
+    uint32_t header_size_ = sizeof(LocalSearchTraceHeader);
+    uint32_t dimension_ = 0;
+    uint32_t nn_count_ = 0;
+    uint64_t coords_offset_ = 0;
+    uint64_t neighbors_offset_ = 0;
+    uint64_t records_offset_ = 0;
+};
+
+
+/*
+ * Reads the trace through a read-only memory mapping of the file. The arrays
+ * returned point directly into the mapping and are valid as long as the
+ * reader exists. The coords and neighbors sections are checked against the
+ * file size when the file is opened.
+ */
+class LocalSearchTraceReader {
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    LocalSearchTraceHeader header_;
+    size_t offset_ = 0;  // Of the next record
+
+    // Returns a pointer to the length-prefixed array at offset_ (and
+    // advances it) or nullptr if the array is truncated
+    const uint32_t *read_array(uint32_t &size) {
+        if (size_ - offset_ < sizeof(uint32_t)) {
+            return nullptr;
+        }
+        memcpy(&size, data_ + offset_, sizeof(uint32_t));
+        offset_ += sizeof(uint32_t);
+        if ((size_ - offset_) / sizeof(uint32_t) < size) {
+            return nullptr;
+        }
+        const auto *array = reinterpret_cast<const uint32_t *>(data_ + offset_);
+        offset_ += size * sizeof(uint32_t);
+        return array;
+    }
+
+    // True if count elements of elem_size bytes at offset lie within the file
+    [[nodiscard]] bool section_fits(uint64_t offset, uint64_t count, uint64_t elem_size) const {
+        return offset <= size_ && count <= (size_ - offset) / elem_size;
+    }
+
+public:
+    struct Record {
+        uint32_t iteration_ = 0;
+        uint32_t ant_ = 0;
+        const uint32_t *route_ = nullptr;
+        uint32_t route_size_ = 0;
+        const uint32_t *checklist_ = nullptr;
+        uint32_t checklist_size_ = 0;
+        const uint32_t *route_after_ls_ = nullptr;
+        uint32_t route_after_ls_size_ = 0;
+    };
+
+    explicit LocalSearchTraceReader(const char *path) {
+        auto fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            throw std::runtime_error(std::string("Cannot open LS trace file: ") + path);
+        }
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(header_))) {
+            auto *ptr = mmap(nullptr, static_cast<size_t>(st.st_size),
+                             PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data_ = static_cast<const uint8_t *>(ptr);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+
+        const LocalSearchTraceHeader expected;
+        if (data_ != nullptr) {
+            memcpy(&header_, data_, sizeof(header_));
+        }
+        if (data_ == nullptr
+                || memcmp(header_.magic_, expected.magic_, sizeof(header_.magic_)) != 0
+                || header_.version_ != LocalSearchTraceHeader::CurrentVersion
+                || header_.header_size_ != sizeof(header_)
+                || header_.records_offset_ > size_
+                || !section_fits(header_.coords_offset_, 2 * uint64_t(header_.dimension_), sizeof(double))
+                || !section_fits(header_.neighbors_offset_,
+                                 uint64_t(header_.dimension_) * header_.nn_count_, sizeof(uint32_t))) {
+            throw std::runtime_error(std::string("Invalid LS trace file: ") + path);
+        }
+        offset_ = header_.records_offset_;
+    }
+
+    LocalSearchTraceReader(const LocalSearchTraceReader &) = delete;
+    LocalSearchTraceReader &operator=(const LocalSearchTraceReader &) = delete;
+
+    ~LocalSearchTraceReader() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+    }
+
+    [[nodiscard]] uint32_t dimension() const { return header_.dimension_; }
+
+    [[nodiscard]] uint32_t nn_count() const { return header_.nn_count_; }
+
+    // [dimension][2] array of the nodes' coordinates
+    [[nodiscard]] const double *coords() const {
+        return reinterpret_cast<const double *>(data_ + header_.coords_offset_);
+    }
+
+    // [dimension][nn_count] array of the nearest neighbors
+    [[nodiscard]] const uint32_t *neighbors() const {
+        return reinterpret_cast<const uint32_t *>(data_ + header_.neighbors_offset_);
+    }
+
+    /*
+     * Reads the next record. Returns false if there are no more records
+     * (an incomplete last record, e.g. if the solver was killed, is skipped).
+     */
+    bool next(Record &record) {
+        const auto record_offset = offset_;
+        if (size_ - offset_ < 2 * sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&record.iteration_, data_ + offset_, sizeof(uint32_t));
+        memcpy(&record.ant_, data_ + offset_ + sizeof(uint32_t), sizeof(uint32_t));
+        offset_ += 2 * sizeof(uint32_t);
+
+        record.route_ = read_array(record.route_size_);
+        record.checklist_ = (record.route_ != nullptr) ? read_array(record.checklist_size_) : nullptr;
+        record.route_after_ls_ = (record.checklist_ != nullptr) ? read_array(record.route_after_ls_size_) : nullptr;
+        if (record.route_after_ls_ == nullptr) {
+            offset_ = record_offset;
+            return false;
+        }
+        return true;
+    }
+
+    void rewind() { offset_ = header_.records_offset_; }
+};
+
+
+/*
+ * Loads the test vectors of the HLS testbenches (HLS/.../main.cpp) from the
+ * trace: the coordinates, the NN lists and the first records_count records,
+ * copied into the testbenches' own structures (Info has the route, checklist,
+ * corrected_route and nn_list_size fields, Point has x and y).
+ *
+ * The kernels have fixed-size arrays, so the trace has to be of an instance
+ * with exactly dimension nodes and nn_count neighbors per node, the routes
+ * have to contain only the nodes < dimension and the checklists at most
+ * checklist_capacity nodes. Otherwise, or if the trace has fewer records,
+ * std::runtime_error is thrown.
+ */
+template<typename Info, typename Point>
+void read_trace_test_vectors(const char *path, size_t records_count,
+                             uint32_t dimension, uint32_t nn_count, uint32_t checklist_capacity,
+                             std::vector<Info> &infos,
+                             std::vector<Point> &coordinates,
+                             std::vector<std::vector<uint32_t>> &nearest_neighbors) {
+    LocalSearchTraceReader trace(path);
+
+    auto fail = [path](const std::string &reason) {
+        throw std::runtime_error(std::string("LS trace ") + path + " " + reason);
+    };
+    if (trace.dimension() != dimension || trace.nn_count() != nn_count) {
+        fail("does not match the kernel's # of nodes or NN list size");
+    }
+    auto nodes_valid = [dimension](const uint32_t *nodes, uint32_t size) {
+        for (uint32_t i = 0; i < size; ++i) {
+            if (nodes[i] >= dimension) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const double *coords = trace.coords();
+    for (uint32_t i = 0; i < dimension; ++i) {
+        coordinates.push_back(Point{ static_cast<int32_t>(coords[2 * i]),
+                                     static_cast<int32_t>(coords[2 * i + 1]) });
+    }
+    const uint32_t *neighbors = trace.neighbors();
+    if (!nodes_valid(neighbors, dimension * nn_count)) {
+        fail("has an invalid NN list");
+    }
+    for (uint32_t i = 0; i < dimension; ++i) {
+        nearest_neighbors.emplace_back(neighbors + i * nn_count, neighbors + (i + 1) * nn_count);
+    }
+
+    LocalSearchTraceReader::Record record;
+    while (infos.size() < records_count && trace.next(record)) {
+        if (record.route_size_ != dimension || record.route_after_ls_size_ != dimension
+                || record.checklist_size_ > checklist_capacity
+                || !nodes_valid(record.route_, record.route_size_)
+                || !nodes_valid(record.checklist_, record.checklist_size_)
+                || !nodes_valid(record.route_after_ls_, record.route_after_ls_size_)) {
+            fail("has an invalid record " + std::to_string(infos.size()));
+        }
+        Info info = {};
+        info.route.assign(record.route_, record.route_ + record.route_size_);
+        info.checklist.assign(record.checklist_, record.checklist_ + record.checklist_size_);
+        info.corrected_route.assign(record.route_after_ls_, record.route_after_ls_ + record.route_after_ls_size_);
+        info.nn_list_size = nn_count;
+        infos.push_back(info);
+    }
+    if (infos.size() < records_count) {
+        fail("has only " + std::to_string(infos.size()) + " records");
+    }
+}
+
+
+struct ProblemInstance;
+
+/*
+ * Writes the trace using a separate thread, so that the threads running the
+ * LS only copy their data into a record and put it into a queue. If the
+ * queue grows over max_queued_bytes (the disk is too slow), submit() waits.
+ */
+class LocalSearchTraceWriter {
+public:
+    // Serialized record, see the file layout above
+    class Record {
+        std::vector<uint8_t> buffer_;
+
+        void append(const uint32_t *values, uint32_t count);
+
+        friend class LocalSearchTraceWriter;
+    public:
+        // The LS inputs
+        Record(uint32_t iteration, uint32_t ant,
+               const std::vector<uint32_t> &route,
+               const std::vector<uint32_t> &checklist);
+
+        // The LS output
+        void set_result(const std::vector<uint32_t> &route);
+    };
+
+    LocalSearchTraceWriter(const std::string &path,
+                           const ProblemInstance &instance,
+                           uint32_t nn_count,
+                           size_t max_queued_bytes = size_t(256) << 20);
+
+    LocalSearchTraceWriter(const LocalSearchTraceWriter &) = delete;
+    LocalSearchTraceWriter &operator=(const LocalSearchTraceWriter &) = delete;
+
+    ~LocalSearchTraceWriter() { close(); }
+
+    // Can be called by many threads at once
+    void submit(Record &&record);
+
+    // Writes the remaining records and closes the file
+    void close();
+
+    [[nodiscard]] uint64_t get_records_count() const { return records_count_; }
+
+    [[nodiscard]] uint64_t get_bytes_written() const { return bytes_written_; }
+
+private:
+    void write_loop();
+
+    FILE *file_ = nullptr;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable queue_not_empty_;
+    std::condition_variable queue_not_full_;
+    std::deque<std::vector<uint8_t>> queue_;
+    size_t queued_bytes_ = 0;
+    size_t max_queued_bytes_;
+    bool is_closing_ = false;
+    uint64_t records_count_ = 0;
+    uint64_t bytes_written_ = 0;
+};
@@ -0,0 +1,175 @@
+/**
+ * Micro-benchmark of the candidate list pheromone memory operations which are
+ * executed in every iteration of the FACO:
+ *
+ * deposit -- the deposition of pheromone on the edges of a route, as in
+ *            ACOModel::deposit_pheromone
+ * refresh -- the refresh of the nn_product_cache, i.e. the products of the
+ *            pheromone and heuristic for every edge on the cand. lists
+ *
+ * Both are measured with the linear scan of the candidate list (the way the
+ * trails were looked up before the slot index was introduced), with the slot
+ * index (find_slot), and - for the refresh - with the direct slot access.
+ *
+ * Usage: ./pher_bench [instance.tsp] [repeats]
+ * By default instances/d15112.tsp is used.
+*/
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "problem_instance.h"
+#include "pheromone.h"
+#include "utils.h"
+
+using namespace std;
+
+
+// The lookup of a trail as done before the slot index
+uint32_t find_slot_linear(const CandListPheromone &pheromone, uint32_t from, uint32_t to) {
+    const auto offset = from * pheromone.cl_size_;
+    for (uint32_t i = offset; i < offset + pheromone.cl_size_; ++i) {
+        if (pheromone.nodes_[i] == to) {
+            return i;
+        }
+    }
+    return CandListPheromone::NoSlot;
+}
+
+
+void increase_linear(CandListPheromone &pheromone, uint32_t from, uint32_t to,
+                     double deposit, double max_value) {
+    auto idx = find_slot_linear(pheromone, from, to);
+    if (idx != CandListPheromone::NoSlot) {
+        pheromone.increase_helper(idx, deposit, max_value);
+    }
+    idx = find_slot_linear(pheromone, to, from);
+    if (idx != CandListPheromone::NoSlot) {
+        pheromone.increase_helper(idx, deposit, max_value);
+    }
+}
+
+
+double get_linear(const CandListPheromone &pheromone, uint32_t from, uint32_t to) {
+    const auto idx = find_slot_linear(pheromone, from, to);
+    return idx != CandListPheromone::NoSlot ? pheromone.trails_[idx]
+                                            : pheromone.default_pheromone_value_;
+}
+
+
+void print_result(const string &name, double time, uint32_t repeats, double checksum) {
+    cout << left << setw(24) << name << right
+         << setw(14) << fixed << setprecision(3) << (1e3 * time / repeats)
+         << setw(20) << setprecision(6) << checksum << endl;
+}
+
+
+int main(int argc, char *argv[]) {
+    const string path = (argc > 1) ? argv[1] : "instances/d15112.tsp";
+    const uint32_t repeats = (argc > 2) ? static_cast<uint32_t>(stoul(argv[2])) : 100;
+    const uint32_t cl_size = 16;  // The FACO default
+
+    auto problem = load_tsplib_instance(path.c_str());
+    problem.compute_nn_lists(32);
+
+    const auto dimension = problem.dimension_;
+    const auto route = problem.build_nn_tour(0);
+    const double cost = problem.calculate_route_length(route);
+    const double max_value = 1.0;
+
+    CandListPheromone pheromone(problem.get_nn_lists(cl_size), 0.5, problem.is_symmetric_);
+
+    vector<double> heuristic(dimension * cl_size);
+    for (uint32_t node = 0; node < dimension; ++node) {
+        uint32_t slot = 0;
+        for (auto nn : problem.get_nearest_neighbors(node, cl_size)) {
+            heuristic[node * cl_size + slot++] = 1.0 / (problem.get_distance(node, nn) + 1);
+        }
+    }
+    vector<double> product_cache(dimension * cl_size);
+    auto cache_checksum = [&]() {
+        double sum = 0;
+        for (auto v : product_cache) { sum += v; }
+        return sum;
+    };
+    auto trails_checksum = [&]() {
+        double sum = 0;
+        for (auto v : pheromone.trails_) { sum += v; }
+        return sum;
+    };
+
+    cout << problem.name_ << ", cand. list size: " << cl_size
+         << ", repeats: " << repeats << '\n';
+    cout << left << setw(24) << "operation" << right << setw(14) << "time [ms]"
+         << setw(20) << "checksum" << '\n';
+
+    // deposit_pheromone
+    {
+        pheromone.set_all_trails(0.5);
+        Timer timer;
+        for (uint32_t r = 0; r < repeats; ++r) {
+            auto prev_node = route.back();
+            for (auto node : route) {
+                increase_linear(pheromone, prev_node, node, 1.0 / cost, max_value);
+                prev_node = node;
+            }
+        }
+        print_result("deposit (linear scan)", timer(), repeats, trails_checksum());
+    }
+    {
+        pheromone.set_all_trails(0.5);
+        Timer timer;
+        for (uint32_t r = 0; r < repeats; ++r) {
+            auto prev_node = route.back();
+            for (auto node : route) {
+                pheromone.increase(prev_node, node, 1.0 / cost, max_value);
+                prev_node = node;
+            }
+        }
+        print_result("deposit (slot index)", timer(), repeats, trails_checksum());
+    }
+
+    // nn_product_cache refresh
+    {
+        Timer timer;
+        for (uint32_t r = 0; r < repeats; ++r) {
+            for (uint32_t node = 0; node < dimension; ++node) {
+                auto cache_it = product_cache.begin() + node * cl_size;
+                auto heuristic_it = heuristic.begin() + node * cl_size;
+                for (auto nn : problem.get_nearest_neighbors(node, cl_size)) {
+                    *cache_it++ = *heuristic_it++ * get_linear(pheromone, node, nn);
+                }
+            }
+        }
+        print_result("refresh (linear scan)", timer(), repeats, cache_checksum());
+    }
+    {
+        Timer timer;
+        for (uint32_t r = 0; r < repeats; ++r) {
+            for (uint32_t node = 0; node < dimension; ++node) {
+                auto cache_it = product_cache.begin() + node * cl_size;
+                auto heuristic_it = heuristic.begin() + node * cl_size;
+                for (auto nn : problem.get_nearest_neighbors(node, cl_size)) {
+                    *cache_it++ = *heuristic_it++ * pheromone.get(node, nn);
+                }
+            }
+        }
+        print_result("refresh (slot index)", timer(), repeats, cache_checksum());
+    }
+    {
+        Timer timer;
+        for (uint32_t r = 0; r < repeats; ++r) {
+            for (uint32_t node = 0; node < dimension; ++node) {
+                auto cache_it = product_cache.begin() + node * cl_size;
+                auto heuristic_it = heuristic.begin() + node * cl_size;
+                for (uint32_t slot = 0; slot < cl_size; ++slot) {
+                    *cache_it++ = *heuristic_it++ * pheromone.get_by_slot(node, slot);
+                }
+            }
+        }
+        print_result("refresh (by slot)", timer(), repeats, cache_checksum());
+    }
+    return EXIT_SUCCESS;
+}
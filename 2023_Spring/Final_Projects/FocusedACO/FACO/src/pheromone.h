@@ -5,6 +5,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <vector>
 #include <cassert>
 
@@ -12,27 +13,111 @@
 #include <iostream>
 
 
+/**
+ * Lazy evaporation of the pheromone trails. Instead of decreasing every trail
+ * in each iteration, only the global evaporation counter (epoch) is
+ * incremented, and the pending decay (1 - rate)^k, where k is the number of
+ * evaporations since the last update of a trail, is applied when the trail is
+ * read or increased.
+ *
+ * The results are the same as for the eager evaporation (up to the rounding
+ * errors) because for the min. values m_1 <= m_2 <= ... <= m_k:
+ *
+ *   max(m_k, ... max(m_2, max(m_1, v * r) * r) ... * r) = max(m_k, v * r^k)
+ *
+ * The MMAS trail limits grow only when a new best solution is found, so this
+ * is the usual case. If the min. value decreases, all the trails are brought
+ * up to date first. The same is done every MaxPendingEpochs evaporations, so
+ * that the decay_powers_ (also saved in the checkpoints) stay short.
+ */
+struct LazyEvaporation {
+    static constexpr uint32_t MaxPendingEpochs = 1024;
+
+    std::vector<uint32_t> epochs_;  // Epoch of the last update of every trail
+    std::vector<double>   decay_powers_{ 1.0 };  // decay_powers_[k] = (1 - rate)^k
+    uint32_t epoch_ = 0;
+    double   rate_ = 0;
+    double   min_value_ = 0;  // Min. value used by the last evaporation
+
+    [[nodiscard]] bool is_enabled() const { return !epochs_.empty(); }
+
+    void init(size_t trails_count) { epochs_.assign(trails_count, epoch_); }
+
+    [[nodiscard]] double get(const std::vector<double> &trails, size_t idx) const {
+        return std::max(min_value_, trails[idx] * decay_powers_[epoch_ - epochs_[idx]]);
+    }
+
+    // Applies the pending evaporation to the trail and returns a ref. to it
+    double &update(std::vector<double> &trails, size_t idx) {
+        trails[idx] = get(trails, idx);
+        epochs_[idx] = epoch_;
+        return trails[idx];
+    }
+
+    /*
+     * Should be called by all the threads of the parallel region (or outside
+     * of it).
+     */
+    void evaporate(std::vector<double> &trails, double rate, double min_value) {
+        const bool update_all = (min_value < min_value_) || (epoch_ > 0 && rate != rate_)
+                             || epoch_ >= MaxPendingEpochs;
+        #pragma omp barrier
+
+        if (update_all) {  // The pending decay can not be applied lazily
+            const auto n = trails.size();
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < n; ++i) {
+                trails[i] = get(trails, i);
+                epochs_[i] = 0;
+            }
+        }
+
+        #pragma omp single
+        {
+            if (update_all) {
+                epoch_ = 0;
+                decay_powers_.assign(1, 1.0);
+            }
+            rate_ = rate;
+            decay_powers_.push_back(decay_powers_.back() * (1 - rate));
+            ++epoch_;
+            min_value_ = min_value;
+        }
+    }
+};
+
+
 struct MatrixPheromone {
     uint32_t dimension_ = 0;
     std::vector<double> trails_; // For every edge (a,b),
                                  // where 0 <= a, b < dimension_
     bool is_symmetric_ = true;
+    LazyEvaporation lazy_;
 
-    MatrixPheromone(uint32_t dimension, double initial_pheromone, bool is_symmetric)
+    MatrixPheromone(uint32_t dimension, double initial_pheromone, bool is_symmetric,
+                    bool lazy_evaporation=false)
         : dimension_(dimension),
-          trails_(dimension * dimension, initial_pheromone),
+          trails_(static_cast<size_t>(dimension) * dimension, initial_pheromone),
           is_symmetric_(is_symmetric) {
+        if (lazy_evaporation) {
+            lazy_.init(trails_.size());
+        }
     }
 
     [[nodiscard]] double get(uint32_t from, uint32_t to) const {
         assert((from < dimension_) && (to < dimension_));
-        return trails_[from * dimension_ + to];
+        const auto idx = static_cast<size_t>(from) * dimension_ + to;
+        return lazy_.is_enabled() ? lazy_.get(trails_, idx) : trails_[idx];
     }
 
     void evaporate(double evaporation_rate, double min_pheromone_value) {
+        if (lazy_.is_enabled()) {
+            lazy_.evaporate(trails_, evaporation_rate, min_pheromone_value);
+            return ;
+        }
         const auto n = trails_.size();
 
-        // #pragma omp for schedule(static)
+        #pragma omp for schedule(static)
         for (size_t i = 0; i < n; ++i) {
             trails_[i] = std::max(min_pheromone_value, trails_[i] * (1 - evaporation_rate));
         }
@@ -43,11 +128,16 @@ struct MatrixPheromone {
 
         assert((from < dimension_) && (to < dimension_));
 
-        auto &value = trails_[from * dimension_ + to];
+        const auto idx = static_cast<size_t>(from) * dimension_ + to;
+        auto &value = lazy_.is_enabled() ? lazy_.update(trails_, idx) : trails_[idx];
         value = std::min(max_pheromone_value, value + deposit);
 
         if (is_symmetric_) {
-            trails_[to * dimension_ + from] = value;
+            const auto sym_idx = static_cast<size_t>(to) * dimension_ + from;
+            trails_[sym_idx] = value;
+            if (lazy_.is_enabled()) {
+                lazy_.epochs_[sym_idx] = lazy_.epoch_;
+            }
         }
     }
 };
@@ -63,11 +153,27 @@ struct CandListPheromone {
     uint32_t cl_size_ = 0;
     bool is_symmetric_ = true;
     double default_pheromone_value_ = 0;
+    LazyEvaporation lazy_;
+
+    // To avoid scanning the candidate lists, the slot (position) of a node on
+    // the candidate list of another node is found using a small perfect hash
+    // table built for every node: slot_table_[(from << slot_table_bits_) + h]
+    // stores the slot of the node "to" such that hash(from, to) == h.
+    static constexpr uint8_t  EmptySlot = 0xFF;
+    static constexpr uint32_t NoSlot = std::numeric_limits<uint32_t>::max();
+
+    uint32_t slot_table_bits_ = 0;
+    std::vector<uint8_t>  slot_table_;
+    std::vector<uint32_t> hash_multipliers_;  // Per-node multipliers
+
+    // For the index of the (a, b) trail, the index of the (b, a) trail or NoSlot
+    std::vector<uint32_t> reverse_slots_;
 
     template<typename NodeList_t>
     CandListPheromone(const std::vector<NodeList_t> &cand_lists,
                       double initial_pheromone,
-                      bool is_symmetric=true)
+                      bool is_symmetric=true,
+                      bool lazy_evaporation=false)
         : dimension_(cand_lists.size()),
           cl_size_(cand_lists.at(0).size()),
           is_symmetric_(is_symmetric),
@@ -80,53 +186,128 @@ struct CandListPheromone {
                 nodes_.push_back(node);
             }
         }
+        if (lazy_evaporation) {
+            lazy_.init(trails_.size());
+        }
+        build_slot_index();
     }
 
-    [[nodiscard]] double get(uint32_t from, uint32_t to) const {
+    [[nodiscard]] uint32_t slot_hash(uint32_t from, uint32_t to) const {
+        return (to * hash_multipliers_[from]) >> (32 - slot_table_bits_);
+    }
+
+    /*
+     * Returns the index of the (from, to) trail or NoSlot if "to" is not on
+     * the candidate list of "from".
+     */
+    [[nodiscard]] uint32_t find_slot(uint32_t from, uint32_t to) const {
         assert((from < dimension_) && (to < dimension_));
 
-        auto offset = from * cl_size_;
-        for (uint32_t i = offset; i < offset + cl_size_; ++i) {
-            if (nodes_[i] == to) {
-                return trails_[i];
+        const auto slot = slot_table_[(static_cast<size_t>(from) << slot_table_bits_)
+                                      + slot_hash(from, to)];
+        if (slot != EmptySlot) {
+            const auto idx = from * cl_size_ + slot;
+            if (nodes_[idx] == to) {
+                return idx;
             }
         }
-        return default_pheromone_value_;
+        return NoSlot;
     }
 
-    void increase_helper(uint32_t from, uint32_t to,
-                         double deposit,
-                         double max_pheromone_value) {
-        assert((from < dimension_) && (to < dimension_));
+    void build_slot_index() {
+        assert(cl_size_ < EmptySlot);
+
+        // The table has at least 4 entries per node on the cand. list, so that
+        // a collision-free multiplier is found after a few attempts
+        slot_table_bits_ = 1;
+        while ((1u << slot_table_bits_) < 4 * cl_size_) {
+            ++slot_table_bits_;
+        }
+        const uint32_t table_size = 1u << slot_table_bits_;
+        slot_table_.assign(static_cast<size_t>(dimension_) * table_size, EmptySlot);
+        hash_multipliers_.resize(dimension_);
+
+        uint32_t multiplier = 0x9E3779B1u;  // Fibonacci hashing
+        for (uint32_t node = 0; node < dimension_; ++node) {
+            auto table = slot_table_.begin() + static_cast<size_t>(node) * table_size;
+            bool collision = true;
+            while (collision) {
+                collision = false;
+                hash_multipliers_[node] = multiplier;
+                std::fill(table, table + table_size, EmptySlot);
 
-        auto offset = from * cl_size_;
-        for (uint32_t i = offset; i < offset + cl_size_; ++i) {
-            if (nodes_[i] == to) {
-                trails_[i] = std::min(max_pheromone_value, deposit + trails_[i]);
-                break ;
+                for (uint32_t slot = 0; slot < cl_size_ && !collision; ++slot) {
+                    const auto neighbor = nodes_[node * cl_size_ + slot];
+                    auto &entry = table[slot_hash(node, neighbor)];
+                    if (entry == EmptySlot) {
+                        entry = static_cast<uint8_t>(slot);
+                    } else {
+                        // A duplicate keeps the first slot, as did the scan
+                        collision = nodes_[node * cl_size_ + entry] != neighbor;
+                    }
+                }
+                if (collision) {
+                    multiplier = multiplier * 0x2C1B3C6Du + 0x297A2D39u;
+                    multiplier |= 1u;
+                }
             }
         }
+
+        reverse_slots_.resize(nodes_.size());
+        for (uint32_t idx = 0; idx < nodes_.size(); ++idx) {
+            reverse_slots_[idx] = find_slot(nodes_[idx], idx / cl_size_);
+        }
+    }
+
+    [[nodiscard]] double get(uint32_t from, uint32_t to) const {
+        const auto idx = find_slot(from, to);
+        if (idx == NoSlot) {
+            return default_pheromone_value_;
+        }
+        return lazy_.is_enabled() ? lazy_.get(trails_, idx) : trails_[idx];
+    }
+
+    // Returns the trail at the given slot of the node's candidate list
+    [[nodiscard]] double get_by_slot(uint32_t from, uint32_t slot) const {
+        assert(from < dimension_ && slot < cl_size_);
+        const auto idx = from * cl_size_ + slot;
+        return lazy_.is_enabled() ? lazy_.get(trails_, idx) : trails_[idx];
+    }
+
+    void increase_helper(uint32_t idx, double deposit, double max_pheromone_value) {
+        auto &value = lazy_.is_enabled() ? lazy_.update(trails_, idx) : trails_[idx];
+        value = std::min(max_pheromone_value, deposit + value);
     }
 
     void increase(uint32_t from, uint32_t to,
                   double delta,
                   double max_pheromone_value) {
 
-        increase_helper(from, to, delta, max_pheromone_value);
+        const auto idx = find_slot(from, to);
+        if (idx != NoSlot) {
+            increase_helper(idx, delta, max_pheromone_value);
+        }
         if (is_symmetric_) {
-            increase_helper(to, from, delta, max_pheromone_value);
+            const auto rev_idx = (idx != NoSlot) ? reverse_slots_[idx] : find_slot(to, from);
+            if (rev_idx != NoSlot) {
+                increase_helper(rev_idx, delta, max_pheromone_value);
+            }
         }
     }
 
     void evaporate(double evaporation_rate, double min_pheromone_value) {
-        const auto n = trails_.size();
+        if (lazy_.is_enabled()) {
+            lazy_.evaporate(trails_, evaporation_rate, min_pheromone_value);
+        } else {
+            const auto n = trails_.size();
 
-        // #pragma omp for schedule(static)
-        for (size_t i = 0; i < n; ++i) {
-            trails_[i] = std::max(min_pheromone_value, trails_[i] * (1 - evaporation_rate));
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < n; ++i) {
+                trails_[i] = std::max(min_pheromone_value, trails_[i] * (1 - evaporation_rate));
+            }
         }
 
-        // #pragma omp single
+        #pragma omp single
         default_pheromone_value_ = std::max(default_pheromone_value_ * (1 - evaporation_rate),
                                             min_pheromone_value);
     }
@@ -135,9 +316,17 @@ struct CandListPheromone {
         for (auto &t : trails_) {
             t = pheromone_value;
         }
+        if (lazy_.is_enabled()) {
+            lazy_.init(trails_.size());
+        }
     }
 
     void print_stats() {
+        if (lazy_.is_enabled()) {
+            for (size_t i = 0; i < trails_.size(); ++i) {
+                lazy_.update(trails_, i);
+            }
+        }
         std::vector<double> ratios;
         for (uint32_t node = 0; node < dimension_; ++node) {
             auto low = *std::min_element(trails_.begin() + (node * cl_size_),
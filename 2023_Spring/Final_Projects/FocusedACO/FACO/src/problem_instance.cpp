@@ -6,6 +6,12 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "problem_instance.h"
 
@@ -42,7 +48,20 @@ static inline void trim(std::string &s) {
  *
  * Returns the loaded problem instance.
  */
-ProblemInstance load_tsplib_instance(const char *path) {
+uint64_t get_auto_distances_memory_budget() {
+    const auto max_budget = AutoBudgetMaxMatrixDimension * AutoBudgetMaxMatrixDimension
+                          * sizeof(int32_t);
+    const auto pages = sysconf(_SC_PHYS_PAGES);
+    const auto page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return DefaultDistancesMemoryBudget;
+    }
+    const auto quarter = static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size) / 4;
+    return std::max(DefaultDistancesMemoryBudget, std::min(quarter, max_budget));
+}
+
+
+ProblemInstance load_tsplib_instance(const char *path, uint64_t distances_memory_budget) {
     using namespace std;
     enum EdgeWeightFormat { UPPER_DIAG_ROW, LOWER_DIAG_ROW, UPPER_ROW, FUNCTION };
 
@@ -209,7 +228,236 @@ ProblemInstance load_tsplib_instance(const char *path) {
     return ProblemInstance(dimension,
                            edge_weight_type,
                            coords, distances,
-                           is_symmetric, name);
+                           is_symmetric, name,
+                           /*best_known_cost*/ -1,
+                           distances_memory_budget);
+}
+
+
+/*
+ * Read-only memory mapping of a whole file. data_ is nullptr if the file
+ * could not be opened or mapped.
+ */
+struct MappedFile {
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+
+    explicit MappedFile(const char *path) {
+        auto fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            return ;
+        }
+        struct stat st {};
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            auto *ptr = mmap(nullptr, static_cast<size_t>(st.st_size),
+                             PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data_ = static_cast<const uint8_t *>(ptr);
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+    }
+};
+
+
+// 64-bit FNV-1a hash
+static uint64_t fnv1a_64(const uint8_t *data, size_t size) {
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+
+/*
+ * Header of the instance cache file. It is followed by the name of the
+ * instance, the coordinates, the distance matrix (only if given explicitly)
+ * and the NN lists, each section starting at a multiple of 8 bytes.
+ */
+struct InstanceCacheHeader {
+    static constexpr uint32_t CurrentVersion = 1;
+
+    char magic_[8] = { 'F', 'A', 'C', 'O', 'T', 'S', 'P', '\0' };
+    uint32_t version_ = CurrentVersion;
+    uint32_t header_size_ = sizeof(InstanceCacheHeader);
+    uint64_t source_size_ = 0;
+    uint64_t source_checksum_ = 0;  // FNV-1a of the instance file contents
+    uint32_t dimension_ = 0;
+    uint32_t edge_weight_type_ = 0;
+    uint32_t is_symmetric_ = 0;
+    uint32_t nn_count_ = 0;
+    uint64_t name_offset_ = 0;
+    uint64_t name_size_ = 0;
+    uint64_t coords_offset_ = 0;     // dimension_ x Vec2d
+    uint64_t coords_count_ = 0;
+    uint64_t distances_offset_ = 0;  // distances_count_ x double
+    uint64_t distances_count_ = 0;
+    uint64_t nn_lists_offset_ = 0;   // dimension_ x nn_count_ x uint32_t
+    uint64_t file_size_ = 0;
+};
+
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~UINT64_C(7);
+}
+
+
+/*
+ * Returns true if a section of count elements of elem_size bytes starting at
+ * offset lies within a file of file_size bytes.
+ */
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t elem_size,
+                         uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / elem_size;
+}
+
+
+static void write_instance_cache(const ProblemInstance &problem,
+                                 const std::string &cache_path,
+                                 uint64_t source_size,
+                                 uint64_t source_checksum) {
+    using namespace std;
+
+    InstanceCacheHeader header;
+    header.source_size_ = source_size;
+    header.source_checksum_ = source_checksum;
+    header.dimension_ = problem.dimension_;
+    header.edge_weight_type_ = problem.edge_weight_type_;
+    header.is_symmetric_ = problem.is_symmetric_;
+    header.nn_count_ = problem.total_nn_per_node_;
+
+    // Only explicitly given distances are stored, the other are
+    // computed from the coordinates
+    const bool store_distances = problem.edge_weight_type_ == EXPLICIT;
+    const auto distances_count = store_distances ? problem.distance_matrix_.size() : 0;
+
+    header.name_offset_ = align8(sizeof(header));
+    header.name_size_ = problem.name_.size();
+    header.coords_offset_ = align8(header.name_offset_ + header.name_size_);
+    header.coords_count_ = problem.coords_.size();
+    header.distances_offset_ = align8(header.coords_offset_ + header.coords_count_ * sizeof(Vec2d));
+    header.distances_count_ = distances_count;
+    header.nn_lists_offset_ = align8(header.distances_offset_ + distances_count * sizeof(double));
+    header.file_size_ = header.nn_lists_offset_
+                      + problem.all_nearest_neighbors_.size() * sizeof(uint32_t);
+
+    vector<uint8_t> buffer(header.file_size_, 0);
+    auto *data = buffer.data();
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + header.name_offset_, problem.name_.data(), header.name_size_);
+    memcpy(data + header.coords_offset_, problem.coords_.data(), header.coords_count_ * sizeof(Vec2d));
+    if (store_distances) {
+        memcpy(data + header.distances_offset_, problem.distance_matrix_.data(),
+               distances_count * sizeof(double));
+    }
+    memcpy(data + header.nn_lists_offset_, problem.all_nearest_neighbors_.data(),
+           problem.all_nearest_neighbors_.size() * sizeof(uint32_t));
+
+    // Write to a temporary file first so that other processes never see
+    // a partially written cache
+    const auto tmp_path = cache_path + ".tmp" + to_string(getpid());
+    {
+        ofstream out(tmp_path, ios::binary);
+        out.write(reinterpret_cast<const char *>(data), static_cast<streamsize>(buffer.size()));
+        if (!out) {
+            cerr << "Warning: cannot write instance cache file: " << tmp_path << endl;
+            filesystem::remove(tmp_path);
+            return ;
+        }
+    }
+    error_code ec;
+    filesystem::rename(tmp_path, cache_path, ec);
+    if (ec) {
+        cerr << "Warning: cannot write instance cache file: " << cache_path << endl;
+        filesystem::remove(tmp_path, ec);
+    }
+}
+
+
+ProblemInstance load_tsplib_instance_cached(const char *path, uint32_t nn_count,
+                                            uint64_t distances_memory_budget) {
+    using namespace std;
+
+    const auto cache_path = string(path) + ".cache";
+
+    uint64_t source_size = 0;
+    uint64_t source_checksum = 0;
+    {
+        MappedFile source(path);
+        if (source.data_ == nullptr) {
+            throw runtime_error(string("Cannot open TSP instance file: ") + path);
+        }
+        source_size = source.size_;
+        source_checksum = fnv1a_64(source.data_, source.size_);
+    }
+
+    MappedFile cache(cache_path.c_str());
+    if (cache.data_ != nullptr && cache.size_ >= sizeof(InstanceCacheHeader)) {
+        InstanceCacheHeader header;
+        memcpy(&header, cache.data_, sizeof(header));
+        const InstanceCacheHeader expected;
+
+        const auto nn_needed = min(nn_count, header.dimension_ - 1);
+
+        if (memcmp(header.magic_, expected.magic_, sizeof(header.magic_)) == 0
+                && header.version_ == InstanceCacheHeader::CurrentVersion
+                && header.header_size_ == sizeof(header)
+                && header.file_size_ == cache.size_
+                && header.source_size_ == source_size
+                && header.source_checksum_ == source_checksum
+                && header.dimension_ > 0
+                && header.nn_count_ >= nn_needed
+                && section_fits(header.name_offset_, header.name_size_, 1, cache.size_)
+                && section_fits(header.coords_offset_, header.coords_count_,
+                                sizeof(Vec2d), cache.size_)
+                && section_fits(header.distances_offset_, header.distances_count_,
+                                sizeof(double), cache.size_)
+                && section_fits(header.nn_lists_offset_,
+                                static_cast<uint64_t>(header.dimension_) * header.nn_count_,
+                                sizeof(uint32_t), cache.size_)) {
+
+            cout << "Loading TSP instance from cache file:" << cache_path << "\n";
+
+            const auto *data = cache.data_;
+            string name(reinterpret_cast<const char *>(data + header.name_offset_), header.name_size_);
+
+            const auto *coords_ptr = reinterpret_cast<const Vec2d *>(data + header.coords_offset_);
+            vector<Vec2d> coords(coords_ptr, coords_ptr + header.coords_count_);
+
+            const auto *dist_ptr = reinterpret_cast<const double *>(data + header.distances_offset_);
+            vector<double> distances(dist_ptr, dist_ptr + header.distances_count_);
+
+            ProblemInstance problem(header.dimension_,
+                                    static_cast<EdgeWeightType>(header.edge_weight_type_),
+                                    std::move(coords), distances,
+                                    header.is_symmetric_ != 0, name,
+                                    /*best_known_cost*/ -1,
+                                    distances_memory_budget);
+
+            Timer nn_lists_timer;
+            problem.set_nn_lists(reinterpret_cast<const uint32_t *>(data + header.nn_lists_offset_),
+                                 header.nn_count_, nn_needed);
+            problem.nn_lists_build_time_ = nn_lists_timer();
+            return problem;
+        }
+    }
+
+    auto problem = load_tsplib_instance(path, distances_memory_budget);
+    problem.compute_nn_lists(nn_count);
+    write_instance_cache(problem, cache_path, source_size, source_checksum);
+    return problem;
 }
 
 
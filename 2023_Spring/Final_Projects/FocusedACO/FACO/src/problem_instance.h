@@ -21,6 +21,32 @@
 enum EdgeWeightType { EUC_2D, EXPLICIT, GEO, ATT, CEIL_2D };
 
 
+/*
+ * How the distances are obtained by ProblemInstance::get_distance:
+ *
+ * FullMatrix -- all distances are stored in a matrix (int32_t, or double for
+ *               EXPLICIT instances)
+ * NNTable    -- only the distances to the nearest neighbors are stored
+ *               (see get_nn_distance), the rest are computed on the fly
+ * OnTheFly   -- all distances are computed from the coordinates
+ */
+enum class DistanceTier { FullMatrix, NNTable, OnTheFly };
+
+// The default amount of memory that can be used to store the distances
+constexpr uint64_t DefaultDistancesMemoryBudget = UINT64_C(64) << 20;
+
+// The largest instance whose int32 distance matrix fits in the budget
+// returned by get_auto_distances_memory_budget()
+constexpr uint64_t AutoBudgetMaxMatrixDimension = 20000;
+
+/*
+ * Returns the memory budget for the distances sized from the physical memory:
+ * a quarter of it, but no more than the int32 distance matrix of an instance
+ * with AutoBudgetMaxMatrixDimension nodes (~1.5 GB).
+ */
+uint64_t get_auto_distances_memory_budget();
+
+
 inline int32_t euc2d_distance(const Vec2d &p1, const Vec2d &p2) {
     return static_cast<int32_t>((p2 - p1).length() + 0.5);
 }
@@ -117,7 +143,13 @@ struct ProblemInstance {
     uint32_t dimension_;
     EdgeWeightType edge_weight_type_ = EUC_2D;
     std::vector<Point> coords_;  // Locations of the instance cities
-    std::vector<double> distance_matrix_;
+    std::vector<double> distance_matrix_;  // Only for the EXPLICIT instances
+    // The distances are integers for all the other edge weight types
+    std::vector<int32_t> int_distance_matrix_;
+    // Distances to the nearest neighbors, parallel to all_nearest_neighbors_
+    std::vector<int32_t> nn_distances_;
+    DistanceTier distance_tier_ = DistanceTier::OnTheFly;
+    uint64_t distances_memory_budget_ = DefaultDistancesMemoryBudget;  // in bytes
     // This stores a specified number of nearest neighbors for every node
     std::vector<uint32_t> all_nearest_neighbors_;
     uint32_t total_nn_per_node_ = 0;
@@ -126,6 +158,7 @@ struct ProblemInstance {
     double best_known_cost_ = -1;
     // k-d tree instance for efficient computation of the nearest neighbors
     mutable std::unique_ptr<KDTree> kdtree_ = nullptr;
+    double nn_lists_build_time_ = 0;  // in seconds
 
 
     ProblemInstance(uint32_t dimension,
@@ -134,10 +167,12 @@ struct ProblemInstance {
                     const std::vector<double> &distance_matrix,
                     bool is_symmetric,
                     std::string name = "Unknown",
-                    double best_known_cost = -1)
+                    double best_known_cost = -1,
+                    uint64_t distances_memory_budget = DefaultDistancesMemoryBudget)
         : dimension_(dimension),
           coords_(std::move(coords)),
           distance_matrix_(distance_matrix),
+          distances_memory_budget_(distances_memory_budget),
           is_symmetric_(is_symmetric),
           name_(std::move(name)),
           best_known_cost_(best_known_cost) {
@@ -150,63 +185,161 @@ struct ProblemInstance {
             // We can use kd-tree to speed up nearest neighbor calculations
             kdtree_ = std::make_unique<KDTree>(coords_);
         }
-        // For smaller instances we can pre-calculate distances for faster
-        // computations
-        if (distance_matrix.empty() && dimension_ < 2000) {
-            std::vector<double> mat(dimension_ * dimension_);
-            for (uint32_t i = 0; i < dimension_; ++i) {
-                for (uint32_t j = 0; j < dimension_; ++j) {
-                    mat[i * dimension_ + j] = get_distance(i, j);
+        // If the matrix fits in the memory budget, we can pre-calculate
+        // distances for faster computations. Otherwise, the distances to the
+        // nearest neighbors are stored once the NN lists are known
+        const auto matrix_size = static_cast<uint64_t>(dimension_) * dimension_;
+        if (!distance_matrix_.empty()) {
+            distance_tier_ = DistanceTier::FullMatrix;
+        } else if (matrix_size * sizeof(int32_t) <= distances_memory_budget_) {
+            distance_tier_ = DistanceTier::FullMatrix;
+            int_distance_matrix_.resize(matrix_size);
+
+            const auto n = static_cast<int32_t>(dimension_);
+            #pragma omp parallel for default(none) shared(n) schedule(static)
+            for (int32_t i = 0; i < n; ++i) {
+                auto row = int_distance_matrix_.begin() + static_cast<int64_t>(i) * n;
+                for (int32_t j = 0; j < n; ++j) {
+                    row[j] = compute_distance(static_cast<uint32_t>(i),
+                                              static_cast<uint32_t>(j));
                 }
             }
-            distance_matrix_ = mat;
+        } else {
+            distance_tier_ = DistanceTier::NNTable;
+        }
+    }
+
+    [[nodiscard]] static const char *get_distance_tier_name(DistanceTier tier) {
+        switch (tier) {
+            case DistanceTier::FullMatrix: return "full matrix";
+            case DistanceTier::NNTable:    return "nn table";
+            default:                       return "on the fly";
+        }
+    }
+
+    /*
+     * Stores the distances to the nearest neighbors if the NNTable tier was
+     * selected and the table fits in the memory budget. Otherwise the tier is
+     * changed to OnTheFly.
+     */
+    void compute_nn_distances() {
+        if (distance_tier_ == DistanceTier::FullMatrix) {
+            return ;
+        }
+        nn_distances_.clear();
+        const auto table_size = all_nearest_neighbors_.size();
+        if (table_size * sizeof(int32_t) > distances_memory_budget_) {
+            distance_tier_ = DistanceTier::OnTheFly;
+            return ;
+        }
+        distance_tier_ = DistanceTier::NNTable;
+        nn_distances_.resize(table_size);
+
+        const auto n = static_cast<int32_t>(dimension_);
+        const auto k = total_nn_per_node_;
+        #pragma omp parallel for default(none) shared(n, k) schedule(static)
+        for (int32_t i = 0; i < n; ++i) {
+            const auto node = static_cast<uint32_t>(i);
+            const auto offset = static_cast<size_t>(node) * k;
+            for (uint32_t j = 0; j < k; ++j) {
+                nn_distances_[offset + j] = compute_distance(node, all_nearest_neighbors_[offset + j]);
+            }
         }
     }
 
+    /*
+     * Computes nn_count nearest neighbors lists of all the nodes.
+     *
+     * The lists are computed in parallel. If the k-d tree is available, the
+     * nodes are processed in chunks following the order of the tree's
+     * buckets, i.e. nodes close in space are processed by the same thread
+     * one after another, which improves the cache utilization. Each list is
+     * written directly to its place in all_nearest_neighbors_ so the result
+     * does not depend on the # of threads.
+     */
     void compute_nn_lists(uint32_t nn_count) {
+        Timer timer;
+
         total_nn_per_node_ = std::min(nn_count, dimension_ - 1);
-        all_nearest_neighbors_.reserve(dimension_ * total_nn_per_node_);
+        all_nearest_neighbors_.resize(static_cast<size_t>(dimension_) * total_nn_per_node_);
 
-        if (kdtree_ != nullptr) {
-            auto &kdtree = *kdtree_;
-            uint32_t n = kdtree.get_points_count();
+        const int32_t ChunkSize = 256;
+        const auto k = total_nn_per_node_;
+        const auto n = static_cast<int32_t>(dimension_);
 
-            for (uint32_t node = 0; node < n; ++node) {
-                for (uint32_t j = 0; j < total_nn_per_node_; ++j) {
-                    auto pt_idx = kdtree.nn_bottom_up(node);
-                    all_nearest_neighbors_.push_back(pt_idx);
-                    kdtree.delete_point(pt_idx);
-                }
+        if (kdtree_ != nullptr) {
+            const auto &kdtree = *kdtree_;
+            // Nodes grouped by the k-d tree's buckets
+            const auto &node_order = kdtree.bucket_points_;
 
-                // Revert changes so that kdtree can be reused for other
-                // lists
-                for (auto pt_idx : get_nearest_neighbors(node, total_nn_per_node_)) {
-                    kdtree.undelete_point(pt_idx);
+            #pragma omp parallel default(none) shared(kdtree, node_order, k, n, ChunkSize)
+            {
+                KDTree::KnnHeap heap;
+                std::vector<uint32_t> neighbors;
+                heap.reserve(k);
+                neighbors.reserve(k);
+
+                #pragma omp for schedule(dynamic, ChunkSize)
+                for (int32_t i = 0; i < n; ++i) {
+                    const auto node = node_order[static_cast<size_t>(i)];
+                    kdtree.knn(node, k, heap, neighbors);
+                    std::copy(neighbors.begin(), neighbors.end(),
+                              all_nearest_neighbors_.begin() + static_cast<int64_t>(node) * k);
                 }
             }
         } else {
-            for (uint32_t node = 0; node < dimension_; ++node) {
+            #pragma omp parallel default(none) shared(k, n, ChunkSize)
+            {
                 std::vector<uint32_t> neighbors;
                 neighbors.reserve(dimension_);
-                for (uint32_t i = 0; i < dimension_; ++i) {
-                    if (i != node) {
-                        neighbors.push_back(i);
+
+                #pragma omp for schedule(dynamic, ChunkSize)
+                for (int32_t i = 0; i < n; ++i) {
+                    const auto node = static_cast<uint32_t>(i);
+                    neighbors.clear();
+                    for (uint32_t j = 0; j < dimension_; ++j) {
+                        if (j != node) {
+                            neighbors.push_back(j);
+                        }
                     }
-                }
-                // This puts the closest cand_list_size + 1 nodes in front of
-                // the array (and sorted)
-                partial_sort(neighbors.begin(),
-                            neighbors.begin() + std::min(total_nn_per_node_, dimension_),
-                            neighbors.end(),
-                            [this, node](uint32_t a, uint32_t b) {
-                                return this->get_distance(node, a) < this->get_distance(node, b);
-                            });
-
-                for (uint32_t i = 0; i < total_nn_per_node_; ++i) {
-                    all_nearest_neighbors_.push_back(neighbors.at(i));
+                    // This puts the closest cand_list_size + 1 nodes in front of
+                    // the array (and sorted)
+                    partial_sort(neighbors.begin(),
+                                neighbors.begin() + k,
+                                neighbors.end(),
+                                [this, node](uint32_t a, uint32_t b) {
+                                    return this->get_distance(node, a) < this->get_distance(node, b);
+                                });
+
+                    std::copy(neighbors.begin(), neighbors.begin() + k,
+                              all_nearest_neighbors_.begin() + static_cast<int64_t>(node) * k);
                 }
             }
         }
+        compute_nn_distances();
+        nn_lists_build_time_ = timer();
+    }
+
+    /*
+     * Sets the nearest neighbors lists from the lists_nn_count long lists
+     * stored one after another, e.g. loaded from a cache file. Only the first
+     * nn_count neighbors of each node are kept.
+     */
+    void set_nn_lists(const uint32_t *lists, uint32_t lists_nn_count, uint32_t nn_count) {
+        assert(nn_count <= lists_nn_count);
+        total_nn_per_node_ = nn_count;
+        all_nearest_neighbors_.resize(static_cast<size_t>(dimension_) * nn_count);
+
+        if (nn_count == lists_nn_count) {
+            std::copy(lists, lists + all_nearest_neighbors_.size(), all_nearest_neighbors_.begin());
+        } else {
+            for (uint32_t node = 0; node < dimension_; ++node) {
+                const auto *list = lists + static_cast<size_t>(node) * lists_nn_count;
+                std::copy(list, list + nn_count,
+                          all_nearest_neighbors_.begin() + static_cast<int64_t>(node) * nn_count);
+            }
+        }
+        compute_nn_distances();
     }
 
     NodeList get_nearest_neighbors(uint32_t node, uint32_t nn_length) const {
@@ -233,8 +366,32 @@ struct ProblemInstance {
     double get_distance(uint32_t from, uint32_t to) const {
         assert((from < dimension_) && (to < dimension_));
 
+        if (!int_distance_matrix_.empty()) {
+            return int_distance_matrix_[static_cast<size_t>(from) * dimension_ + to];
+        }
+        if (!distance_matrix_.empty()) {
+            return distance_matrix_[static_cast<size_t>(from) * dimension_ + to];
+        }
+        return compute_distance(from, to);
+    }
+
+    /*
+     * Returns the distance between the node and its index-th nearest neighbor,
+     * i.e. get_distance(node, get_nearest_neighbors(node, ...)[index])
+     */
+    double get_nn_distance(uint32_t node, uint32_t index) const {
+        assert(index < total_nn_per_node_);
+        const auto offset = static_cast<size_t>(node) * total_nn_per_node_ + index;
+        if (!nn_distances_.empty()) {
+            return nn_distances_[offset];
+        }
+        return get_distance(node, all_nearest_neighbors_[offset]);
+    }
+
+    // Computes the distance from the coordinates (or reads the explicit one)
+    double compute_distance(uint32_t from, uint32_t to) const {
         if (!distance_matrix_.empty()) {
-            return distance_matrix_[from * dimension_ + to];
+            return distance_matrix_[static_cast<size_t>(from) * dimension_ + to];
         }
 
         auto a = coords_[from];
@@ -252,7 +409,7 @@ struct ProblemInstance {
             return att_distance(a, b);
         }
         // else edge_weight_type_ == EXPLICIT
-        assert(!distance_matrix_.empty());
+        assert(false);
         return 0;
     }
 
@@ -288,6 +445,11 @@ struct ProblemInstance {
         tour.push_back(start_node);
 
         if (kdtree_ != nullptr) {
+            // The points are temporarily deleted from the shared k-d tree, so
+            // only one tour can be built at a time (e.g. by the island model
+            // colonies)
+            #pragma omp critical(build_nn_tour_kdtree)
+            {
             auto &kdtree = *kdtree_;
             kdtree.delete_point(start_node);
 
@@ -300,6 +462,7 @@ struct ProblemInstance {
             for (auto it = tour.rbegin(); it != tour.rend(); ++it) {
                 kdtree.undelete_point(*it);
             }
+            }
         } else {  // Use NN lists
             Bitmask visited(dimension_);
             visited.set_bit(start_node);
@@ -350,7 +513,24 @@ struct ProblemInstance {
  *
  * Returns the loaded problem instance.
  */
-ProblemInstance load_tsplib_instance(const char *path);
+ProblemInstance load_tsplib_instance(const char *path,
+                                     uint64_t distances_memory_budget=DefaultDistancesMemoryBudget);
+
+
+/**
+ * Loads a TSPLIB instance along with its nn_count nearest neighbors lists
+ * using a binary cache file stored next to the instance file (path + ".cache").
+ *
+ * If the cache does not exist, is stale (the instance file has changed) or
+ * contains too short NN lists, the instance is parsed with
+ * load_tsplib_instance, the NN lists are computed and the cache is
+ * (re)written. Otherwise the cache file is memory-mapped and the data are
+ * taken from it directly, which is much faster than parsing the text.
+ *
+ * Failing to write the cache is not an error, only a warning is printed.
+ */
+ProblemInstance load_tsplib_instance_cached(const char *path, uint32_t nn_count,
+                                            uint64_t distances_memory_budget=DefaultDistancesMemoryBudget);
 
 
 void route_to_svg(const ProblemInstance &instance,
@@ -0,0 +1,109 @@
+/**
+ * Low-overhead instrumentation of the FACO main loop: per-thread counters of
+ * the solution construction events and per-phase timers based on the CPU's
+ * time-stamp counter (TSC).
+ *
+ * Each thread updates its own ConstructionStats and PhaseTimers, so that no
+ * synchronization is needed in the hot path; the values are summed after the
+ * parallel region.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+struct ConstructionStats {
+    int64_t select_next_node_calls_ = 0;
+    int64_t backup_list_hits_ = 0;          // Node taken from the backup list
+    int64_t max_product_fallbacks_ = 0;     // Backup list exhausted
+    int64_t fallback_unvisited_nodes_ = 0;  // Sum of the # of unvisited nodes at these fallbacks
+
+    ConstructionStats &operator+=(const ConstructionStats &other) {
+        select_next_node_calls_ += other.select_next_node_calls_;
+        backup_list_hits_ += other.backup_list_hits_;
+        max_product_fallbacks_ += other.max_product_fallbacks_;
+        fallback_unvisited_nodes_ += other.fallback_unvisited_nodes_;
+        return *this;
+    }
+};
+
+
+// Returns the current value of the TSC or, if it is not available, of
+// a nanosecond clock
+inline uint64_t read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+enum class Phase : uint32_t {
+    CacheRefresh = 0,
+    Construction,
+    LocalSearch,
+    Evaporation,
+    Deposition,
+    BarrierWait,  // Waiting for the other threads at the explicit barriers
+    Count
+};
+
+static constexpr uint32_t PhasesCount = static_cast<uint32_t>(Phase::Count);
+
+// Used as the keys in the computations log
+static const char *const PhaseNames[PhasesCount] = {
+    "cache refresh", "construction", "local search", "evaporation", "deposition",
+    "barrier wait"
+};
+
+
+struct PhaseTimers {
+    uint64_t cycles_[PhasesCount] = {};
+
+    // Adds the cycles elapsed since start to the phase and returns the
+    // current counter value, so that the calls can be chained
+    uint64_t add(Phase phase, uint64_t start) {
+        const auto now = read_cycle_counter();
+        cycles_[static_cast<uint32_t>(phase)] += now - start;
+        return now;
+    }
+
+    [[nodiscard]] uint64_t get(Phase phase) const {
+        return cycles_[static_cast<uint32_t>(phase)];
+    }
+
+    // Element-wise max, i.e. the time of the slowest thread
+    void merge_max(const PhaseTimers &other) {
+        for (uint32_t i = 0; i < PhasesCount; ++i) {
+            cycles_[i] = std::max(cycles_[i], other.cycles_[i]);
+        }
+    }
+};
+
+
+/*
+ * Converts the cycle counts into seconds. The TSC frequency is estimated
+ * from the # of cycles and the wall-clock time elapsed between the
+ * constructor and the call to get_cycles_per_sec(), hence it should be
+ * called at the end of the measured computations.
+ */
+class CycleClock {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start_time_ = Clock::now();
+    uint64_t start_cycles_ = read_cycle_counter();
+
+public:
+    [[nodiscard]] double get_cycles_per_sec() const {
+        const auto cycles = read_cycle_counter() - start_cycles_;
+        const std::chrono::duration<double> elapsed = Clock::now() - start_time_;
+        return (elapsed.count() > 0) ? static_cast<double>(cycles) / elapsed.count() : 1.0;
+    }
+};
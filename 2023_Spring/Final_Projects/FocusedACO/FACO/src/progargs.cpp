@@ -58,7 +58,7 @@ struct OptionsParser {
 ProgramOptions parse_program_options(int argc, char *argv[]) {
     ProgramOptions opts;
     OptionsParser p;
-    p.add("alg", "Algorithm name [faco,mmas]", opts.algorithm_);
+    p.add("alg", "Algorithm name [faco,mmas,mmas-matrix]", opts.algorithm_);
 
     p.add("a,ants", "Number of ants", opts.ants_count_);
 
@@ -68,6 +68,9 @@ ProgramOptions parse_program_options(int argc, char *argv[]) {
 
     p.add("cand-list-size", "Size of the candidate list", opts.cand_list_size_);
 
+    p.add("compact-cache", "Use single-precision pheromone * heuristic cache (with AVX2)",
+          opts.compact_cache_);
+
     p.add("id", "Id of the experiment (optional)", opts.id_);
 
     p.add("gbest-as-source-prob",
@@ -76,19 +79,37 @@ ProgramOptions parse_program_options(int argc, char *argv[]) {
 
     p.add("i,iterations", "Iterations count", opts.iterations_);
 
-    p.add("local-search", "Should local search be used", opts.local_search_);
+    p.add("local-search", "Local search: 0 - none, 1 - 2-opt, 2 - 3-opt", opts.local_search_);
+
+    p.add("ls-order", "Order of checking nodes by the 3-opt local search [fifo,gain]",
+          opts.ls_order_);
 
     p.add("ls-cand-list-size", "# of nearest nodes considered by the local search", opts.ls_cand_list_size_);
 
+    p.add("two-level-list", "Use the two-level doubly-linked list tour in the full local search (not the ants' checklist LS)",
+          opts.two_level_list_);
+
+    p.add("ls-batch", "Run the 2-opt for all the ants of an iteration as a single batch",
+          opts.ls_batch_);
+
     p.add("min-new-edges", "Min # of new edges in a constructed sol.", opts.min_new_edges_);
 
     p.add("p-best", "p_best parameter of the MMAS", opts.p_best_);
 
+    p.add("lazy-evaporation", "Evaporate the pheromone trails lazily, when they are used",
+          opts.lazy_evaporation_);
+
     p.add("picture", "Generate route picture in SVG format?", opts.save_route_picture_);
 
     p.add("p,problem", "Path to a TSP instance in the TSPLIB format",
                opts.problem_path_);
 
+    p.add("instance-cache", "Use (and create) a binary cache of the instance and its NN lists",
+          opts.instance_cache_);
+
+    p.add("distances-memory-mb", "Memory budget (MB) for the distance matrix / NN distances table, 0 - auto",
+          opts.distances_memory_mb_);
+
     p.add("results-dir", "Where to store the results", opts.results_dir_);
 
     p.add("rho", "How much of the pheromone remains after evaporation", opts.rho_);
@@ -99,9 +120,47 @@ ProgramOptions parse_program_options(int argc, char *argv[]) {
 
     p.add("threads", "If > 0 then sets the # of threads used", opts.threads_);
 
-    p.add("dump-log", "Enable logging of local search", opts.dump_log_);
+    p.add("thread-scaling", "Run for 1, 2, 4, ... up to --threads threads and report iterations/sec",
+          opts.thread_scaling_);
+
+    p.add("islands", "# of FACO colonies (islands) exchanging their best solutions",
+          opts.islands_);
+
+    p.add("migration-interval", "# of iterations between migrations of the best solutions",
+          opts.migration_interval_);
+
+    p.add("island-rho", "Comma separated values of rho for the islands", opts.island_rho_);
+
+    p.add("island-min-new-edges", "Comma separated values of min-new-edges for the islands",
+          opts.island_min_new_edges_);
+
+    p.add("island-gbest-prob", "Comma separated values of gbest-as-source-prob for the islands",
+          opts.island_gbest_prob_);
+
+    p.add("time-limit", "If > 0 then the FACO stops after this # of seconds", opts.time_limit_);
+
+    p.add("checkpoint", "Path of the file to which the FACO state is periodically saved",
+          opts.checkpoint_path_);
+
+    p.add("checkpoint-interval", "Time (sec.) between the checkpoints", opts.checkpoint_interval_);
+
+    p.add("resume", "Continue the FACO run from the checkpoint (if it exists)", opts.resume_);
+
+    p.add("target-errors", "Comma separated relative errors (%) for which the time to reach them is recorded",
+          opts.target_errors_);
+
+    p.add("dump-log", "Write the local search inputs and outputs to stats.bin", opts.dump_log_);
 
     p.parse(argc, argv);
 
+    // Options which have no effect with the selected local search
+    if (opts.ls_batch_ && opts.local_search_ != 1) {
+        std::cerr << "Warning: --ls-batch is used only with --local-search 1 (2-opt), ignoring it\n";
+        opts.ls_batch_ = false;
+    }
+    if (opts.two_level_list_ && opts.local_search_ == 0) {
+        std::cerr << "Warning: --two-level-list has no effect without the local search\n";
+    }
+
     return opts;
 }
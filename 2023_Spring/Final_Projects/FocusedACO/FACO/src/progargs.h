@@ -22,6 +22,10 @@ struct ProgramOptions {
 
     uint32_t cand_list_size_ = 16;
 
+    // If true, the pheromone * heuristic products for the candidate lists are
+    // cached in single precision and processed with AVX2 (if available)
+    bool compact_cache_ = false;
+
     std::string id_ = "default";  // Id of the comp. experiment
 
     // Probability of using the current global best as a source solution
@@ -29,18 +33,46 @@ struct ProgramOptions {
 
     int32_t iterations_ = 5 * 1000;
 
-    int32_t local_search_ = 1;  // 0 - no local search, 1 - default LS
+    int32_t local_search_ = 1;  // 0 - no local search, 1 - default LS (2-opt),
+                                // 2 - 3-opt (FACO only)
+
+    // Order in which the 3-opt checks the active nodes [fifo, gain]
+    std::string ls_order_ = "fifo";
 
     uint32_t ls_cand_list_size_ = 20u;  // #nodes used by the LS heuristics
 
+    // If true, the full 2-opt/3-opt (of the initial routes, and of the ants'
+    // routes in MMAS) use the two-level doubly-linked list tour instead of a
+    // vector, i.e. a 2-opt move takes O(sqrt(n)) time
+    bool two_level_list_ = false;
+
+    // If true, the 2-opt is run for all the ants of an iteration as a single
+    // batch (see TwoOptBatch) instead of for each ant separately
+    bool ls_batch_ = false;
+
     uint32_t min_new_edges_ = 8;
 
     // Prob. that a solution will contain only edges with the
     // highest pheromone levels. Used to calculate pheromone trail limits.
     double p_best_ = 0.1;
 
+    // If true, the pheromone evaporation is applied lazily, i.e. only to the
+    // trails which are read or increased
+    bool lazy_evaporation_ = false;
+
     std::string problem_path_ = "kroA100.tsp";
 
+    // If true, the parsed instance and its NN lists are stored in a binary
+    // cache file next to the instance file and reused by later runs
+    bool instance_cache_ = false;
+
+    // Memory (in MB) which can be used to store the distances: the full
+    // (int32) distance matrix is used if it fits, otherwise only the
+    // distances to the nearest neighbors are stored.
+    // 0 - a quarter of the physical memory, at most enough for the matrix
+    // of a 20K-node instance (see get_auto_distances_memory_budget)
+    uint32_t distances_memory_mb_ = 0;
+
     // By default the results will be stored in "results" folder
     std::string results_dir_ = "results";
 
@@ -58,6 +90,40 @@ struct ProgramOptions {
 
     int32_t threads_ = 0;  // If > 0 then force specific # of threads in OpenMP
 
+    // If true, the algorithm is run once for every # of threads in
+    // 1, 2, 4, ... up to threads_ (or # of cores) to measure the speedup
+    bool thread_scaling_ = false;
+
+    // If > 1 then the FACO is run as an island model with this number of
+    // colonies, each using its own group of threads
+    uint32_t islands_ = 1;
+
+    // Every migration_interval_ iterations each colony sends its best
+    // solution to the next colony
+    uint32_t migration_interval_ = 100;
+
+    // Comma separated per-island values of rho, min_new_edges_ and
+    // gbest_as_source_prob_ (if empty, the common value is used)
+    std::string island_rho_;
+    std::string island_min_new_edges_;
+    std::string island_gbest_prob_;
+
+    // If > 0 then the FACO stops after the iteration in which the total
+    // computation time (in sec.) reached this limit
+    double time_limit_ = 0;
+
+    // If not empty, the state of the FACO is periodically saved to this file
+    std::string checkpoint_path_;
+
+    double checkpoint_interval_ = 60;  // Time (sec.) between the checkpoints
+
+    // If true, the run is continued from the checkpoint (if it exists)
+    bool resume_ = false;
+
+    // Comma separated relative errors (%) for which the time needed by the
+    // FACO to reach them is recorded
+    std::string target_errors_ = "5,2,1,0.5,0.1,0";
+
     bool dump_log_ = false; // whether or not to dump log for local search
 };
 
@@ -69,20 +135,38 @@ void dump(const ProgramOptions &opt, MapT &map) {
     map["backup list size"] = opt.backup_list_size_;
     map["beta"] = opt.beta_;
     map["cand list size"] = opt.cand_list_size_;
+    map["compact cache"] = opt.compact_cache_;
     map["id"] = opt.id_;
     map["gbest as source prob"] = opt.gbest_as_source_prob_;
     map["iterations"] = opt.iterations_;
     map["local search"] = opt.local_search_;
+    map["ls order"] = opt.ls_order_;
     map["ls cand list size"] = opt.ls_cand_list_size_;
+    map["two level list"] = opt.two_level_list_;
+    map["ls batch"] = opt.ls_batch_;
     map["min new edges"] = opt.min_new_edges_;
     map["p best"] = opt.p_best_;
+    map["lazy evaporation"] = opt.lazy_evaporation_;
     map["problem"] = opt.problem_path_;
+    map["instance cache"] = opt.instance_cache_;
+    map["distances memory mb"] = opt.distances_memory_mb_;
     map["results dir"] = opt.results_dir_;
     map["rho"] = opt.rho_;
     map["seed"] = opt.seed_;
     map["picture"] = opt.save_route_picture_;
     map["repeat"] = opt.repeat_;
     map["threads"] = opt.threads_;
+    map["thread scaling"] = opt.thread_scaling_;
+    map["islands"] = opt.islands_;
+    map["migration interval"] = opt.migration_interval_;
+    map["island rho"] = opt.island_rho_;
+    map["island min new edges"] = opt.island_min_new_edges_;
+    map["island gbest prob"] = opt.island_gbest_prob_;
+    map["time limit"] = opt.time_limit_;
+    map["checkpoint"] = opt.checkpoint_path_;
+    map["checkpoint interval"] = opt.checkpoint_interval_;
+    map["resume"] = opt.resume_;
+    map["target errors"] = opt.target_errors_;
     map["dump_log"] = opt.dump_log_;
 }
 
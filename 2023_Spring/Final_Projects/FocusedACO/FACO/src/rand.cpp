@@ -9,16 +9,12 @@
  * This is used to get a default (pseudo-)random number generator (RNG).
  * Every OpenMP thread has its own private instance that is
  * initialized by calling init_random_number_generators().
- * All threads generators share the same sequence of the random numbers,
- * however they are looking at different (non-overlapping) parts of it.
- * This assumes that each thread does not generates more than 2^64 
- * numbers.
  *
  * @return Instance of the RNG for the calling thread.
  */
 Random &get_rng() {
     static Random rng;
-// #pragma omp threadprivate(rng)
+#pragma omp threadprivate(rng)
     return rng;
 }
 
@@ -26,18 +22,18 @@ Random &get_rng() {
  * This should be called before drawing any random numbers.
  */
 void init_random_number_generators(uint64_t seed) {
-    // #pragma omp parallel default(none) shared(seed)
-    {
-        // Each thread sets its own generator to the same initial state
-        get_rng().init(seed);
+    #pragma omp parallel default(none) shared(seed)
+    init_thread_random_number_generator(seed, omp_get_thread_num());
+}
 
-        // Now, each thread has to "jump" within the sequence -- we want
-        // each thread to be in a different part of the whole RNG sequence.
-        // OpenMP threads are numbered from 0 to n-1, so the number of jumps
-        // is equal to the id of a thread.
-        const int thread_id = omp_get_thread_num();
-        for (int i = 0; i < thread_id; ++i) {
-            get_rng().jump();
-        }
+void init_thread_random_number_generator(uint64_t seed, int thread_id) {
+    // Each thread gets its own seed drawn from the SplitMix64 sequence,
+    // OpenMP threads are numbered from 0 to n-1, so the number of steps
+    // is equal to the id of a thread. Thread 0 uses the seed as is.
+    uint64_t state = seed;
+    uint64_t thread_seed = seed;
+    for (int i = 0; i < thread_id; ++i) {
+        thread_seed = splitmix64_next(state);
     }
+    get_rng().init(thread_seed);
 }
@@ -4,6 +4,18 @@
 #include <cstdint>
 #include <limits>
 
+/**
+ * Returns the next value of the SplitMix64 sequence and advances its state.
+ * See: http://xoshiro.di.unimi.it/splitmix64.c
+ */
+inline uint64_t splitmix64_next(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+
 /**
  * This is based on xoroshiro+ algorithm by David Blackman and Sebastiano Vigna
  * as described at: http://xoroshiro.di.unimi.it/
@@ -95,6 +107,18 @@ struct Random {
 
     [[nodiscard]] static uint64_t max() noexcept { return std::numeric_limits<uint64_t>::max(); }
 
+    // The state can be saved and restored to continue the same sequence,
+    // e.g. after resuming the computations from a checkpoint
+    void get_state(uint64_t state[2]) const {
+        state[0] = state_[0];
+        state[1] = state_[1];
+    }
+
+    void set_state(const uint64_t state[2]) {
+        state_[0] = state[0];
+        state_[1] = state[1];
+    }
+
 private:
 
     /**
@@ -125,18 +149,28 @@ private:
  * This is used to get a default (pseudo-)random number generator (RNG).
  * Every OpenMP thread has its own private instance that is
  * initialized by calling init_random_number_generators().
- * All threads generators share the same sequence of the random numbers,
- * however they are looking at different (non-overlapping) parts of it.
- * This assumes that each thread does not generates more than 2^64 
- * numbers.
  *
  * @return Instance of the RNG for the calling thread.
  */
 Random &get_rng();
 
 /**
- * This should be called before drawing any random numbers.
+ * This should be called before drawing any random numbers, and after the
+ * number of OpenMP threads has been set.
+ *
+ * Thread 0 is seeded with the given seed, thread i > 0 with the i-th value
+ * of the SplitMix64 sequence started at seed. For a fixed number of threads
+ * the computations are thus repeatable.
  */
 void init_random_number_generators(uint64_t seed);
 
+/**
+ * Initializes the RNG of the calling thread in the same way as
+ * init_random_number_generators() does for the thread_id-th thread of a team.
+ *
+ * This is needed for nested parallel regions, whose threads (and their private
+ * RNGs) are not guaranteed to persist between the regions.
+ */
+void init_thread_random_number_generator(uint64_t seed, int thread_id);
+
 #endif
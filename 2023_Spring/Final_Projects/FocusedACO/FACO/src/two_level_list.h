@@ -0,0 +1,367 @@
+/**
+ * @author: Rafał Skinderowicz (rafal.skinderowicz@us.edu.pl)
+*/
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+/**
+ * Two-level doubly-linked list representation of a tour as described in:
+ *
+ * Fredman, Michael L., et al. "Data structures for traveling salesmen."
+ * Journal of Algorithms 18.3 (1995): 432-479.
+ *
+ * The tour is divided into roughly sqrt(n) segments. The nodes of a segment
+ * form a doubly-linked list and are numbered with consecutive ranks. Each
+ * segment has a reversal bit, so a sequence of whole segments can be
+ * reversed by reordering the segments and flipping their bits. As a result
+ * reverse_path() takes O(sqrt(n)) time instead of O(n) needed for
+ * a vector-based route.
+ *
+ * The order of the segments is kept in a (circular) vector. A path is
+ * reversed by splitting its end segments so that the path consists of
+ * whole segments, which creates new segments. When there are too many of
+ * them the whole structure is rebuilt, which keeps the amortized cost at
+ * O(sqrt(n)).
+ *
+ * A global reversal bit allows to reverse the shorter of the path and its
+ * complement -- both give the same tour up to its orientation.
+ */
+class TwoLevelList {
+public:
+    enum : uint32_t { Nil = std::numeric_limits<uint32_t>::max() };
+
+    struct Node {
+        uint32_t next_ = Nil;  // Next node in the same segment (not reversed)
+        uint32_t prev_ = Nil;  // Previous node in the same segment
+        uint32_t segment_ = 0;
+        int32_t rank_ = 0;     // Consecutive numbers within segment
+    };
+
+    struct Segment {
+        uint32_t first_ = Nil;  // Ignoring reversed_ flag
+        uint32_t last_ = Nil;
+        uint32_t size_ = 0;
+        uint32_t rank_ = 0;     // Position in order_
+        bool reversed_ = false;
+    };
+
+    explicit TwoLevelList(const std::vector<uint32_t> &route) {
+        rebuild(route);
+    }
+
+    void rebuild(const std::vector<uint32_t> &route) {
+        const auto n = static_cast<uint32_t>(route.size());
+        assert(n >= 2);
+
+        group_size_ = std::max(8u, static_cast<uint32_t>(std::sqrt(n)));
+        const auto segments_count = (n + group_size_ - 1) / group_size_;
+        max_segments_ = 2 * segments_count + 8;
+
+        nodes_.resize(n);
+        segments_.clear();
+        segments_.reserve(max_segments_ + 2);
+        order_.clear();
+        order_.reserve(max_segments_ + 2);
+        reversed_ = false;
+
+        for (uint32_t i = 0; i < n; i += group_size_) {
+            const auto end = std::min(n, i + group_size_);
+            const auto seg_id = static_cast<uint32_t>(segments_.size());
+
+            Segment seg;
+            seg.first_ = route[i];
+            seg.last_ = route[end - 1];
+            seg.size_ = end - i;
+            seg.rank_ = static_cast<uint32_t>(order_.size());
+            segments_.push_back(seg);
+            order_.push_back(seg_id);
+
+            for (uint32_t j = i; j < end; ++j) {
+                auto &node = nodes_[route[j]];
+                node.prev_ = (j > i) ? route[j - 1] : Nil;
+                node.next_ = (j + 1 < end) ? route[j + 1] : Nil;
+                node.segment_ = seg_id;
+                node.rank_ = static_cast<int32_t>(j);
+            }
+        }
+    }
+
+    [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(nodes_.size()); }
+
+    [[nodiscard]] uint32_t succ(uint32_t node) const {
+        return reversed_ ? raw_pred(node) : raw_succ(node);
+    }
+
+    [[nodiscard]] uint32_t pred(uint32_t node) const {
+        return reversed_ ? raw_succ(node) : raw_pred(node);
+    }
+
+    /*
+     * Returns a key which is increasing along the tour, starting from some
+     * (unspecified) node. It can be used to find the order in which nodes
+     * appear on the tour.
+     */
+    [[nodiscard]] int64_t sequence(uint32_t node) const {
+        const auto &seg = segments_[nodes_[node].segment_];
+        const int64_t key = (static_cast<int64_t>(seg.rank_) << 32) + seq(node);
+        return reversed_ ? -key : key;
+    }
+
+    /*
+     * Reverses the path which starts at first and, going in the successor
+     * direction, ends at last.
+     */
+    void reverse_path(uint32_t first, uint32_t last) {
+        if (reversed_) {
+            raw_reverse(last, first);
+        } else {
+            raw_reverse(first, last);
+        }
+        if (order_.size() > max_segments_) {
+            std::vector<uint32_t> route;
+            to_vector(route);
+            rebuild(route);
+        }
+    }
+
+    void to_vector(std::vector<uint32_t> &route) const {
+        route.resize(size());
+        // Segment by segment, in the raw order -- reversed at the end if needed
+        auto out = route.begin();
+        for (auto seg_id : order_) {
+            const auto &seg = segments_[seg_id];
+            if (seg.reversed_) {
+                for (auto node = seg.last_; node != Nil; node = nodes_[node].prev_) {
+                    *out++ = node;
+                }
+            } else {
+                for (auto node = seg.first_; node != Nil; node = nodes_[node].next_) {
+                    *out++ = node;
+                }
+            }
+        }
+        if (reversed_) {
+            std::reverse(route.begin(), route.end());
+        }
+    }
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<Segment> segments_;
+    std::vector<uint32_t> order_;  // Segments in the tour order
+    bool reversed_ = false;
+    uint32_t group_size_ = 0;
+    uint32_t max_segments_ = 0;
+
+    [[nodiscard]] uint32_t head(const Segment &seg) const {
+        return seg.reversed_ ? seg.last_ : seg.first_;
+    }
+
+    [[nodiscard]] uint32_t tail(const Segment &seg) const {
+        return seg.reversed_ ? seg.first_ : seg.last_;
+    }
+
+    [[nodiscard]] uint32_t next_segment(uint32_t seg_id) const {
+        const auto rank = segments_[seg_id].rank_ + 1;
+        return order_[rank < order_.size() ? rank : 0];
+    }
+
+    [[nodiscard]] uint32_t prev_segment(uint32_t seg_id) const {
+        const auto rank = segments_[seg_id].rank_;
+        return order_[rank > 0 ? rank - 1 : order_.size() - 1];
+    }
+
+    // Successor ignoring the global reversal bit
+    [[nodiscard]] uint32_t raw_succ(uint32_t node) const {
+        const auto &n = nodes_[node];
+        const auto next = segments_[n.segment_].reversed_ ? n.prev_ : n.next_;
+        return next != Nil ? next : head(segments_[next_segment(n.segment_)]);
+    }
+
+    // Predecessor ignoring the global reversal bit
+    [[nodiscard]] uint32_t raw_pred(uint32_t node) const {
+        const auto &n = nodes_[node];
+        const auto prev = segments_[n.segment_].reversed_ ? n.next_ : n.prev_;
+        return prev != Nil ? prev : tail(segments_[prev_segment(n.segment_)]);
+    }
+
+    // Position of the node within its segment, increasing in the raw
+    // successor direction
+    [[nodiscard]] int32_t seq(uint32_t node) const {
+        const auto &n = nodes_[node];
+        return segments_[n.segment_].reversed_ ? -n.rank_ : n.rank_;
+    }
+
+    /*
+     * Reverses the raw path from first to last. If the reversal is done on
+     * the complement of the path then the global reversal bit is flipped.
+     */
+    void raw_reverse(uint32_t first, uint32_t last) {
+        if (nodes_[first].segment_ == nodes_[last].segment_) {
+            if (seq(first) <= seq(last)) {
+                reverse_inside_segment(first, last);
+            } else {
+                // The path goes around the whole tour -- its complement lies
+                // inside the segment
+                const auto comp_first = raw_succ(last);
+                const auto comp_last = raw_pred(first);
+                if (comp_first != first) {
+                    reverse_inside_segment(comp_first, comp_last);
+                }
+                reversed_ = !reversed_;
+            }
+            return ;
+        }
+        split_before(first);
+        split_after(last);
+
+        const auto segments_count = static_cast<uint32_t>(order_.size());
+        const auto first_rank = segments_[nodes_[first].segment_].rank_;
+        const auto last_rank = segments_[nodes_[last].segment_].rank_;
+        const auto path_segments = (last_rank + segments_count - first_rank) % segments_count + 1;
+        const auto complement_segments = segments_count - path_segments;
+
+        if (complement_segments == 0) {  // Whole tour
+            reversed_ = !reversed_;
+        } else if (path_segments <= complement_segments) {
+            reverse_segments(first_rank, path_segments);
+        } else {
+            reverse_segments((last_rank + 1) % segments_count, complement_segments);
+            reversed_ = !reversed_;
+        }
+    }
+
+    /*
+     * Reverses the raw path between first and last, both in the same segment
+     * and first not after last.
+     */
+    void reverse_inside_segment(uint32_t first, uint32_t last) {
+        auto &seg = segments_[nodes_[first].segment_];
+        // In terms of the next_ links (not reversed)
+        auto from = seg.reversed_ ? last : first;
+        auto to = seg.reversed_ ? first : last;
+
+        const auto before = nodes_[from].prev_;
+        const auto after = nodes_[to].next_;
+        auto rank = nodes_[from].rank_;
+        auto prev = before;
+        auto node = to;
+        while (true) {
+            const auto next = nodes_[node].prev_;
+            nodes_[node].prev_ = prev;
+            nodes_[node].rank_ = rank++;
+            if (prev != Nil) {
+                nodes_[prev].next_ = node;
+            } else {
+                seg.first_ = node;
+            }
+            prev = node;
+            if (node == from) {
+                break ;
+            }
+            node = next;
+        }
+        nodes_[from].next_ = after;
+        if (after != Nil) {
+            nodes_[after].prev_ = from;
+        } else {
+            seg.last_ = from;
+        }
+    }
+
+    // Makes node the (raw) head of a segment
+    void split_before(uint32_t node) {
+        const auto seg_id = nodes_[node].segment_;
+        auto &seg = segments_[seg_id];
+        if (node == head(seg)) {
+            return ;
+        }
+        // Nodes preceding node (in the raw order) stay on the other side of
+        // the cut of the next_ links
+        if (seg.reversed_) {
+            split(seg_id, node, nodes_[node].next_);
+        } else {
+            split(seg_id, nodes_[node].prev_, node);
+        }
+    }
+
+    // Makes node the (raw) tail of a segment
+    void split_after(uint32_t node) {
+        const auto &seg = segments_[nodes_[node].segment_];
+        if (node != tail(seg)) {
+            split_before(raw_succ(node));
+        }
+    }
+
+    /*
+     * Cuts the segment between nodes left and right (left.next_ == right).
+     * The smaller part is moved to a new segment.
+     */
+    void split(uint32_t seg_id, uint32_t left, uint32_t right) {
+        auto seg = segments_[seg_id];
+        const auto left_size = static_cast<uint32_t>(nodes_[left].rank_ - nodes_[seg.first_].rank_ + 1);
+        const auto right_size = seg.size_ - left_size;
+        const bool move_left = left_size <= right_size;
+
+        const auto new_id = static_cast<uint32_t>(segments_.size());
+        Segment part;
+        part.reversed_ = seg.reversed_;
+        if (move_left) {
+            part.first_ = seg.first_;
+            part.last_ = left;
+            part.size_ = left_size;
+            seg.first_ = right;
+            seg.size_ = right_size;
+        } else {
+            part.first_ = right;
+            part.last_ = seg.last_;
+            part.size_ = right_size;
+            seg.last_ = left;
+            seg.size_ = left_size;
+        }
+        nodes_[left].next_ = Nil;
+        nodes_[right].prev_ = Nil;
+        for (auto node = part.first_; node != Nil; node = nodes_[node].next_) {
+            nodes_[node].segment_ = new_id;
+        }
+        // The new segment goes before the old one in the raw order if it
+        // contains its head
+        const bool goes_before = (move_left != seg.reversed_);
+        const auto pos = seg.rank_ + (goes_before ? 0 : 1);
+
+        segments_[seg_id] = seg;
+        segments_.push_back(part);
+        order_.insert(order_.begin() + pos, new_id);
+        for (auto i = pos; i < order_.size(); ++i) {
+            segments_[order_[i]].rank_ = i;
+        }
+    }
+
+    /*
+     * Reverses the order of count segments starting at position start
+     * in order_ (circularly).
+     */
+    void reverse_segments(uint32_t start, uint32_t count) {
+        const auto n = static_cast<uint32_t>(order_.size());
+        auto i = start;
+        auto j = (start + count - 1) % n;
+        for (uint32_t k = 0; k < count / 2; ++k) {
+            std::swap(order_[i], order_[j]);
+            i = (i + 1 < n) ? i + 1 : 0;
+            j = (j > 0) ? j - 1 : n - 1;
+        }
+        for (uint32_t k = 0, pos = start; k < count; ++k) {
+            auto &seg = segments_[order_[pos]];
+            seg.rank_ = pos;
+            seg.reversed_ = !seg.reversed_;
+            pos = (pos + 1 < n) ? pos + 1 : 0;
+        }
+    }
+};
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "two_opt_batch.h"
+
+
+/*
+ * This is the same as the flip_route_section in local_search.cpp (and in the
+ * HLS kernel) but works on a row of the routes buffer.
+ */
+static void flip_route_section(uint32_t *route,
+                               uint32_t *pos_in_route,
+                               int32_t length,
+                               int32_t first, int32_t last) {
+    if (first > last) {
+        std::swap(first, last);
+    }
+
+    const int32_t segment_length = last - first;
+    const int32_t remaining_length = length - segment_length;
+
+    if (segment_length <= remaining_length) {  // Reverse the specified segment
+        std::reverse(route + first, route + last);
+
+        for (auto k = first; k < last; ++k) {
+            pos_in_route[ route[k] ] = static_cast<uint32_t>(k);
+        }
+    } else {  // Reverse the rest of the route, leave the segment intact
+        first = (first > 0) ? first - 1 : length - 1;
+        last = last % length;
+        std::swap(first, last);
+        int32_t l = first;
+        int32_t r = last;
+        int32_t i = 0;
+        int32_t j = length - first + last + 1;
+        while(i++ < j--) {
+            std::swap(route[l], route[r]);
+            pos_in_route[route[l]] = static_cast<uint32_t>(l);
+            pos_in_route[route[r]] = static_cast<uint32_t>(r);
+            l = (l+1) % length;
+            r = (r > 0) ? r - 1 : length - 1;
+        }
+    }
+}
+
+
+// Same as euc2d_distance but on the coords_ buffer, so that it can be
+// vectorized
+#pragma omp declare simd uniform(coords) notinbranch
+static inline double coords_distance(const double *coords, uint32_t a, uint32_t b) {
+    const auto dx = coords[2 * b] - coords[2 * a];
+    const auto dy = coords[2 * b + 1] - coords[2 * a + 1];
+    return static_cast<int32_t>(std::sqrt(dx * dx + dy * dy) + 0.5);
+}
+
+
+TwoOptBatch::Workspace::Workspace(uint32_t dimension, uint32_t nn_count)
+    : pos_in_route_(dimension),
+      b_pos_(nn_count),
+      b_succ_(nn_count),
+      b_pred_(nn_count),
+      succ_gain_(nn_count),
+      pred_gain_(nn_count) {
+    checklist_.reserve(dimension);
+}
+
+
+TwoOptBatch::TwoOptBatch(const ProblemInstance &instance,
+                         uint32_t nn_count,
+                         uint32_t batch_size)
+    : dimension_(instance.dimension_),
+      nn_count_(std::min(nn_count, instance.total_nn_per_node_)),
+      batch_size_(batch_size),
+      coords_(2 * static_cast<size_t>(dimension_)),
+      neighbors_(static_cast<size_t>(dimension_) * nn_count_),
+      nn_distances_(static_cast<size_t>(dimension_) * nn_count_),
+      routes_(static_cast<size_t>(batch_size_) * dimension_),
+      checklists_(static_cast<size_t>(batch_size_) * dimension_),
+      checklist_sizes_(batch_size_, 0),
+      changes_(batch_size_, 0) {
+
+    assert(is_supported(instance));
+
+    for (uint32_t node = 0; node < dimension_; ++node) {
+        coords_[2 * node]     = instance.coords_[node].x_;
+        coords_[2 * node + 1] = instance.coords_[node].y_;
+
+        const auto nn_list = instance.get_nearest_neighbors(node, nn_count_);
+        const auto offset = static_cast<size_t>(node) * nn_count_;
+        for (uint32_t index = 0; index < nn_count_; ++index) {
+            neighbors_[offset + index] = nn_list[index];
+            nn_distances_[offset + index] = instance.get_nn_distance(node, index);
+        }
+    }
+}
+
+
+void TwoOptBatch::set_route(uint32_t idx, const std::vector<uint32_t> &route) {
+    assert(idx < batch_size_ && route.size() == dimension_);
+    std::copy(route.begin(), route.end(), get_route(idx));
+}
+
+
+void TwoOptBatch::set_checklist(uint32_t idx, const std::vector<uint32_t> &checklist) {
+    assert(idx < batch_size_ && checklist.size() <= dimension_);
+    std::copy(checklist.begin(), checklist.end(),
+              checklists_.begin() + static_cast<int64_t>(idx) * dimension_);
+    checklist_sizes_[idx] = static_cast<uint32_t>(checklist.size());
+}
+
+
+void TwoOptBatch::copy_route(uint32_t idx, std::vector<uint32_t> &route) const {
+    const auto *row = &routes_[static_cast<size_t>(idx) * dimension_];
+    route.assign(row, row + dimension_);
+}
+
+
+void TwoOptBatch::run(LocalSearchStats *stats) {
+    Workspace ws(dimension_, nn_count_);
+    int64_t evaluated_count = 0;
+    int64_t applied_count = 0;
+
+    // Routes which need more work are spread over the threads by the
+    // interleaving, while the results do not depend on the schedule
+    #pragma omp for schedule(static, 1)
+    for (uint32_t idx = 0; idx < batch_size_; ++idx) {
+        changes_[idx] = two_opt_route(idx, ws, evaluated_count);
+        applied_count += changes_[idx];
+    }
+
+    if (stats != nullptr) {
+        stats->evaluated_moves_ += evaluated_count;
+        stats->applied_moves_ += applied_count;
+    }
+}
+
+
+/*
+ * The checklist-based 2-opt of the idx-th route. It follows the two_opt_nn
+ * from local_search.cpp, however the gains of the moves for all the nearest
+ * neighbors of a node are computed at once: first the successors and
+ * predecessors of the neighbors are gathered, next the gains are computed in
+ * a SIMD loop and finally the best move is selected (in the same order as in
+ * two_opt_nn, so that ties are resolved in the same way).
+ *
+ * Because the NN lists are sorted by the distance, masking the gains for the
+ * neighbors farther than the successor (predecessor) is equivalent to
+ * stopping the search at the first such neighbor.
+ */
+uint32_t TwoOptBatch::two_opt_route(uint32_t idx, Workspace &ws, int64_t &evaluated_count) {
+    const auto n = dimension_;
+    const auto nn_count = nn_count_;
+    const double *coords = coords_.data();
+    uint32_t *route = get_route(idx);
+    auto &pos_in_route = ws.pos_in_route_;
+    auto &checklist = ws.checklist_;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        pos_in_route[ route[i] ] = i;
+    }
+
+    const auto *checklist_row = &checklists_[static_cast<size_t>(idx) * n];
+    checklist.assign(checklist_row, checklist_row + checklist_sizes_[idx]);
+
+    // Setting maximum number of allowed route changes prevents very long-running times
+    // for very hard to solve TSP instances.
+    const uint32_t MaxChanges = n;
+    uint32_t changes_count = 0;
+
+    uint32_t *b_pos  = ws.b_pos_.data();
+    uint32_t *b_succ = ws.b_succ_.data();
+    uint32_t *b_pred = ws.b_pred_.data();
+    double *succ_gain = ws.succ_gain_.data();
+    double *pred_gain = ws.pred_gain_.data();
+
+    size_t checklist_pos_pos = 0;
+    while (checklist_pos_pos < checklist.size() && changes_count < MaxChanges) {
+        const auto a = checklist[checklist_pos_pos++];
+        assert(a < n);
+        const auto i = pos_in_route[a];
+
+        const auto a_next = (i + 1 < n) ? route[i+1] : route[0];
+        const auto a_prev = (i > 0) ? route[i-1] : route[n-1];
+
+        const auto dist_a_to_next = coords_distance(coords, a, a_next);
+        const auto dist_a_to_prev = coords_distance(coords, a, a_prev);
+
+        const auto *nn_list = &neighbors_[static_cast<size_t>(a) * nn_count];
+        const auto *nn_dist = &nn_distances_[static_cast<size_t>(a) * nn_count];
+
+        for (uint32_t k = 0; k < nn_count; ++k) {
+            const auto pos = pos_in_route[ nn_list[k] ];
+            b_pos[k]  = pos;
+            b_succ[k] = (pos + 1 < n) ? route[pos + 1] : route[0];
+            b_pred[k] = (pos > 0) ? route[pos - 1] : route[n - 1];
+        }
+
+        int64_t evaluated = 0;
+        #pragma omp simd reduction(+ : evaluated)
+        for (uint32_t k = 0; k < nn_count; ++k) {
+            const auto b = nn_list[k];
+            const auto dist_ab = nn_dist[k];
+
+            // New edges: { a, b } and { a_next, b_next }
+            const bool is_succ_valid = dist_a_to_next > dist_ab;
+            const auto succ_diff = dist_a_to_next
+                                 + coords_distance(coords, b, b_succ[k])
+                                 - dist_ab
+                                 - coords_distance(coords, a_next, b_succ[k]);
+            succ_gain[k] = is_succ_valid ? succ_diff : -1.0;
+
+            // New edges: { a, b } and { a_prev, b_prev }
+            const bool is_pred_valid = dist_a_to_prev > dist_ab;
+            const auto pred_diff = dist_a_to_prev
+                                 + coords_distance(coords, b_pred[k], b)
+                                 - dist_ab
+                                 - coords_distance(coords, a_prev, b_pred[k]);
+            pred_gain[k] = is_pred_valid ? pred_diff : -1.0;
+
+            evaluated += is_succ_valid + is_pred_valid;
+        }
+        evaluated_count += evaluated;
+
+        double max_diff = -1;
+        uint32_t left = 0;
+        uint32_t right = 0;
+
+        for (uint32_t k = 0; k < nn_count; ++k) {
+            if (succ_gain[k] > max_diff) {
+                left  = std::min(i, b_pos[k]) + 1;
+                right = std::max(i, b_pos[k]) + 1;
+                max_diff = succ_gain[k];
+            }
+        }
+        for (uint32_t k = 0; k < nn_count; ++k) {
+            if (pred_gain[k] > max_diff) {
+                left  = std::min(i, b_pos[k]);
+                right = std::max(i, b_pos[k]);
+                max_diff = pred_gain[k];
+            }
+        }
+
+        if (max_diff > 0) {
+            flip_route_section(route, pos_in_route.data(), static_cast<int32_t>(n),
+                               static_cast<int32_t>(left), static_cast<int32_t>(right));
+
+            // Add nodes at the beginning/end of the flipped segment
+            // and the non-flipped part
+            uint32_t endpoints[] = {
+                route[left],
+                route[right-1],
+                route[(left > 0) ? left-1 : n-1],
+                route[(right < n) ? right : 0]
+            };
+
+            for (auto x : endpoints) {
+                if (std::find(checklist.begin() + static_cast<int32_t>(checklist_pos_pos),
+                              checklist.end(), x) == checklist.end()) {
+                    checklist.push_back(x);
+                }
+            }
+            ++changes_count;
+        }
+    }
+    return changes_count;
+}
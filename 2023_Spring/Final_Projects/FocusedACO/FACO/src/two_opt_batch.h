@@ -0,0 +1,91 @@
+/**
+ * Batched 2-opt local search of all the routes built in an iteration.
+ *
+ * The data are kept in flat structure-of-arrays buffers laid out in the same
+ * way as the arguments of the HLS kernel (HLS/LocalSearchOptimized):
+ *
+ *   coords_[dimension][2]             -- shared, written once
+ *   neighbors_[dimension][nn_count]   -- shared, written once
+ *   routes_[batch_size][dimension]    -- one row per ant
+ *   checklists_[batch_size][dimension]
+ *   checklist_sizes_[batch_size]
+ *
+ * so that a whole batch can be moved to (and from) an accelerator with a
+ * single transfer per buffer instead of per-ant calls.
+ *
+ * On the CPU the routes are processed in parallel by the threads of the
+ * enclosing OpenMP team and the gains of the moves for all the nearest
+ * neighbors of a node are evaluated in a vectorized loop. The moves chosen
+ * are the same as those of the checklist-based two_opt_nn, hence the
+ * results do not change.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "local_search.h"
+#include "problem_instance.h"
+
+
+class TwoOptBatch {
+    uint32_t dimension_;
+    uint32_t nn_count_;
+    uint32_t batch_size_;
+
+    std::vector<double> coords_;          // [dimension][2]
+    std::vector<uint32_t> neighbors_;     // [dimension][nn_count]
+    std::vector<double> nn_distances_;    // [dimension][nn_count]
+    std::vector<uint32_t> routes_;        // [batch_size][dimension]
+    std::vector<uint32_t> checklists_;    // [batch_size][dimension]
+    std::vector<uint32_t> checklist_sizes_;
+    std::vector<uint32_t> changes_;       // # of moves applied to each route
+
+public:
+    TwoOptBatch(const ProblemInstance &instance, uint32_t nn_count, uint32_t batch_size);
+
+    // The gains are computed from the coordinates, which requires EUC_2D
+    // distances
+    static bool is_supported(const ProblemInstance &instance) {
+        return instance.edge_weight_type_ == EUC_2D && instance.is_symmetric_;
+    }
+
+    [[nodiscard]] uint32_t size() const { return batch_size_; }
+
+    uint32_t *get_route(uint32_t idx) {
+        return &routes_[static_cast<size_t>(idx) * dimension_];
+    }
+
+    [[nodiscard]] uint32_t get_changes(uint32_t idx) const { return changes_[idx]; }
+
+    void set_route(uint32_t idx, const std::vector<uint32_t> &route);
+
+    void set_checklist(uint32_t idx, const std::vector<uint32_t> &checklist);
+
+    void copy_route(uint32_t idx, std::vector<uint32_t> &route) const;
+
+    /*
+     * Runs the 2-opt for all the routes in the batch. If called inside a
+     * parallel region the routes are divided among the threads of the team
+     * (it has to be reached by all of them, as an omp for loop). The counts
+     * of the evaluated and applied moves are added to the stats of the
+     * calling thread.
+     */
+    void run(LocalSearchStats *stats = nullptr);
+
+private:
+    // Per-thread buffers used while a route is processed
+    struct Workspace {
+        std::vector<uint32_t> pos_in_route_;
+        std::vector<uint32_t> checklist_;
+        std::vector<uint32_t> b_pos_;   // [nn_count], positions of the neighbors
+        std::vector<uint32_t> b_succ_;  // [nn_count], their successors
+        std::vector<uint32_t> b_pred_;  // [nn_count], their predecessors
+        std::vector<double> succ_gain_; // [nn_count]
+        std::vector<double> pred_gain_; // [nn_count]
+
+        Workspace(uint32_t dimension, uint32_t nn_count);
+    };
+
+    uint32_t two_opt_route(uint32_t idx, Workspace &ws, int64_t &evaluated_count);
+};
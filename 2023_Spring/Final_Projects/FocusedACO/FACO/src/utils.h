@@ -4,7 +4,10 @@
 #include <random>
 #include <ostream>
 #include <cassert>
+#include <cstddef>
+#include <new>
 #include <string>
+#include <vector>
 
 #include "rand.h"
 
@@ -96,6 +99,41 @@ struct Bitmask {
 };
 
 
+/*
+ * Allocator returning memory aligned to the given boundary, e.g. 32 bytes as
+ * required by the aligned AVX2 loads and stores.
+ */
+template<typename T, size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T *ptr, size_t) {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 32>>;
+
+
 inline double round(double value, int decimal_places) {
     const double s = std::pow(10.0, decimal_places);
     return std::round(value * s) / s;
@@ -22,6 +22,8 @@
 #include <cmath>
 #include <cassert>
 
+#include "../../FACO/src/ls_trace.h"
+
 #define NODES 2392
 #define NN_LIST_SIZE 20
 #define CHECKLIST_CAPACITY 500
@@ -164,7 +166,13 @@ int main() {
     std::vector<local_search_info> ls_info_list;
     std::vector<Point> coordinates;
     std::vector<std::vector<uint32_t>> nearest_neighbors;
-    parse_data("stats.txt", ls_info_list, coordinates, nearest_neighbors);
+    // The binary trace is used if present, otherwise the old text dump
+    if (std::filesystem::exists("stats.bin")) {
+        read_trace_test_vectors("stats.bin", ITERATIONS, NODES, NN_LIST_SIZE, CHECKLIST_CAPACITY,
+                                ls_info_list, coordinates, nearest_neighbors);
+    } else {
+        parse_data("stats.txt", ls_info_list, coordinates, nearest_neighbors);
+    }
     
     int32_t coords[NODES][2];
     for (int i = 0; i < coordinates.size(); i++) {
@@ -22,9 +22,12 @@
 #include <cmath>
 #include <cassert>
 
+#include "../../FACO/src/ls_trace.h"
+
 #define NODES 2392
 #define NN_LIST_SIZE 20
 #define CHECKLIST_CAPACITY 500
+#define ITERATIONS 20
 uint32_t CHECKLIST_SIZE = 0;
 
 // #define USE_THREE_OPT
@@ -165,7 +168,13 @@ int main() {
     std::vector<local_search_info> ls_info_list;
     std::vector<Point> coordinates;
     std::vector<std::vector<uint32_t>> nearest_neighbors;
-    parse_data("stats.txt", ls_info_list, coordinates, nearest_neighbors);
+    // The binary trace is used if present, otherwise the old text dump
+    if (std::filesystem::exists("stats.bin")) {
+        read_trace_test_vectors("stats.bin", ITERATIONS, NODES, NN_LIST_SIZE, CHECKLIST_CAPACITY,
+                                ls_info_list, coordinates, nearest_neighbors);
+    } else {
+        parse_data("stats.txt", ls_info_list, coordinates, nearest_neighbors);
+    }
 
     int32_t coords[NODES][2];
     for (int i = 0; i < coordinates.size(); i++) {
@@ -181,7 +190,7 @@ int main() {
     double two_opt_savings = 0;
     double three_opt_savings = 0;
 
-    for (int iter = 0; iter < 20; iter++) {
+    for (int iter = 0; iter < ITERATIONS; iter++) {
         uint32_t route[NODES];
         std::copy(ls_info_list[iter].route.begin(), ls_info_list[iter].route.end(), route);
         uint32_t checklist[CHECKLIST_CAPACITY];